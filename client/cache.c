@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+/**
+ * @brief Position d'un message dans le fichier de données, telle que rangée
+ * dans l'index.
+ *
+ * @param id identifiant du message
+ * @param reserve alignement, toujours 0
+ * @param position position du message dans le fichier de données
+ */
+typedef struct PositionCache PositionCache;
+struct PositionCache
+{
+	uint32_t id;
+	uint32_t reserve;
+	uint64_t position;
+};
+
+/**
+ * - fdDonnees = fichier de données du salon ouvert, -1 si le cache est fermé
+ * - fdIndex = fichier d'index du salon ouvert
+ * - donnees = projection du fichier de données, en lecture
+ * - carteIndex = projection du fichier d'index
+ * - tailleDonnees = taille du fichier de données
+ * - nombre = nombre de messages du cache
+ * - capacite = nombre de messages que peut recevoir le fichier d'index sans être agrandi
+ * - mutexCache = protège le cache, lu par l'interface et complété par le thread de réception
+ */
+static int fdDonnees = -1;
+static int fdIndex = -1;
+static uint8_t *donnees = MAP_FAILED;
+static uint8_t *carteIndex = MAP_FAILED;
+static uint64_t tailleDonnees = 0;
+static uint64_t nombre = 0;
+static uint64_t capacite = 0;
+static pthread_mutex_t mutexCache = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Donne les positions des messages, rangées après l'en-tête de l'index.
+ */
+static PositionCache *positions(void)
+{
+	return (PositionCache *)(carteIndex + TAILLE_ENTETE_INDEX_CACHE);
+}
+
+/**
+ * @brief Écrit l'en-tête de l'index : il ne couvre que les données écrites avant.
+ */
+static void ecrireEnteteIndex(void)
+{
+	memcpy(carteIndex, MAGIE_INDEX_CACHE, TAILLE_MAGIE_CACHE);
+	memcpy(carteIndex + 8, &nombre, 8);
+	memcpy(carteIndex + 16, &tailleDonnees, 8);
+}
+
+/**
+ * @brief Agrandit le fichier d'index pour qu'il reçoive au moins voulu messages.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int agrandirIndex(uint64_t voulu)
+{
+	if (voulu <= capacite)
+	{
+		return 0;
+	}
+	uint64_t nouvelle = capacite < INDEX_INITIAL_CACHE ? INDEX_INITIAL_CACHE : capacite;
+	while (nouvelle < voulu)
+	{
+		nouvelle *= 2;
+	}
+	uint64_t taille = TAILLE_ENTETE_INDEX_CACHE + nouvelle * sizeof(PositionCache);
+	if (taille > TAILLE_CARTE_INDEX_CACHE || ftruncate(fdIndex, taille) != 0)
+	{
+		return -1;
+	}
+	capacite = nouvelle;
+	return 0;
+}
+
+/**
+ * @brief Rang du premier message d'identifiant supérieur ou égal à id, par
+ * dichotomie dans l'index.
+ */
+static uint64_t chercher(uint32_t id)
+{
+	const PositionCache *index = positions();
+	uint64_t debut = 0;
+	uint64_t fin = nombre;
+	while (debut < fin)
+	{
+		uint64_t milieu = debut + (fin - debut) / 2;
+		if (index[milieu].id < id)
+		{
+			debut = milieu + 1;
+		}
+		else
+		{
+			fin = milieu;
+		}
+	}
+	return debut;
+}
+
+/**
+ * @brief Taille d'un message des données, en-tête compris.
+ */
+static uint64_t tailleEnregistrement(const uint8_t *enregistrement)
+{
+	uint16_t longueurTexte;
+	memcpy(&longueurTexte, enregistrement + 5, 2);
+	return TAILLE_ENREGISTREMENT_CACHE + enregistrement[4] + longueurTexte;
+}
+
+/**
+ * @brief Compare deux positions par identifiant, puis par position : à
+ * identifiant égal, le message écrit le premier est gardé.
+ */
+static int comparerPositions(const void *a, const void *b)
+{
+	const PositionCache *x = a;
+	const PositionCache *y = b;
+	if (x->id != y->id)
+	{
+		return x->id < y->id ? -1 : 1;
+	}
+	return x->position < y->position ? -1 : x->position > y->position;
+}
+
+/**
+ * @brief Reconstruit l'index en parcourant les données. Un message écrit à
+ * moitié, en fin de fichier, est retiré.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int reconstruireIndex(void)
+{
+	PositionCache *trouvees = NULL;
+	uint64_t nbTrouvees = 0;
+	uint64_t tailleTrouvees = 0;
+	uint64_t position = TAILLE_ENTETE_CACHE;
+	while (position + TAILLE_ENREGISTREMENT_CACHE <= tailleDonnees &&
+		   position + tailleEnregistrement(donnees + position) <= tailleDonnees)
+	{
+		if (nbTrouvees == tailleTrouvees)
+		{
+			tailleTrouvees = tailleTrouvees * 2 + INDEX_INITIAL_CACHE;
+			PositionCache *agrandi = realloc(trouvees, tailleTrouvees * sizeof(PositionCache));
+			if (agrandi == NULL)
+			{
+				free(trouvees);
+				return -1;
+			}
+			trouvees = agrandi;
+		}
+		memcpy(&trouvees[nbTrouvees].id, donnees + position, 4);
+		trouvees[nbTrouvees].reserve = 0;
+		trouvees[nbTrouvees++].position = position;
+		position += tailleEnregistrement(donnees + position);
+	}
+	if (position != tailleDonnees && ftruncate(fdDonnees, position) == 0)
+	{
+		tailleDonnees = position;
+	}
+
+	// L'index repart d'un fichier vide, assez grand pour son en-tête même sans message
+	qsort(trouvees, nbTrouvees, sizeof(PositionCache), comparerPositions);
+	nombre = 0;
+	capacite = 0;
+	if (ftruncate(fdIndex, 0) != 0 || agrandirIndex(nbTrouvees > 0 ? nbTrouvees : 1) != 0)
+	{
+		free(trouvees);
+		return -1;
+	}
+	PositionCache *index = positions();
+	for (uint64_t i = 0; i < nbTrouvees; i++)
+	{
+		if (nombre == 0 || index[nombre - 1].id != trouvees[i].id)
+		{
+			index[nombre++] = trouvees[i];
+		}
+	}
+	free(trouvees);
+	ecrireEnteteIndex();
+	return 0;
+}
+
+/**
+ * @brief Crée un dossier et ceux qui le contiennent, s'ils n'existent pas.
+ *
+ * @param chemin chemin du dossier, modifié pendant l'appel puis restauré
+ */
+static void creerDossiers(char *chemin)
+{
+	for (char *separateur = strchr(chemin + 1, '/'); separateur != NULL; separateur = strchr(separateur + 1, '/'))
+	{
+		*separateur = '\0';
+		mkdir(chemin, 0700);
+		*separateur = '/';
+	}
+	mkdir(chemin, 0700);
+}
+
+/**
+ * @brief Recopie un nom (serveur, salon) en nom de fichier : tout caractère
+ * autre qu'une lettre, un chiffre, '-' ou '_' devient %XX.
+ */
+static void echapper(char *destination, size_t taille, const char *nom)
+{
+	size_t rempli = 0;
+	for (const unsigned char *c = (const unsigned char *)nom; *c != '\0' && rempli + 4 < taille; c++)
+	{
+		if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-' || *c == '_')
+		{
+			destination[rempli++] = *c;
+		}
+		else
+		{
+			rempli += snprintf(destination + rempli, taille - rempli, "%%%02X", *c);
+		}
+	}
+	destination[rempli] = '\0';
+}
+
+/**
+ * @brief Ferme le cache ouvert ; le mutex doit être tenu.
+ */
+static void fermerVerrouille(void)
+{
+	if (donnees != MAP_FAILED)
+	{
+		munmap(donnees, TAILLE_CARTE_CACHE);
+		donnees = MAP_FAILED;
+	}
+	if (carteIndex != MAP_FAILED)
+	{
+		munmap(carteIndex, TAILLE_CARTE_INDEX_CACHE);
+		carteIndex = MAP_FAILED;
+	}
+	if (fdDonnees >= 0)
+	{
+		close(fdDonnees);
+		fdDonnees = -1;
+	}
+	if (fdIndex >= 0)
+	{
+		close(fdIndex);
+		fdIndex = -1;
+	}
+	nombre = 0;
+	capacite = 0;
+	tailleDonnees = 0;
+}
+
+/**
+ * @brief Ouvre le cache d'un salon, à la place du cache ouvert. Un cache
+ * d'une autre époque de l'historique du serveur est vidé : ses identifiants
+ * ne désignent plus les mêmes messages. Un cache déjà ouvert par un autre
+ * client n'est pas partagé.
+ *
+ * @param dossier dossier des caches
+ * @param serveur nom du serveur, par exemple « adresse_port »
+ * @param salon nom du salon
+ * @param epoque époque de l'historique annoncée par le serveur
+ * @return 0 si tout se passe bien, -1 si le salon reste sans cache.
+ */
+int cacheOuvrir(const char *dossier, const char *serveur, const char *salon, uint32_t epoque)
+{
+	char nomServeur[256];
+	char nomSalon[256];
+	char chemin[4096];
+	echapper(nomServeur, sizeof(nomServeur), serveur);
+	echapper(nomSalon, sizeof(nomSalon), salon);
+
+	pthread_mutex_lock(&mutexCache);
+	fermerVerrouille();
+	int longueur = snprintf(chemin, sizeof(chemin) - 8, "%s/%s", dossier, nomServeur);
+	if (longueur < 0 || longueur >= (int)sizeof(chemin) - 8 - (int)strlen(nomSalon) - 5)
+	{
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	creerDossiers(chemin);
+
+	snprintf(chemin + longueur, sizeof(chemin) - longueur, "/%s.msg", nomSalon);
+	fdDonnees = open(chemin, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fdDonnees < 0 || flock(fdDonnees, LOCK_EX | LOCK_NB) != 0)
+	{
+		fermerVerrouille();
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	snprintf(chemin + longueur, sizeof(chemin) - longueur, "/%s.idx", nomSalon);
+	fdIndex = open(chemin, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	donnees = mmap(NULL, TAILLE_CARTE_CACHE, PROT_READ, MAP_SHARED, fdDonnees, 0);
+	carteIndex = mmap(NULL, TAILLE_CARTE_INDEX_CACHE, PROT_READ | PROT_WRITE, MAP_SHARED, fdIndex, 0);
+	struct stat infosDonnees;
+	struct stat infosIndex;
+	if (fdIndex < 0 || donnees == MAP_FAILED || carteIndex == MAP_FAILED || fstat(fdDonnees, &infosDonnees) != 0 ||
+		fstat(fdIndex, &infosIndex) != 0)
+	{
+		fermerVerrouille();
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+
+	// Des données d'une autre époque, ou illisibles, sont remplacées par un cache vide
+	uint32_t epoqueCache = 0;
+	tailleDonnees = infosDonnees.st_size;
+	if (tailleDonnees >= TAILLE_ENTETE_CACHE && memcmp(donnees, MAGIE_CACHE, TAILLE_MAGIE_CACHE) == 0)
+	{
+		memcpy(&epoqueCache, donnees + 8, 4);
+	}
+	if (epoqueCache != epoque)
+	{
+		uint8_t entete[TAILLE_ENTETE_CACHE];
+		uint32_t suivant = UINT32_MAX;
+		memcpy(entete, MAGIE_CACHE, TAILLE_MAGIE_CACHE);
+		memcpy(entete + 8, &epoque, 4);
+		memcpy(entete + 12, &suivant, 4);
+		if (ftruncate(fdDonnees, 0) != 0 || pwrite(fdDonnees, entete, TAILLE_ENTETE_CACHE, 0) != TAILLE_ENTETE_CACHE)
+		{
+			fermerVerrouille();
+			pthread_mutex_unlock(&mutexCache);
+			return -1;
+		}
+		tailleDonnees = TAILLE_ENTETE_CACHE;
+	}
+
+	// L'index n'est gardé que s'il couvre exactement les données
+	uint64_t nombreIndex = 0;
+	uint64_t tailleCouverte = 0;
+	if ((uint64_t)infosIndex.st_size >= TAILLE_ENTETE_INDEX_CACHE && memcmp(carteIndex, MAGIE_INDEX_CACHE, TAILLE_MAGIE_CACHE) == 0)
+	{
+		memcpy(&nombreIndex, carteIndex + 8, 8);
+		memcpy(&tailleCouverte, carteIndex + 16, 8);
+	}
+	capacite = infosIndex.st_size >= TAILLE_ENTETE_INDEX_CACHE ? (infosIndex.st_size - TAILLE_ENTETE_INDEX_CACHE) / sizeof(PositionCache) : 0;
+	nombre = nombreIndex;
+	if ((tailleCouverte != tailleDonnees || nombreIndex > capacite) && reconstruireIndex() != 0)
+	{
+		fermerVerrouille();
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	pthread_mutex_unlock(&mutexCache);
+	return 0;
+}
+
+/**
+ * @brief Ajoute des messages au cache ; ceux qu'il contient déjà sont
+ * ignorés. Les nouveaux messages sont écrits en une fois à la fin des
+ * données, puis fusionnés dans l'index par la fin, sans le trier à nouveau.
+ *
+ * @param entrees messages à ajouter, de préférence par identifiant croissant
+ * @param nombreEntrees nombre de messages
+ * @return le nombre de messages ajoutés, -1 si le cache est fermé ou si l'écriture échoue.
+ */
+int cacheAjouter(const EntreeCache *entrees, int nombreEntrees)
+{
+	pthread_mutex_lock(&mutexCache);
+	if (fdDonnees < 0)
+	{
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+
+	// Les nouveaux messages, triés et sans doublons, et la taille de leurs enregistrements
+	PositionCache *nouvelles = malloc(sizeof(PositionCache) * (nombreEntrees + 1));
+	if (nouvelles == NULL)
+	{
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	int nbNouvelles = 0;
+	for (int i = 0; i < nombreEntrees; i++)
+	{
+		uint64_t rang = chercher(entrees[i].id);
+		if (rang < nombre && positions()[rang].id == entrees[i].id)
+		{
+			continue;
+		}
+		nouvelles[nbNouvelles].id = entrees[i].id;
+		nouvelles[nbNouvelles].reserve = 0;
+		nouvelles[nbNouvelles++].position = i;
+	}
+	qsort(nouvelles, nbNouvelles, sizeof(PositionCache), comparerPositions);
+	size_t tailleAjout = 0;
+	int nbGardees = 0;
+	for (int i = 0; i < nbNouvelles; i++)
+	{
+		if (nbGardees > 0 && nouvelles[nbGardees - 1].id == nouvelles[i].id)
+		{
+			continue;
+		}
+		const EntreeCache *entree = &entrees[nouvelles[i].position];
+		size_t longueurAuteur = strlen(entree->auteur);
+		tailleAjout += TAILLE_ENREGISTREMENT_CACHE + (longueurAuteur < 255 ? longueurAuteur : 255) +
+					   (entree->longueur < UINT16_MAX ? entree->longueur : UINT16_MAX);
+		nouvelles[nbGardees++] = nouvelles[i];
+	}
+	uint8_t *ajout = malloc(tailleAjout + 1);
+	if (ajout == NULL || tailleDonnees + tailleAjout > TAILLE_CARTE_CACHE || agrandirIndex(nombre + nbGardees) != 0)
+	{
+		free(ajout);
+		free(nouvelles);
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+
+	// Tous les enregistrements partent en une écriture ; l'index ne change qu'une fois elle réussie
+	size_t rempli = 0;
+	for (int i = 0; i < nbGardees; i++)
+	{
+		const EntreeCache *entree = &entrees[nouvelles[i].position];
+		size_t longueurAuteur = strlen(entree->auteur);
+		uint8_t lgAuteur = longueurAuteur < 255 ? longueurAuteur : 255;
+		uint16_t lgTexte = entree->longueur < UINT16_MAX ? entree->longueur : UINT16_MAX;
+		memcpy(ajout + rempli, &entree->id, 4);
+		ajout[rempli + 4] = lgAuteur;
+		memcpy(ajout + rempli + 5, &lgTexte, 2);
+		memcpy(ajout + rempli + TAILLE_ENREGISTREMENT_CACHE, entree->auteur, lgAuteur);
+		memcpy(ajout + rempli + TAILLE_ENREGISTREMENT_CACHE + lgAuteur, entree->texte, lgTexte);
+		nouvelles[i].position = tailleDonnees + rempli;
+		rempli += TAILLE_ENREGISTREMENT_CACHE + lgAuteur + lgTexte;
+	}
+	size_t ecrit = 0;
+	while (ecrit < rempli)
+	{
+		ssize_t n = pwrite(fdDonnees, ajout + ecrit, rempli - ecrit, tailleDonnees + ecrit);
+		if (n <= 0 && errno != EINTR)
+		{
+			free(ajout);
+			free(nouvelles);
+			pthread_mutex_unlock(&mutexCache);
+			return -1;
+		}
+		ecrit += n > 0 ? n : 0;
+	}
+	free(ajout);
+
+	// Fusion par la fin : les messages de l'index plus récents que le nouveau reculent d'autant
+	PositionCache *index = positions();
+	uint64_t ancien = nombre;
+	uint64_t destination = nombre + nbGardees;
+	for (int i = nbGardees - 1; i >= 0; i--)
+	{
+		while (ancien > 0 && index[ancien - 1].id > nouvelles[i].id)
+		{
+			index[--destination] = index[--ancien];
+		}
+		index[--destination] = nouvelles[i];
+	}
+	nombre += nbGardees;
+	tailleDonnees += rempli;
+	ecrireEnteteIndex();
+	free(nouvelles);
+	pthread_mutex_unlock(&mutexCache);
+	return nbGardees;
+}
+
+/**
+ * @brief Donne le nombre de messages du cache.
+ *
+ * @return le nombre de messages, 0 si le cache est fermé.
+ */
+uint64_t cacheNombre(void)
+{
+	pthread_mutex_lock(&mutexCache);
+	uint64_t valeur = nombre;
+	pthread_mutex_unlock(&mutexCache);
+	return valeur;
+}
+
+/**
+ * @brief Donne le nombre de messages du cache d'identifiant inférieur à id :
+ * c'est aussi le rang du premier message qui ne le précède pas.
+ */
+uint64_t cacheRang(uint32_t id)
+{
+	pthread_mutex_lock(&mutexCache);
+	uint64_t rang = fdDonnees >= 0 ? chercher(id) : 0;
+	pthread_mutex_unlock(&mutexCache);
+	return rang;
+}
+
+/**
+ * @brief Donne l'identifiant d'un message du cache.
+ *
+ * @param rang rang du message, par identifiant croissant
+ * @return l'identifiant, UINT32_MAX si le rang est hors du cache.
+ */
+uint32_t cacheIdentifiant(uint64_t rang)
+{
+	pthread_mutex_lock(&mutexCache);
+	uint32_t id = rang < nombre ? positions()[rang].id : UINT32_MAX;
+	pthread_mutex_unlock(&mutexCache);
+	return id;
+}
+
+/**
+ * @brief Copie un message du cache. L'auteur puis le texte sont copiés dans
+ * le tampon, chacun terminé par '\0' ; le texte est tronqué à ce qu'il reste.
+ *
+ * @param rang rang du message, par identifiant croissant
+ * @param entree reçoit le message ; ses champs auteur et texte pointent dans le tampon
+ * @param tampon buffer recevant l'auteur et le texte
+ * @param taille taille du tampon, au moins 257 octets
+ * @return 0 si tout se passe bien, -1 si le rang est hors du cache ou le message illisible.
+ */
+int cacheLire(uint64_t rang, EntreeCache *entree, char *tampon, size_t taille)
+{
+	pthread_mutex_lock(&mutexCache);
+	if (rang >= nombre || taille < 257)
+	{
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	uint64_t position = positions()[rang].position;
+	const uint8_t *enregistrement = donnees + position;
+	if (position + TAILLE_ENREGISTREMENT_CACHE > tailleDonnees || position + tailleEnregistrement(enregistrement) > tailleDonnees)
+	{
+		pthread_mutex_unlock(&mutexCache);
+		return -1;
+	}
+	uint8_t lgAuteur = enregistrement[4];
+	uint16_t lgTexte;
+	memcpy(&lgTexte, enregistrement + 5, 2);
+	memcpy(&entree->id, enregistrement, 4);
+	memcpy(tampon, enregistrement + TAILLE_ENREGISTREMENT_CACHE, lgAuteur);
+	tampon[lgAuteur] = '\0';
+	entree->longueur = lgTexte < taille - lgAuteur - 2 ? lgTexte : taille - lgAuteur - 2;
+	memcpy(tampon + lgAuteur + 1, enregistrement + TAILLE_ENREGISTREMENT_CACHE + lgAuteur, entree->longueur);
+	tampon[lgAuteur + 1 + entree->longueur] = '\0';
+	entree->auteur = tampon;
+	entree->texte = tampon + lgAuteur + 1;
+	pthread_mutex_unlock(&mutexCache);
+	return 0;
+}
+
+/**
+ * @brief Donne l'identifiant à demander au serveur pour les messages qui
+ * précèdent le cache.
+ *
+ * @return l'identifiant, 0 s'il n'y en a pas, UINT32_MAX s'il est inconnu ou si le cache est fermé.
+ */
+uint32_t cacheSuivantAncien(void)
+{
+	pthread_mutex_lock(&mutexCache);
+	uint32_t suivant = UINT32_MAX;
+	if (fdDonnees >= 0)
+	{
+		memcpy(&suivant, donnees + 12, 4);
+	}
+	pthread_mutex_unlock(&mutexCache);
+	return suivant;
+}
+
+/**
+ * @brief Retient l'identifiant à demander au serveur pour les messages qui
+ * précèdent le cache, après une page qui l'a prolongé vers le passé.
+ *
+ * @param suivant identifiant donné par la page, 0 s'il n'y a plus rien avant
+ */
+void cacheMarquerAncien(uint32_t suivant)
+{
+	pthread_mutex_lock(&mutexCache);
+	if (fdDonnees >= 0 && pwrite(fdDonnees, &suivant, 4, 12) != 4)
+	{
+		perror("Erreur écriture cache");
+	}
+	pthread_mutex_unlock(&mutexCache);
+}
+
+/**
+ * @brief Ferme le cache ouvert, s'il y en a un.
+ */
+void cacheFermer(void)
+{
+	pthread_mutex_lock(&mutexCache);
+	fermerVerrouille();
+	pthread_mutex_unlock(&mutexCache);
+}
@@ -0,0 +1,75 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Cache local de l'historique d'un salon, un par serveur et par salon, gardé
+ * d'une session à l'autre : le client n'a plus à demander au serveur que les
+ * messages arrivés depuis le dernier qu'il connaît.
+ *
+ * Deux fichiers par salon, en ordre de la machine. Le fichier de données
+ * (.msg) commence par MAGIE_CACHE, l'époque de l'historique du serveur
+ * (4 octets) et l'identifiant à demander au serveur pour les messages qui
+ * précèdent le cache (4 octets, 0xffffffff s'il est inconnu, 0 s'il n'y en a
+ * pas), puis les messages y sont seulement ajoutés, chacun en
+ * TAILLE_ENREGISTREMENT_CACHE octets :
+ *   [u32 identifiant][u8 longueur de l'auteur][u16 longueur du texte]
+ * suivis de l'auteur et du texte. Le fichier d'index (.idx) commence par
+ * MAGIE_INDEX_CACHE, le nombre de messages (8 octets) et la taille des
+ * données qu'il couvre (8 octets), puis donne la position de chaque message
+ * dans les données, par identifiant croissant. Les deux fichiers sont lus à
+ * travers une projection en mémoire ; un index qui ne correspond pas aux
+ * données est reconstruit en les parcourant.
+ */
+
+/**
+ * - MAGIE_CACHE = signature et version du fichier de données
+ * - MAGIE_INDEX_CACHE = signature et version du fichier d'index
+ * - TAILLE_MAGIE_CACHE = taille des signatures
+ * - TAILLE_ENTETE_CACHE = taille de l'en-tête du fichier de données
+ * - TAILLE_ENTETE_INDEX_CACHE = taille de l'en-tête du fichier d'index
+ * - TAILLE_ENREGISTREMENT_CACHE = taille de l'en-tête d'un message dans les données
+ * - TAILLE_CARTE_CACHE = espace d'adresses réservé à la projection des données, donc leur taille maximum
+ * - TAILLE_CARTE_INDEX_CACHE = espace d'adresses réservé à la projection de l'index
+ * - INDEX_INITIAL_CACHE = nombre de messages réservés au départ dans l'index, doublé à la demande
+ */
+#define MAGIE_CACHE "MSGCHE\0\1"
+#define MAGIE_INDEX_CACHE "MSGIDX\0\1"
+#define TAILLE_MAGIE_CACHE 8
+#define TAILLE_ENTETE_CACHE 16
+#define TAILLE_ENTETE_INDEX_CACHE 24
+#define TAILLE_ENREGISTREMENT_CACHE 7
+#define TAILLE_CARTE_CACHE (1ULL << 34)
+#define TAILLE_CARTE_INDEX_CACHE (1ULL << 32)
+#define INDEX_INITIAL_CACHE 4096
+
+/**
+ * @brief Message du cache.
+ *
+ * @param id identifiant du message dans l'historique du serveur
+ * @param auteur pseudo de l'auteur, vide pour un texte du serveur
+ * @param texte texte du message, terminé par '\0'
+ * @param longueur longueur du texte
+ */
+typedef struct EntreeCache EntreeCache;
+struct EntreeCache
+{
+	uint32_t id;
+	const char *auteur;
+	const char *texte;
+	size_t longueur;
+};
+
+int cacheOuvrir(const char *dossier, const char *serveur, const char *salon, uint32_t epoque);
+int cacheAjouter(const EntreeCache *entrees, int nombre);
+uint64_t cacheNombre(void);
+uint64_t cacheRang(uint32_t id);
+uint32_t cacheIdentifiant(uint64_t rang);
+int cacheLire(uint64_t rang, EntreeCache *entree, char *tampon, size_t taille);
+uint32_t cacheSuivantAncien(void);
+void cacheMarquerAncien(uint32_t suivant);
+void cacheFermer(void);
+
+#endif
@@ -1,15 +1,23 @@
 #include <stdio.h>
-#include <sys/socket.h>
-#include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <SDL.h>
 #include <SDL2/SDL_ttf.h>
+#include <stdatomic.h>
+
+#include "protocole.h"
+#include "messagerie.h"
+#include "fil.h"
+#include "vue.h"
+#include "cache.h"
 
 /**
  * Définition des différents codes pour l'utilisation de couleurs dans le texte
@@ -24,38 +32,116 @@
 
 /**
  * - TAILLE_PSEUDO = taille maximum du pseudo
- * - TAILLE_MESSAGE = taille maximum d'un message
+ * - TAILLE_MESSAGE = taille maximum d'un fragment lu au clavier, '\0' compris ; une ligne plus longue part en plusieurs fragments
+ * - MAX_IDENTITES = nombre d'identifiants d'expéditeur possibles (2 octets)
+ * - DELAI_SAISIE = délai minimum (s) entre deux annonces de saisie au serveur
+ * - DUREE_SAISIE = durée (s) d'affichage de l'indicateur de saisie d'un autre utilisateur sans nouvelle annonce
+ * - INTERVALLE_IMAGE = délai minimum (ms) entre deux images, pour limiter le rendu pendant une rafale,
+ *   quand la fréquence de rafraîchissement de l'écran est inconnue
+ * - DELAI_REVEIL = attente maximum (ms) de l'interface sans événement : expiration des indicateurs,
+ *   marques de lecture en attente
+ * - MESSAGES_PAGE = nombre de messages demandés par page d'historique
+ * - MESSAGES_CACHE_AFFICHES = nombre de messages du cache affichés à l'arrivée dans un salon
  * - WINDOW_WIDTH = taille de la fenêtre en largeur
  * - WINDOW_HEIGHT = taille de la fenêtre en hauteur
+ * - CODE_SECRET = texte du serveur qui arrête la réception
  */
 #define TAILLE_PSEUDO 20
 #define TAILLE_MESSAGE 500
+#define MAX_IDENTITES 65536
+#define DELAI_SAISIE 3
+#define DUREE_SAISIE 6
+#define INTERVALLE_IMAGE 16
+#define DELAI_REVEIL 1000
+#define MESSAGES_PAGE 100
+#define MESSAGES_CACHE_AFFICHES 200
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 768
+#define CODE_SECRET "Tout ce message est le code secret pour désactiver les clients"
 
 /**
  * - nomFichier = nom du fichier à transférer
  * - estFin = booléen vérifiant si le client est connecté ou s'il a terminé la discussion avec le serveur
- * - dS = socket du serveur
  * - boolConnect = booléen vérifiant si le client est connecté afin de gérer les signaux (CTRL+C)
  * - addrServeur = adresse du serveur sur laquelle est connecté le client
  * - portServeur = port du serveur sur lequel est connecté le client
- * - aS = structure contenant toutes les informations de connexion du client au serveur
  * - thread_envoi = thread gérant l'envoi de messages
  * - thread_reception = thread gérant la réception de messages
+ * - session = connexion au serveur, tenue par libmessagerie
+ * - mutexSession = réserve la session à un thread à la fois ; récursif, les rappels de la session pouvant envoyer
+ * - reveilSession = réveille le thread de réception quand des trames attendent leur envoi
+ * - estRepondu = 1 quand le serveur a répondu au dernier pseudo envoyé
+ * - estAccepte = 1 quand le serveur a accepté le pseudo
+ * - estSecret = 1 quand le serveur a envoyé le code secret
+ * - estEnCours = 1 pour un expéditeur dont le dernier fragment reçu annonçait une suite
+ * - finSaisie = instant où l'indicateur de saisie d'un expéditeur s'éteint, 0 s'il n'écrit pas
+ * - luA = instant de la dernière marque de lecture reçue de chaque expéditeur
+ * - saisieEnvoyee = instant où l'on a annoncé sa saisie, 0 si elle n'est pas annoncée
+ * - dernierEnvoi = instant de notre dernier message envoyé
+ * - estNonLu = 1 si des messages reçus n'ont pas encore été marqués comme lus
+ * - evenementReveil = type d'événement SDL qui réveille l'interface, 0 tant que SDL n'est pas prête
+ * - estReveillee = 1 si un réveil est déjà dans la file d'événements de SDL
+ * - pageSuivante = identifiant à demander au serveur pour la page d'historique précédente, 0 s'il n'y en a plus
+ * - estDemandee = 1 tant qu'une page d'historique demandée n'est pas arrivée
+ * - dossierCache = dossier du cache local de l'historique, NULL s'il est désactivé
+ * - pseudoClient = pseudo de ce client, auteur de ses propres messages dans le cache
+ * - estSynchro = 1 quand le cache du salon a rattrapé l'historique du serveur
+ * - premierLive = plus petit identifiant reçu en direct pendant le rattrapage, UINT32_MAX sinon
+ * - attente = messages reçus en direct pendant le rattrapage, rangés dans le cache à sa fin
+ * - nbAttente = nombre de messages en attente
+ * - tailleAttente = taille du tableau attente
+ * - demandesEnCours = pages d'historique demandées et pas encore reçues
+ * - pagesPerimees = pages encore attendues demandées dans le salon précédent, ignorées à leur arrivée
+ * - debutProgramme = instant (ms) du lancement, origine des mesures du démarrage
  */
 char nomFichier[20];
 int estFin = 0;
-int dS = -1;
 int boolConnect = 0;
 char *addrServeur;
 int portServeur;
-struct sockaddr_in aS;
 char *messageserveur;
 int stop = 0;
 int compteur = 0;
 int nb_elements = 0;
-char *msgfichier = "Messagerie Initialisé";
+Session *session = NULL;
+pthread_mutex_t mutexSession;
+int reveilSession = -1;
+atomic_int estRepondu = 0;
+atomic_int estAccepte = 0;
+atomic_int estSecret = 0;
+char estEnCours[MAX_IDENTITES];
+time_t finSaisie[MAX_IDENTITES];
+time_t luA[MAX_IDENTITES];
+time_t saisieEnvoyee = 0;
+time_t dernierEnvoi = 0;
+int estNonLu = 0;
+_Atomic Uint32 evenementReveil = 0;
+atomic_int estReveillee = 0;
+_Atomic uint32_t pageSuivante = 0;
+atomic_int estDemandee = 0;
+char *dossierCache = NULL;
+char pseudoClient[TAILLE_PSEUDO] = "";
+int estSynchro = 0;
+uint32_t premierLive = UINT32_MAX;
+EntreeCache *attente = NULL;
+int nbAttente = 0;
+int tailleAttente = 0;
+atomic_int demandesEnCours = 0;
+int pagesPerimees = 0;
+long long debutProgramme = 0;
+
+/**
+ * @brief Ressources de la fenêtre, chargées par un thread pendant la connexion.
+ *
+ * @param fond image de fond, décodée et convertie au format des textures, NULL en cas d'erreur
+ * @param police police des messages, NULL en cas d'erreur
+ */
+typedef struct Ressources Ressources;
+struct Ressources
+{
+	SDL_Surface *fond;
+	TTF_Font *police;
+};
 
 // Création des threads
 pthread_t thread_envoi;
@@ -64,14 +150,31 @@ pthread_t thread_reception;
 // Déclaration des fonctions
 int finDeCommunication(char *msg);
 void envoi(char *msg);
+void envoiPseudo(char *pseudo);
+void envoiEphemere(uint8_t type, uint8_t valeur);
+int envoyerTrame(uint8_t type, uint8_t drapeaux, const char *charge, size_t longueur);
+void viderSession(void);
 void *envoieFichier();
 void *receptionFichier(void *ds);
 int utilisationCommande(char *msg);
 void *envoiPourThread();
-void reception(char *rep, ssize_t size);
+void attendreIdentification(void);
+void lirePseudo(char *pseudo);
+void *chargerRessources(void *ressources);
+long long millisecondes(void);
 void *receptionPourThread();
 void sigintHandler(int sig_num);
 void SDL_ExitWithError(const char *message);
+void reveillerInterface(void);
+void composerStatut(char *statut, size_t taille, time_t maintenant);
+void demanderHistorique(void);
+int demanderPage(uint32_t repere, uint8_t drapeaux);
+void recevoirPage(uint8_t drapeaux, uint32_t suivant, const EntreeHistorique *entrees, int nombre);
+void recevoirSalon(uint32_t epoque, const char *salon);
+int rangerMessage(uint32_t id, const char *auteur, const char *texte, size_t longueur);
+void viderAttente(void);
+void finirSynchro(void);
+int origineHistorique(const char *auteur);
 
 /**
  * @brief Vérifie si un client souhaite quitter la communication.
@@ -89,17 +192,148 @@ int finDeCommunication(char *msg)
 }
 
 /**
- * @brief Envoie un message au serveur et teste que tout se passe bien.
+ * @brief Envoie sans attendre les trames en file dans la session ; ce que la
+ * socket n'accepte pas tout de suite part depuis le thread de réception,
+ * réveillé pour surveiller l'écriture. Appelée avec mutexSession.
+ */
+void viderSession(void)
+{
+	uint64_t reveil = 1;
+	if (messagerieVider(session) == 0 && (messagerieEvenements(session) & POLLOUT) && reveilSession >= 0)
+	{
+		write(reveilSession, &reveil, sizeof(reveil));
+	}
+}
+
+/**
+ * @brief Envoie une trame complète au serveur.
+ *
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param charge charge utile de la trame
+ * @param longueur taille de la charge utile, tronquée à TAILLE_MAX_TRAME
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int envoyerTrame(uint8_t type, uint8_t drapeaux, const char *charge, size_t longueur)
+{
+	pthread_mutex_lock(&mutexSession);
+	int etat = messagerieEnvoyerTrame(session, type, drapeaux, charge, longueur);
+	viderSession();
+	pthread_mutex_unlock(&mutexSession);
+	return etat;
+}
+
+/**
+ * @brief Envoie un message au serveur et teste que tout se passe bien. Un
+ * message trop long part en plusieurs fragments, coupés entre deux caractères
+ * et marqués DRAPEAU_SUITE, sauf le dernier.
  *
  * @param msg message à envoyer
  */
 void envoi(char *msg)
 {
-	if (send(dS, msg, strlen(msg) + 1, 0) == -1)
+	pthread_mutex_lock(&mutexSession);
+	int etat = messagerieEnvoyerTexte(session, msg, strlen(msg));
+	viderSession();
+	pthread_mutex_unlock(&mutexSession);
+	if (etat == -1)
 	{
 		fprintf(stderr, ANSI_COLOR_RED "Votre message n'a pas pu être envoyé\n" ANSI_COLOR_RESET);
+	}
+}
+
+/**
+ * @brief Envoie son pseudo au serveur, en signalant que le client sait
+ * décompresser les réponses volumineuses, recevoir les messages par
+ * identifiant d'expéditeur, les événements éphémères de son salon et
+ * l'historique par pages. Le pseudo est retenu comme auteur de nos propres
+ * messages dans le cache.
+ *
+ * @param pseudo pseudo à envoyer
+ */
+void envoiPseudo(char *pseudo)
+{
+	snprintf(pseudoClient, sizeof(pseudoClient), "%.*s", (int)strcspn(pseudo, "\n"), pseudo);
+	pthread_mutex_lock(&mutexSession);
+	atomic_store(&estRepondu, 0);
+	int etat = messagerieIdentifier(session, pseudo, DRAPEAU_DEFLATE | DRAPEAU_IDENTITES | DRAPEAU_EPHEMERES | DRAPEAU_HISTORIQUE);
+	viderSession();
+	pthread_mutex_unlock(&mutexSession);
+	if (etat == -1)
+	{
+		fprintf(stderr, ANSI_COLOR_RED "Votre pseudo n'a pas pu être envoyé\n" ANSI_COLOR_RESET);
+	}
+}
+
+/**
+ * @brief Envoie un événement éphémère au serveur. Il peut être perdu sans
+ * conséquence : aucune erreur n'est affichée.
+ *
+ * @param type type de l'événement (TypeEphemere)
+ * @param valeur 1 ou 0 pour la saisie, ignorée pour la lecture
+ */
+void envoiEphemere(uint8_t type, uint8_t valeur)
+{
+	char charge[2] = {type, valeur};
+	envoyerTrame(TRAME_EPHEMERE, 0, charge, sizeof(charge));
+}
+
+/**
+ * @brief Demande une page d'historique au serveur.
+ *
+ * @param repere identifiant avant lequel (après lequel, avec DRAPEAU_APRES) chercher les messages
+ * @param drapeaux DRAPEAU_APRES pour les messages plus récents, 0 pour les plus anciens
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int demanderPage(uint32_t repere, uint8_t drapeaux)
+{
+	char demande[TAILLE_DEMANDE_HISTORIQUE] = {repere >> 24, repere >> 16, repere >> 8, repere, MESSAGES_PAGE >> 8, MESSAGES_PAGE & 0xff};
+	atomic_fetch_add(&demandesEnCours, 1);
+	if (envoyerTrame(TRAME_HISTORIQUE, drapeaux, demande, sizeof(demande)) == -1)
+	{
+		atomic_fetch_sub(&demandesEnCours, 1);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Ajoute au fil la page d'historique qui précède les messages
+ * affichés, sauf s'il n'y en a plus ou si une demande attend encore sa
+ * réponse. Le cache sert d'abord ce qu'il garde, sans attendre le serveur ;
+ * le serveur n'est interrogé qu'au-delà.
+ */
+void demanderHistorique(void)
+{
+	uint32_t avant = atomic_load(&pageSuivante);
+	if (avant == 0 || atomic_exchange(&estDemandee, 1))
+	{
+		return;
+	}
+
+	uint64_t rang = cacheRang(avant);
+	if (rang > 0)
+	{
+		char tampon[TAILLE_MAX_TRAME];
+		EntreeCache entree;
+		uint64_t fin = rang > MESSAGES_PAGE ? rang - MESSAGES_PAGE : 0;
+		for (uint64_t i = rang; i > fin && cacheLire(i - 1, &entree, tampon, sizeof(tampon)) == 0; i--)
+		{
+			filAjouter(FIL_ANCIEN, entree.auteur, entree.texte);
+			avant = entree.id;
+		}
+		atomic_store(&pageSuivante, fin > 0 || cacheSuivantAncien() != 0 ? avant : 0);
+		atomic_store(&estDemandee, 0);
+		reveillerInterface();
 		return;
 	}
+
+	// Le cache retient où reprendre la page suivante quand le serveur a déjà été interrogé
+	uint32_t suivant = cacheSuivantAncien();
+	if (demanderPage(suivant < avant ? suivant : avant, 0) == -1)
+	{
+		atomic_store(&estDemandee, 0);
+	}
 }
 
 /**
@@ -107,134 +341,509 @@ void envoi(char *msg)
  */
 void *envoiPourThread()
 {
+	// Une ligne plus longue que le buffer est lue en plusieurs fois : chaque morceau part
+	// comme un fragment, et les octets d'un caractère coupé passent au morceau suivant
+	char report[4];
+	size_t longueurReport = 0;
+	int estSuite = 0;
 	while (!estFin)
 	{
 		/*Saisie du message au clavier*/
 		char *m = (char *)malloc(sizeof(char) * TAILLE_MESSAGE);
-		fgets(m, TAILLE_MESSAGE, stdin);
+		memcpy(m, report, longueurReport);
+		m[longueurReport] = '\0';
+		if (fgets(m + longueurReport, TAILLE_MESSAGE - longueurReport, stdin) == NULL && longueurReport == 0)
+		{
+			// Entrée standard fermée (lancement sans terminal) : on écrit depuis la fenêtre
+			// seulement, au lieu de relire la fin de fichier et d'envoyer des messages vides
+			free(m);
+			break;
+		}
+		size_t longueur = strlen(m);
+		int estCoupe = longueur == TAILLE_MESSAGE - 1 && m[longueur - 1] != '\n';
+		size_t fragment = estCoupe ? texteCoupure(m, longueur) : longueur;
+		longueurReport = longueur - fragment;
+		memcpy(report, m + fragment, longueurReport);
+		m[fragment] = '\0';
 
-		// On vérifie si le client veut quitter la communication
-		estFin = finDeCommunication(m);
+		// On vérifie si le client veut quitter la communication, au début d'un message seulement
+		estFin = !estSuite && finDeCommunication(m);
 
 		// On vérifie si le client utilise une des commandes
 		char *msgAVerif = (char *)malloc(sizeof(char) * strlen(m));
 		strcpy(msgAVerif, m);
 
-		if (stop == 0){
-			FILE* fichiermsg = fopen("fichiermsg.txt", "a");
-			if (fichiermsg != NULL)
-			{
-				fprintf(fichiermsg, "Me : %s\n\n", m);
-				fclose(fichiermsg);
-			}
+		// Envoi
+		if (envoyerTrame(TRAME_TEXTE, estCoupe ? DRAPEAU_SUITE : 0, m, fragment) == -1)
+		{
+			fprintf(stderr, ANSI_COLOR_RED "Votre message n'a pas pu être envoyé\n" ANSI_COLOR_RESET);
+		}
+		estSuite = estCoupe;
+		if (stop == 0)
+		{
+			m[strcspn(m, "\n")] = '\0';
+			filAjouter(FIL_ENVOYE, NULL, m);
+			reveillerInterface();
+		}
+		free(m);
+	}
+	return NULL;
+}
 
-			FILE* fichier = fopen("fichiermsg.txt", "r");
-			long taille_fichier;
-			char *contenu;
+/**
+ * @brief Réveille l'interface, qui attend dans SDL_WaitEventTimeout, pour
+ * qu'elle redessine la fenêtre. Un seul réveil à la fois est mis dans la file
+ * d'événements : une rafale de messages ne donne qu'une image.
+ */
+void reveillerInterface(void)
+{
+	Uint32 type = atomic_load(&evenementReveil);
+	if (type == 0 || type == (Uint32)-1 || atomic_exchange(&estReveillee, 1))
+	{
+		return;
+	}
+	SDL_Event event = {0};
+	event.type = type;
+	if (SDL_PushEvent(&event) != 1)
+	{
+		atomic_store(&estReveillee, 0);
+	}
+}
 
-			if (fichier)
-			{
-				// Obtenir la taille du fichier
-				fseek(fichier, 0, SEEK_END);
-				taille_fichier = ftell(fichier);
-				rewind(fichier);
+/**
+ * @brief Donne l'origine dans le fil d'un message de l'historique, selon son
+ * auteur : ce client, un autre utilisateur ou le serveur.
+ */
+int origineHistorique(const char *auteur)
+{
+	return auteur[0] == '\0' ? FIL_SERVEUR : strcmp(auteur, pseudoClient) == 0 ? FIL_ENVOYE : FIL_RECU;
+}
 
-				// Allouer de la mémoire pour le contenu du fichier
-				contenu = (char *)malloc(taille_fichier);
+/**
+ * @brief Range dans le cache un message numéroté reçu en direct. Pendant le
+ * rattrapage, il est mis en attente : le cache ne reçoit les messages qu'à la
+ * suite de ceux qu'il a déjà, sans trou.
+ *
+ * @param id identifiant du message, UINT32_MAX s'il n'est pas dans l'historique
+ * @param auteur pseudo de l'auteur
+ * @param texte texte du message, pas forcément terminé par '\0'
+ * @param longueur longueur du texte
+ * @return 1 si le message est à afficher, 0 si une page d'historique l'a déjà affiché.
+ */
+int rangerMessage(uint32_t id, const char *auteur, const char *texte, size_t longueur)
+{
+	if (id == UINT32_MAX)
+	{
+		return 1;
+	}
+	while (longueur > 0 && texte[longueur - 1] == '\n')
+	{
+		longueur--;
+	}
+	EntreeCache entree = {id, auteur, texte, longueur};
+	if (estSynchro)
+	{
+		return cacheAjouter(&entree, 1) != 0;
+	}
 
-				// Lire le contenu du fichier dans la variable
-        		fread(contenu, 1, taille_fichier, fichier);
+	premierLive = id < premierLive ? id : premierLive;
+	if (nbAttente == tailleAttente)
+	{
+		EntreeCache *agrandi = realloc(attente, sizeof(EntreeCache) * (tailleAttente * 2 + 16));
+		if (agrandi == NULL)
+		{
+			return 1;
+		}
+		attente = agrandi;
+		tailleAttente = tailleAttente * 2 + 16;
+	}
+	entree.auteur = strdup(auteur);
+	entree.texte = strndup(texte, longueur);
+	if (entree.auteur == NULL || entree.texte == NULL)
+	{
+		free((char *)entree.auteur);
+		free((char *)entree.texte);
+		return 1;
+	}
+	attente[nbAttente++] = entree;
+	return 1;
+}
 
-				// Fermer le fichier
-				fclose(fichier);
+/**
+ * @brief Oublie les messages en attente du cache.
+ */
+void viderAttente(void)
+{
+	for (int i = 0; i < nbAttente; i++)
+	{
+		free((char *)attente[i].auteur);
+		free((char *)attente[i].texte);
+	}
+	nbAttente = 0;
+}
 
-				// Utiliser le contenu du fichier
-				msgfichier = contenu;
+/**
+ * @brief Termine le rattrapage : les messages reçus en direct entre-temps
+ * rejoignent le cache, à la suite de l'historique rattrapé.
+ */
+void finirSynchro(void)
+{
+	estSynchro = 1;
+	cacheAjouter(attente, nbAttente);
+	viderAttente();
+}
 
-			}
-		}
+/**
+ * @brief Arrive dans un salon annoncé par TRAME_SALON : la vue repart des
+ * derniers messages du cache du salon, affichés tout de suite, et le serveur
+ * n'est interrogé que sur les messages arrivés depuis le dernier du cache.
+ * Sans cache, la dernière page de l'historique est demandée.
+ *
+ * @param epoque époque de l'historique du serveur
+ * @param salon nom du salon
+ */
+void recevoirSalon(uint32_t epoque, const char *salon)
+{
+	char serveur[128];
+	snprintf(serveur, sizeof(serveur), "%s_%d", addrServeur, portServeur);
+
+	// Les pages encore attendues répondent à des demandes faites dans le salon précédent
+	pagesPerimees = atomic_load(&demandesEnCours);
+	estSynchro = 0;
+	premierLive = UINT32_MAX;
+	viderAttente();
+	atomic_store(&estDemandee, 0);
+	if (dossierCache == NULL || cacheOuvrir(dossierCache, serveur, salon, epoque) != 0)
+	{
+		cacheFermer();
+	}
 
-		// Envoi
-		envoi(m);
-		free(m);
+	filAjouter(FIL_SALON, NULL, "");
+	char tampon[TAILLE_MAX_TRAME];
+	EntreeCache entree;
+	uint64_t nombre = cacheNombre();
+	uint64_t debut = nombre > MESSAGES_CACHE_AFFICHES ? nombre - MESSAGES_CACHE_AFFICHES : 0;
+	for (uint64_t i = debut; i < nombre && cacheLire(i, &entree, tampon, sizeof(tampon)) == 0; i++)
+	{
+		filAjouter(origineHistorique(entree.auteur), entree.auteur, entree.texte);
 	}
-	shutdown(dS, 2);
-	return NULL;
+	if (nombre > 0)
+	{
+		atomic_store(&pageSuivante, debut > 0 || cacheSuivantAncien() != 0 ? cacheIdentifiant(debut) : 0);
+		demanderPage(cacheIdentifiant(nombre - 1), DRAPEAU_APRES);
+	}
+	else
+	{
+		atomic_store(&pageSuivante, 0);
+		demanderPage(UINT32_MAX, 0);
+	}
+	reveillerInterface();
 }
 
 /**
- * @brief Réceptionne un message du serveur et teste que tout se passe bien.
+ * @brief Traite une page d'historique reçue du serveur ; ses messages sont
+ * rangés dans le cache. Une page de rattrapage (DRAPEAU_APRES), ou la
+ * dernière page demandée à l'arrivée dans un salon sans cache, complète la
+ * vue par la fin, sans les messages déjà reçus en direct ; une page demandée
+ * en remontant le fil passe avant les messages affichés, donc du plus récent
+ * au plus ancien.
  *
- * @param rep buffer contenant le message reçu
- * @param size taille maximum du message à recevoir
+ * @param drapeaux drapeaux de la trame
+ * @param suivant identifiant à demander pour la page suivante
+ * @param entrees messages de la page, du plus ancien au plus récent
+ * @param nombre nombre de messages
  */
-void reception(char *rep, ssize_t size)
+void recevoirPage(uint8_t drapeaux, uint32_t suivant, const EntreeHistorique *entrees, int nombre)
 {
-	if (recv(dS, rep, size, 0) == -1)
+	if (atomic_load(&demandesEnCours) > 0)
 	{
-		printf(ANSI_COLOR_YELLOW "** fin de la communication **\n" ANSI_COLOR_RESET);
-		exit(-1);
+		atomic_fetch_sub(&demandesEnCours, 1);
+	}
+	if (pagesPerimees > 0)
+	{
+		pagesPerimees--;
+		return;
+	}
+	int estApres = (drapeaux & DRAPEAU_APRES) != 0;
+	int estAncien = !estApres && estSynchro;
+
+	EntreeCache rangees[TAILLE_MAX_TRAME / TAILLE_ENTREE_HISTORIQUE];
+	for (int i = 0; i < nombre; i++)
+	{
+		rangees[i] = (EntreeCache){entrees[i].id, entrees[i].auteur, entrees[i].texte, entrees[i].longueur};
+	}
+	cacheAjouter(rangees, nombre);
+
+	char texte[TAILLE_MAX_TRAME];
+	for (int i = 0; i < nombre; i++)
+	{
+		const EntreeHistorique *entree = &entrees[estAncien ? nombre - 1 - i : i];
+		snprintf(texte, sizeof(texte), "%.*s", (int)entree->longueur, entree->texte);
+		if (estAncien)
+		{
+			filAjouter(FIL_ANCIEN, entree->auteur, texte);
+		}
+		else if (entree->id < premierLive)
+		{
+			filAjouter(origineHistorique(entree->auteur), entree->auteur, texte);
+			printf(entree->auteur[0] != '\0' ? "%s : %s\n" : "%s%s\n", entree->auteur, texte);
+		}
 	}
+
+	// Le rattrapage continue jusqu'au dernier message ; une page plus ancienne prolonge le cache vers le passé
+	if (estApres && suivant != UINT32_MAX)
+	{
+		demanderPage(suivant, DRAPEAU_APRES);
+	}
+	else if (estApres)
+	{
+		finirSynchro();
+	}
+	else
+	{
+		cacheMarquerAncien(suivant);
+		atomic_store(&pageSuivante, suivant);
+		atomic_store(&estDemandee, 0);
+		if (!estSynchro)
+		{
+			finirSynchro();
+		}
+	}
+	reveillerInterface();
 }
 
+/**
+ * @brief Réponse du serveur au pseudo envoyé.
+ */
+void rappelIdentification(Session *session, void *contexte, int accepte, const char *reponse)
+{
+	printf(ANSI_COLOR_MAGENTA "%s\n" ANSI_COLOR_RESET, reponse);
+	atomic_store(&estAccepte, accepte);
+	atomic_store(&estRepondu, 1);
+}
 
+/**
+ * @brief Texte du serveur : réponse à une commande, message privé...
+ */
+void rappelTexte(Session *session, void *contexte, const char *texte, size_t longueur)
+{
+	if (strcmp(texte, CODE_SECRET) == 0)
+	{
+		atomic_store(&estSecret, 1);
+		return;
+	}
+	if (stop == 0)
+	{
+		filAjouter(FIL_SERVEUR, "", texte);
+		reveillerInterface();
+		printf("%s\n", texte);
+	}
+}
 
 /**
- * @brief Fonction principale pour le thread gérant la réception de messages.
+ * @brief Message d'un salon.
  */
-void *receptionPourThread()
+void rappelMessage(Session *session, void *contexte, const MessageSession *message)
 {
+	int id = message->idAuteur;
 
-	while (!estFin)
+	// Notre propre message, déjà affiché à l'envoi, n'est que rangé dans le cache
+	if (message->drapeaux & DRAPEAU_ECHO)
 	{
-		char *r = (char *)malloc(sizeof(char) * TAILLE_MESSAGE);
-		reception(r, sizeof(char) * TAILLE_MESSAGE);
-		if (strcmp(r, "Tout ce message est le code secret pour désactiver les clients") == 0)
-		{
-			free(r);
-			break;
-		}
+		rangerMessage(message->id, pseudoClient, message->texte, message->longueur);
+		return;
+	}
 
-		if (stop == 0){
-			FILE* fichiermsg = fopen("fichiermsg.txt", "a");
-			if (fichiermsg != NULL)
-			{
-				fprintf(fichiermsg, "%s\n\n", r);
-				fclose(fichiermsg);
-			}
+	// Les fragments d'un long message sont affichés dès leur arrivée ; ceux qui suivent
+	// le premier sont marqués, d'autres messages du salon pouvant s'intercaler
+	int estContinuation = estEnCours[id];
+	estEnCours[id] = (message->drapeaux & DRAPEAU_SUITE) != 0;
+	if (message->longueur == 0 || !rangerMessage(message->id, message->auteur, message->texte, message->longueur))
+	{
+		return;
+	}
+	char auteur[TAILLE_AUTEUR];
+	char texte[TAILLE_MAX_TRAME + 1];
+	snprintf(auteur, sizeof(auteur), estContinuation ? "%s (suite)" : "%s", message->auteur);
+	snprintf(texte, sizeof(texte), "%.*s", (int)message->longueur, message->texte);
+	finSaisie[id] = estEnCours[id] ? finSaisie[id] : 0;
+	estNonLu = 1;
+	if (strcmp(texte, CODE_SECRET) == 0)
+	{
+		atomic_store(&estSecret, 1);
+		return;
+	}
+	if (stop == 0)
+	{
+		filAjouter(FIL_RECU, auteur, texte);
+		reveillerInterface();
+		printf("%s : %s\n", auteur, texte);
+	}
+}
 
-			FILE* fichier = fopen("fichiermsg.txt", "r");
-			long taille_fichier;
-			char *contenu;
+/**
+ * @brief Événement éphémère d'un utilisateur du salon ; le serveur n'envoie
+ * que le dernier état de chaque expéditeur, à chaque tick.
+ */
+void rappelEphemere(Session *session, void *contexte, int idAuteur, uint8_t type, uint32_t valeur)
+{
+	if (type == EPHEMERE_SAISIE)
+	{
+		finSaisie[idAuteur] = valeur ? time(NULL) + DUREE_SAISIE : 0;
+	}
+	else if (type == EPHEMERE_LECTURE)
+	{
+		luA[idAuteur] = time(NULL);
+	}
+	reveillerInterface();
+}
 
-			if (fichier)
-			{
-				// Obtenir la taille du fichier
-				fseek(fichier, 0, SEEK_END);
-				taille_fichier = ftell(fichier);
-				rewind(fichier);
+/**
+ * @brief Page d'historique reçue du serveur.
+ */
+void rappelPage(Session *session, void *contexte, uint8_t drapeaux, uint32_t suivant, const EntreeHistorique *entrees, int nombre)
+{
+	recevoirPage(drapeaux, suivant, entrees, nombre);
+}
 
-				// Allouer de la mémoire pour le contenu du fichier
-				contenu = (char *)malloc(taille_fichier);
+/**
+ * @brief Arrivée dans un salon.
+ */
+void rappelSalon(Session *session, void *contexte, uint32_t epoque, uint32_t nbMessages, const char *nom)
+{
+	recevoirSalon(epoque, nom);
+}
 
-				// Lire le contenu du fichier dans la variable
-        		fread(contenu, 1, taille_fichier, fichier);
+/**
+ * @brief Le serveur refuse la connexion : on affiche quand réessayer et on quitte.
+ */
+void rappelOccupe(Session *session, void *contexte, unsigned int reessai)
+{
+	printf(ANSI_COLOR_YELLOW "** serveur occupé, réessayez dans %u secondes **\n" ANSI_COLOR_RESET, reessai);
+	exit(-1);
+}
 
-				// Fermer le fichier
-				fclose(fichier);
+/**
+ * @brief Fin de la connexion au serveur.
+ */
+void rappelFin(Session *session, void *contexte)
+{
+	printf(ANSI_COLOR_YELLOW "** fin de la communication **\n" ANSI_COLOR_RESET);
+	exit(-1);
+}
 
-				// Utiliser le contenu du fichier
-				msgfichier = contenu;
+const RappelsSession rappelsClient = {
+	rappelIdentification,
+	rappelTexte,
+	rappelMessage,
+	rappelEphemere,
+	rappelPage,
+	rappelSalon,
+	rappelOccupe,
+	rappelFin,
+};
 
-			}
+/**
+ * @brief Attend la réponse du serveur au pseudo envoyé, reçue par le thread de
+ * réception ; la fenêtre continue de traiter ses événements entre-temps.
+ */
+void attendreIdentification(void)
+{
+	while (!atomic_load(&estRepondu))
+	{
+		SDL_PumpEvents();
+		SDL_Delay(INTERVALLE_IMAGE);
+	}
+}
 
-			printf("%s\n", r);
-			free(r);
+/**
+ * @brief Lit le pseudo au clavier, en remplaçant ses espaces ; la fenêtre
+ * continue de traiter ses événements pendant la saisie.
+ *
+ * @param pseudo buffer de TAILLE_PSEUDO octets recevant le pseudo, retour à la ligne compris
+ */
+void lirePseudo(char *pseudo)
+{
+	do
+	{
+		printf(ANSI_COLOR_MAGENTA "\nVotre pseudo (maximum 19 caractères):\n" ANSI_COLOR_RESET);
+		fflush(stdout);
+		struct pollfd entree = {STDIN_FILENO, POLLIN, 0};
+		while (poll(&entree, 1, INTERVALLE_IMAGE) == 0)
+		{
+			SDL_PumpEvents();
+		}
+		if (fgets(pseudo, TAILLE_PSEUDO, stdin) == NULL)
+		{
+			exit(-1);
 		}
+		for (int i = 0; pseudo[i] != '\0'; i++)
+		{
+			pseudo[i] = pseudo[i] == ' ' ? '_' : pseudo[i];
+		}
+	} while (strcmp(pseudo, "\n") == 0);
+}
 
+/**
+ * @brief Fonction principale pour le thread chargeant les ressources de la
+ * fenêtre : l'image de fond est décodée et convertie au format des textures,
+ * pour que le thread de l'interface n'ait plus qu'à la copier.
+ *
+ * @param ressources Ressources à remplir
+ */
+void *chargerRessources(void *ressources)
+{
+	Ressources *chargees = ressources;
+	SDL_Surface *image = SDL_LoadBMP("Image/fond.bmp");
+	if (image != NULL)
+	{
+		chargees->fond = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+		SDL_FreeSurface(image);
 	}
+	chargees->police = TTF_OpenFont("Police/arial_narrow_7.ttf", 20);
+	return NULL;
+}
+
+/**
+ * @brief Donne l'instant courant en millisecondes, sur une horloge monotone.
+ */
+long long millisecondes(void)
+{
+	struct timespec maintenant;
+	clock_gettime(CLOCK_MONOTONIC, &maintenant);
+	return (long long)maintenant.tv_sec * 1000 + maintenant.tv_nsec / 1000000;
+}
 
-	shutdown(dS, 2);
+/**
+ * @brief Fonction principale pour le thread gérant la réception de messages :
+ * il surveille la socket de la session et le réveil des envois, et remet les
+ * trames reçues aux rappels de la session.
+ */
+void *receptionPourThread()
+{
+	while (!atomic_load(&estSecret))
+	{
+		pthread_mutex_lock(&mutexSession);
+		struct pollfd attentes[2] = {{messagerieDescripteur(session), messagerieEvenements(session), 0}, {reveilSession, POLLIN, 0}};
+		pthread_mutex_unlock(&mutexSession);
+		if (poll(attentes, 2, -1) < 0 && errno != EINTR)
+		{
+			perror("poll");
+			break;
+		}
+		if (attentes[1].revents & POLLIN)
+		{
+			uint64_t reveils;
+			read(reveilSession, &reveils, sizeof(reveils));
+		}
+		pthread_mutex_lock(&mutexSession);
+		messagerieTraiter(session, attentes[0].revents);
+		pthread_mutex_unlock(&mutexSession);
+	}
+
+	pthread_mutex_lock(&mutexSession);
+	messagerieFermer(session);
+	pthread_mutex_unlock(&mutexSession);
 	pthread_cancel(thread_envoi);
 	return NULL;
 }
@@ -257,16 +866,42 @@ void sigintHandler(int sig_num)
 	sleep(0.2);
 	stop = 1;
 	envoi("/fin\n");
-	remove("fichiermsg.txt");
 	exit(1);
 }
 
+/**
+ * @brief Compose la ligne de statut : qui écrit, et qui a lu depuis notre
+ * dernier message.
+ *
+ * @param statut buffer recevant la ligne, vide s'il n'y a rien à signaler
+ * @param taille taille du buffer
+ * @param maintenant date courante
+ */
+void composerStatut(char *statut, size_t taille, time_t maintenant)
+{
+	size_t tailleStatut = 0;
+	statut[0] = '\0';
+	pthread_mutex_lock(&mutexSession);
+	int nbIdentites = messagerieNbIdentites(session);
+	for (int id = 0; id < nbIdentites && tailleStatut + TAILLE_PSEUDO + 16 < taille; id++)
+	{
+		if (finSaisie[id] > maintenant)
+		{
+			tailleStatut += snprintf(statut + tailleStatut, taille - tailleStatut, "%s écrit...  ", messagerieIdentite(session, id));
+		}
+		else if (dernierEnvoi != 0 && luA[id] >= dernierEnvoi)
+		{
+			tailleStatut += snprintf(statut + tailleStatut, taille - tailleStatut, "vu par %s  ", messagerieIdentite(session, id));
+		}
+	}
+	pthread_mutex_unlock(&mutexSession);
+}
+
 void SDL_ExitWithError(const char *message)
 {
 	printf(ANSI_COLOR_YELLOW "%s\n" ANSI_COLOR_RESET, message);
 	sleep(0.2);
 	envoi("/fin\n");
-	remove("fichiermsg.txt");
 	exit(1);
 }
 
@@ -275,108 +910,126 @@ void SDL_DoneTask(const char *message)
 	printf("%s\n", message);
 }
 
-// argv[1] = adresse ip
-// argv[2] = port
+// argv[optind] = adresse ip
+// argv[optind + 1] = port
 int main(int argc, char *argv[])
 {
+	debutProgramme = millisecondes();
+	char *fichierSauvegarde = NULL;
+	char *pseudoDemande = NULL;
+	char *autorite = NULL;
+	char dossierDefaut[4096];
+	const char *racineCache = getenv("XDG_CACHE_HOME");
+	const char *maison = getenv("HOME");
+	if (racineCache != NULL && racineCache[0] == '/')
+	{
+		snprintf(dossierDefaut, sizeof(dossierDefaut), "%s/messagerie", racineCache);
+		dossierCache = dossierDefaut;
+	}
+	else if (maison != NULL && maison[0] == '/')
+	{
+		snprintf(dossierDefaut, sizeof(dossierDefaut), "%s/.cache/messagerie", maison);
+		dossierCache = dossierDefaut;
+	}
+	int option;
+	while ((option = getopt(argc, argv, "f:C:u:t:")) != -1)
+	{
+		if (option == 'f')
+		{
+			fichierSauvegarde = optarg;
+		}
+		else if (option == 'C')
+		{
+			dossierCache = optarg[0] != '\0' ? optarg : NULL;
+		}
+		else if (option == 'u')
+		{
+			pseudoDemande = optarg;
+		}
+		else if (option == 't')
+		{
+			autorite = optarg;
+		}
+	}
 
-	if (argc < 3)
+	if (argc - optind < 2)
 	{
-		fprintf(stderr, ANSI_COLOR_RED "Erreur : Lancez avec ./client [votre_ip] [votre_port]\n" ANSI_COLOR_RESET);
+		fprintf(stderr, ANSI_COLOR_RED "Erreur : Lancez avec ./client [-f fichier_sauvegarde] [-C dossier_cache] [-u pseudo] [-t autorite] [votre_ip] [votre_port]\n"
+										"  dossier_cache : cache local de l'historique (défaut ~/.cache/messagerie, vide pour le désactiver)\n"
+										"  pseudo : envoyé dès la connexion, sans le demander au clavier\n"
+										"  autorite : fichier PEM qui authentifie le serveur ; la connexion est alors chiffrée (TLS)\n" ANSI_COLOR_RESET);
 		return -1;
 	}
+	atexit(cacheFermer);
 	printf(ANSI_COLOR_MAGENTA "Début programme\n" ANSI_COLOR_RESET);
 
-	addrServeur = argv[1];
-	portServeur = atoi(argv[2]);
+	addrServeur = argv[optind];
+	portServeur = atoi(argv[optind + 1]);
 
-	// Création de la socket
-	dS = socket(PF_INET, SOCK_STREAM, 0);
-	if (dS == -1)
+	// Sauvegarde facultative du fil, écrite par un thread dédié
+	if (fichierSauvegarde != NULL && filSauvegarder(fichierSauvegarde) != 0)
 	{
-		fprintf(stderr, ANSI_COLOR_RED "Problème de création de socket client\n" ANSI_COLOR_RESET);
 		return -1;
 	}
-	printf(ANSI_COLOR_MAGENTA "Socket Créé\n" ANSI_COLOR_RESET);
 
-	// Nommage de la socket
-	aS.sin_family = AF_INET;
-	inet_pton(AF_INET, argv[1], &(aS.sin_addr));
-	aS.sin_port = htons(atoi(argv[2]));
-	socklen_t lgA = sizeof(struct sockaddr_in);
+	// La session est partagée entre les threads ; ses rappels envoient en la tenant déjà
+	pthread_mutexattr_t attributs;
+	pthread_mutexattr_init(&attributs);
+	pthread_mutexattr_settype(&attributs, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutexSession, &attributs);
+	pthread_mutexattr_destroy(&attributs);
+	reveilSession = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	session = messagerieCreer(&rappelsClient, NULL);
+	if (reveilSession == -1 || session == NULL)
+	{
+		fprintf(stderr, ANSI_COLOR_RED "Problème de création de socket client\n" ANSI_COLOR_RESET);
+		return -1;
+	}
+	if (autorite != NULL && messagerieChiffrer(session, autorite) != 0)
+	{
+		fprintf(stderr, ANSI_COLOR_RED "Autorité de certification illisible : %s\n" ANSI_COLOR_RESET, autorite);
+		return -1;
+	}
 
-	// Envoi d'une demande de connexion
+	// Envoi d'une demande de connexion, établie pendant la saisie du pseudo
 	printf(ANSI_COLOR_MAGENTA "Connexion en cours...\n" ANSI_COLOR_RESET);
-	if (connect(dS, (struct sockaddr *)&aS, lgA) < 0)
+	if (messagerieConnecter(session, addrServeur, portServeur) != 0)
 	{
 		fprintf(stderr, ANSI_COLOR_RED "Problème de connexion au serveur\n" ANSI_COLOR_RESET);
 		exit(-1);
 	}
-	printf(ANSI_COLOR_MAGENTA "Socket connectée\n" ANSI_COLOR_RESET);
 
-	// Fin avec Ctrl + C
+	// Fin avec Ctrl + C ; une écriture TLS sur une connexion perdue ne doit pas tuer le client
 	signal(SIGINT, sigintHandler);
+	signal(SIGPIPE, SIG_IGN);
 
-	// Saisie du pseudo du client au clavier
-	char *monPseudo = (char *)malloc(sizeof(char) * TAILLE_PSEUDO);
-	do
+	// Le thread de réception tient la session dès maintenant : la connexion et la réponse au
+	// pseudo avancent pendant que la fenêtre s'ouvre et que ses ressources se chargent
+	if (pthread_create(&thread_reception, NULL, receptionPourThread, 0) < 0)
 	{
-		printf(ANSI_COLOR_MAGENTA "\nVotre pseudo (maximum 19 caractères):\n" ANSI_COLOR_RESET);
-		fgets(monPseudo, TAILLE_PSEUDO, stdin);
-		for (int i = 0; i < strlen(monPseudo); i++)
-		{
-			if (monPseudo[i] == ' ')
-			{
-				monPseudo[i] = '_';
-			}
-		}
-	} while (strcmp(monPseudo, "\n") == 0);
-
-	// Envoie du pseudo
-	envoi(monPseudo);
-
-	char *repServeur = (char *)malloc(sizeof(char) * 61);
-	// Récéption de la réponse du serveur
-	reception(repServeur, sizeof(char) * 61);
-	printf(ANSI_COLOR_MAGENTA "%s\n" ANSI_COLOR_RESET, repServeur);
-
-	while (strcmp(repServeur, "Pseudo déjà existant\n") == 0)
+		fprintf(stderr, ANSI_COLOR_RED "Erreur de création de thread réception client\n" ANSI_COLOR_RESET);
+		exit(-1);
+	}
+	char *monPseudo = (char *)malloc(sizeof(char) * TAILLE_PSEUDO);
+	if (pseudoDemande != NULL)
 	{
-		// Saisie du pseudo du client au clavier
-		printf(ANSI_COLOR_MAGENTA "Votre pseudo (maximum 19 caractères):\n" ANSI_COLOR_RESET);
-		fgets(monPseudo, TAILLE_PSEUDO, stdin);
-
-		for (int i = 0; i < strlen(monPseudo); i++)
+		snprintf(monPseudo, TAILLE_PSEUDO, "%s", pseudoDemande);
+		for (int i = 0; monPseudo[i] != '\0'; i++)
 		{
-			if (monPseudo[i] == ' ')
-			{
-				monPseudo[i] = '_';
-			}
+			monPseudo[i] = monPseudo[i] == ' ' ? '_' : monPseudo[i];
 		}
-
-		// Envoie du pseudo
-		envoi(monPseudo);
-
-		// Récéption de la réponse du serveur
-		reception(repServeur, sizeof(char) * 61);
-		printf(ANSI_COLOR_MAGENTA "%s\n" ANSI_COLOR_RESET, repServeur);
-
-	}
-
-	free(monPseudo);
-	boolConnect = 1;
-
-	//_____________________ Communication _____________________
-
-	if (pthread_create(&thread_envoi, NULL, envoiPourThread, 0) < 0)
-	{
-		fprintf(stderr, ANSI_COLOR_RED "Erreur de création de thread d'envoi client\n" ANSI_COLOR_RESET);
-		exit(-1);
+		envoiPseudo(monPseudo);
 	}
 
-	if (pthread_create(&thread_reception, NULL, receptionPourThread, 0) < 0)
+	// L'image de fond et la police ne dépendent pas de la vidéo : leur chargement commence
+	// avant l'ouverture de la fenêtre et avance pendant la création du rendu
+	if (TTF_Init() != 0)
+		SDL_ExitWithError("Initialisation TTF");
+	Ressources ressources = {0};
+	pthread_t thread_ressources;
+	if (pthread_create(&thread_ressources, NULL, chargerRessources, &ressources) < 0)
 	{
-		fprintf(stderr, ANSI_COLOR_RED "Erreur de création de thread réception client\n" ANSI_COLOR_RESET);
+		fprintf(stderr, ANSI_COLOR_RED "Erreur de création de thread de chargement\n" ANSI_COLOR_RESET);
 		exit(-1);
 	}
 
@@ -386,13 +1039,14 @@ int main(int argc, char *argv[])
     SDL_Renderer *renderer = NULL;
     TTF_Font *font = NULL;
 
+    // Le rendu logiciel dessine directement dans la surface de la fenêtre, sans passer par
+    // une texture OpenGL intermédiaire à créer puis à recopier à chaque image
+    SDL_SetHint(SDL_HINT_FRAMEBUFFER_ACCELERATION, "0");
+
     //Fonction si SDL ne démarre pas > Log erreur
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
             SDL_ExitWithError("Initialisation SDL");
 
-    if (TTF_Init() != 0)
-            SDL_ExitWithError("Initialisation TTF");
-
     //Execution du programme....
     //SDL_CreateWindow("Titre de la fenêtre", Position X, Position Y, largeur, hauteur, affichage)
     window = SDL_CreateWindow("ChatGTI", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, 0);
@@ -404,11 +1058,53 @@ int main(int argc, char *argv[])
 
 	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
 
+	// Le thread de réception réveille l'interface par cet événement quand un message arrive
+	atomic_store(&evenementReveil, SDL_RegisterEvents(1));
+
+	// La fenêtre s'affiche tout de suite, vide ; l'image de fond et la police finissent d'être
+	// décodées pendant la saisie du pseudo et l'identification
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	SDL_RenderClear(renderer);
+	SDL_RenderPresent(renderer);
+	printf(ANSI_COLOR_MAGENTA "Première image : %lld ms\n" ANSI_COLOR_RESET, millisecondes() - debutProgramme);
+
+	// Saisie du pseudo du client au clavier, sauf s'il est donné par -u
+	if (pseudoDemande == NULL)
+	{
+		lirePseudo(monPseudo);
+		envoiPseudo(monPseudo);
+	}
+
+	// Récéption de la réponse du serveur
+	attendreIdentification();
+
+	while (!atomic_load(&estAccepte))
+	{
+		lirePseudo(monPseudo);
+		envoiPseudo(monPseudo);
+		attendreIdentification();
+	}
+
+	free(monPseudo);
+	boolConnect = 1;
+
+	//_____________________ Communication _____________________
+
+	if (pthread_create(&thread_envoi, NULL, envoiPourThread, 0) < 0)
+	{
+		fprintf(stderr, ANSI_COLOR_RED "Erreur de création de thread d'envoi client\n" ANSI_COLOR_RESET);
+		exit(-1);
+	}
+
+	/*----------------------------------------------------------------------------------------------------------------------------------*/
+
+	pthread_join(thread_ressources, NULL);
+
     SDL_Surface *image = NULL;
     SDL_Texture *texture = NULL;
 
-    //SDL_LoadBMP(chemin approximatif de l'image en bmp)
-    image = SDL_LoadBMP("Image/fond.bmp");
+    // Image décodée par le thread de chargement
+    image = ressources.fond;
 
     if (image == NULL)
     {
@@ -467,28 +1163,44 @@ int main(int argc, char *argv[])
 		SDL_DoneTask(ANSI_COLOR_MAGENTA "Test de l'affichage des textures : DONE" ANSI_COLOR_RESET);
 	}
 
-	SDL_RenderPresent(renderer);
+	// Pas d'image intermédiaire : la boucle présente aussitôt la discussion complète
 	printf(ANSI_COLOR_MAGENTA "Connexion complète\n" ANSI_COLOR_RESET);
 
 	/*----------------------------------------------------------------------------------------------------------------------------------*/
 
-	font = TTF_OpenFont("Police/arial_narrow_7.ttf", 20);
+	font = ressources.police;
 
     // Créer le champ de saisie de texte
     SDL_StartTextInput();
-    char text[256];
+    char text[256] = "";
     int textLength = 0;
-    int tailletxt = 20;
+    TexteVue saisie = {0};
+    TexteVue statutVue = {0};
 
     if (font == NULL)
     {
         printf("Erreur Police\n");
         return 1;
     }
+    vueInitialiser(renderer, font);
 
 	/*----------------------------------------------------------------------------------------------------------------------------------*/
 
 	SDL_bool program_launched = SDL_TRUE;
+	int estSale = 1;
+	SDL_Rect tchat = {10, 20, 1260, 650};
+	Uint32 derniereImage = 0;
+	char statut[256] = "";
+	time_t derniereLecture = 0;
+	int estPrete = 0;
+
+	// Pendant un défilement, une image par rafraîchissement de l'écran
+	Uint32 intervalleImage = INTERVALLE_IMAGE;
+	SDL_DisplayMode mode;
+	if (SDL_GetCurrentDisplayMode(0, &mode) == 0 && mode.refresh_rate > 0)
+	{
+		intervalleImage = 1000 / mode.refresh_rate;
+	}
 
 	char *insultes[] = {"tg", "salope", "pétasse", "pd"};
 
@@ -496,8 +1208,20 @@ int main(int argc, char *argv[])
     {
         SDL_Event event;
 
-        while(SDL_PollEvent(&event))
+        // On dort jusqu'au prochain événement ; une image en attente n'attend que la fin de son intervalle
+        Uint32 ecoule = SDL_GetTicks() - derniereImage;
+        int attente = !estSale ? DELAI_REVEIL : ecoule < intervalleImage ? (int)(intervalleImage - ecoule) : 0;
+        int estEvenement = SDL_WaitEventTimeout(&event, attente);
+        while (estEvenement)
         {
+            if (event.type == atomic_load(&evenementReveil))
+            {
+                atomic_store(&estReveillee, 0);
+            }
+            if (event.type != SDL_MOUSEMOTION)
+            {
+                estSale = 1;
+            }
             switch(event.type)
             {
 				case SDL_TEXTINPUT:
@@ -505,24 +1229,32 @@ int main(int argc, char *argv[])
                     if (textLength < 62){
                         strcat(text, event.text.text);
                         textLength++;
-						if (tailletxt < 1260) 
-                    	{
-                        	tailletxt += 20;
-                    	}
+						// La saisie n'est réannoncée que toutes les DELAI_SAISIE secondes
+						if (time(NULL) - saisieEnvoyee >= DELAI_SAISIE)
+						{
+							saisieEnvoyee = time(NULL);
+							envoiEphemere(EPHEMERE_SAISIE, 1);
+						}
                     }
                     break;
                 
+				case SDL_MOUSEWHEEL:
+					vueDefiler(-event.wheel.y * PAS_DEFILEMENT);
+					break;
+
                 case SDL_KEYDOWN:
                     // Effacer le caractère précédent
                     if (event.key.keysym.sym == SDLK_BACKSPACE && textLength > 0) {
                         text[--textLength] = '\0';
-                        if (tailletxt > 20)
-                        {
-                            tailletxt -= 20;
-                        }
-                        
                     }
 
+					// Défiler d'une page, en gardant une ligne de la précédente
+					if (event.key.keysym.sym == SDLK_PAGEUP || event.key.keysym.sym == SDLK_PAGEDOWN)
+					{
+						int page = tchat.h - 2 * ESPACE_MESSAGES;
+						vueDefiler(event.key.keysym.sym == SDLK_PAGEUP ? -page : page);
+					}
+
 					if (event.key.keysym.sym == SDLK_RETURN) 
 					{
 						char *msgaenvoyer = (char *)malloc(sizeof(char) * strlen(text));
@@ -553,7 +1285,6 @@ int main(int argc, char *argv[])
 						{
 							text[i] = 0;
 						}
-						tailletxt = 0;
 					
 						// On vérifie si le client veut quitter la communication
 						estFin = finDeCommunication(msgaenvoyer);
@@ -567,38 +1298,14 @@ int main(int argc, char *argv[])
 								sigintHandler(2);
 							}
 							
-							FILE* fichiermsg = fopen("fichiermsg.txt", "a");
-							if (fichiermsg != NULL)
-							{
-								fprintf(fichiermsg, "Me : %s\n\n", msgaenvoyer);
-								fclose(fichiermsg);
-							}
-
-							FILE* fichier = fopen("fichiermsg.txt", "r");
-							long taille_fichier;
-							char *contenu2;
-
-							if (fichier)
-							{
-								// Obtenir la taille du fichier
-								fseek(fichier, 0, SEEK_END);
-								taille_fichier = ftell(fichier);
-								rewind(fichier);
-
-								// Allouer de la mémoire pour le contenu du fichier
-								contenu2 = (char *)malloc(taille_fichier);
-
-								// Lire le contenu du fichier dans la variable
-								fread(contenu2, 1, taille_fichier, fichier);
-
-								// Fermer le fichier
-								fclose(fichier);
-
-								// Utiliser le contenu du fichier
-								msgfichier = contenu2;
-								
-							}
+							filAjouter(FIL_ENVOYE, NULL, msgaenvoyer);
 							envoi(msgaenvoyer);
+							dernierEnvoi = time(NULL);
+						}
+						if (saisieEnvoyee != 0)
+						{
+							saisieEnvoyee = 0;
+							envoiEphemere(EPHEMERE_SAISIE, 0);
 						}
 					}
 					break;
@@ -611,8 +1318,34 @@ int main(int argc, char *argv[])
 					default:
 						break;
 				}
+            estEvenement = SDL_PollEvent(&event);
+        }
+
+        // Marquer les messages reçus comme lus, au plus une fois par seconde
+        time_t maintenant = time(NULL);
+        if (estNonLu && maintenant > derniereLecture)
+        {
+            estNonLu = 0;
+            derniereLecture = maintenant;
+            envoiEphemere(EPHEMERE_LECTURE, 0);
+        }
+
+        // Le statut change aussi sans événement, quand un indicateur de saisie expire
+        char nouveauStatut[sizeof(statut)];
+        composerStatut(nouveauStatut, sizeof(nouveauStatut), maintenant);
+        if (strcmp(nouveauStatut, statut) != 0)
+        {
+            strcpy(statut, nouveauStatut);
+            estSale = 1;
         }
 
+        if (!estSale || SDL_GetTicks() - derniereImage < intervalleImage)
+        {
+            continue;
+        }
+        estSale = 0;
+        derniereImage = SDL_GetTicks();
+
 		// Rendu
         SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
         SDL_RenderClear(renderer);
@@ -621,42 +1354,32 @@ int main(int argc, char *argv[])
         SDL_RenderCopy(renderer, texture, NULL, &rectangle);
 
         // Afficher le champ de saisie de texte
-        SDL_Rect tchat = { 10, 20, 1260, 650 };
         SDL_Rect textRect1 = { 10, 690, 1260, 40 };
-        SDL_Rect textRect = { 10, 690, tailletxt, 40 };
+        SDL_Rect textRect = { 15, 698, 0, 0 };
         SDL_RenderDrawRect(renderer, &textRect1);
         SDL_RenderDrawRect(renderer, &tchat);
         SDL_Color color = {255, 255, 255, 255};
 
-        // Afficher le texte
-        SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, color);
-        SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-        SDL_FreeSurface(textSurface);
-        SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-        SDL_DestroyTexture(textTexture);
+        SDL_Color gris = {160, 160, 160, 255};
+        vueDessinerTexte(&statutVue, statut, gris, &(SDL_Rect){10, 670, 0, 0});
 
-		SDL_Color White = {255, 255, 255};
-		int wrap_length = 400;
-		SDL_Surface* surfaceMessage = TTF_RenderUTF8_Blended_Wrapped(font, msgfichier, White, wrap_length);
-		SDL_Texture* Message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
-		SDL_Rect Message_rect;
+        // Afficher le texte en cours de saisie, puis les messages visibles du fil ; tant que
+        // le fil défile, une autre image suit
+        vueDessinerTexte(&saisie, text, color, &textRect);
+        estSale = vueDessinerFil(&tchat);
+        if (vueVeutAnciens())
+        {
+            demanderHistorique();
+        }
 
-		if (SDL_QueryTexture(Message, NULL, NULL, &Message_rect.w, &Message_rect.h) != 0)
+		SDL_RenderPresent(renderer);
+
+		// Première image complète : la discussion est utilisable
+		if (!estPrete)
 		{
-			SDL_DestroyRenderer(renderer);
-			SDL_DestroyWindow(window);
-			SDL_ExitWithError("Impossible de charger la texture");
+			estPrete = 1;
+			printf(ANSI_COLOR_MAGENTA "Discussion prête : %lld ms\n" ANSI_COLOR_RESET, millisecondes() - debutProgramme);
 		}
-
-		Message_rect.x = 30;
-		Message_rect.y = (670 - Message_rect.h);
-		Message_rect.w = 450;
-
-		SDL_RenderCopy(renderer, Message, NULL, &Message_rect);
-
-		SDL_FreeSurface(surfaceMessage);
-		SDL_DestroyTexture(Message);
-		SDL_RenderPresent(renderer);
     }
 
 	pthread_join(thread_envoi, NULL);
@@ -664,6 +1387,9 @@ int main(int argc, char *argv[])
 
 	/*----------------------------------------------------------------------------------------------------------------------------------*/
 
+	vueLiberer();
+	SDL_DestroyTexture(saisie.texture);
+	SDL_DestroyTexture(statutVue.texture);
 	SDL_DestroyTexture(texture); //##############
     SDL_DestroyRenderer(renderer); //##############
     SDL_DestroyWindow(window); //##############
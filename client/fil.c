@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "fil.h"
+
+/**
+ * - anneau = derniers messages ; le message n occupe la case n % TAILLE_FIL
+ * - dernier = numéro du dernier message ajouté, 0 si le fil est vide
+ * - sauvegarde = fichier de sauvegarde, NULL si elle est désactivée
+ * - ecrit = numéro du dernier message écrit dans la sauvegarde
+ * - mutexFil = protège l'anneau et les compteurs
+ * - condSauvegarde = réveille le thread de sauvegarde quand un message arrive
+ */
+static MessageFil anneau[TAILLE_FIL];
+static uint64_t dernier = 0;
+static FILE *sauvegarde = NULL;
+static uint64_t ecrit = 0;
+static pthread_mutex_t mutexFil = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condSauvegarde = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Ajoute un message au fil, en remplaçant le plus ancien si l'anneau
+ * est plein. Le coût ne dépend que de la taille du message.
+ *
+ * @param origine origine du message (OrigineMessage)
+ * @param auteur pseudo de l'auteur, NULL ou vide pour un texte du serveur
+ * @param texte texte du message
+ */
+void filAjouter(int origine, const char *auteur, const char *texte)
+{
+	size_t longueur = strlen(texte);
+	char *copie = malloc(longueur + 1);
+	if (copie == NULL)
+	{
+		return;
+	}
+	memcpy(copie, texte, longueur + 1);
+
+	pthread_mutex_lock(&mutexFil);
+	MessageFil *message = &anneau[(dernier + 1) % TAILLE_FIL];
+	free(message->texte);
+	message->numero = ++dernier;
+	message->origine = origine;
+	message->auteur[0] = '\0';
+	if (auteur != NULL)
+	{
+		strncat(message->auteur, auteur, TAILLE_AUTEUR - 1);
+	}
+	message->texte = copie;
+	message->longueur = longueur;
+	pthread_cond_signal(&condSauvegarde);
+	pthread_mutex_unlock(&mutexFil);
+}
+
+/**
+ * @brief Donne le numéro du dernier message du fil ; il change à chaque ajout.
+ *
+ * @return le numéro du dernier message, 0 si le fil est vide.
+ */
+uint64_t filDernier(void)
+{
+	pthread_mutex_lock(&mutexFil);
+	uint64_t numero = dernier;
+	pthread_mutex_unlock(&mutexFil);
+	return numero;
+}
+
+/**
+ * @brief Copie un message du fil.
+ *
+ * @param numero numéro du message
+ * @param message reçoit le message ; son champ texte pointe sur le buffer texte
+ * @param texte buffer recevant le texte, tronqué à sa taille
+ * @param taille taille du buffer texte
+ * @return 0 si tout se passe bien, -1 si le message n'existe pas ou a quitté l'anneau.
+ */
+int filLire(uint64_t numero, MessageFil *message, char *texte, size_t taille)
+{
+	pthread_mutex_lock(&mutexFil);
+	MessageFil *source = &anneau[numero % TAILLE_FIL];
+	if (numero == 0 || source->numero != numero)
+	{
+		pthread_mutex_unlock(&mutexFil);
+		return -1;
+	}
+	*message = *source;
+	message->longueur = source->longueur < taille - 1 ? source->longueur : taille - 1;
+	memcpy(texte, source->texte, message->longueur);
+	texte[message->longueur] = '\0';
+	message->texte = texte;
+	pthread_mutex_unlock(&mutexFil);
+	return 0;
+}
+
+/**
+ * @brief Donne ce qui précède le texte d'un message sur sa ligne : "Me" pour
+ * un message envoyé, le pseudo de l'auteur sinon, rien pour un texte du serveur.
+ */
+static const char *prefixeLigne(const MessageFil *message)
+{
+	return message->origine == FIL_ENVOYE ? "Me" : message->auteur;
+}
+
+/**
+ * @brief Met en forme un message sur une ligne : "pseudo : texte", "Me : texte"
+ * pour un message envoyé, le texte seul pour un texte du serveur.
+ *
+ * @param ligne buffer recevant la ligne, terminée par '\0'
+ * @param taille taille du buffer
+ * @param message message à mettre en forme
+ * @return la longueur de la ligne complète, comme snprintf.
+ */
+int filLigne(char *ligne, size_t taille, const MessageFil *message)
+{
+	const char *prefixe = prefixeLigne(message);
+	return snprintf(ligne, taille, "%s%s%s", prefixe, prefixe[0] != '\0' ? " : " : "", message->texte);
+}
+
+/**
+ * @brief Fonction principale du thread de sauvegarde : écrit les nouveaux
+ * messages hors du verrou du fil. Les messages sortis de l'anneau avant
+ * d'avoir été écrits sont perdus pour la sauvegarde ; l'historique plus ancien
+ * demandé au serveur, et les changements de salon, n'y sont pas écrits.
+ */
+static void *sauvegardeThread(void *arg)
+{
+	(void)arg;
+	MessageFil message;
+	char *texte = NULL;
+	size_t taille = 0;
+	while (1)
+	{
+		pthread_mutex_lock(&mutexFil);
+		while (ecrit == dernier)
+		{
+			pthread_cond_wait(&condSauvegarde, &mutexFil);
+		}
+		if (dernier - ecrit > TAILLE_FIL)
+		{
+			ecrit = dernier - TAILLE_FIL;
+		}
+		uint64_t numero = ++ecrit;
+		MessageFil *source = &anneau[numero % TAILLE_FIL];
+		if (source->origine == FIL_ANCIEN || source->origine == FIL_SALON)
+		{
+			int estAJour = ecrit == dernier;
+			pthread_mutex_unlock(&mutexFil);
+			if (estAJour)
+			{
+				fflush(sauvegarde);
+			}
+			continue;
+		}
+		if (source->longueur + 1 > taille)
+		{
+			char *agrandi = realloc(texte, source->longueur + 1);
+			if (agrandi == NULL)
+			{
+				pthread_mutex_unlock(&mutexFil);
+				continue;
+			}
+			texte = agrandi;
+			taille = source->longueur + 1;
+		}
+		message = *source;
+		memcpy(texte, source->texte, source->longueur + 1);
+		message.texte = texte;
+		int estAJour = ecrit == dernier;
+		pthread_mutex_unlock(&mutexFil);
+
+		const char *prefixe = prefixeLigne(&message);
+		fprintf(sauvegarde, "%s%s%s\n\n", prefixe, prefixe[0] != '\0' ? " : " : "", message.texte);
+		if (estAJour)
+		{
+			fflush(sauvegarde);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Active la sauvegarde du fil dans un fichier, complété à chaque message.
+ *
+ * @param chemin chemin du fichier de sauvegarde
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int filSauvegarder(const char *chemin)
+{
+	sauvegarde = fopen(chemin, "a");
+	if (sauvegarde == NULL)
+	{
+		perror("Impossible d'ouvrir le fichier de sauvegarde");
+		return -1;
+	}
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, sauvegardeThread, NULL) != 0)
+	{
+		perror("Erreur thread sauvegarde");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef FIL_H
+#define FIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fil de discussion du client : les derniers messages, gardés en mémoire dans
+ * un anneau de taille fixe et partagés entre le thread réseau et l'interface.
+ * Une sauvegarde sur disque, facultative, est écrite par un thread dédié.
+ */
+
+/**
+ * - TAILLE_FIL = nombre de messages gardés en mémoire (puissance de 2)
+ * - TAILLE_AUTEUR = taille maximum de l'auteur d'un message, '\0' compris
+ */
+#define TAILLE_FIL 1024
+#define TAILLE_AUTEUR 32
+
+/**
+ * @brief Origine d'un message du fil.
+ *
+ * - FIL_RECU = message d'un autre utilisateur
+ * - FIL_ENVOYE = message envoyé par ce client
+ * - FIL_SERVEUR = texte du serveur (réponse à une commande, historique...)
+ * - FIL_ANCIEN = message de l'historique demandé au serveur, plus ancien que tous ceux de la vue ;
+ *   les messages d'une page arrivent du plus récent au plus ancien
+ * - FIL_SALON = arrivée dans un salon, sans texte : la vue oublie les messages qui précèdent
+ */
+enum OrigineMessage
+{
+	FIL_RECU,
+	FIL_ENVOYE,
+	FIL_SERVEUR,
+	FIL_ANCIEN,
+	FIL_SALON
+};
+
+/**
+ * @brief Message du fil.
+ *
+ * @param numero numéro du message, croissant depuis 1 pendant la session
+ * @param origine origine du message (OrigineMessage)
+ * @param auteur pseudo de l'auteur, vide pour un texte du serveur
+ * @param texte texte du message, terminé par '\0'
+ * @param longueur longueur du texte
+ */
+typedef struct MessageFil MessageFil;
+struct MessageFil
+{
+	uint64_t numero;
+	int origine;
+	char auteur[TAILLE_AUTEUR];
+	char *texte;
+	size_t longueur;
+};
+
+void filAjouter(int origine, const char *auteur, const char *texte);
+uint64_t filDernier(void);
+int filLire(uint64_t numero, MessageFil *message, char *texte, size_t taille);
+int filLigne(char *ligne, size_t taille, const MessageFil *message);
+int filSauvegarder(const char *chemin);
+
+#endif
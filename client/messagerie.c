@@ -0,0 +1,809 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <zlib.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include "messagerie.h"
+
+/**
+ * @brief Connexion d'un client au serveur.
+ *
+ * @param dS socket du serveur, -1 quand la session est fermée
+ * @param estConnectee 1 quand la connexion est établie
+ * @param etatPseudo 0 sans pseudo en attente, 1 en attendant la réponse du serveur, 2 une fois accepté
+ * @param estFinie 1 quand le rappel de fin a été appelé, ou la session fermée par l'application
+ * @param drapeaux drapeaux envoyés avec le pseudo (DRAPEAU_DEFLATE, DRAPEAU_IDENTITES...)
+ * @param estNumerote 1 quand le serveur numérote les messages des salons
+ * @param rappels rappels de l'application
+ * @param contexte passé tel quel aux rappels
+ * @param lecteur tampon de réception des trames
+ * @param sortie trames en attente d'envoi
+ * @param tailleSortie taille du tampon sortie
+ * @param rempliSortie octets écrits dans sortie
+ * @param envoyeSortie octets de sortie déjà envoyés
+ * @param flux flux de décompression, ouvert par TRAME_COMPRESSION
+ * @param estCompresse 1 quand le flux est ouvert
+ * @param identites pseudo de chaque identifiant d'expéditeur annoncé
+ * @param nbIdentites plus grand identifiant annoncé, plus un
+ * @param tailleIdentites taille du tableau identites
+ * @param contexteTls contexte TLS demandé par messagerieChiffrer, NULL pour une connexion en clair
+ * @param ssl session TLS de la connexion, NULL en clair
+ * @param estChiffree 1 quand la poignée de main TLS est terminée
+ * @param attenteTls événements qu'attend OpenSSL pour avancer (poignée de main, écriture bloquée)
+ */
+struct Session
+{
+	int dS;
+	int estConnectee;
+	int etatPseudo;
+	int estFinie;
+	uint8_t drapeaux;
+	int estNumerote;
+	const RappelsSession *rappels;
+	void *contexte;
+	LecteurTrame lecteur;
+	uint8_t *sortie;
+	size_t tailleSortie;
+	size_t rempliSortie;
+	size_t envoyeSortie;
+	z_stream flux;
+	int estCompresse;
+	char (*identites)[TAILLE_PSEUDO_MESSAGERIE];
+	int nbIdentites;
+	int tailleIdentites;
+	SSL_CTX *contexteTls;
+	SSL *ssl;
+	int estChiffree;
+	short attenteTls;
+};
+
+/**
+ * @brief Crée une session, pas encore connectée.
+ *
+ * @param rappels rappels de l'application, gardés par la session jusqu'à sa libération
+ * @param contexte passé tel quel aux rappels
+ * @return la session, NULL si la mémoire manque.
+ */
+Session *messagerieCreer(const RappelsSession *rappels, void *contexte)
+{
+	Session *session = calloc(1, sizeof(Session));
+	if (session == NULL)
+	{
+		return NULL;
+	}
+	session->dS = -1;
+	session->rappels = rappels;
+	session->contexte = contexte;
+	return session;
+}
+
+/**
+ * @brief Ferme la session après une erreur ou la fermeture par le serveur,
+ * et l'annonce au rappel de fin.
+ *
+ * @return -1, pour le rendre directement.
+ */
+static int terminer(Session *session)
+{
+	ERR_clear_error();
+	SSL_free(session->ssl);
+	session->ssl = NULL;
+	if (session->dS >= 0)
+	{
+		close(session->dS);
+		session->dS = -1;
+	}
+	if (!session->estFinie)
+	{
+		session->estFinie = 1;
+		if (session->rappels->fin != NULL)
+		{
+			session->rappels->fin(session, session->contexte);
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Demande que la connexion soit chiffrée (TLS) ; à appeler avant
+ * messagerieConnecter. Le certificat du serveur doit être signé par une
+ * autorité acceptée et valoir pour l'adresse connectée. Une écriture TLS
+ * peut lever SIGPIPE : l'application l'ignore.
+ *
+ * @param autorite fichier PEM des autorités acceptées (un certificat auto-signé convient),
+ *        NULL pour celles du système
+ * @return 0 si tout se passe bien, -1 si la session est déjà connectée ou l'autorité illisible.
+ */
+int messagerieChiffrer(Session *session, const char *autorite)
+{
+	if (session->dS >= 0 || session->contexteTls != NULL)
+	{
+		return -1;
+	}
+	SSL_CTX *contexte = SSL_CTX_new(TLS_client_method());
+	if (contexte == NULL)
+	{
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version(contexte, TLS1_2_VERSION);
+	SSL_CTX_set_verify(contexte, SSL_VERIFY_PEER, NULL);
+	SSL_CTX_set_options(contexte, SSL_OP_ENABLE_KTLS);
+	// La file d'envoi part par morceaux, et peut être déplacée entre deux essais
+	SSL_CTX_set_mode(contexte, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	if ((autorite != NULL ? SSL_CTX_load_verify_locations(contexte, autorite, NULL) : SSL_CTX_set_default_verify_paths(contexte)) != 1)
+	{
+		ERR_clear_error();
+		SSL_CTX_free(contexte);
+		return -1;
+	}
+	session->contexteTls = contexte;
+	return 0;
+}
+
+/**
+ * @brief Ouvre la connexion au serveur, sans attendre qu'elle aboutisse : les
+ * envois faits entre-temps partent une fois la connexion établie, et la
+ * poignée de main TLS terminée si la session est chiffrée.
+ *
+ * @param adresse adresse IPv4 du serveur
+ * @param port port du serveur
+ * @return 0 si la connexion est en cours ou établie, -1 sinon.
+ */
+int messagerieConnecter(Session *session, const char *adresse, int port)
+{
+	struct sockaddr_in aS = {0};
+	aS.sin_family = AF_INET;
+	aS.sin_port = htons(port);
+	if (session->dS >= 0 || inet_pton(AF_INET, adresse, &aS.sin_addr) != 1)
+	{
+		return -1;
+	}
+	session->dS = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (session->dS < 0)
+	{
+		return -1;
+	}
+	if (session->contexteTls != NULL)
+	{
+		// La poignée de main commence par l'envoi du premier message, dès la connexion établie
+		session->ssl = SSL_new(session->contexteTls);
+		session->estChiffree = 0;
+		session->attenteTls = POLLOUT;
+		if (session->ssl == NULL || SSL_set_fd(session->ssl, session->dS) != 1 ||
+			X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(session->ssl), adresse) != 1)
+		{
+			ERR_clear_error();
+			SSL_free(session->ssl);
+			session->ssl = NULL;
+			close(session->dS);
+			session->dS = -1;
+			return -1;
+		}
+		SSL_set_connect_state(session->ssl);
+	}
+	if (connect(session->dS, (struct sockaddr *)&aS, sizeof(aS)) == 0)
+	{
+		session->estConnectee = 1;
+	}
+	else if (errno != EINPROGRESS)
+	{
+		SSL_free(session->ssl);
+		session->ssl = NULL;
+		close(session->dS);
+		session->dS = -1;
+		return -1;
+	}
+	session->estFinie = 0;
+	return 0;
+}
+
+/**
+ * @brief Donne la socket de la session, à surveiller par l'application.
+ *
+ * @return la socket, -1 si la session est fermée.
+ */
+int messagerieDescripteur(const Session *session)
+{
+	return session->dS;
+}
+
+/**
+ * @brief Donne les événements à surveiller sur la socket de la session :
+ * toujours la lecture, l'écriture tant que la connexion s'établit ou que des
+ * trames attendent leur envoi ; pendant la poignée de main TLS, ce qu'elle attend.
+ *
+ * @return les événements, au sens de poll, 0 si la session est fermée.
+ */
+short messagerieEvenements(const Session *session)
+{
+	if (session->dS < 0)
+	{
+		return 0;
+	}
+	if (!session->estConnectee)
+	{
+		return POLLOUT;
+	}
+	if (session->ssl != NULL && !session->estChiffree)
+	{
+		return session->attenteTls;
+	}
+	return POLLIN | (session->envoyeSortie < session->rempliSortie ? POLLOUT : 0) | session->attenteTls;
+}
+
+/**
+ * @brief Met une trame en file d'envoi.
+ *
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param charge charge utile de la trame
+ * @param longueur taille de la charge utile, tronquée à TAILLE_MAX_TRAME
+ * @return 0 si tout se passe bien, -1 si la session est fermée ou sa file pleine.
+ */
+int messagerieEnvoyerTrame(Session *session, uint8_t type, uint8_t drapeaux, const char *charge, size_t longueur)
+{
+	if (session->dS < 0)
+	{
+		return -1;
+	}
+	longueur = longueur < TAILLE_MAX_TRAME ? longueur : TAILLE_MAX_TRAME;
+	size_t besoin = TAILLE_ENTETE_TRAME + longueur;
+	if (session->rempliSortie + besoin > session->tailleSortie)
+	{
+		// La place déjà envoyée est reprise avant d'agrandir le tampon
+		memmove(session->sortie, session->sortie + session->envoyeSortie, session->rempliSortie - session->envoyeSortie);
+		session->rempliSortie -= session->envoyeSortie;
+		session->envoyeSortie = 0;
+	}
+	if (session->rempliSortie + besoin > session->tailleSortie)
+	{
+		if (session->rempliSortie + besoin > TAILLE_SORTIE_MESSAGERIE)
+		{
+			return -1;
+		}
+		size_t nouvelle = session->tailleSortie > 0 ? session->tailleSortie * 2 : 4096;
+		while (nouvelle < session->rempliSortie + besoin)
+		{
+			nouvelle *= 2;
+		}
+		uint8_t *agrandi = realloc(session->sortie, nouvelle);
+		if (agrandi == NULL)
+		{
+			return -1;
+		}
+		session->sortie = agrandi;
+		session->tailleSortie = nouvelle;
+	}
+	trameEcrireEntete(session->sortie + session->rempliSortie, type, drapeaux, longueur);
+	if (longueur > 0)
+	{
+		memcpy(session->sortie + session->rempliSortie + TAILLE_ENTETE_TRAME, charge, longueur);
+	}
+	session->rempliSortie += besoin;
+	return 0;
+}
+
+/**
+ * @brief Lit la socket de la session dans son lecteur de trames, sans attendre,
+ * en déchiffrant si la session est chiffrée.
+ *
+ * @return le nombre d'octets lus, 0 si la connexion est fermée, -1 en cas d'erreur (EAGAIN s'il faut attendre).
+ */
+static ssize_t lire(Session *session)
+{
+	if (session->ssl == NULL)
+	{
+		return lecteurTrameRemplir(&session->lecteur, session->dS);
+	}
+	size_t lu = 0;
+	int resultat = SSL_read_ex(session->ssl, session->lecteur.tampon + session->lecteur.rempli,
+							   sizeof(session->lecteur.tampon) - session->lecteur.rempli, &lu);
+	if (resultat == 1)
+	{
+		session->lecteur.rempli += lu;
+		return lu;
+	}
+	int erreur = SSL_get_error(session->ssl, resultat);
+	if (erreur == SSL_ERROR_WANT_READ || erreur == SSL_ERROR_WANT_WRITE)
+	{
+		session->attenteTls |= erreur == SSL_ERROR_WANT_WRITE ? POLLOUT : 0;
+		errno = EAGAIN;
+		return -1;
+	}
+	errno = EPROTO;
+	return erreur == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+}
+
+/**
+ * @brief Envoie les trames en file, autant que la socket en accepte sans
+ * attendre ; le reste part quand elle redevient disponible en écriture.
+ *
+ * @return 0 si tout se passe bien, -1 si la connexion est perdue.
+ */
+int messagerieVider(Session *session)
+{
+	if (session->dS < 0)
+	{
+		return -1;
+	}
+	while (session->estConnectee && (session->ssl == NULL || session->estChiffree) && session->envoyeSortie < session->rempliSortie)
+	{
+		if (session->ssl != NULL)
+		{
+			// Un essai bloqué est refait avec les mêmes octets, éventuellement déplacés et suivis d'autres
+			size_t ecrit = 0;
+			int resultat = SSL_write_ex(session->ssl, session->sortie + session->envoyeSortie, session->rempliSortie - session->envoyeSortie, &ecrit);
+			int erreur = resultat == 1 ? SSL_ERROR_NONE : SSL_get_error(session->ssl, resultat);
+			session->attenteTls = erreur == SSL_ERROR_WANT_READ ? POLLIN : 0;
+			if (erreur == SSL_ERROR_WANT_READ || erreur == SSL_ERROR_WANT_WRITE)
+			{
+				return 0;
+			}
+			if (erreur != SSL_ERROR_NONE)
+			{
+				return terminer(session);
+			}
+			session->envoyeSortie += ecrit;
+			continue;
+		}
+		ssize_t n = send(session->dS, session->sortie + session->envoyeSortie, session->rempliSortie - session->envoyeSortie,
+						 MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return 0;
+		}
+		if (n < 0 && errno != EINTR)
+		{
+			return terminer(session);
+		}
+		session->envoyeSortie += n > 0 ? n : 0;
+	}
+	if (session->envoyeSortie == session->rempliSortie)
+	{
+		session->envoyeSortie = 0;
+		session->rempliSortie = 0;
+	}
+	return 0;
+}
+
+/**
+ * @brief Envoie son pseudo au serveur ; sa réponse arrive au rappel
+ * d'identification. Un pseudo refusé peut être remplacé par un autre appel.
+ *
+ * @param pseudo pseudo, sans retour à la ligne
+ * @param drapeaux capacités annoncées au serveur : DRAPEAU_DEFLATE, DRAPEAU_IDENTITES,
+ *        DRAPEAU_EPHEMERES, DRAPEAU_HISTORIQUE
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int messagerieIdentifier(Session *session, const char *pseudo, uint8_t drapeaux)
+{
+	session->drapeaux = drapeaux;
+	session->etatPseudo = 1;
+	return messagerieEnvoyerTrame(session, TRAME_TEXTE, drapeaux, pseudo, strlen(pseudo));
+}
+
+/**
+ * @brief Envoie un texte, message ou commande. Un texte trop long part en
+ * plusieurs fragments, coupés entre deux caractères et marqués
+ * DRAPEAU_SUITE, sauf le dernier.
+ *
+ * @param texte texte à envoyer
+ * @param longueur longueur du texte
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int messagerieEnvoyerTexte(Session *session, const char *texte, size_t longueur)
+{
+	do
+	{
+		size_t fragment = longueur <= TAILLE_FRAGMENT_MESSAGERIE ? longueur : texteCoupure(texte, TAILLE_FRAGMENT_MESSAGERIE);
+		if (messagerieEnvoyerTrame(session, TRAME_TEXTE, fragment < longueur ? DRAPEAU_SUITE : 0, texte, fragment) == -1)
+		{
+			return -1;
+		}
+		texte += fragment;
+		longueur -= fragment;
+	} while (longueur > 0);
+	return 0;
+}
+
+/**
+ * @brief Envoie un événement éphémère.
+ *
+ * @param type type de l'événement (TypeEphemere)
+ * @param valeur 1 ou 0 pour la saisie, ignorée pour la lecture
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int messagerieEnvoyerEphemere(Session *session, uint8_t type, uint8_t valeur)
+{
+	char charge[2] = {type, valeur};
+	return messagerieEnvoyerTrame(session, TRAME_EPHEMERE, 0, charge, sizeof(charge));
+}
+
+/**
+ * @brief Demande une page d'historique du salon ; elle arrive au rappel de page.
+ *
+ * @param repere identifiant avant lequel (après lequel, avec DRAPEAU_APRES) chercher les messages
+ * @param nombre nombre maximum de messages
+ * @param drapeaux DRAPEAU_APRES pour les messages plus récents, 0 pour les plus anciens
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int messagerieDemanderPage(Session *session, uint32_t repere, uint16_t nombre, uint8_t drapeaux)
+{
+	char demande[TAILLE_DEMANDE_HISTORIQUE] = {repere >> 24, repere >> 16, repere >> 8, repere, nombre >> 8, nombre & 0xff};
+	return messagerieEnvoyerTrame(session, TRAME_HISTORIQUE, drapeaux, demande, sizeof(demande));
+}
+
+/**
+ * @brief Donne la charge d'une trame texte ou d'une page d'historique,
+ * décompressée si elle l'est ; une charge non compressée entre dans la
+ * fenêtre du flux, comme chez le serveur.
+ *
+ * @param entete en-tête de la trame, en tête du lecteur
+ * @param charge reçoit l'adresse de la charge
+ * @param longueur reçoit la taille de la charge
+ * @param decompresse buffer de TAILLE_MAX_TRAME octets recevant une charge décompressée
+ * @return 0 si tout se passe bien, -1 si la trame compressée est illisible.
+ */
+static int lireCharge(Session *session, const EnteteTrame *entete, uint8_t **charge, size_t *longueur, uint8_t *decompresse)
+{
+	*charge = session->lecteur.tampon + TAILLE_ENTETE_TRAME;
+	*longueur = entete->longueur;
+	if (session->estCompresse && (entete->drapeaux & DRAPEAU_DEFLATE))
+	{
+		// Même flux que le serveur : la décompression reprend où la trame précédente s'est arrêtée
+		session->flux.next_in = *charge;
+		session->flux.avail_in = entete->longueur;
+		session->flux.next_out = decompresse;
+		session->flux.avail_out = TAILLE_MAX_TRAME;
+		int etatFlux = inflate(&session->flux, Z_SYNC_FLUSH);
+		if ((etatFlux != Z_OK && etatFlux != Z_BUF_ERROR) || session->flux.avail_in > 0)
+		{
+			return -1;
+		}
+		*charge = decompresse;
+		*longueur = TAILLE_MAX_TRAME - session->flux.avail_out;
+	}
+	else if (session->estCompresse && entete->longueur > 0)
+	{
+		inflateSetDictionary(&session->flux, *charge, entete->longueur);
+	}
+	return 0;
+}
+
+/**
+ * @brief Retient le pseudo d'un identifiant d'expéditeur.
+ */
+static void retenirIdentite(Session *session, int id, const uint8_t *pseudo, size_t longueur)
+{
+	if (id >= session->tailleIdentites)
+	{
+		int nouvelle = session->tailleIdentites > 0 ? session->tailleIdentites : 64;
+		while (nouvelle <= id)
+		{
+			nouvelle *= 2;
+		}
+		char(*agrandi)[TAILLE_PSEUDO_MESSAGERIE] = realloc(session->identites, sizeof(*agrandi) * nouvelle);
+		if (agrandi == NULL)
+		{
+			return;
+		}
+		memset(agrandi + session->tailleIdentites, 0, sizeof(*agrandi) * (nouvelle - session->tailleIdentites));
+		session->identites = agrandi;
+		session->tailleIdentites = nouvelle;
+	}
+	longueur = longueur < TAILLE_PSEUDO_MESSAGERIE - 1 ? longueur : TAILLE_PSEUDO_MESSAGERIE - 1;
+	memcpy(session->identites[id], pseudo, longueur);
+	session->identites[id][longueur] = '\0';
+	session->nbIdentites = id >= session->nbIdentites ? id + 1 : session->nbIdentites;
+}
+
+/**
+ * @brief Découpe une page d'historique et la remet au rappel de page.
+ */
+static void recevoirPage(Session *session, uint8_t drapeaux, const uint8_t *charge, size_t longueur)
+{
+	if (longueur < TAILLE_ENTETE_HISTORIQUE || session->rappels->page == NULL)
+	{
+		return;
+	}
+	EntreeHistorique entrees[TAILLE_MAX_TRAME / TAILLE_ENTREE_HISTORIQUE];
+	int nombre = 0;
+	for (size_t position = TAILLE_ENTETE_HISTORIQUE; position + TAILLE_ENTREE_HISTORIQUE <= longueur;)
+	{
+		const uint8_t *entree = charge + position;
+		int id = (entree[4] << 8) | entree[5];
+		size_t longueurTexte = (entree[6] << 8) | entree[7];
+		if (position + TAILLE_ENTREE_HISTORIQUE + longueurTexte > longueur)
+		{
+			break;
+		}
+		position += TAILLE_ENTREE_HISTORIQUE + longueurTexte;
+		while (longueurTexte > 0 && entree[TAILLE_ENTREE_HISTORIQUE + longueurTexte - 1] == '\n')
+		{
+			longueurTexte--;
+		}
+		entrees[nombre].id = ((uint32_t)entree[0] << 24) | (entree[1] << 16) | (entree[2] << 8) | entree[3];
+		entrees[nombre].auteur = messagerieIdentite(session, id);
+		entrees[nombre].texte = (const char *)entree + TAILLE_ENTREE_HISTORIQUE;
+		entrees[nombre++].longueur = longueurTexte;
+	}
+	uint32_t suivant = ((uint32_t)charge[0] << 24) | (charge[1] << 16) | (charge[2] << 8) | charge[3];
+	session->rappels->page(session, session->contexte, drapeaux, suivant, entrees, nombre);
+}
+
+/**
+ * @brief Traite la trame complète en tête du lecteur.
+ *
+ * @param texte buffer de TAILLE_MAX_TRAME + 1 octets, pour décompresser ou terminer un texte
+ * @return 0 si tout se passe bien, -1 si la trame compressée est illisible.
+ */
+static int traiterTrame(Session *session, const EnteteTrame *entete, uint8_t *texte)
+{
+	const RappelsSession *rappels = session->rappels;
+	uint8_t *charge = session->lecteur.tampon + TAILLE_ENTETE_TRAME;
+	size_t longueur = entete->longueur;
+	size_t prefixe = TAILLE_IDENTIFIANT + (session->estNumerote ? TAILLE_NUMERO : 0);
+	switch (entete->type)
+	{
+	case TRAME_TEXTE:
+		if (lireCharge(session, entete, &charge, &longueur, texte) != 0)
+		{
+			return -1;
+		}
+		memmove(texte, charge, longueur);
+		texte[longueur] = '\0';
+
+		// La première réponse au pseudo dit s'il est accepté
+		if (session->etatPseudo == 1)
+		{
+			int estAccepte = strcmp((char *)texte, REFUS_PSEUDO) != 0;
+			session->etatPseudo = estAccepte ? 2 : 0;
+			if (rappels->identification != NULL)
+			{
+				rappels->identification(session, session->contexte, estAccepte, (char *)texte);
+			}
+		}
+		else if (rappels->texte != NULL)
+		{
+			rappels->texte(session, session->contexte, (char *)texte, longueur);
+		}
+		break;
+	case TRAME_MESSAGE:
+		if (longueur < prefixe)
+		{
+			break;
+		}
+		if (session->estCompresse)
+		{
+			inflateSetDictionary(&session->flux, charge, longueur);
+		}
+		if (rappels->message != NULL)
+		{
+			MessageSession message;
+			message.idAuteur = (charge[0] << 8) | charge[1];
+			message.auteur = messagerieIdentite(session, message.idAuteur);
+			message.id = session->estNumerote ? ((uint32_t)charge[2] << 24) | (charge[3] << 16) | (charge[4] << 8) | charge[5] : UINT32_MAX;
+			message.texte = (const char *)charge + prefixe;
+			message.longueur = longueur - prefixe;
+			message.drapeaux = entete->drapeaux;
+			rappels->message(session, session->contexte, &message);
+		}
+		break;
+	case TRAME_IDENTITE:
+		if (longueur >= TAILLE_IDENTIFIANT)
+		{
+			retenirIdentite(session, (charge[0] << 8) | charge[1], charge + TAILLE_IDENTIFIANT, longueur - TAILLE_IDENTIFIANT);
+		}
+		break;
+	case TRAME_EPHEMERE:
+		// Le serveur n'envoie que le dernier état de chaque expéditeur, à chaque tick
+		if (longueur >= 7 && rappels->ephemere != NULL)
+		{
+			uint32_t valeur = ((uint32_t)charge[3] << 24) | (charge[4] << 16) | (charge[5] << 8) | charge[6];
+			rappels->ephemere(session, session->contexte, (charge[0] << 8) | charge[1], charge[2], valeur);
+		}
+		break;
+	case TRAME_HISTORIQUE:
+		if (lireCharge(session, entete, &charge, &longueur, texte) != 0)
+		{
+			return -1;
+		}
+		recevoirPage(session, entete->drapeaux, charge, longueur);
+		break;
+	case TRAME_SALON:
+		if (longueur >= 8)
+		{
+			session->estNumerote = (session->drapeaux & DRAPEAU_HISTORIQUE) != 0;
+			if (rappels->salon != NULL)
+			{
+				uint32_t epoque = ((uint32_t)charge[0] << 24) | (charge[1] << 16) | (charge[2] << 8) | charge[3];
+				uint32_t nombre = ((uint32_t)charge[4] << 24) | (charge[5] << 16) | (charge[6] << 8) | charge[7];
+				memcpy(texte, charge + 8, longueur - 8);
+				texte[longueur - 8] = '\0';
+				rappels->salon(session, session->contexte, epoque, nombre, (char *)texte);
+			}
+		}
+		break;
+	case TRAME_COMPRESSION:
+		if (!session->estCompresse && (session->drapeaux & DRAPEAU_DEFLATE))
+		{
+			session->estCompresse = inflateInit2(&session->flux, -15) == Z_OK;
+		}
+		break;
+	case TRAME_PING:
+		messagerieEnvoyerTrame(session, TRAME_PONG, 0, NULL, 0);
+		break;
+	case TRAME_OCCUPE:
+		if (longueur >= 2 && rappels->occupe != NULL)
+		{
+			rappels->occupe(session, session->contexte, (charge[0] << 8) | charge[1]);
+		}
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/**
+ * @brief Traite ce que la socket a reçu et envoie ce qui attend, sans
+ * bloquer. À appeler quand la socket de la session est prête, avec les
+ * événements constatés.
+ *
+ * @param evenements événements constatés sur la socket, au sens de poll
+ * @return 0 si la session reste ouverte, -1 si elle est fermée.
+ */
+int messagerieTraiter(Session *session, short evenements)
+{
+	if (session->dS < 0)
+	{
+		return -1;
+	}
+	if (!session->estConnectee && (evenements & (POLLOUT | POLLERR | POLLHUP)))
+	{
+		int erreur = 0;
+		socklen_t taille = sizeof(erreur);
+		if (getsockopt(session->dS, SOL_SOCKET, SO_ERROR, &erreur, &taille) != 0 || erreur != 0)
+		{
+			return terminer(session);
+		}
+		session->estConnectee = 1;
+	}
+	if (session->estConnectee && session->ssl != NULL && !session->estChiffree)
+	{
+		// Poignée de main TLS : elle avance à chaque événement attendu, puis les trames en file partent
+		int resultat = SSL_do_handshake(session->ssl);
+		int erreur = resultat == 1 ? SSL_ERROR_NONE : SSL_get_error(session->ssl, resultat);
+		if (erreur == SSL_ERROR_WANT_READ || erreur == SSL_ERROR_WANT_WRITE)
+		{
+			session->attenteTls = erreur == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT;
+			return 0;
+		}
+		if (erreur != SSL_ERROR_NONE)
+		{
+			return terminer(session);
+		}
+		session->estChiffree = 1;
+		session->attenteTls = 0;
+	}
+	if (messagerieVider(session) != 0)
+	{
+		return -1;
+	}
+
+	// Quelques lectures au plus : une session très active ne prive pas les autres. Les octets
+	// déjà déchiffrés par OpenSSL sont lus quand même, poll ne les signalerait plus
+	uint8_t texte[TAILLE_MAX_TRAME + 1];
+	for (int i = 0; session->estConnectee && (session->ssl == NULL || session->estChiffree) &&
+					((i < LECTURES_MESSAGERIE && (evenements & (POLLIN | POLLHUP | POLLERR))) || (session->ssl != NULL && SSL_pending(session->ssl) > 0));
+		 i++)
+	{
+		ssize_t recu = lire(session);
+		if (recu < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			break;
+		}
+		if (recu <= 0)
+		{
+			return terminer(session);
+		}
+		EnteteTrame entete;
+		int etat;
+		while ((etat = lecteurTrameDisponible(&session->lecteur, &entete)) == 1)
+		{
+			if (traiterTrame(session, &entete, texte) != 0)
+			{
+				return terminer(session);
+			}
+			if (session->dS < 0)
+			{
+				return -1;
+			}
+			lecteurTrameConsommer(&session->lecteur, &entete);
+		}
+		if (etat < 0)
+		{
+			return terminer(session);
+		}
+	}
+	return messagerieVider(session);
+}
+
+/**
+ * @brief Donne le pseudo d'un identifiant d'expéditeur.
+ *
+ * @return le pseudo, vide s'il n'a pas été annoncé.
+ */
+const char *messagerieIdentite(const Session *session, int id)
+{
+	return id >= 0 && id < session->nbIdentites ? session->identites[id] : "";
+}
+
+/**
+ * @brief Donne le plus grand identifiant d'expéditeur annoncé, plus un.
+ */
+int messagerieNbIdentites(const Session *session)
+{
+	return session->nbIdentites;
+}
+
+/**
+ * @brief Indique si le serveur a accepté le pseudo de la session.
+ */
+int messagerieEstIdentifiee(const Session *session)
+{
+	return session->etatPseudo == 2;
+}
+
+/**
+ * @brief Ferme la connexion, sans appeler le rappel de fin ; les trames
+ * encore en file sont perdues. Peut être appelée depuis un rappel.
+ */
+void messagerieFermer(Session *session)
+{
+	session->estFinie = 1;
+	if (session->ssl != NULL)
+	{
+		// Alerte de fermeture si la socket l'accepte tout de suite
+		if (session->estChiffree)
+		{
+			SSL_shutdown(session->ssl);
+		}
+		ERR_clear_error();
+		SSL_free(session->ssl);
+		session->ssl = NULL;
+	}
+	if (session->dS >= 0)
+	{
+		close(session->dS);
+		session->dS = -1;
+	}
+}
+
+/**
+ * @brief Ferme la session si besoin et libère sa mémoire.
+ */
+void messagerieLiberer(Session *session)
+{
+	if (session == NULL)
+	{
+		return;
+	}
+	messagerieFermer(session);
+	if (session->estCompresse)
+	{
+		inflateEnd(&session->flux);
+	}
+	SSL_CTX_free(session->contexteTls);
+	free(session->sortie);
+	free(session->identites);
+	free(session);
+}
@@ -0,0 +1,123 @@
+#ifndef MESSAGERIE_H
+#define MESSAGERIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocole.h"
+
+/**
+ * Bibliothèque cliente du protocole (libmessagerie) : une session par
+ * connexion au serveur, sans thread ni appel bloquant. L'application
+ * surveille le descripteur de chaque session (poll, epoll...) avec les
+ * événements que donne messagerieEvenements, puis appelle messagerieTraiter :
+ * les trames reçues sont décodées (décompression, identités, numéros de
+ * messages) et remises aux rappels de la session, les pings reçoivent leur
+ * réponse. Les envois sont mis en file et partent ensemble au prochain
+ * messagerieVider ou messagerieTraiter. Une session n'est pas protégée
+ * contre les appels concurrents : un seul thread l'utilise à la fois ; un
+ * processus peut en ouvrir autant qu'il a de descripteurs. Une session peut
+ * être chiffrée (TLS, messagerieChiffrer) : la poignée de main avance au fil
+ * des messagerieTraiter, comme l'établissement de la connexion.
+ */
+
+/**
+ * - TAILLE_PSEUDO_MESSAGERIE = taille maximum d'un pseudo, '\0' compris
+ * - TAILLE_FRAGMENT_MESSAGERIE = taille maximum d'un fragment de texte envoyé ; un texte plus long part en plusieurs
+ * - TAILLE_SORTIE_MESSAGERIE = octets en attente d'envoi au-delà desquels un envoi échoue
+ * - LECTURES_MESSAGERIE = lectures de la socket au plus par messagerieTraiter, pour partager le temps entre sessions
+ * - REFUS_PSEUDO = réponse du serveur à un pseudo déjà pris
+ */
+#define TAILLE_PSEUDO_MESSAGERIE 20
+#define TAILLE_FRAGMENT_MESSAGERIE 499
+#define TAILLE_SORTIE_MESSAGERIE (1 << 20)
+#define LECTURES_MESSAGERIE 4
+#define REFUS_PSEUDO "Pseudo déjà existant\n"
+
+typedef struct Session Session;
+
+/**
+ * @brief Message d'un salon reçu par une session.
+ *
+ * @param idAuteur identifiant de l'expéditeur
+ * @param auteur pseudo de l'expéditeur, vide s'il n'a pas été annoncé
+ * @param id identifiant du message dans l'historique du serveur, UINT32_MAX s'il n'est pas numéroté
+ * @param texte texte du message, pas forcément terminé par '\0'
+ * @param longueur longueur du texte ; vide pour clore un message interrompu
+ * @param drapeaux drapeaux de la trame : DRAPEAU_SUITE si le message continue, DRAPEAU_ECHO pour le nôtre
+ */
+typedef struct MessageSession MessageSession;
+struct MessageSession
+{
+	int idAuteur;
+	const char *auteur;
+	uint32_t id;
+	const char *texte;
+	size_t longueur;
+	uint8_t drapeaux;
+};
+
+/**
+ * @brief Message d'une page d'historique.
+ *
+ * @param id identifiant du message dans l'historique du serveur
+ * @param auteur pseudo de l'expéditeur, vide s'il est inconnu
+ * @param texte texte du message, pas forcément terminé par '\0', sans retour à la ligne final
+ * @param longueur longueur du texte
+ */
+typedef struct EntreeHistorique EntreeHistorique;
+struct EntreeHistorique
+{
+	uint32_t id;
+	const char *auteur;
+	const char *texte;
+	size_t longueur;
+};
+
+/**
+ * @brief Rappels d'une session, appelés depuis messagerieTraiter ; chacun
+ * peut être NULL. Les textes passés ne valent que pendant l'appel. Un rappel
+ * peut envoyer sur sa session, pas la libérer.
+ *
+ * @param identification réponse au pseudo : estAccepte à 0 si le pseudo est déjà pris
+ * @param texte texte du serveur (réponse à une commande, message privé...)
+ * @param message message d'un salon
+ * @param ephemere événement éphémère (TypeEphemere) d'un utilisateur du salon
+ * @param page page d'historique, messages du plus ancien au plus récent ; suivant est l'identifiant
+ *        à demander pour la page d'après (0 ou UINT32_MAX s'il n'y en a plus, selon le sens)
+ * @param salon arrivée dans un salon, avec l'époque et la taille de l'historique du serveur
+ * @param occupe le serveur refuse la connexion ; réessayer dans reessai secondes
+ * @param fin la connexion est perdue ou fermée ; la session ne sert plus
+ */
+typedef struct RappelsSession RappelsSession;
+struct RappelsSession
+{
+	void (*identification)(Session *session, void *contexte, int estAccepte, const char *reponse);
+	void (*texte)(Session *session, void *contexte, const char *texte, size_t longueur);
+	void (*message)(Session *session, void *contexte, const MessageSession *message);
+	void (*ephemere)(Session *session, void *contexte, int idAuteur, uint8_t type, uint32_t valeur);
+	void (*page)(Session *session, void *contexte, uint8_t drapeaux, uint32_t suivant, const EntreeHistorique *entrees, int nombre);
+	void (*salon)(Session *session, void *contexte, uint32_t epoque, uint32_t nbMessages, const char *nom);
+	void (*occupe)(Session *session, void *contexte, unsigned int reessai);
+	void (*fin)(Session *session, void *contexte);
+};
+
+Session *messagerieCreer(const RappelsSession *rappels, void *contexte);
+int messagerieChiffrer(Session *session, const char *autorite);
+int messagerieConnecter(Session *session, const char *adresse, int port);
+int messagerieDescripteur(const Session *session);
+short messagerieEvenements(const Session *session);
+int messagerieTraiter(Session *session, short evenements);
+int messagerieVider(Session *session);
+int messagerieIdentifier(Session *session, const char *pseudo, uint8_t drapeaux);
+int messagerieEnvoyerTrame(Session *session, uint8_t type, uint8_t drapeaux, const char *charge, size_t longueur);
+int messagerieEnvoyerTexte(Session *session, const char *texte, size_t longueur);
+int messagerieEnvoyerEphemere(Session *session, uint8_t type, uint8_t valeur);
+int messagerieDemanderPage(Session *session, uint32_t repere, uint16_t nombre, uint8_t drapeaux);
+const char *messagerieIdentite(const Session *session, int id);
+int messagerieNbIdentites(const Session *session);
+int messagerieEstIdentifiee(const Session *session);
+void messagerieFermer(Session *session);
+void messagerieLiberer(Session *session);
+
+#endif
@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "messagerie.h"
+
+/**
+ * Client en terminal, sans interface graphique, construit sur libmessagerie :
+ * un seul thread surveille l'entrée standard et toutes les sessions avec
+ * epoll. Avec une session, il envoie les lignes lues au clavier et affiche ce
+ * qui arrive ; avec -n ou -m, il ouvre plusieurs sessions qui envoient des
+ * messages à intervalle régulier, puis affiche le débit obtenu.
+ */
+
+/**
+ * - MESSAGES_PAGE_TERMINAL = nombre de messages de l'historique affichés à l'arrivée dans un salon
+ * - MAX_EVENEMENTS_TERMINAL = événements lus au plus par epoll_wait
+ * - DUREE_TERMINAL = durée maximum (s) par défaut du mode automatique
+ * - TAILLE_LIGNE_TERMINAL = taille du buffer de l'entrée standard
+ * - PREFIXE_TERMINAL = début des messages du mode automatique, qui distingue leurs échos de l'annonce d'arrivée
+ */
+#define MESSAGES_PAGE_TERMINAL 20
+#define MAX_EVENEMENTS_TERMINAL 64
+#define DUREE_TERMINAL 30
+#define TAILLE_LIGNE_TERMINAL 4096
+#define PREFIXE_TERMINAL "message "
+
+/**
+ * @brief Session du client en terminal.
+ *
+ * @param session session de libmessagerie
+ * @param numero numéro de la session, à partir de 0
+ * @param evenements événements surveillés par epoll sur sa socket
+ * @param estIdentifiee 1 une fois le pseudo accepté
+ * @param estFinie 1 une fois la session fermée
+ * @param envoyes messages envoyés
+ * @param echos échos de nos messages reçus du serveur
+ * @param prochainEnvoi instant (ms) du prochain envoi
+ */
+typedef struct Participant Participant;
+struct Participant
+{
+	Session *session;
+	int numero;
+	short evenements;
+	int estIdentifiee;
+	int estFinie;
+	int envoyes;
+	int echos;
+	long long prochainEnvoi;
+};
+
+/**
+ * - participants = sessions ouvertes par le client
+ * - nbParticipants = nombre de sessions
+ * - estInteractif = 1 pour une seule session pilotée au clavier
+ * - nbMessages = messages envoyés par chaque session en mode automatique
+ * - intervalle = délai (ms) entre deux envois d'une session
+ * - lot = messages mis en file à chaque envoi, partis en une seule écriture
+ * - epollTerminal = instance epoll surveillant l'entrée standard et les sessions
+ * - nbIdentifiees = sessions dont le pseudo est accepté
+ * - nbFinies = sessions fermées
+ * - totalEnvoyes = messages envoyés par toutes les sessions
+ * - totalEchos = échos reçus par toutes les sessions
+ * - totalRecus = messages des autres reçus par toutes les sessions
+ */
+Participant *participants = NULL;
+int nbParticipants = 1;
+int estInteractif = 1;
+int nbMessages = 0;
+int intervalle = 100;
+int lot = 1;
+int epollTerminal = -1;
+int nbIdentifiees = 0;
+int nbFinies = 0;
+long long totalEnvoyes = 0;
+long long totalEchos = 0;
+long long totalRecus = 0;
+
+/**
+ * @brief Donne l'instant courant en millisecondes, sur une horloge monotone.
+ */
+long long horloge(void)
+{
+	struct timespec maintenant;
+	clock_gettime(CLOCK_MONOTONIC, &maintenant);
+	return (long long)maintenant.tv_sec * 1000 + maintenant.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Réponse du serveur au pseudo d'une session.
+ */
+void terminalIdentification(Session *session, void *contexte, int estAccepte, const char *reponse)
+{
+	Participant *participant = contexte;
+	if (estInteractif)
+	{
+		printf("%s", reponse);
+	}
+	if (!estAccepte)
+	{
+		fprintf(stderr, "Session %d : pseudo refusé\n", participant->numero);
+		messagerieFermer(session);
+		participant->estFinie = 1;
+		nbFinies++;
+		return;
+	}
+	participant->estIdentifiee = 1;
+	participant->prochainEnvoi = horloge();
+	nbIdentifiees++;
+}
+
+/**
+ * @brief Texte du serveur, affiché en mode interactif.
+ */
+void terminalTexte(Session *session, void *contexte, const char *texte, size_t longueur)
+{
+	if (estInteractif)
+	{
+		printf("%.*s%s", (int)longueur, texte, longueur > 0 && texte[longueur - 1] == '\n' ? "" : "\n");
+	}
+}
+
+/**
+ * @brief Message d'un salon : affiché en mode interactif, compté sinon.
+ */
+void terminalMessage(Session *session, void *contexte, const MessageSession *message)
+{
+	Participant *participant = contexte;
+	if (message->drapeaux & DRAPEAU_ECHO)
+	{
+		if (message->longueur >= strlen(PREFIXE_TERMINAL) && memcmp(message->texte, PREFIXE_TERMINAL, strlen(PREFIXE_TERMINAL)) == 0)
+		{
+			participant->echos++;
+			totalEchos++;
+		}
+		return;
+	}
+	totalRecus++;
+	if (estInteractif && message->longueur > 0)
+	{
+		size_t longueur = message->longueur;
+		longueur -= message->texte[longueur - 1] == '\n';
+		printf("%s : %.*s\n", message->auteur, (int)longueur, message->texte);
+	}
+}
+
+/**
+ * @brief Page d'historique, affichée en mode interactif.
+ */
+void terminalPage(Session *session, void *contexte, uint8_t drapeaux, uint32_t suivant, const EntreeHistorique *entrees, int nombre)
+{
+	for (int i = 0; estInteractif && i < nombre; i++)
+	{
+		printf("%s : %.*s\n", entrees[i].auteur, (int)entrees[i].longueur, entrees[i].texte);
+	}
+}
+
+/**
+ * @brief Arrivée dans un salon : en mode interactif, ses derniers messages
+ * sont demandés au serveur.
+ */
+void terminalSalon(Session *session, void *contexte, uint32_t epoque, uint32_t nbMessages, const char *nom)
+{
+	if (estInteractif)
+	{
+		printf("** salon %s, %u messages **\n", nom, nbMessages);
+		messagerieDemanderPage(session, UINT32_MAX, MESSAGES_PAGE_TERMINAL, 0);
+	}
+}
+
+/**
+ * @brief Le serveur refuse la connexion.
+ */
+void terminalOccupe(Session *session, void *contexte, unsigned int reessai)
+{
+	Participant *participant = contexte;
+	fprintf(stderr, "Session %d : serveur occupé, réessayez dans %u secondes\n", participant->numero, reessai);
+}
+
+/**
+ * @brief Fin d'une session.
+ */
+void terminalFin(Session *session, void *contexte)
+{
+	Participant *participant = contexte;
+	if (!participant->estIdentifiee)
+	{
+		fprintf(stderr, "Session %d : problème de connexion au serveur\n", participant->numero);
+	}
+	else if (estInteractif)
+	{
+		printf("** fin de la communication **\n");
+	}
+	participant->estFinie = 1;
+	nbFinies++;
+}
+
+const RappelsSession rappelsTerminal = {
+	terminalIdentification,
+	terminalTexte,
+	terminalMessage,
+	NULL,
+	terminalPage,
+	terminalSalon,
+	terminalOccupe,
+	terminalFin,
+};
+
+/**
+ * @brief Met à jour les événements surveillés par epoll sur la socket d'une
+ * session, s'ils ont changé.
+ */
+void terminalSurveiller(Participant *participant)
+{
+	short evenements = messagerieEvenements(participant->session);
+	if (participant->estFinie || evenements == participant->evenements)
+	{
+		return;
+	}
+	struct epoll_event evenement = {0};
+	evenement.events = (evenements & POLLIN ? EPOLLIN : 0) | (evenements & POLLOUT ? EPOLLOUT : 0);
+	evenement.data.ptr = participant;
+	int operation = participant->evenements == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+	if (epoll_ctl(epollTerminal, operation, messagerieDescripteur(participant->session), &evenement) == 0)
+	{
+		participant->evenements = evenements;
+	}
+}
+
+/**
+ * @brief Envoie les lignes lues sur l'entrée standard par la session interactive.
+ *
+ * @return 0 si tout se passe bien, -1 à la fin de l'entrée standard.
+ */
+int terminalLire(Participant *participant)
+{
+	static char ligne[TAILLE_LIGNE_TERMINAL];
+	static size_t rempli = 0;
+	ssize_t lu = read(STDIN_FILENO, ligne + rempli, sizeof(ligne) - rempli);
+	if (lu <= 0)
+	{
+		return lu < 0 && errno == EINTR ? 0 : -1;
+	}
+	rempli += lu;
+
+	// Chaque ligne complète part comme un message, sans son retour à la ligne, comme depuis la
+	// fenêtre du client, pour que le serveur reconnaisse les commandes ; une ligne trop longue part telle quelle
+	char *debut = ligne;
+	char *fin;
+	while ((fin = memchr(debut, '\n', ligne + rempli - debut)) != NULL)
+	{
+		if (fin > debut)
+		{
+			messagerieEnvoyerTexte(participant->session, debut, fin - debut);
+		}
+		debut = fin + 1;
+	}
+	if (debut == ligne && rempli == sizeof(ligne))
+	{
+		messagerieEnvoyerTexte(participant->session, ligne, rempli);
+		debut = ligne + rempli;
+	}
+	rempli -= debut - ligne;
+	memmove(ligne, debut, rempli);
+	messagerieVider(participant->session);
+	return 0;
+}
+
+/**
+ * @brief Envoie les messages dus par les sessions du mode automatique.
+ *
+ * @param maintenant instant courant (ms)
+ * @return le délai (ms) jusqu'au prochain envoi, -1 s'il n'y en a plus.
+ */
+int terminalEnvoyer(long long maintenant)
+{
+	long long prochain = -1;
+	char texte[64];
+	for (int i = 0; i < nbParticipants; i++)
+	{
+		Participant *participant = &participants[i];
+		if (!participant->estIdentifiee || participant->estFinie || participant->envoyes >= nbMessages)
+		{
+			continue;
+		}
+		if (participant->prochainEnvoi <= maintenant)
+		{
+			for (int j = 0; j < lot && participant->envoyes < nbMessages; j++)
+			{
+				int longueur = snprintf(texte, sizeof(texte), PREFIXE_TERMINAL "%d de la session %d\n", participant->envoyes, participant->numero);
+				if (messagerieEnvoyerTexte(participant->session, texte, longueur) != 0)
+				{
+					break;
+				}
+				participant->envoyes++;
+				totalEnvoyes++;
+			}
+			participant->prochainEnvoi = maintenant + intervalle;
+			messagerieVider(participant->session);
+		}
+		if (participant->envoyes < nbMessages && (prochain < 0 || participant->prochainEnvoi < prochain))
+		{
+			prochain = participant->prochainEnvoi;
+		}
+	}
+	return prochain < 0 ? -1 : (int)(prochain > maintenant ? prochain - maintenant : 0);
+}
+
+/**
+ * @brief Indique si le mode automatique a terminé : chaque session a envoyé
+ * ses messages et reçu leur écho, ou elles sont toutes fermées.
+ */
+int terminalEstTermine(void)
+{
+	if (nbFinies == nbParticipants)
+	{
+		return 1;
+	}
+	for (int i = 0; i < nbParticipants; i++)
+	{
+		Participant *participant = &participants[i];
+		if (!participant->estFinie && (!participant->estIdentifiee || participant->echos < nbMessages))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// argv[optind] = adresse ip
+// argv[optind + 1] = port
+// argv[optind + 2] = pseudo
+int main(int argc, char *argv[])
+{
+	int duree = DUREE_TERMINAL;
+	char *autorite = NULL;
+	int option;
+	while ((option = getopt(argc, argv, "n:m:i:b:d:t:")) != -1)
+	{
+		if (option == 'n')
+		{
+			nbParticipants = atoi(optarg);
+		}
+		else if (option == 'm')
+		{
+			nbMessages = atoi(optarg);
+		}
+		else if (option == 'i')
+		{
+			intervalle = atoi(optarg);
+		}
+		else if (option == 'b')
+		{
+			lot = atoi(optarg);
+		}
+		else if (option == 'd')
+		{
+			duree = atoi(optarg);
+		}
+		else if (option == 't')
+		{
+			autorite = optarg;
+		}
+	}
+	if (argc - optind < 3 || nbParticipants < 1 || lot < 1)
+	{
+		fprintf(stderr, "Erreur : Lancez avec ./terminal [-n sessions] [-m messages] [-i intervalle_ms] [-b lot] [-d duree] [-t autorite] [ip] [port] [pseudo]\n"
+						"  Avec -t, la connexion est chiffrée (TLS) et le serveur authentifié par ce fichier PEM.\n"
+						"  Avec -n ou -m, chaque session envoie ses messages puis le débit est affiché ;\n"
+						"  les pseudos deviennent pseudo0, pseudo1...\n");
+		return -1;
+	}
+	estInteractif = nbParticipants == 1 && nbMessages == 0;
+	// Une écriture TLS sur une connexion fermée par le serveur ne doit pas tuer le terminal
+	signal(SIGPIPE, SIG_IGN);
+
+	epollTerminal = epoll_create1(EPOLL_CLOEXEC);
+	participants = calloc(nbParticipants, sizeof(Participant));
+	if (epollTerminal < 0 || participants == NULL)
+	{
+		perror("epoll_create1");
+		exit(-1);
+	}
+
+	// Toutes les sessions se connectent en même temps ; le pseudo part dès la connexion établie
+	long long debut = horloge();
+	for (int i = 0; i < nbParticipants; i++)
+	{
+		Participant *participant = &participants[i];
+		char pseudo[TAILLE_PSEUDO_MESSAGERIE];
+		if (estInteractif)
+		{
+			snprintf(pseudo, sizeof(pseudo), "%s", argv[optind + 2]);
+		}
+		else
+		{
+			snprintf(pseudo, sizeof(pseudo), "%.*s%d", TAILLE_PSEUDO_MESSAGERIE - 8, argv[optind + 2], i);
+		}
+		participant->numero = i;
+		participant->session = messagerieCreer(&rappelsTerminal, participant);
+		if (participant->session == NULL || (autorite != NULL && messagerieChiffrer(participant->session, autorite) != 0) ||
+			messagerieConnecter(participant->session, argv[optind], atoi(argv[optind + 1])) != 0)
+		{
+			fprintf(stderr, "Session %d : problème de connexion au serveur\n", i);
+			participant->estFinie = 1;
+			nbFinies++;
+			continue;
+		}
+		messagerieIdentifier(participant->session, pseudo, DRAPEAU_DEFLATE | DRAPEAU_IDENTITES | DRAPEAU_HISTORIQUE);
+		terminalSurveiller(participant);
+	}
+	if (estInteractif)
+	{
+		struct epoll_event evenement = {0};
+		evenement.events = EPOLLIN;
+		evenement.data.ptr = NULL;
+		epoll_ctl(epollTerminal, EPOLL_CTL_ADD, STDIN_FILENO, &evenement);
+	}
+
+	struct epoll_event evenements[MAX_EVENEMENTS_TERMINAL];
+	long long limite = debut + (long long)duree * 1000;
+	while (nbFinies < nbParticipants && (estInteractif || (!terminalEstTermine() && horloge() < limite)))
+	{
+		int delai = estInteractif ? -1 : terminalEnvoyer(horloge());
+		if (!estInteractif)
+		{
+			long long reste = limite - horloge();
+			delai = delai < 0 || delai > reste ? (int)(reste > 0 ? reste : 0) : delai;
+		}
+		int nombre = epoll_wait(epollTerminal, evenements, MAX_EVENEMENTS_TERMINAL, delai);
+		if (nombre < 0 && errno != EINTR)
+		{
+			perror("epoll_wait");
+			exit(-1);
+		}
+		for (int i = 0; i < nombre; i++)
+		{
+			Participant *participant = evenements[i].data.ptr;
+			if (participant == NULL)
+			{
+				if (terminalLire(&participants[0]) != 0)
+				{
+					messagerieFermer(participants[0].session);
+					nbFinies = nbParticipants;
+				}
+				continue;
+			}
+			uint32_t prets = evenements[i].events;
+			short evenementsSession = (prets & EPOLLIN ? POLLIN : 0) | (prets & EPOLLOUT ? POLLOUT : 0) |
+									  (prets & EPOLLERR ? POLLERR : 0) | (prets & EPOLLHUP ? POLLHUP : 0);
+			messagerieTraiter(participant->session, evenementsSession);
+		}
+		for (int i = 0; i < nbParticipants; i++)
+		{
+			terminalSurveiller(&participants[i]);
+		}
+	}
+
+	if (!estInteractif)
+	{
+		double secondes = (horloge() - debut) / 1000.0;
+		printf("%d sessions identifiées sur %d, %lld messages envoyés, %lld échos, %lld messages reçus en %.2f s (%.0f messages/s)\n",
+			   nbIdentifiees, nbParticipants, totalEnvoyes, totalEchos, totalRecus, secondes,
+			   secondes > 0 ? (totalEchos + totalRecus) / secondes : 0.0);
+	}
+	for (int i = 0; i < nbParticipants; i++)
+	{
+		messagerieLiberer(participants[i].session);
+	}
+	free(participants);
+	close(epollTerminal);
+	return 0;
+}
@@ -0,0 +1,521 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vue.h"
+#include "fil.h"
+
+/**
+ * @brief Message de la vue.
+ *
+ * @param texte ligne du message (« pseudo : texte »)
+ * @param hauteur place (px) du message dans la vue, ESPACE_MESSAGES compris ;
+ *        estimée tant qu'il n'a pas été mis en page
+ * @param estMesure 1 quand la hauteur est celle de la mise en page
+ */
+typedef struct LigneVue LigneVue;
+struct LigneVue
+{
+	char *texte;
+	int hauteur;
+	int estMesure;
+};
+
+/**
+ * @brief Message de la vue mis en page.
+ *
+ * @param rang rang du message dans la vue
+ * @param texture texture du message, coupé en lignes à LARGEUR_FIL, NULL si la case est libre
+ * @param largeur largeur de la texture
+ * @param hauteur hauteur de la texture
+ */
+typedef struct MessageVue MessageVue;
+struct MessageVue
+{
+	int64_t rang;
+	SDL_Texture *texture;
+	int largeur;
+	int hauteur;
+};
+
+/**
+ * - rendu = moteur de rendu de la fenêtre
+ * - police = police des textes
+ * - cache = messages mis en page ; le message de rang n occupe la case n % TAILLE_CACHE_VUE
+ * - accueil = texte affiché tant que la vue est vide
+ * - lignes = messages de la vue, du plus ancien (indice debut) au plus récent (indice fin - 1) ;
+ *   de la place est laissée des deux côtés pour l'historique plus ancien et les nouveaux messages
+ * - sommes = arbre de Fenwick des hauteurs des messages, indexé comme lignes à partir de 1
+ * - capacite = taille de lignes, puissance de 2
+ * - debut, fin = indices du premier message de la vue et de la case qui suit le dernier
+ * - decalageRang = rang du message d'indice 0 ; le rang d'un message ne change pas quand lignes est agrandi
+ * - total = hauteur (px) de tous les messages
+ * - haut = ordonnée, dans la vue, du haut de la zone affichée
+ * - cible = ordonnée vers laquelle haut se déplace image après image
+ * - estEnBas = 1 tant que la zone suit les nouveaux messages
+ * - hauteurZone = hauteur de la zone lors du dernier dessin
+ * - lu = numéro du dernier message du fil ajouté à la vue
+ * - hauteurLigne = hauteur (px) d'une ligne de texte
+ * - largeurCaractere = largeur (px) moyenne d'un caractère, pour estimer les hauteurs
+ */
+static SDL_Renderer *rendu = NULL;
+static TTF_Font *police = NULL;
+static MessageVue cache[TAILLE_CACHE_VUE];
+static TexteVue accueil;
+static LigneVue *lignes = NULL;
+static int64_t *sommes = NULL;
+static int capacite = 0;
+static int debut = 0;
+static int fin = 0;
+static int64_t decalageRang = 0;
+static int64_t total = 0;
+static double haut = 0;
+static double cible = 0;
+static int estEnBas = 1;
+static int hauteurZone = 0;
+static uint64_t lu = 0;
+static int hauteurLigne = 20;
+static int largeurCaractere = 8;
+
+/**
+ * @brief Prépare le rendu du fil et des textes.
+ *
+ * @param renderer moteur de rendu de la fenêtre
+ * @param font police des textes
+ */
+void vueInitialiser(SDL_Renderer *renderer, TTF_Font *font)
+{
+	rendu = renderer;
+	police = font;
+
+	const char *alphabet = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	int largeur = 0;
+	if (TTF_SizeUTF8(police, alphabet, &largeur, NULL) == 0 && largeur >= (int)strlen(alphabet))
+	{
+		largeurCaractere = largeur / strlen(alphabet);
+	}
+	hauteurLigne = TTF_FontLineSkip(police) > 0 ? TTF_FontLineSkip(police) : hauteurLigne;
+}
+
+/**
+ * @brief Ajoute delta à la hauteur d'un message dans l'index.
+ */
+static void indexAjouter(int indice, int64_t delta)
+{
+	for (int i = indice + 1; i <= capacite; i += i & -i)
+	{
+		sommes[i] += delta;
+	}
+	total += delta;
+}
+
+/**
+ * @brief Donne l'ordonnée d'un message dans la vue.
+ *
+ * @return la somme des hauteurs des messages d'indice inférieur.
+ */
+static int64_t indexPrefixe(int indice)
+{
+	int64_t somme = 0;
+	for (int i = indice; i > 0; i -= i & -i)
+	{
+		somme += sommes[i];
+	}
+	return somme;
+}
+
+/**
+ * @brief Cherche le message qui occupe une ordonnée de la vue, en descendant
+ * l'arbre de Fenwick.
+ *
+ * @param y ordonnée, entre 0 et total - 1
+ * @return l'indice du message.
+ */
+static int indexChercher(int64_t y)
+{
+	int position = 0;
+	for (int pas = capacite; pas > 0; pas >>= 1)
+	{
+		if (position + pas <= capacite && sommes[position + pas] <= y)
+		{
+			position += pas;
+			y -= sommes[position];
+		}
+	}
+	return position;
+}
+
+/**
+ * @brief Reconstruit l'index à partir des hauteurs des messages, en un seul
+ * passage.
+ */
+static void indexReconstruire(void)
+{
+	memset(sommes, 0, sizeof(int64_t) * (capacite + 1));
+	for (int i = 1; i <= capacite; i++)
+	{
+		if (i - 1 >= debut && i - 1 < fin)
+		{
+			sommes[i] += lignes[i - 1].hauteur;
+		}
+		int parent = i + (i & -i);
+		if (parent <= capacite)
+		{
+			sommes[parent] += sommes[i];
+		}
+	}
+}
+
+/**
+ * @brief Double la place des messages et recentre ceux de la vue, pour en
+ * ajouter des deux côtés.
+ *
+ * @return 0 si tout se passe bien, -1 si la mémoire manque.
+ */
+static int vueAgrandir(void)
+{
+	int nombre = fin - debut;
+	int nouvelleCapacite = capacite > 0 ? capacite * 2 : LIGNES_INITIALES_VUE;
+	LigneVue *nouvellesLignes = malloc(sizeof(LigneVue) * nouvelleCapacite);
+	int64_t *nouvellesSommes = malloc(sizeof(int64_t) * (nouvelleCapacite + 1));
+	if (nouvellesLignes == NULL || nouvellesSommes == NULL)
+	{
+		free(nouvellesLignes);
+		free(nouvellesSommes);
+		return -1;
+	}
+
+	int nouveauDebut = (nouvelleCapacite - nombre) / 2;
+	if (nombre > 0)
+	{
+		memcpy(nouvellesLignes + nouveauDebut, lignes + debut, sizeof(LigneVue) * nombre);
+	}
+	free(lignes);
+	free(sommes);
+	lignes = nouvellesLignes;
+	sommes = nouvellesSommes;
+	capacite = nouvelleCapacite;
+	decalageRang += debut - nouveauDebut;
+	debut = nouveauDebut;
+	fin = nouveauDebut + nombre;
+	indexReconstruire();
+	return 0;
+}
+
+/**
+ * @brief Estime la hauteur d'un message sans le mettre en page, d'après la
+ * largeur moyenne d'un caractère.
+ *
+ * @param texte ligne du message
+ * @return la hauteur estimée, ESPACE_MESSAGES compris.
+ */
+static int hauteurEstimee(const char *texte)
+{
+	int nombreLignes = 0;
+	const char *segment = texte;
+	while (segment != NULL)
+	{
+		const char *finSegment = strchr(segment, '\n');
+		size_t longueur = finSegment != NULL ? (size_t)(finSegment - segment) : strlen(segment);
+		int64_t largeur = (int64_t)longueur * largeurCaractere;
+		nombreLignes += largeur > LARGEUR_FIL ? (largeur + LARGEUR_FIL - 1) / LARGEUR_FIL : 1;
+		segment = finSegment != NULL ? finSegment + 1 : NULL;
+	}
+	return nombreLignes * hauteurLigne + ESPACE_MESSAGES;
+}
+
+/**
+ * @brief Ajoute un message à la vue, après le plus récent ou avant le plus
+ * ancien. Un message ajouté avant ne déplace pas ce qui est affiché.
+ *
+ * @param texte ligne du message
+ * @param estAncien 1 pour l'ajouter avant le plus ancien
+ */
+static void vueAjouter(const char *texte, int estAncien)
+{
+	if (((estAncien && debut == 0) || (!estAncien && fin == capacite)) && vueAgrandir() != 0)
+	{
+		return;
+	}
+	char *copie = strdup(texte);
+	if (copie == NULL)
+	{
+		return;
+	}
+	int indice = estAncien ? --debut : fin++;
+	lignes[indice].texte = copie;
+	lignes[indice].hauteur = hauteurEstimee(copie);
+	lignes[indice].estMesure = 0;
+	indexAjouter(indice, lignes[indice].hauteur);
+	if (estAncien)
+	{
+		haut += lignes[indice].hauteur;
+		cible += lignes[indice].hauteur;
+	}
+}
+
+/**
+ * @brief Oublie tous les messages de la vue, à l'arrivée dans un salon.
+ */
+static void vueVider(void)
+{
+	for (int i = debut; i < fin; i++)
+	{
+		free(lignes[i].texte);
+	}
+	for (int i = 0; i < TAILLE_CACHE_VUE; i++)
+	{
+		if (cache[i].texture != NULL)
+		{
+			SDL_DestroyTexture(cache[i].texture);
+			cache[i].texture = NULL;
+		}
+	}
+	debut = fin = capacite / 2;
+	if (sommes != NULL)
+	{
+		memset(sommes, 0, sizeof(int64_t) * (capacite + 1));
+	}
+	total = 0;
+	haut = cible = 0;
+	estEnBas = 1;
+}
+
+/**
+ * @brief Ajoute à la vue les messages arrivés dans le fil depuis la dernière
+ * image. Ceux qui ont quitté l'anneau entre-temps sont perdus pour la vue.
+ */
+static void vueLireFil(void)
+{
+	static char texte[TAILLE_MAX_MESSAGE_VUE];
+	static char ligne[TAILLE_MAX_MESSAGE_VUE + TAILLE_AUTEUR + 4];
+	uint64_t dernier = filDernier();
+	if (dernier - lu > TAILLE_FIL)
+	{
+		lu = dernier - TAILLE_FIL;
+	}
+	while (lu < dernier)
+	{
+		MessageFil message;
+		if (filLire(++lu, &message, texte, sizeof(texte)) != 0)
+		{
+			continue;
+		}
+		if (message.origine == FIL_SALON)
+		{
+			vueVider();
+			continue;
+		}
+		filLigne(ligne, sizeof(ligne), &message);
+		vueAjouter(ligne, message.origine == FIL_ANCIEN);
+	}
+}
+
+/**
+ * @brief Donne la mise en page d'un message, en la calculant s'il n'est pas
+ * encore dans le cache. À sa première mise en page, la hauteur estimée du
+ * message est remplacée par la vraie ; si le message est au-dessus de la
+ * zone affichée, la zone suit pour que rien ne bouge à l'écran.
+ *
+ * @param indice indice du message dans la vue
+ * @return le message mis en page, NULL s'il n'a pas pu être rendu.
+ */
+static MessageVue *messageVue(int indice)
+{
+	int64_t rang = indice + decalageRang;
+	MessageVue *vue = &cache[(uint64_t)rang % TAILLE_CACHE_VUE];
+	if (vue->texture != NULL && vue->rang == rang)
+	{
+		return vue;
+	}
+
+	LigneVue *ligne = &lignes[indice];
+	SDL_Color blanc = {255, 255, 255, 255};
+	SDL_Surface *surface = TTF_RenderUTF8_Blended_Wrapped(police, ligne->texte[0] != '\0' ? ligne->texte : " ", blanc, LARGEUR_FIL);
+	if (surface == NULL)
+	{
+		return NULL;
+	}
+	if (vue->texture != NULL)
+	{
+		SDL_DestroyTexture(vue->texture);
+	}
+	vue->texture = SDL_CreateTextureFromSurface(rendu, surface);
+	vue->largeur = surface->w;
+	vue->hauteur = surface->h;
+	vue->rang = rang;
+	SDL_FreeSurface(surface);
+	if (vue->texture == NULL)
+	{
+		return NULL;
+	}
+
+	if (!ligne->estMesure)
+	{
+		int64_t delta = vue->hauteur + ESPACE_MESSAGES - ligne->hauteur;
+		if (delta != 0 && indexPrefixe(indice) < haut)
+		{
+			haut += delta;
+			cible += delta;
+		}
+		indexAjouter(indice, delta);
+		ligne->hauteur += delta;
+		ligne->estMesure = 1;
+	}
+	return vue;
+}
+
+/**
+ * @brief Borne la position visée, puis en rapproche la zone affichée. Un
+ * grand saut est fait d'un coup.
+ *
+ * @param hauteur hauteur de la zone
+ */
+static void vuePositionner(int hauteur)
+{
+	double maximum = total > hauteur ? total - hauteur : 0;
+	if (estEnBas || cible >= maximum)
+	{
+		cible = maximum;
+		estEnBas = 1;
+	}
+	cible = cible > 0 ? cible : 0;
+
+	double reste = cible - haut;
+	if ((reste > -1 && reste < 1) || reste > 2 * hauteur || reste < -2 * hauteur)
+	{
+		haut = cible;
+	}
+	else
+	{
+		haut += reste / AMORTI_DEFILEMENT;
+	}
+	haut = haut < 0 ? 0 : haut > maximum ? maximum : haut;
+}
+
+/**
+ * @brief Dessine les messages visibles de la vue. Leur position est lue dans
+ * l'index des hauteurs : le coût d'une image ne dépend pas du nombre de
+ * messages. Les messages tiennent dans le bas de la zone tant qu'ils ne la
+ * remplissent pas.
+ *
+ * @param zone zone de la fenêtre réservée au fil
+ * @return 1 si la zone défile encore et qu'il faut une autre image, 0 sinon.
+ */
+int vueDessinerFil(const SDL_Rect *zone)
+{
+	vueLireFil();
+	hauteurZone = zone->h;
+	if (debut == fin)
+	{
+		SDL_Color blanc = {255, 255, 255, 255};
+		vueDessinerTexte(&accueil, "Messagerie Initialisé", blanc, &(SDL_Rect){zone->x + 20, zone->y + zone->h - 40, 0, 0});
+		return 0;
+	}
+
+	// Les messages visibles sont mis en page avant le dessin : leurs vraies hauteurs fixent les positions
+	vuePositionner(zone->h);
+	int premier = indexChercher((int64_t)haut);
+	int64_t y = indexPrefixe(premier);
+	for (int i = premier; i < fin && y < (int64_t)haut + zone->h; i++)
+	{
+		messageVue(i);
+		y += lignes[i].hauteur;
+	}
+	vuePositionner(zone->h);
+
+	int64_t origine = (int64_t)haut;
+	int marge = total < zone->h ? zone->h - total : 0;
+	SDL_RenderSetClipRect(rendu, zone);
+	int i = indexChercher(origine);
+	for (y = indexPrefixe(i); i < fin && y < origine + zone->h; y += lignes[i].hauteur, i++)
+	{
+		MessageVue *vue = messageVue(i);
+		if (vue == NULL)
+		{
+			continue;
+		}
+		SDL_Rect position = {zone->x + 20, zone->y + marge + (int)(y - origine), vue->largeur, vue->hauteur};
+		SDL_RenderCopy(rendu, vue->texture, NULL, &position);
+	}
+	SDL_RenderSetClipRect(rendu, NULL);
+	return haut != cible;
+}
+
+/**
+ * @brief Fait défiler la vue ; le défilement se fait en douceur au fil des
+ * images suivantes. Revenir tout en bas fait de nouveau suivre les nouveaux messages.
+ *
+ * @param pixels distance du défilement, positive vers les messages récents
+ */
+void vueDefiler(int pixels)
+{
+	cible += pixels;
+	estEnBas = 0;
+}
+
+/**
+ * @brief Indique si la zone affichée approche du plus ancien message de la
+ * vue, à moins d'une hauteur de zone : il est temps de demander la page
+ * précédente de l'historique.
+ *
+ * @return 1 si la vue veut des messages plus anciens, 0 sinon.
+ */
+int vueVeutAnciens(void)
+{
+	return debut != fin && haut < hauteurZone;
+}
+
+/**
+ * @brief Dessine un texte isolé, rendu à nouveau seulement s'il a changé
+ * depuis l'image précédente.
+ *
+ * @param vue cache du texte
+ * @param texte texte à dessiner
+ * @param couleur couleur du texte
+ * @param zone position du texte ; une largeur ou une hauteur nulle prend celle du texte
+ */
+void vueDessinerTexte(TexteVue *vue, const char *texte, SDL_Color couleur, const SDL_Rect *zone)
+{
+	if (vue->texture == NULL || strncmp(vue->texte, texte, sizeof(vue->texte)) != 0)
+	{
+		if (vue->texture != NULL)
+		{
+			SDL_DestroyTexture(vue->texture);
+			vue->texture = NULL;
+		}
+		snprintf(vue->texte, sizeof(vue->texte), "%s", texte);
+		SDL_Surface *surface = texte[0] != '\0' ? TTF_RenderUTF8_Blended(police, vue->texte, couleur) : NULL;
+		if (surface == NULL)
+		{
+			return;
+		}
+		vue->texture = SDL_CreateTextureFromSurface(rendu, surface);
+		vue->largeur = surface->w;
+		vue->hauteur = surface->h;
+		SDL_FreeSurface(surface);
+	}
+	if (vue->texture != NULL)
+	{
+		SDL_Rect position = {zone->x, zone->y, zone->w > 0 ? zone->w : vue->largeur, zone->h > 0 ? zone->h : vue->hauteur};
+		SDL_RenderCopy(rendu, vue->texture, NULL, &position);
+	}
+}
+
+/**
+ * @brief Libère les messages et les textures de la vue.
+ */
+void vueLiberer(void)
+{
+	vueVider();
+	free(lignes);
+	free(sommes);
+	lignes = NULL;
+	sommes = NULL;
+	capacite = debut = fin = 0;
+	if (accueil.texture != NULL)
+	{
+		SDL_DestroyTexture(accueil.texture);
+		accueil.texture = NULL;
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef VUE_H
+#define VUE_H
+
+#include <stdint.h>
+#include <SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+/**
+ * Rendu du fil et des textes de la fenêtre. La vue garde tous les messages
+ * de la session et un index des sommes de leurs hauteurs : la position de
+ * chacun se trouve sans parcourir les autres, et seuls les messages visibles
+ * sont mis en page et dessinés. La hauteur d'un message est estimée à son
+ * arrivée, puis mesurée une seule fois, à sa première apparition ; sa
+ * texture est gardée tant qu'il reste à l'écran.
+ */
+
+/**
+ * - TAILLE_CACHE_VUE = nombre de messages mis en page gardés (puissance de 2)
+ * - LARGEUR_FIL = largeur (px) à laquelle les messages sont coupés en lignes
+ * - ESPACE_MESSAGES = espace vertical (px) entre deux messages
+ * - TAILLE_TEXTE_VUE = taille maximum d'un texte mis en cache par TexteVue
+ * - TAILLE_MAX_MESSAGE_VUE = longueur maximum affichée d'un message, au-delà il est tronqué
+ * - LIGNES_INITIALES_VUE = messages réservés au départ dans la vue (puissance de 2), doublés à la demande
+ * - PAS_DEFILEMENT = défilement (px) d'un cran de molette
+ * - AMORTI_DEFILEMENT = à chaque image, le défilement parcourt 1 / AMORTI_DEFILEMENT de la distance restante
+ */
+#define TAILLE_CACHE_VUE 128
+#define LARGEUR_FIL 450
+#define ESPACE_MESSAGES 20
+#define TAILLE_TEXTE_VUE 512
+#define TAILLE_MAX_MESSAGE_VUE 8192
+#define LIGNES_INITIALES_VUE 4096
+#define PAS_DEFILEMENT 60
+#define AMORTI_DEFILEMENT 4
+
+/**
+ * @brief Texte isolé de la fenêtre (ligne de saisie, statut), rendu à nouveau
+ * seulement quand il change.
+ *
+ * @param texte texte de la texture actuelle
+ * @param texture texture du texte, NULL s'il est vide
+ * @param largeur largeur de la texture
+ * @param hauteur hauteur de la texture
+ */
+typedef struct TexteVue TexteVue;
+struct TexteVue
+{
+	char texte[TAILLE_TEXTE_VUE];
+	SDL_Texture *texture;
+	int largeur;
+	int hauteur;
+};
+
+void vueInitialiser(SDL_Renderer *renderer, TTF_Font *font);
+int vueDessinerFil(const SDL_Rect *zone);
+void vueDefiler(int pixels);
+int vueVeutAnciens(void);
+void vueDessinerTexte(TexteVue *vue, const char *texte, SDL_Color couleur, const SDL_Rect *zone);
+void vueLiberer(void);
+
+#endif
@@ -0,0 +1,100 @@
+#include <string.h>
+#include <sys/socket.h>
+
+#include "protocole.h"
+
+/**
+ * @brief Écrit l'en-tête d'une trame.
+ *
+ * @param destination emplacement de TAILLE_ENTETE_TRAME octets
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param longueur taille de la charge utile qui suit
+ */
+void trameEcrireEntete(uint8_t *destination, uint8_t type, uint8_t drapeaux, uint16_t longueur)
+{
+	destination[0] = type;
+	destination[1] = drapeaux;
+	destination[2] = longueur >> 8;
+	destination[3] = longueur & 0xff;
+}
+
+/**
+ * @brief Indique si une trame complète est présente en tête du tampon.
+ *
+ * @param lecteur tampon de réception
+ * @param entete en-tête décodé de la trame, si elle est complète
+ * @return 1 si une trame complète est disponible, 0 s'il faut recevoir
+ *         davantage, -1 si l'en-tête est invalide.
+ */
+int lecteurTrameDisponible(const LecteurTrame *lecteur, EnteteTrame *entete)
+{
+	if (lecteur->rempli < TAILLE_ENTETE_TRAME)
+	{
+		return 0;
+	}
+	entete->type = lecteur->tampon[0];
+	entete->drapeaux = lecteur->tampon[1];
+	entete->longueur = (lecteur->tampon[2] << 8) | lecteur->tampon[3];
+	if (entete->longueur > TAILLE_MAX_TRAME)
+	{
+		return -1;
+	}
+	return lecteur->rempli >= TAILLE_ENTETE_TRAME + (size_t)entete->longueur;
+}
+
+/**
+ * @brief Retire du tampon la trame traitée.
+ *
+ * @param lecteur tampon de réception
+ * @param entete en-tête de la trame en tête du tampon
+ */
+void lecteurTrameConsommer(LecteurTrame *lecteur, const EnteteTrame *entete)
+{
+	size_t taille = TAILLE_ENTETE_TRAME + entete->longueur;
+	lecteur->rempli -= taille;
+	memmove(lecteur->tampon, lecteur->tampon + taille, lecteur->rempli);
+}
+
+/**
+ * @brief Reçoit sur la socket autant d'octets que le tampon peut en contenir.
+ *
+ * @param lecteur tampon de réception
+ * @param dS socket sur laquelle recevoir
+ * @return le résultat de recv.
+ */
+ssize_t lecteurTrameRemplir(LecteurTrame *lecteur, int dS)
+{
+	ssize_t recu = recv(dS, lecteur->tampon + lecteur->rempli, sizeof(lecteur->tampon) - lecteur->rempli, 0);
+	if (recu > 0)
+	{
+		lecteur->rempli += recu;
+	}
+	return recu;
+}
+
+/**
+ * @brief Choisit où couper un texte UTF-8 trop long pour un seul fragment,
+ * sans séparer les octets d'un même caractère.
+ *
+ * @param texte texte à couper
+ * @param longueur nombre d'octets disponibles
+ * @return le nombre d'octets du fragment : longueur, moins un caractère incomplet en fin de texte.
+ */
+size_t texteCoupure(const char *texte, size_t longueur)
+{
+	const uint8_t *octets = (const uint8_t *)texte;
+	size_t debut = longueur;
+	while (debut > 0 && longueur - debut < 4 && (octets[debut - 1] & 0xc0) == 0x80)
+	{
+		debut--;
+	}
+	if (debut == 0 || longueur - debut >= 4 || octets[debut - 1] < 0xc0)
+	{
+		// Pas de caractère multi-octets entamé en fin de texte
+		return longueur;
+	}
+	uint8_t tete = octets[debut - 1];
+	size_t taille = tete >= 0xf0 ? 4 : tete >= 0xe0 ? 3 : 2;
+	return debut - 1 + taille > longueur ? debut - 1 : longueur;
+}
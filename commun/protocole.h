@@ -0,0 +1,166 @@
+#ifndef PROTOCOLE_H
+#define PROTOCOLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Protocole commun au client et au serveur : chaque message circule dans une
+ * trame précédée d'un en-tête de 4 octets (type, drapeaux, longueur de la
+ * charge utile sur 16 bits, octets de poids fort en premier). Le texte d'une
+ * trame n'est pas terminé par '\0'.
+ */
+
+/**
+ * - TAILLE_ENTETE_TRAME = taille de l'en-tête d'une trame
+ * - TAILLE_MAX_TRAME = taille maximum de la charge utile d'une trame
+ * - TAILLE_IDENTIFIANT = taille de l'identifiant d'utilisateur en tête de TRAME_IDENTITE et TRAME_MESSAGE
+ * - TAILLE_NUMERO = taille de l'identifiant d'un message dans l'historique du serveur
+ * - TAILLE_DEMANDE_HISTORIQUE = taille d'une demande TRAME_HISTORIQUE du client
+ * - TAILLE_ENTETE_HISTORIQUE = taille de l'en-tête d'une page TRAME_HISTORIQUE du serveur
+ * - TAILLE_ENTREE_HISTORIQUE = taille de l'en-tête de chaque message d'une page TRAME_HISTORIQUE
+ */
+#define TAILLE_ENTETE_TRAME 4
+#define TAILLE_MAX_TRAME 16384
+#define TAILLE_IDENTIFIANT 2
+#define TAILLE_NUMERO 4
+#define TAILLE_DEMANDE_HISTORIQUE 6
+#define TAILLE_ENTETE_HISTORIQUE 4
+#define TAILLE_ENTREE_HISTORIQUE 8
+
+/**
+ * @brief Types de trames.
+ *
+ * - TRAME_TEXTE = pseudo, message ou commande du client ; message du serveur
+ * - TRAME_PING = demande de signe de vie, à laquelle on répond par TRAME_PONG
+ * - TRAME_PONG = réponse à TRAME_PING
+ * - TRAME_OCCUPE = connexion refusée par le serveur ; la charge donne, sur 2 octets
+ *   (ordre réseau), le délai en secondes avant de réessayer
+ * - TRAME_LOT = lot d'enregistrements échangé entre serveurs fédérés, jamais vu des clients
+ * - TRAME_COMPRESSION = compression acceptée par le serveur : à partir de cette trame, chaque
+ *   trame texte du serveur passe dans un flux deflate propre à la connexion (voir DRAPEAU_DEFLATE)
+ * - TRAME_IDENTITE = identité d'un utilisateur : identifiant sur 2 octets (ordre réseau), puis son pseudo ;
+ *   envoyée avant le premier message de cet utilisateur, aux clients qui ont négocié DRAPEAU_IDENTITES
+ * - TRAME_MESSAGE = message diffusé dans un salon : identifiant de l'expéditeur sur 2 octets, puis le texte ;
+ *   pour un client qui a négocié DRAPEAU_HISTORIQUE, l'identifiant du message dans l'historique suit celui
+ *   de l'expéditeur, sur TAILLE_NUMERO octets (0xffffffff si le message n'y est pas)
+ * - TRAME_EPHEMERE = événement éphémère (TypeEphemere), jamais conservé : du client, le type sur 1 octet
+ *   puis, pour une saisie, 1 si elle commence et 0 si elle s'arrête ; du serveur, l'identifiant de
+ *   l'expéditeur sur 2 octets, le type sur 1 octet et la valeur sur 4 octets (ordre réseau). Le serveur
+ *   n'en envoie qu'aux clients qui ont négocié DRAPEAU_EPHEMERES
+ * - TRAME_HISTORIQUE = page de l'historique du salon. Du client : demande des messages d'identifiant
+ *   inférieur (ou supérieur, avec DRAPEAU_APRES) à un identifiant sur 4 octets, puis leur nombre maximum
+ *   sur 2 octets. Du serveur, avec le drapeau de la demande : l'identifiant à demander pour la page
+ *   suivante sur 4 octets (0 s'il n'y a plus de messages plus anciens, 0xffffffff s'il n'y en a plus
+ *   de plus récents), puis les messages du plus ancien au plus récent, chacun en
+ *   TAILLE_ENTREE_HISTORIQUE octets (identifiant du message sur 4 octets, identifiant de l'expéditeur
+ *   sur 2 octets, 0xffff s'il est inconnu, longueur du texte sur 2 octets) suivis du texte. Le serveur
+ *   n'en envoie qu'aux clients qui ont négocié DRAPEAU_HISTORIQUE
+ * - TRAME_SALON = arrivée dans un salon, pour un client qui a négocié DRAPEAU_HISTORIQUE, à la place de
+ *   l'historique rejoué : époque de l'historique sur 4 octets, tirée au démarrage du serveur (les
+ *   identifiants de messages ne valent que pour une époque), nombre de messages de l'historique sur
+ *   4 octets, puis le nom du salon
+ */
+enum TypeTrame
+{
+	TRAME_TEXTE = 1,
+	TRAME_PING = 2,
+	TRAME_PONG = 3,
+	TRAME_OCCUPE = 4,
+	TRAME_LOT = 5,
+	TRAME_COMPRESSION = 6,
+	TRAME_IDENTITE = 7,
+	TRAME_MESSAGE = 8,
+	TRAME_EPHEMERE = 9,
+	TRAME_HISTORIQUE = 10,
+	TRAME_SALON = 11
+};
+
+/**
+ * @brief Drapeaux des trames texte.
+ *
+ * - DRAPEAU_DEFLATE = du client, sur la trame de son pseudo : il sait décompresser ;
+ *   du serveur, après TRAME_COMPRESSION : la charge d'une trame texte ou d'une page d'historique est
+ *   compressée (deflate brut, terminé par Z_SYNC_FLUSH). Une trame texte ou une page non compressée,
+ *   ou une trame message, entre aussi dans
+ *   la fenêtre du flux, comme un dictionnaire : les réponses volumineuses réutilisent le trafic
+ *   récent du salon.
+ * - DRAPEAU_IDENTITES = du client, sur la trame de son pseudo : il reçoit les messages des
+ *   salons en trames TRAME_MESSAGE, et garde la table des identités
+ * - DRAPEAU_SUITE = sur une trame texte du client ou une trame message du serveur : le message
+ *   continue dans la prochaine trame du même expéditeur. Un long message circule ainsi en
+ *   fragments, relayés dès leur arrivée ; son dernier fragment n'a pas ce drapeau
+ * - DRAPEAU_EPHEMERES = du client, sur la trame de son pseudo, avec DRAPEAU_IDENTITES : il reçoit
+ *   les événements éphémères de son salon
+ * - DRAPEAU_HISTORIQUE = du client, sur la trame de son pseudo, avec DRAPEAU_IDENTITES : il reçoit
+ *   TRAME_SALON à son arrivée dans un salon, demande lui-même les pages TRAME_HISTORIQUE qui lui
+ *   manquent, et reçoit les messages des salons numérotés, les siens compris (DRAPEAU_ECHO)
+ * - DRAPEAU_ANCIENS = sur une page TRAME_HISTORIQUE du serveur : elle répond à une demande de messages
+ *   plus anciens. Une page volumineuse peut être compressée, avec DRAPEAU_DEFLATE
+ * - DRAPEAU_APRES = sur une demande TRAME_HISTORIQUE, et sur la page qui lui répond : messages plus
+ *   récents que l'identifiant donné, pour rattraper ce qui a été manqué
+ * - DRAPEAU_ECHO = sur une trame message numérotée : c'est le message du destinataire lui-même, qu'il
+ *   affiche déjà et ne fait que ranger
+ */
+enum DrapeauTrame
+{
+	DRAPEAU_DEFLATE = 0x01,
+	DRAPEAU_IDENTITES = 0x02,
+	DRAPEAU_SUITE = 0x04,
+	DRAPEAU_EPHEMERES = 0x08,
+	DRAPEAU_HISTORIQUE = 0x10,
+	DRAPEAU_ANCIENS = 0x20,
+	DRAPEAU_APRES = 0x40,
+	DRAPEAU_ECHO = 0x80
+};
+
+/**
+ * @brief Types des événements éphémères.
+ *
+ * - EPHEMERE_SAISIE = l'utilisateur écrit (valeur 1) ou a cessé d'écrire (valeur 0)
+ * - EPHEMERE_LECTURE = l'utilisateur a lu le salon ; le serveur donne en valeur le nombre de
+ *   messages de l'historique à cet instant
+ */
+enum TypeEphemere
+{
+	EPHEMERE_SAISIE = 1,
+	EPHEMERE_LECTURE = 2
+};
+
+/**
+ * @brief En-tête décodé d'une trame.
+ *
+ * @param type type de la trame (TypeTrame)
+ * @param drapeaux options propres au type, 0 par défaut
+ * @param longueur taille de la charge utile
+ */
+typedef struct EnteteTrame EnteteTrame;
+struct EnteteTrame
+{
+	uint8_t type;
+	uint8_t drapeaux;
+	uint16_t longueur;
+};
+
+/**
+ * @brief Tampon de réception d'une connexion : accumule les octets reçus
+ * jusqu'à former une trame complète.
+ *
+ * @param rempli nombre d'octets présents dans le tampon
+ * @param tampon octets reçus, en-tête de la prochaine trame en tête
+ */
+typedef struct LecteurTrame LecteurTrame;
+struct LecteurTrame
+{
+	size_t rempli;
+	uint8_t tampon[TAILLE_ENTETE_TRAME + TAILLE_MAX_TRAME];
+};
+
+void trameEcrireEntete(uint8_t *destination, uint8_t type, uint8_t drapeaux, uint16_t longueur);
+int lecteurTrameDisponible(const LecteurTrame *lecteur, EnteteTrame *entete);
+void lecteurTrameConsommer(LecteurTrame *lecteur, const EnteteTrame *entete);
+ssize_t lecteurTrameRemplir(LecteurTrame *lecteur, int dS);
+size_t texteCoupure(const char *texte, size_t longueur);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "serveur.h"
+#include "admission.h"
+
+/**
+ * - TAILLE_TABLE_ADRESSES = nombre d'entrées de la table des adresses (puissance de 2,
+ *   au moins le double de MAX_CLIENT pour que le sondage linéaire reste court)
+ */
+#define TAILLE_TABLE_ADRESSES 64
+
+/**
+ * @brief Nombre de connexions ouvertes par une adresse.
+ *
+ * @param adresse adresse IPv4 (ordre réseau), 0 si l'entrée est libre
+ * @param nombre connexions ouvertes
+ */
+typedef struct ConnexionsAdresse ConnexionsAdresse;
+struct ConnexionsAdresse
+{
+	uint32_t adresse;
+	int nombre;
+};
+
+/**
+ * - maxParAdresse = connexions simultanées autorisées par adresse, 0 pour ne pas plafonner
+ * - tableAdresses = connexions ouvertes par adresse, par adressage ouvert
+ * - mutexAdmission = protège tableAdresses
+ */
+static int maxParAdresse = 3;
+static ConnexionsAdresse tableAdresses[TAILLE_TABLE_ADRESSES];
+static pthread_mutex_t mutexAdmission = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Fixe le plafond de connexions par adresse.
+ *
+ * @param maximum connexions simultanées par adresse, 0 pour ne pas plafonner
+ */
+void admissionConfigurer(int maximum)
+{
+	maxParAdresse = maximum;
+}
+
+/**
+ * @brief Cherche l'entrée d'une adresse, ou l'entrée libre où l'insérer.
+ * Appelée sous mutexAdmission.
+ */
+static ConnexionsAdresse *entreeAdresse(uint32_t adresse)
+{
+	uint32_t indice = (adresse * 2654435761u) & (TAILLE_TABLE_ADRESSES - 1);
+	while (tableAdresses[indice].adresse != 0 && tableAdresses[indice].adresse != adresse)
+	{
+		indice = (indice + 1) & (TAILLE_TABLE_ADRESSES - 1);
+	}
+	return &tableAdresses[indice];
+}
+
+/**
+ * @brief Réserve une place pour une nouvelle connexion : une place sur le
+ * serveur (semaphoreNbClients) et une place pour son adresse.
+ *
+ * @param adresse adresse IPv4 du client, en ordre réseau ; 0 si inconnue (non plafonnée)
+ * @return 0 si la connexion est admise ; sinon le délai (s) à proposer au client.
+ */
+int admissionPrendre(uint32_t adresse)
+{
+	if (sem_trywait(&semaphoreNbClients) == -1)
+	{
+		// Délai un peu dispersé pour que les clients refusés ne reviennent pas tous ensemble
+		return REESSAI_COMPLET + rand() % REESSAI_COMPLET;
+	}
+
+	if (adresse == 0)
+	{
+		return 0;
+	}
+	pthread_mutex_lock(&mutexAdmission);
+	ConnexionsAdresse *entree = entreeAdresse(adresse);
+	if (maxParAdresse > 0 && entree->adresse == adresse && entree->nombre >= maxParAdresse)
+	{
+		pthread_mutex_unlock(&mutexAdmission);
+		sem_post(&semaphoreNbClients);
+		return REESSAI_ADRESSE;
+	}
+	entree->adresse = adresse;
+	entree->nombre++;
+	pthread_mutex_unlock(&mutexAdmission);
+	return 0;
+}
+
+/**
+ * @brief Recompte une connexion reprise d'un serveur précédent, qui l'avait
+ * déjà admise : ni le plafond par adresse ni la place libre ne sont vérifiés.
+ *
+ * @param adresse adresse IPv4 du client, en ordre réseau ; 0 si inconnue
+ */
+void admissionReprendre(uint32_t adresse)
+{
+	sem_trywait(&semaphoreNbClients);
+	if (adresse == 0)
+	{
+		return;
+	}
+	pthread_mutex_lock(&mutexAdmission);
+	ConnexionsAdresse *entree = entreeAdresse(adresse);
+	entree->adresse = adresse;
+	entree->nombre++;
+	pthread_mutex_unlock(&mutexAdmission);
+}
+
+/**
+ * @brief Rend les places réservées par admissionPrendre quand la connexion se termine.
+ *
+ * @param adresse adresse IPv4 du client, en ordre réseau
+ */
+void admissionRendre(uint32_t adresse)
+{
+	if (adresse == 0)
+	{
+		sem_post(&semaphoreNbClients);
+		return;
+	}
+	pthread_mutex_lock(&mutexAdmission);
+	ConnexionsAdresse *entree = entreeAdresse(adresse);
+	if (entree->adresse == adresse && --entree->nombre <= 0)
+	{
+		// Retrait par décalage arrière, pour ne pas casser les chaînes de sondage
+		uint32_t libre = entree - tableAdresses;
+		uint32_t indice = libre;
+		tableAdresses[libre].adresse = 0;
+		tableAdresses[libre].nombre = 0;
+		while (1)
+		{
+			indice = (indice + 1) & (TAILLE_TABLE_ADRESSES - 1);
+			if (tableAdresses[indice].adresse == 0)
+			{
+				break;
+			}
+			uint32_t ideal = (tableAdresses[indice].adresse * 2654435761u) & (TAILLE_TABLE_ADRESSES - 1);
+			if (((indice - ideal) & (TAILLE_TABLE_ADRESSES - 1)) >= ((indice - libre) & (TAILLE_TABLE_ADRESSES - 1)))
+			{
+				tableAdresses[libre] = tableAdresses[indice];
+				tableAdresses[indice].adresse = 0;
+				tableAdresses[indice].nombre = 0;
+				libre = indice;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutexAdmission);
+	sem_post(&semaphoreNbClients);
+}
+
+/**
+ * @brief Répond à une connexion refusée par une trame TRAME_OCCUPE puis la ferme.
+ * Rien ne bloque : le thread d'acceptation passe aussitôt à la suivante.
+ *
+ * @param dSC socket du client refusé
+ * @param reessai délai en secondes avant de réessayer
+ */
+void admissionRefuser(int dSC, uint16_t reessai)
+{
+	uint8_t trame[TAILLE_ENTETE_TRAME + 2];
+	trameEcrireEntete(trame, TRAME_OCCUPE, 0, 2);
+	trame[TAILLE_ENTETE_TRAME] = reessai >> 8;
+	trame[TAILLE_ENTETE_TRAME + 1] = reessai & 0xff;
+	send(dSC, trame, sizeof(trame), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	// Des données non lues à la fermeture provoqueraient un RST, qui peut faire
+	// perdre la trame au client : on vide ce qui est déjà arrivé
+	char poubelle[512];
+	shutdown(dSC, SHUT_WR);
+	while (recv(dSC, poubelle, sizeof(poubelle), MSG_DONTWAIT) > 0)
+	{
+	}
+	close(dSC);
+}
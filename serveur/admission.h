@@ -0,0 +1,31 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+/**
+ * Contrôle d'admission : le serveur accepte toujours les connexions, et
+ * répond immédiatement à celles qu'il ne peut pas servir par une trame
+ * TRAME_OCCUPE indiquant quand réessayer, puis les ferme. Le nombre de
+ * connexions simultanées d'une même adresse IP est plafonné.
+ */
+
+/**
+ * - TAILLE_FILE_ECOUTE = taille demandée pour la file des connexions en attente (listen)
+ * - DELAI_ACCEPTATION_DIFFEREE = secondes pendant lesquelles le noyau garde une
+ *   connexion sans données avant de la présenter à accept (TCP_DEFER_ACCEPT)
+ * - REESSAI_COMPLET = délai de base (s) proposé quand le serveur est complet
+ * - REESSAI_ADRESSE = délai (s) proposé quand l'adresse a trop de connexions
+ */
+#define TAILLE_FILE_ECOUTE 1024
+#define DELAI_ACCEPTATION_DIFFEREE 5
+#define REESSAI_COMPLET 5
+#define REESSAI_ADRESSE 30
+
+void admissionConfigurer(int maxParAdresse);
+int admissionPrendre(uint32_t adresse);
+void admissionReprendre(uint32_t adresse);
+void admissionRendre(uint32_t adresse);
+void admissionRefuser(int dSC, uint16_t reessai);
+
+#endif
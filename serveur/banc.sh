@@ -0,0 +1,106 @@
+#!/bin/sh
+# Banc de débit du serveur : rejoue la charge synthétique de ./charge contre
+# chaque binaire donné et compare au premier les médianes du débit et du temps
+# CPU du serveur, les binaires alternant d'un tour à l'autre.
+#
+#   ./banc.sh [-t tours] binaire_serveur...
+#
+# Chaque tour lance le binaire sur un port libre, sans limites de débit ni
+# d'admission, rejoue la capture sans attente et mesure le temps écoulé ainsi
+# que le temps CPU consommé par le serveur. Le serveur est arrêté par SIGINT,
+# ce qui écrit le profil d'un binaire instrumenté (-fprofile-generate).
+#
+# Variables : CAPTURE (fichier de charge), CHARGE (options de ./charge, par
+# exemple "-c 6" pour que toutes les connexions compressent).
+
+TOURS=5
+while getopts t: option
+do
+	case $option in
+	t) TOURS=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+if [ $# -lt 1 ]
+then
+	echo "Erreur : Lancez avec ./banc.sh [-t tours] binaire_serveur..." >&2
+	exit 1
+fi
+
+CAPTURE=${CAPTURE:-charge.cap}
+CHARGE=${CHARGE:--n 6 -s 3 -m 20000}
+TICKS=$(getconf CLK_TCK)
+[ -f "$CAPTURE" ] || ./charge $CHARGE "$CAPTURE" > /dev/null || exit 1
+
+# Temps CPU (ticks) consommé jusqu'ici par le processus $1
+cpu() {
+	sed 's/.*) //' "/proc/$1/stat" | awk '{ print $12 + $13 }'
+}
+
+# Un tour : affiche "trames durée_ms cpu_ms". Chaque tour prend un port neuf,
+# celui du précédent pouvant rester en TIME_WAIT.
+tour() {
+	port=$(( 20000 + ($$ * 16 + $2) % 40000 ))
+	"$1" "$port" -p 0 -l 1000000000 -L 1000000000 -r "/tmp/banc-$$-$port.relais" > /dev/null 2>&1 &
+	pid=$!
+	sleep 0.3
+	if ! kill -0 $pid 2> /dev/null
+	then
+		echo "Erreur : $1 n'a pas démarré sur le port $port" >&2
+		return 1
+	fi
+	debut=$(date +%s%N)
+	trames=$(./rejeu -v 0 "$CAPTURE" 127.0.0.1 "$port" | sed -n 's/^trames envoyées \([0-9]*\).*/\1/p')
+	fin=$(date +%s%N)
+	# Attente que le serveur ait fini de traiter ce qu'il a reçu
+	avant=-1
+	apres=$(cpu $pid)
+	while [ "$avant" != "$apres" ]
+	do
+		sleep 0.1
+		avant=$apres
+		apres=$(cpu $pid)
+	done
+	kill -INT $pid
+	wait $pid 2> /dev/null
+	echo "$trames $(( (fin - debut) / 1000000 )) $(( apres * 1000 / TICKS ))"
+}
+
+# Les binaires alternent à chaque tour : une dérive de la machine (fréquence,
+# cache, autres processus) touche ainsi tous les binaires de la même façon
+resultats=$(mktemp)
+trap 'rm -f "$resultats"' EXIT
+n=0
+i=0
+while [ $i -lt "$TOURS" ]
+do
+	b=0
+	for binaire in "$@"
+	do
+		echo "$b $(tour "$binaire" $n)" >> "$resultats"
+		b=$((b + 1))
+		n=$((n + 1))
+	done
+	i=$((i + 1))
+done
+
+# Médianes des tours, prises séparément sur le débit et sur le temps CPU
+mediane() {
+	sort -n | awk '{ v[NR] = $1 } END { printf "%.0f", v[int((NR + 1) / 2)] }'
+}
+reference=
+referenceCpu=
+b=0
+for binaire in "$@"
+do
+	debit=$(awk -v b=$b '$1 == b && $3 > 0 { print $2 * 1000 / $3 }' "$resultats" | mediane)
+	duree=$(awk -v b=$b '$1 == b { print $3 }' "$resultats" | mediane)
+	tempsCpu=$(awk -v b=$b '$1 == b { print $4 }' "$resultats" | mediane)
+	[ -n "$reference" ] || reference=$debit
+	[ -n "$referenceCpu" ] || referenceCpu=$tempsCpu
+	printf '%-24s %10s trames/s %+6.1f %%  %6s ms  cpu %6s ms %+6.1f %%\n' "$binaire" "$debit" \
+		"$(echo "$debit $reference" | awk '{ print ($1 / $2 - 1) * 100 }')" "$duree" "$tempsCpu" \
+		"$(echo "$tempsCpu $referenceCpu" | awk '{ print ($1 / $2 - 1) * 100 }')"
+	b=$((b + 1))
+done
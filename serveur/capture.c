@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/random.h>
+
+#include "capture.h"
+#include "serveur.h"
+#include "metriques.h"
+
+/**
+ * - TAILLE_TAMPON_CAPTURE = taille du tampon d'écriture du fichier de capture
+ */
+#define TAILLE_TAMPON_CAPTURE (1024 * 1024)
+
+/**
+ * - fichierCapture = fichier de capture, NULL si la capture est désactivée
+ * - cle = clé aléatoire de la pseudonymisation, jamais écrite
+ * - dernierEnregistrement = horloge du dernier enregistrement écrit
+ * - prochaineConnexion = identifiant de la prochaine connexion capturée
+ * - connexions = identifiant de capture de la connexion de chaque client
+ * - mutexCapture = protège le fichier et les champs précédents
+ */
+static FILE *fichierCapture = NULL;
+static uint64_t cle;
+static uint64_t dernierEnregistrement;
+static uint32_t prochaineConnexion = 1;
+static uint32_t connexions[MAX_CLIENT];
+static pthread_mutex_t mutexCapture = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Remplace chaque mot d'un texte par un mot de même longueur, tiré de
+ * son empreinte : les lettres deviennent des lettres, les chiffres des chiffres.
+ * Le nom d'une commande et ses arguments numériques sont conservés, pour que le
+ * rejeu suive les mêmes chemins dans le serveur.
+ *
+ * @param texte texte à pseudonymiser, modifié sur place
+ * @param longueur longueur du texte
+ */
+static void pseudonymiser(char *texte, size_t longueur)
+{
+	int estCommande = longueur > 0 && texte[0] == '/';
+	size_t i = 0;
+	while (estCommande && i < longueur && texte[i] != ' ')
+	{
+		i++;
+	}
+	while (i < longueur)
+	{
+		if (texte[i] == ' ' || texte[i] == '\n' || texte[i] == '\t' || texte[i] == '\r')
+		{
+			i++;
+			continue;
+		}
+		size_t debut = i;
+		int estNombre = 1;
+		uint64_t empreinte = cle;
+		for (; i < longueur && texte[i] != ' ' && texte[i] != '\n' && texte[i] != '\t' && texte[i] != '\r'; i++)
+		{
+			estNombre = estNombre && texte[i] >= '0' && texte[i] <= '9';
+			empreinte = (empreinte ^ (unsigned char)texte[i]) * 1099511628211ULL;
+		}
+		if (estCommande && estNombre)
+		{
+			continue;
+		}
+		for (size_t j = debut; j < i; j++)
+		{
+			empreinte = empreinte * 6364136223846793005ULL + 1442695040888963407ULL;
+			uint32_t tirage = empreinte >> 33;
+			texte[j] = texte[j] >= '0' && texte[j] <= '9' ? '0' + tirage % 10 : 'a' + tirage % 26;
+		}
+	}
+}
+
+/**
+ * @brief Écrit un enregistrement. Appelée sous mutexCapture.
+ */
+static void ecrireEnregistrement(uint32_t connexion, int idSalon, uint8_t evenement, uint8_t type, uint8_t drapeaux,
+								 const char *charge, uint16_t longueur)
+{
+	uint64_t maintenant = metriqueHorloge();
+	uint64_t delai = maintenant - dernierEnregistrement;
+	uint32_t delaiCapture = delai > UINT32_MAX ? UINT32_MAX : delai;
+	dernierEnregistrement = maintenant;
+	uint16_t salon = idSalon >= 0 && idSalon < SALON_CAPTURE_AUCUN ? idSalon : SALON_CAPTURE_AUCUN;
+
+	uint8_t entete[TAILLE_ENREGISTREMENT_CAPTURE] = {
+		delaiCapture >> 24, (delaiCapture >> 16) & 0xff, (delaiCapture >> 8) & 0xff, delaiCapture & 0xff,
+		connexion >> 24, (connexion >> 16) & 0xff, (connexion >> 8) & 0xff, connexion & 0xff,
+		salon >> 8, salon & 0xff, evenement, type, drapeaux, longueur >> 8, longueur & 0xff};
+	fwrite(entete, 1, sizeof(entete), fichierCapture);
+	if (longueur > 0)
+	{
+		fwrite(charge, 1, longueur, fichierCapture);
+	}
+}
+
+/**
+ * @brief Vide le tampon du fichier de capture à la sortie du programme.
+ */
+static void captureVider(void)
+{
+	pthread_mutex_lock(&mutexCapture);
+	fflush(fichierCapture);
+	pthread_mutex_unlock(&mutexCapture);
+}
+
+/**
+ * @brief Ouvre le fichier de capture et écrit son en-tête.
+ *
+ * @param chemin chemin du fichier, écrasé s'il existe
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int captureDemarrer(const char *chemin)
+{
+	FILE *fichier = fopen(chemin, "wb");
+	if (fichier == NULL)
+	{
+		perror("Impossible d'ouvrir le fichier de capture");
+		return -1;
+	}
+	setvbuf(fichier, NULL, _IOFBF, TAILLE_TAMPON_CAPTURE);
+	if (getrandom(&cle, sizeof(cle), 0) != sizeof(cle))
+	{
+		cle = ((uint64_t)time(NULL) << 32) ^ getpid() ^ metriqueHorloge();
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t debut = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	uint8_t entete[TAILLE_MAGIE_CAPTURE + 8];
+	memcpy(entete, MAGIE_CAPTURE, TAILLE_MAGIE_CAPTURE);
+	for (int i = 0; i < 8; i++)
+	{
+		entete[TAILLE_MAGIE_CAPTURE + i] = debut >> (56 - 8 * i);
+	}
+	fwrite(entete, 1, sizeof(entete), fichier);
+
+	dernierEnregistrement = metriqueHorloge();
+	fichierCapture = fichier;
+	atexit(captureVider);
+	return 0;
+}
+
+/**
+ * @brief Enregistre l'ouverture d'une connexion, nouvelle ou reprise lors
+ * d'un redémarrage à chaud, et lui donne un identifiant de capture.
+ *
+ * @param numClient client qui se connecte
+ */
+void captureConnexion(int numClient)
+{
+	if (fichierCapture == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&mutexCapture);
+	connexions[numClient] = prochaineConnexion++;
+	ecrireEnregistrement(connexions[numClient], tabClient[numClient].idSalon, CAPTURE_CONNEXION, 0, 0, NULL, 0);
+	pthread_mutex_unlock(&mutexCapture);
+}
+
+/**
+ * @brief Enregistre une trame reçue d'un client, texte pseudonymisé.
+ *
+ * @param numClient client qui a envoyé la trame
+ * @param entete en-tête de la trame
+ * @param charge charge de la trame
+ */
+void captureTrame(int numClient, const EnteteTrame *entete, const char *charge)
+{
+	if (fichierCapture == NULL)
+	{
+		return;
+	}
+	char copie[TAILLE_MAX_TRAME];
+	memcpy(copie, charge, entete->longueur);
+	if (entete->type == TRAME_TEXTE)
+	{
+		pseudonymiser(copie, entete->longueur);
+	}
+	pthread_mutex_lock(&mutexCapture);
+	ecrireEnregistrement(connexions[numClient], tabClient[numClient].idSalon, CAPTURE_TRAME, entete->type, entete->drapeaux,
+						 copie, entete->longueur);
+	pthread_mutex_unlock(&mutexCapture);
+}
+
+/**
+ * @brief Enregistre la fermeture d'une connexion.
+ *
+ * @param numClient client qui se déconnecte
+ */
+void captureDeconnexion(int numClient)
+{
+	if (fichierCapture == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&mutexCapture);
+	ecrireEnregistrement(connexions[numClient], tabClient[numClient].idSalon, CAPTURE_DECONNEXION, 0, 0, NULL, 0);
+	pthread_mutex_unlock(&mutexCapture);
+}
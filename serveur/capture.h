@@ -0,0 +1,52 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#include "protocole.h"
+
+/**
+ * Capture du trafic entrant, pour le rejouer avec l'outil rejeu.
+ *
+ * Le fichier commence par MAGIE_CAPTURE (8 octets, version comprise), suivi de
+ * la date de début en microsecondes depuis l'epoch (8 octets, ordre réseau).
+ * Chaque enregistrement a un en-tête de TAILLE_ENREGISTREMENT_CAPTURE octets,
+ * en ordre réseau :
+ *   [u32 délai depuis l'enregistrement précédent, µs][u32 connexion][u16 salon]
+ *   [u8 EvenementCapture][u8 type de trame][u8 drapeaux][u16 longueur]
+ * suivi de la charge de la trame. Le texte est pseudonymisé : chaque mot est
+ * remplacé par un mot de même longueur, toujours le même pendant une capture,
+ * et le nom des commandes est conservé.
+ */
+
+/**
+ * - MAGIE_CAPTURE = signature et version du fichier de capture
+ * - TAILLE_MAGIE_CAPTURE = taille de la signature
+ * - TAILLE_ENREGISTREMENT_CAPTURE = taille de l'en-tête d'un enregistrement
+ * - SALON_CAPTURE_AUCUN = salon d'un client qui n'en a pas encore
+ */
+#define MAGIE_CAPTURE "MSGCAP\0\1"
+#define TAILLE_MAGIE_CAPTURE 8
+#define TAILLE_ENREGISTREMENT_CAPTURE 15
+#define SALON_CAPTURE_AUCUN 0xffff
+
+/**
+ * @brief Événements d'une capture.
+ *
+ * - CAPTURE_CONNEXION = ouverture d'une connexion client
+ * - CAPTURE_TRAME = trame reçue du client
+ * - CAPTURE_DECONNEXION = fermeture de la connexion
+ */
+enum EvenementCapture
+{
+	CAPTURE_CONNEXION = 1,
+	CAPTURE_TRAME = 2,
+	CAPTURE_DECONNEXION = 3
+};
+
+int captureDemarrer(const char *chemin);
+void captureConnexion(int numClient);
+void captureTrame(int numClient, const EnteteTrame *entete, const char *charge);
+void captureDeconnexion(int numClient);
+
+#endif
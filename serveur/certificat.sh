@@ -0,0 +1,25 @@
+#!/bin/sh
+# Certificat auto-signé pour essayer le transport chiffré en local.
+#
+#   ./certificat.sh [nom_fichiers] [adresse_ip...]
+#
+# Écrit nom.pem (certificat) et nom.cle (clé privée), « serveur » par défaut,
+# valables pour localhost, 127.0.0.1 et les adresses données. Le certificat
+# sert aussi d'autorité aux clients :
+#
+#   ./serveur 1234 -T serveur.pem -K serveur.cle
+#   ../client/terminal -t serveur/serveur.pem 127.0.0.1 1234 pseudo
+
+NOM=${1:-serveur}
+[ $# -gt 0 ] && shift
+NOMS="DNS:localhost,IP:127.0.0.1"
+for adresse in "$@"
+do
+	NOMS="$NOMS,IP:$adresse"
+done
+
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 365 \
+	-subj "/CN=localhost" -addext "subjectAltName=$NOMS" \
+	-keyout "$NOM.cle" -out "$NOM.pem" 2> /dev/null || exit 1
+chmod 600 "$NOM.cle"
+echo "Certificat $NOM.pem et clé $NOM.cle pour $NOMS"
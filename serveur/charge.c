@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "capture.h"
+
+/**
+ * Génère une charge de travail synthétique au format des captures, à rejouer
+ * avec rejeu : plusieurs connexions réparties dans plusieurs salons envoient
+ * des messages de tailles variées, des commandes (/mp, /chercher, /enLigne,
+ * /estConnecte, /rejoindre), des demandes d'historique et des événements
+ * éphémères, puis se déconnectent par /fin. Le tirage est déterministe : une
+ * même graine donne la même charge, pour comparer deux constructions du
+ * serveur sur le même travail.
+ */
+
+/**
+ * - TAILLE_PAGE_CHARGE = nombre de messages demandés par page d'historique
+ * - MOTS_MAX_CHARGE = nombre maximum de mots d'un message
+ */
+#define TAILLE_PAGE_CHARGE 50
+#define MOTS_MAX_CHARGE 40
+
+/**
+ * - vocabulaire = mots des messages et des recherches
+ * - graine = état du générateur pseudo-aléatoire
+ * - fichier = capture écrite
+ * - delai = délai (µs) entre deux enregistrements
+ */
+static const char *vocabulaire[] = {"bonjour", "salut", "réunion", "demain", "projet", "serveur", "client", "message",
+									"salon", "fichier", "rapport", "merci", "question", "réponse", "midi", "soir",
+									"lundi", "vendredi", "code", "test", "version", "erreur", "correction", "idée",
+									"café", "pause", "semaine", "équipe", "document", "lien"};
+static uint64_t graine = 1;
+static FILE *fichier = NULL;
+static uint32_t delai = 50;
+
+/**
+ * @brief Tire un entier pseudo-aléatoire (xorshift64*).
+ *
+ * @param borne borne exclue du tirage
+ * @return un entier de [0, borne[.
+ */
+static uint32_t tirer(uint32_t borne)
+{
+	graine ^= graine >> 12;
+	graine ^= graine << 25;
+	graine ^= graine >> 27;
+	return (uint32_t)((graine * 2685821657736338717ULL) >> 32) % borne;
+}
+
+/**
+ * @brief Donne un mot du vocabulaire au hasard.
+ */
+static const char *mot(void)
+{
+	return vocabulaire[tirer(sizeof(vocabulaire) / sizeof(vocabulaire[0]))];
+}
+
+/**
+ * @brief Écrit un enregistrement de capture.
+ */
+static void ecrire(uint32_t connexion, uint16_t salon, uint8_t evenement, uint8_t type, uint8_t drapeaux, const char *charge,
+				   uint16_t longueur)
+{
+	uint8_t entete[TAILLE_ENREGISTREMENT_CAPTURE] = {
+		delai >> 24, (delai >> 16) & 0xff, (delai >> 8) & 0xff, delai & 0xff,
+		connexion >> 24, (connexion >> 16) & 0xff, (connexion >> 8) & 0xff, connexion & 0xff,
+		salon >> 8, salon & 0xff, evenement, type, drapeaux, longueur >> 8, longueur & 0xff};
+	fwrite(entete, 1, sizeof(entete), fichier);
+	if (longueur > 0)
+	{
+		fwrite(charge, 1, longueur, fichier);
+	}
+}
+
+/**
+ * @brief Écrit une trame texte de la connexion.
+ */
+static void ecrireTexte(uint32_t connexion, uint16_t salon, const char *texte)
+{
+	ecrire(connexion, salon, CAPTURE_TRAME, TRAME_TEXTE, 0, texte, strlen(texte));
+}
+
+int main(int argc, char *argv[])
+{
+	int nbConnexions = 6;
+	int nbActions = 5000;
+	int nbSalons = 3;
+	int nbCompressees = 0;
+	int option;
+	while ((option = getopt(argc, argv, "n:m:s:c:g:d:")) != -1)
+	{
+		switch (option)
+		{
+		case 'n':
+			nbConnexions = atoi(optarg);
+			break;
+		case 'm':
+			nbActions = atoi(optarg);
+			break;
+		case 's':
+			nbSalons = atoi(optarg);
+			break;
+		case 'c':
+			nbCompressees = atoi(optarg);
+			break;
+		case 'g':
+			graine = strtoull(optarg, NULL, 10);
+			break;
+		case 'd':
+			delai = atoi(optarg);
+			break;
+		default:
+			break;
+		}
+	}
+	if (argc - optind < 1 || nbConnexions < 1 || nbSalons < 1 || graine == 0)
+	{
+		fprintf(stderr, "Erreur : Lancez avec ./charge [-n connexions] [-m actions] [-s salons] [-c connexions_compressees] [-g graine] [-d delai_us] fichier_capture\n"
+						"  Le serveur rejoué doit accepter autant de connexions locales (-p 0, MAX_CLIENT)\n");
+		exit(-1);
+	}
+
+	fichier = fopen(argv[optind], "wb");
+	if (fichier == NULL)
+	{
+		perror("Impossible d'ouvrir le fichier de capture");
+		exit(-1);
+	}
+	uint8_t entete[TAILLE_MAGIE_CAPTURE + 8] = {0};
+	memcpy(entete, MAGIE_CAPTURE, TAILLE_MAGIE_CAPTURE);
+	fwrite(entete, 1, sizeof(entete), fichier);
+
+	// Connexion de chacun, avec les capacités d'un client récent, et arrivée dans son salon. La
+	// compression est laissée aux seules premières connexions : deflate (zlib) dominerait sinon le
+	// temps du serveur, alors qu'il n'est pas construit avec lui
+	uint16_t *salons = calloc(nbConnexions, sizeof(uint16_t));
+	char texte[TAILLE_MAX_TRAME];
+	for (int i = 0; i < nbConnexions; i++)
+	{
+		ecrire(i + 1, SALON_CAPTURE_AUCUN, CAPTURE_CONNEXION, 0, 0, NULL, 0);
+		snprintf(texte, sizeof(texte), "charge%d", i);
+		uint8_t capacites = DRAPEAU_IDENTITES | DRAPEAU_EPHEMERES | DRAPEAU_HISTORIQUE | (i < nbCompressees ? DRAPEAU_DEFLATE : 0);
+		ecrire(i + 1, SALON_CAPTURE_AUCUN, CAPTURE_TRAME, TRAME_TEXTE, capacites, texte, strlen(texte));
+		salons[i] = i % nbSalons;
+		snprintf(texte, sizeof(texte), "/rejoindre salon%d", salons[i]);
+		ecrireTexte(i + 1, 0, texte);
+	}
+
+	// Les actions des connexions s'entremêlent ; les messages de salon dominent
+	uint64_t nbEnregistrements = 0;
+	for (int action = 0; action < nbActions; action++)
+	{
+		for (int i = 0; i < nbConnexions; i++, nbEnregistrements++)
+		{
+			uint32_t connexion = i + 1;
+			uint32_t tirage = tirer(100);
+			if (tirage < 78)
+			{
+				size_t longueur = 0;
+				for (uint32_t n = 1 + tirer(MOTS_MAX_CHARGE); n > 0; n--)
+				{
+					longueur += snprintf(texte + longueur, sizeof(texte) - longueur, n > 1 ? "%s " : "%s", mot());
+				}
+				ecrireTexte(connexion, salons[i], texte);
+			}
+			else if (tirage < 84)
+			{
+				snprintf(texte, sizeof(texte), "/mp charge%u %s %s", tirer(nbConnexions), mot(), mot());
+				ecrireTexte(connexion, salons[i], texte);
+			}
+			else if (tirage < 87)
+			{
+				snprintf(texte, sizeof(texte), "/chercher %s %s", mot(), mot());
+				ecrireTexte(connexion, salons[i], texte);
+			}
+			else if (tirage < 89)
+			{
+				ecrireTexte(connexion, salons[i], "/enLigne");
+			}
+			else if (tirage < 90)
+			{
+				snprintf(texte, sizeof(texte), "/estConnecte charge%u", tirer(nbConnexions));
+				ecrireTexte(connexion, salons[i], texte);
+			}
+			else if (tirage < 93)
+			{
+				char demande[TAILLE_DEMANDE_HISTORIQUE] = {0xff, 0xff, 0xff, 0xff, 0, TAILLE_PAGE_CHARGE};
+				ecrire(connexion, salons[i], CAPTURE_TRAME, TRAME_HISTORIQUE, 0, demande, sizeof(demande));
+			}
+			else if (tirage < 99)
+			{
+				char ephemere[2] = {tirage & 1 ? EPHEMERE_SAISIE : EPHEMERE_LECTURE, 1};
+				ecrire(connexion, salons[i], CAPTURE_TRAME, TRAME_EPHEMERE, 0, ephemere, sizeof(ephemere));
+			}
+			else
+			{
+				salons[i] = tirer(nbSalons);
+				snprintf(texte, sizeof(texte), "/rejoindre salon%d", salons[i]);
+				ecrireTexte(connexion, salons[i], texte);
+			}
+		}
+	}
+
+	// Le serveur ferme lui-même chaque connexion après /fin : rejeu attend ainsi qu'il ait tout traité
+	for (int i = 0; i < nbConnexions; i++)
+	{
+		ecrireTexte(i + 1, salons[i], "/fin\n");
+	}
+	fclose(fichier);
+	free(salons);
+	printf("%lu action(s) sur %d connexion(s), %d salon(s) : %s\n", (unsigned long)nbEnregistrements, nbConnexions, nbSalons,
+		   argv[optind]);
+	return 0;
+}
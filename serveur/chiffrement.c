@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "serveur.h"
+#include "chiffrement.h"
+#include "sortie.h"
+#include "memoire.h"
+#include "metriques.h"
+#include "journal.h"
+#include "relais.h"
+
+/**
+ * - TAILLE_LOT_SCELLE = tampon de la paire de BIO pour les enregistrements à émettre : un lot
+ *   de TAILLE_SCELLEMENT octets et le surcoût de ses enregistrements
+ * - TAILLE_RECU_CHIFFRE = tampon de la paire de BIO pour les octets reçus : un enregistrement
+ *   incomplet et une lecture de la socket
+ * - SUITES_TLS12 = suites TLS 1.2 proposées, toutes prises en charge par kTLS (TLS 1.3 n'a que celles-là)
+ */
+#define TAILLE_LOT_SCELLE (TAILLE_SCELLEMENT + (TAILLE_SCELLEMENT / TAILLE_ENREGISTREMENT + 2) * 512)
+#define TAILLE_RECU_CHIFFRE (2 * TAILLE_ENREGISTREMENT_CHIFFRE)
+#define SUITES_TLS12 "ECDHE+AESGCM:ECDHE+CHACHA20"
+
+/**
+ * @brief Session TLS d'un client.
+ *
+ * @param mutex sérialise les appels OpenSSL du thread du client (lecture) et des travailleurs d'envoi (écriture)
+ * @param etat bits CHIFFREMENT_*, 0 pour une connexion en clair
+ * @param ssl session OpenSSL, NULL avant la poignée de main et après la fermeture
+ * @param reseau côté réseau de la paire de BIO, NULL si les deux sens sont dans le noyau
+ * @param memoire octets imputés à la connexion pour la session
+ */
+typedef struct Chiffrement Chiffrement;
+struct Chiffrement
+{
+	pthread_mutex_t mutex;
+	atomic_uint etat;
+	SSL *ssl;
+	BIO *reseau;
+	size_t memoire;
+};
+
+/**
+ * - contexte = contexte TLS du serveur, NULL pour des connexions en clair
+ * - sessions = session TLS de chaque client
+ */
+static SSL_CTX *contexte = NULL;
+static Chiffrement sessions[MAX_CLIENT];
+
+/**
+ * @brief Charge le certificat et la clé du serveur : les connexions suivantes
+ * seront chiffrées.
+ *
+ * @param certificat fichier PEM du certificat, suivi de sa chaîne
+ * @param cle fichier PEM de la clé privée
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int chiffrementConfigurer(const char *certificat, const char *cle)
+{
+	contexte = SSL_CTX_new(TLS_server_method());
+	if (contexte == NULL)
+	{
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version(contexte, TLS1_2_VERSION);
+	// Le noyau prend les enregistrements s'il le peut ; pas de renégociation ni de tickets, que kTLS ne suivrait pas
+	SSL_CTX_set_options(contexte, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+	SSL_CTX_set_num_tickets(contexte, 0);
+	SSL_CTX_set_session_cache_mode(contexte, SSL_SESS_CACHE_OFF);
+	SSL_CTX_set_mode(contexte, SSL_MODE_RELEASE_BUFFERS);
+	if (SSL_CTX_set_cipher_list(contexte, SUITES_TLS12) != 1 ||
+		SSL_CTX_use_certificate_chain_file(contexte, certificat) != 1 ||
+		SSL_CTX_use_PrivateKey_file(contexte, cle, SSL_FILETYPE_PEM) != 1 ||
+		SSL_CTX_check_private_key(contexte) != 1)
+	{
+		fprintf(stderr, "Erreur chargement du certificat %s ou de la clé %s\n", certificat, cle);
+		ERR_print_errors_fp(stderr);
+		SSL_CTX_free(contexte);
+		contexte = NULL;
+		return -1;
+	}
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		pthread_mutex_init(&sessions[i].mutex, NULL);
+	}
+	return 0;
+}
+
+/**
+ * @brief Prépare l'état d'une connexion qui vient d'être acceptée : chiffrée
+ * si le serveur a un certificat, en clair sinon. Tant que la poignée de main
+ * n'est pas faite, sa file d'envoi attend.
+ *
+ * @param numClient numéro du client
+ */
+void chiffrementOuvrir(int numClient)
+{
+	atomic_store(&sessions[numClient].etat, contexte != NULL ? CHIFFREMENT_ACTIF : 0);
+}
+
+/**
+ * @brief Libère la session OpenSSL d'un client et rend sa mémoire. Appelée
+ * sous le mutex de la session, ou avant qu'elle ne soit partagée.
+ */
+static void liberer(int numClient, Chiffrement *session)
+{
+	SSL_free(session->ssl);
+	BIO_free(session->reseau);
+	session->ssl = NULL;
+	session->reseau = NULL;
+	memoireRendre(numClient, session->memoire);
+	session->memoire = 0;
+}
+
+/**
+ * @brief Envoie, sans attendre, les enregistrements scellés en attente dans la
+ * paire de BIO. Appelée sous le mutex de la session.
+ *
+ * @return 0 si tout est parti, -1 sinon (EAGAIN si la socket est pleine).
+ */
+static int envoyerScelles(int dSC, Chiffrement *session)
+{
+	char *donnees;
+	int attente;
+	// Les octets sont lus en place dans la paire, sans copie
+	while ((attente = BIO_nread0(session->reseau, &donnees)) > 0)
+	{
+		ssize_t envoye = send(dSC, donnees, attente, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (envoye == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (envoye == -1)
+		{
+			return -1;
+		}
+		BIO_nread(session->reseau, &donnees, envoye);
+	}
+	return 0;
+}
+
+/**
+ * @brief Fait la poignée de main TLS d'une connexion acceptée, dans le thread
+ * du client, puis confie au noyau les sens qu'il sait chiffrer. La minuterie
+ * de poignée de main interrompt un client qui ne la termine pas. Ne fait rien
+ * pour une connexion en clair ou reprise.
+ *
+ * @param numClient numéro du client
+ * @return 0 si la connexion peut servir, -1 sinon.
+ */
+int chiffrementAccepter(int numClient)
+{
+	Chiffrement *session = &sessions[numClient];
+	if (atomic_load(&session->etat) != CHIFFREMENT_ACTIF)
+	{
+		return 0;
+	}
+	int dSC = tabClient[numClient].dSC;
+	session->ssl = SSL_new(contexte);
+	session->memoire = MEMOIRE_CHIFFREMENT;
+	memoireImputer(numClient, session->memoire);
+	if (session->ssl == NULL || SSL_set_fd(session->ssl, dSC) != 1)
+	{
+		liberer(numClient, session);
+		atomic_store(&session->etat, CHIFFREMENT_ACTIF | CHIFFREMENT_PRET);
+		return -1;
+	}
+
+	// Socket bloquante : une attente n'est rendue que sur signal, celui d'un redémarrage à chaud
+	int resultat;
+	while ((resultat = SSL_accept(session->ssl)) != 1)
+	{
+		int erreur = SSL_get_error(session->ssl, resultat);
+		if (erreur != SSL_ERROR_WANT_READ && erreur != SSL_ERROR_WANT_WRITE)
+		{
+			break;
+		}
+		if (relaisEnCours())
+		{
+			relaisAttendre();
+		}
+	}
+	if (resultat != 1)
+	{
+		unsigned long erreur = ERR_get_error();
+		journalEcrire(JOURNAL_INFO, EVT_TLS, numClient, 0, 0, erreur != 0 ? ERR_reason_error_string(erreur) : "interrompue");
+		ERR_clear_error();
+		metriqueIncrementer(CPT_TLS_ECHECS, 1);
+		liberer(numClient, session);
+		atomic_store(&session->etat, CHIFFREMENT_ACTIF | CHIFFREMENT_PRET);
+		return -1;
+	}
+
+	// Le sens que le noyau ne prend pas passe par la paire de BIO : plus de lecture ni d'écriture
+	// OpenSSL bloquante sur la socket, partagée entre le thread du client et son travailleur d'envoi
+	int noyauEmission = BIO_get_ktls_send(SSL_get_wbio(session->ssl));
+	int noyauReception = BIO_get_ktls_recv(SSL_get_rbio(session->ssl));
+	if (!noyauEmission || !noyauReception)
+	{
+		BIO *interne;
+		if (BIO_new_bio_pair(&interne, TAILLE_LOT_SCELLE, &session->reseau, TAILLE_RECU_CHIFFRE) != 1)
+		{
+			liberer(numClient, session);
+			atomic_store(&session->etat, CHIFFREMENT_ACTIF | CHIFFREMENT_PRET);
+			return -1;
+		}
+		if (!noyauReception)
+		{
+			BIO_up_ref(interne);
+			SSL_set0_rbio(session->ssl, interne);
+		}
+		if (!noyauEmission)
+		{
+			BIO_up_ref(interne);
+			SSL_set0_wbio(session->ssl, interne);
+		}
+		BIO_free(interne);
+		session->memoire += TAILLE_LOT_SCELLE + TAILLE_RECU_CHIFFRE;
+		memoireImputer(numClient, TAILLE_LOT_SCELLE + TAILLE_RECU_CHIFFRE);
+	}
+
+	metriqueIncrementer(CPT_TLS_POIGNEES, 1);
+	metriqueIncrementer(CPT_TLS_NOYAU_EMISSION, noyauEmission != 0);
+	metriqueIncrementer(CPT_TLS_NOYAU_RECEPTION, noyauReception != 0);
+	journalEcrire(JOURNAL_DEBUG, EVT_TLS, numClient, noyauEmission != 0, noyauReception != 0, SSL_get_cipher_name(session->ssl));
+	atomic_store(&session->etat, CHIFFREMENT_ACTIF | CHIFFREMENT_PRET |
+									 (noyauEmission ? CHIFFREMENT_NOYAU_EMISSION : 0) |
+									 (noyauReception ? CHIFFREMENT_NOYAU_RECEPTION : 0));
+
+	// Les trames mises en file pendant la poignée de main (pings) peuvent partir
+	sortieReveiller(numClient);
+	return 0;
+}
+
+/**
+ * @brief Reprend l'état de chiffrement d'une connexion transmise lors d'un
+ * redémarrage à chaud. Seule une connexion dont les deux sens sont dans le
+ * noyau survit : la socket porte alors tout l'état TLS utile.
+ *
+ * @param numClient numéro du client
+ * @param etat état transmis par l'ancien processus
+ * @return 0 si la connexion peut être reprise, -1 sinon.
+ */
+int chiffrementReprendre(int numClient, uint32_t etat)
+{
+	uint32_t noyau = CHIFFREMENT_ACTIF | CHIFFREMENT_PRET | CHIFFREMENT_NOYAU_EMISSION | CHIFFREMENT_NOYAU_RECEPTION;
+	if (etat != 0 && etat != noyau)
+	{
+		return -1;
+	}
+	atomic_store(&sessions[numClient].etat, etat);
+	return 0;
+}
+
+/**
+ * @brief Donne l'état de chiffrement d'une connexion, à transmettre lors d'un
+ * redémarrage à chaud.
+ */
+uint32_t chiffrementEtat(int numClient)
+{
+	return atomic_load(&sessions[numClient].etat);
+}
+
+/**
+ * @brief Indique si la file d'envoi d'un client peut être vidée : connexion
+ * en clair, ou poignée de main terminée.
+ */
+int chiffrementPret(int numClient)
+{
+	uint32_t etat = atomic_load(&sessions[numClient].etat);
+	return !(etat & CHIFFREMENT_ACTIF) || (etat & CHIFFREMENT_PRET);
+}
+
+/**
+ * @brief Indique si des enregistrements scellés en espace utilisateur
+ * attendent encore leur envoi.
+ */
+int chiffrementEnAttente(int numClient)
+{
+	Chiffrement *session = &sessions[numClient];
+	uint32_t etat = atomic_load(&session->etat);
+	if (!(etat & CHIFFREMENT_ACTIF) || (etat & CHIFFREMENT_NOYAU_EMISSION))
+	{
+		return 0;
+	}
+	pthread_mutex_lock(&session->mutex);
+	int attente = session->reseau != NULL && BIO_ctrl_pending(session->reseau) > 0;
+	pthread_mutex_unlock(&session->mutex);
+	return attente;
+}
+
+/**
+ * @brief Lit la socket d'un client dans son lecteur de trames, en clair.
+ * Bloque jusqu'à ce que des octets arrivent, comme lecteurTrameRemplir.
+ *
+ * @param numClient numéro du client
+ * @param lecteur lecteur de trames du client
+ * @return le nombre d'octets ajoutés au lecteur, 0 si la connexion est fermée, -1 en cas d'erreur (errno).
+ */
+ssize_t chiffrementRemplir(int numClient, LecteurTrame *lecteur)
+{
+	Chiffrement *session = &sessions[numClient];
+	uint32_t etat = atomic_load(&session->etat);
+	if (!(etat & CHIFFREMENT_ACTIF) || (etat & CHIFFREMENT_NOYAU_RECEPTION))
+	{
+		// En clair, ou déchiffré par le noyau : un enregistrement de contrôle fait échouer recv (EIO)
+		return lecteurTrameRemplir(lecteur, tabClient[numClient].dSC);
+	}
+
+	uint8_t chiffre[TAILLE_ENREGISTREMENT_CHIFFRE];
+	while (1)
+	{
+		// Les enregistrements déjà reçus passent avant une nouvelle lecture de la socket
+		pthread_mutex_lock(&session->mutex);
+		size_t lu = 0;
+		int erreur = SSL_ERROR_ZERO_RETURN;
+		if (session->ssl != NULL)
+		{
+			int resultat = SSL_read_ex(session->ssl, lecteur->tampon + lecteur->rempli, sizeof(lecteur->tampon) - lecteur->rempli, &lu);
+			erreur = resultat == 1 ? SSL_ERROR_NONE : SSL_get_error(session->ssl, resultat);
+		}
+		// Une lecture peut produire une réponse (alerte, mise à jour de clé) à émettre
+		int estAEnvoyer = !(etat & CHIFFREMENT_NOYAU_EMISSION) && session->reseau != NULL && BIO_ctrl_pending(session->reseau) > 0;
+		ERR_clear_error();
+		pthread_mutex_unlock(&session->mutex);
+		if (estAEnvoyer)
+		{
+			sortieReveiller(numClient);
+		}
+
+		if (erreur == SSL_ERROR_NONE)
+		{
+			lecteur->rempli += lu;
+			return lu;
+		}
+		if (erreur == SSL_ERROR_ZERO_RETURN)
+		{
+			return 0;
+		}
+		if (erreur != SSL_ERROR_WANT_READ)
+		{
+			errno = EPROTO;
+			return -1;
+		}
+
+		ssize_t recu = recv(tabClient[numClient].dSC, chiffre, sizeof(chiffre), 0);
+		if (recu <= 0)
+		{
+			return recu;
+		}
+		pthread_mutex_lock(&session->mutex);
+		int ecrit = session->reseau != NULL ? BIO_write(session->reseau, chiffre, recu) : -1;
+		pthread_mutex_unlock(&session->mutex);
+		if (ecrit != recu)
+		{
+			errno = EPROTO;
+			return -1;
+		}
+	}
+}
+
+/**
+ * @brief Envoie des trames à un client, sans bloquer. En clair ou avec
+ * l'émission dans le noyau, les trames partent directement par sendmsg ;
+ * sinon, le lot chiffré précédent doit être parti, puis au plus
+ * TAILLE_SCELLEMENT octets sont scellés en enregistrements pleins et envoyés
+ * autant que la socket le permet. Appelée sous mutexEnvoi.
+ *
+ * @param numClient numéro du client
+ * @param iov trames à envoyer
+ * @param nbIov nombre de trames, 0 pour envoyer seulement les enregistrements en attente
+ * @return le nombre d'octets de trames envoyés ou scellés, -1 en cas d'erreur (EAGAIN si la socket est pleine).
+ */
+ssize_t chiffrementEnvoyer(int numClient, const struct iovec *iov, int nbIov)
+{
+	Chiffrement *session = &sessions[numClient];
+	int dSC = tabClient[numClient].dSC;
+	uint32_t etat = atomic_load(&session->etat);
+	if (!(etat & CHIFFREMENT_ACTIF) || (etat & CHIFFREMENT_NOYAU_EMISSION))
+	{
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = (struct iovec *)iov;
+		msg.msg_iovlen = nbIov;
+		return sendmsg(dSC, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+
+	pthread_mutex_lock(&session->mutex);
+	if (session->ssl == NULL)
+	{
+		// Connexion close : rien ne doit plus partir, surtout pas en clair
+		pthread_mutex_unlock(&session->mutex);
+		errno = EPIPE;
+		return -1;
+	}
+	if (envoyerScelles(dSC, session) != 0)
+	{
+		pthread_mutex_unlock(&session->mutex);
+		return -1;
+	}
+
+	// Les petites trames sont regroupées en enregistrements pleins : moins d'en-têtes et d'appels au chiffrement
+	uint8_t bloc[TAILLE_ENREGISTREMENT];
+	size_t rempli = 0;
+	size_t scelle = 0;
+	int estErreur = 0;
+	for (int i = 0; i < nbIov && !estErreur && scelle + rempli < TAILLE_SCELLEMENT; i++)
+	{
+		const uint8_t *octets = iov[i].iov_base;
+		size_t pris = 0;
+		while (pris < iov[i].iov_len && scelle + rempli < TAILLE_SCELLEMENT)
+		{
+			size_t longueur = iov[i].iov_len - pris < sizeof(bloc) - rempli ? iov[i].iov_len - pris : sizeof(bloc) - rempli;
+			memcpy(bloc + rempli, octets + pris, longueur);
+			rempli += longueur;
+			pris += longueur;
+			if (rempli == sizeof(bloc))
+			{
+				size_t ecrit;
+				estErreur = SSL_write_ex(session->ssl, bloc, rempli, &ecrit) != 1;
+				scelle += estErreur ? 0 : rempli;
+				rempli = 0;
+				if (estErreur)
+				{
+					break;
+				}
+			}
+		}
+	}
+	if (rempli > 0 && !estErreur)
+	{
+		size_t ecrit;
+		estErreur = SSL_write_ex(session->ssl, bloc, rempli, &ecrit) != 1;
+		scelle += estErreur ? 0 : rempli;
+	}
+	if (estErreur)
+	{
+		ERR_clear_error();
+		pthread_mutex_unlock(&session->mutex);
+		errno = EPROTO;
+		return -1;
+	}
+
+	// Le lot est scellé : ce que la socket ne prend pas maintenant partira au prochain appel
+	if (envoyerScelles(dSC, session) != 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+	{
+		pthread_mutex_unlock(&session->mutex);
+		return -1;
+	}
+	pthread_mutex_unlock(&session->mutex);
+	return scelle;
+}
+
+/**
+ * @brief Clôt la session TLS d'un client qui part : alerte de fermeture si la
+ * socket l'accepte sans attendre, puis libération. Les trames mises en file
+ * ensuite ne partent plus.
+ *
+ * @param numClient numéro du client
+ */
+void chiffrementFermer(int numClient)
+{
+	Chiffrement *session = &sessions[numClient];
+	if (!(atomic_load(&session->etat) & CHIFFREMENT_ACTIF))
+	{
+		return;
+	}
+	pthread_mutex_lock(&session->mutex);
+	if (session->ssl != NULL)
+	{
+		// La socket va être fermée : elle peut passer en non bloquant pour l'alerte
+		int dSC = tabClient[numClient].dSC;
+		fcntl(dSC, F_SETFL, fcntl(dSC, F_GETFL) | O_NONBLOCK);
+		SSL_shutdown(session->ssl);
+		if (session->reseau != NULL)
+		{
+			envoyerScelles(dSC, session);
+		}
+		ERR_clear_error();
+		liberer(numClient, session);
+	}
+	atomic_fetch_or(&session->etat, CHIFFREMENT_PRET);
+	pthread_mutex_unlock(&session->mutex);
+}
@@ -0,0 +1,58 @@
+#ifndef CHIFFREMENT_H
+#define CHIFFREMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "protocole.h"
+
+/**
+ * Transport chiffré (TLS) des connexions clientes, quand le serveur a un
+ * certificat. La poignée de main se fait en espace utilisateur (OpenSSL),
+ * dans le thread du client ; le chiffrement des enregistrements est ensuite
+ * confié au noyau (kTLS) quand il le propose, séparément pour l'émission et
+ * la réception. Avec l'émission dans le noyau, les travailleurs d'envoi
+ * gardent leur sendmsg sans copie sur les trames partagées ; sinon, les
+ * trames sont scellées par lots dans une paire de BIO puis envoyées telles
+ * quelles, et la réception passe par la même paire.
+ */
+
+/**
+ * - TAILLE_ENREGISTREMENT = charge maximum d'un enregistrement TLS
+ * - TAILLE_ENREGISTREMENT_CHIFFRE = taille maximum d'un enregistrement TLS reçu, en-tête compris
+ * - TAILLE_SCELLEMENT = octets de trames scellés au plus par envoi en espace utilisateur ; le lot
+ *   chiffré doit être parti avant que le suivant ne soit scellé
+ * - MEMOIRE_CHIFFREMENT = mémoire d'une session OpenSSL (état et tampons d'enregistrement), imputée à la connexion
+ */
+#define TAILLE_ENREGISTREMENT (16 * 1024)
+#define TAILLE_ENREGISTREMENT_CHIFFRE (TAILLE_ENREGISTREMENT + 2048 + 5)
+#define TAILLE_SCELLEMENT (64 * 1024)
+#define MEMOIRE_CHIFFREMENT (2 * TAILLE_ENREGISTREMENT_CHIFFRE + 8 * 1024)
+
+/**
+ * @brief État du chiffrement d'une connexion, transmis lors d'un redémarrage à chaud.
+ *
+ * - CHIFFREMENT_ACTIF = la connexion est chiffrée
+ * - CHIFFREMENT_PRET = la poignée de main est terminée (ou a échoué) : la file d'envoi peut être vidée
+ * - CHIFFREMENT_NOYAU_EMISSION = les enregistrements émis sont chiffrés par le noyau
+ * - CHIFFREMENT_NOYAU_RECEPTION = les enregistrements reçus sont déchiffrés par le noyau
+ */
+#define CHIFFREMENT_ACTIF 0x01
+#define CHIFFREMENT_PRET 0x02
+#define CHIFFREMENT_NOYAU_EMISSION 0x04
+#define CHIFFREMENT_NOYAU_RECEPTION 0x08
+
+int chiffrementConfigurer(const char *certificat, const char *cle);
+void chiffrementOuvrir(int numClient);
+int chiffrementAccepter(int numClient);
+int chiffrementReprendre(int numClient, uint32_t etat);
+uint32_t chiffrementEtat(int numClient);
+int chiffrementPret(int numClient);
+int chiffrementEnAttente(int numClient);
+ssize_t chiffrementRemplir(int numClient, LecteurTrame *lecteur);
+ssize_t chiffrementEnvoyer(int numClient, const struct iovec *iov, int nbIov);
+void chiffrementFermer(int numClient);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "compression.h"
+#include "metriques.h"
+#include "protocole.h"
+
+/**
+ * @brief Flux de compression d'une connexion.
+ *
+ * @param flux état deflate, toujours en fin de bloc entre deux trames
+ */
+struct Compression
+{
+	z_stream flux;
+};
+
+/**
+ * @brief Crée le flux de compression d'une connexion.
+ *
+ * @return le flux, NULL si la mémoire manque.
+ */
+Compression *compressionCreer(void)
+{
+	Compression *compression = calloc(1, sizeof(Compression));
+	if (compression == NULL)
+	{
+		return NULL;
+	}
+	if (deflateInit2(&compression->flux, NIVEAU_COMPRESSION, Z_DEFLATED, BITS_FENETRE, NIVEAU_MEMOIRE, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(compression);
+		return NULL;
+	}
+	return compression;
+}
+
+/**
+ * @brief Libère le flux de compression d'une connexion.
+ *
+ * @param compression flux à libérer, NULL accepté
+ */
+void compressionLiberer(Compression *compression)
+{
+	if (compression != NULL)
+	{
+		deflateEnd(&compression->flux);
+		free(compression);
+	}
+}
+
+/**
+ * @brief Compresse une charge dans le flux. Si le résultat n'est pas plus
+ * petit, la sortie est jetée : la fenêtre contient la charge comme si elle
+ * avait servi de dictionnaire, et le client la traite ainsi en la recevant telle quelle.
+ *
+ * @return la trame compressée, NULL s'il faut envoyer l'originale.
+ */
+static Message *compresser(Compression *compression, Message *original, const uint8_t *charge, size_t longueur)
+{
+	Message *message = malloc(sizeof(Message) + TAILLE_ENTETE_TRAME + longueur);
+	uint8_t rebut[1024];
+	z_stream *flux = &compression->flux;
+	flux->next_in = (Bytef *)charge;
+	flux->avail_in = longueur;
+	flux->next_out = message != NULL ? message->octets + TAILLE_ENTETE_TRAME : rebut;
+	flux->avail_out = message != NULL ? longueur : sizeof(rebut);
+	deflate(flux, Z_SYNC_FLUSH);
+	if (message != NULL && flux->avail_out > 0)
+	{
+		size_t compresse = longueur - flux->avail_out;
+		atomic_init(&message->references, 1);
+		message->classe = original->classe;
+		message->creation = original->creation;
+		message->longueur = TAILLE_ENTETE_TRAME + compresse;
+		trameEcrireEntete(message->octets, original->octets[0], original->octets[1] | DRAPEAU_DEFLATE, compresse);
+		metriqueIncrementer(CPT_COMPRESSION_OCTETS_ENTREE, longueur);
+		metriqueIncrementer(CPT_COMPRESSION_OCTETS_SORTIE, compresse);
+		return message;
+	}
+
+	// Sortie trop grande : on la vide jusqu'à la fin de bloc, sans la garder
+	while (flux->avail_out == 0)
+	{
+		flux->next_out = rebut;
+		flux->avail_out = sizeof(rebut);
+		deflate(flux, Z_SYNC_FLUSH);
+	}
+	free(message);
+	return NULL;
+}
+
+/**
+ * @brief Fait passer une trame engagée dans le flux du client, dans l'ordre
+ * d'envoi. Une trame texte volumineuse de la classe vrac, ou une page
+ * d'historique volumineuse, est compressée ; une autre trame texte, une autre
+ * page ou une trame message enrichit seulement la fenêtre du flux.
+ *
+ * @param compression flux du client
+ * @param message trame engagée
+ * @return la trame compressée, avec une référence pour l'appelant, à envoyer
+ *         à la place de l'originale ; NULL si l'originale part telle quelle.
+ */
+Message *compressionTraiter(Compression *compression, Message *message)
+{
+	uint8_t type = message->longueur >= TAILLE_ENTETE_TRAME ? message->octets[0] : 0;
+	if (type != TRAME_TEXTE && type != TRAME_MESSAGE && type != TRAME_HISTORIQUE)
+	{
+		return NULL;
+	}
+	const uint8_t *charge = message->octets + TAILLE_ENTETE_TRAME;
+	size_t longueur = message->longueur - TAILLE_ENTETE_TRAME;
+
+	// Temps processeur du thread : seul le travail de zlib est compté
+	struct timespec avant;
+	struct timespec apres;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &avant);
+	Message *compresse = NULL;
+	if (((type == TRAME_TEXTE && message->classe == CLASSE_VRAC) || type == TRAME_HISTORIQUE) && longueur >= SEUIL_COMPRESSION)
+	{
+		compresse = compresser(compression, message, charge, longueur);
+	}
+	else if (longueur > 0)
+	{
+		deflateSetDictionary(&compression->flux, charge, longueur);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &apres);
+	metriqueIncrementer(CPT_COMPRESSION_MICROSECONDES,
+						(apres.tv_sec - avant.tv_sec) * 1000000 + (apres.tv_nsec - avant.tv_nsec) / 1000);
+	return compresse;
+}
@@ -0,0 +1,34 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "sortie.h"
+
+/**
+ * Compression des trames sortantes d'un client qui l'a négociée : un flux
+ * deflate brut par connexion, alimenté dans l'ordre exact d'envoi des trames
+ * (à leur engagement). Seules les trames texte volumineuses de la classe vrac
+ * (historique, résultats de recherche) sont compressées ; les autres trames
+ * texte et les trames message entrent seulement dans la fenêtre du flux,
+ * comme dictionnaire, ce que le client reproduit de son côté.
+ */
+
+/**
+ * - SEUIL_COMPRESSION = taille minimum de la charge d'une trame compressée
+ * - NIVEAU_COMPRESSION = niveau deflate (1 rapide à 9 compact)
+ * - BITS_FENETRE = log2 de la fenêtre deflate, en négatif pour un flux brut
+ * - NIVEAU_MEMOIRE = mémoire de l'état deflate (1 à 9)
+ * - MEMOIRE_COMPRESSION = mémoire d'un flux deflate, imputée à la connexion (formule de zconf.h)
+ */
+#define SEUIL_COMPRESSION 256
+#define NIVEAU_COMPRESSION 6
+#define BITS_FENETRE (-15)
+#define NIVEAU_MEMOIRE 8
+#define MEMOIRE_COMPRESSION ((1 << (2 - BITS_FENETRE)) + (1 << (NIVEAU_MEMOIRE + 9)) + 6 * 1024)
+
+typedef struct Compression Compression;
+
+Compression *compressionCreer(void);
+void compressionLiberer(Compression *compression);
+Message *compressionTraiter(Compression *compression, Message *message);
+
+#endif
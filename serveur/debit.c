@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#include "serveur.h"
+#include "debit.h"
+#include "metriques.h"
+#include "journal.h"
+
+/**
+ * - RAFALE = une rafale vaut RAFALE secondes de débit
+ * - ATTENTE_MAX = attente maximum (µs) imposée à un expéditeur avant de rejeter son message
+ * - TAILLE_PAGE_SALONS = nombre de seaux de salon alloués d'un coup
+ * - NB_VERROUS_SALONS = nombre de verrous se partageant les seaux de salon
+ */
+#define RAFALE 4
+#define ATTENTE_MAX 2000000
+#define TAILLE_PAGE_SALONS 4096
+#define NB_VERROUS_SALONS 64
+
+/**
+ * - debitConnexion = octets par seconde accordés à chaque client
+ * - debitSalon = octets par seconde accordés à chaque salon, tous expéditeurs confondus
+ * - pagesSalons = seaux des salons, par pages allouées à la demande qui ne sont jamais
+ *   déplacées (tabSalon, lui, peut être réalloué)
+ * - verrousSalons = verrous des seaux de salon, choisis selon l'identifiant du salon
+ */
+static int64_t debitConnexion = 32 * 1024;
+static int64_t debitSalon = 256 * 1024;
+static _Atomic(SeauJetons *) pagesSalons[MAX_SALON / TAILLE_PAGE_SALONS];
+static pthread_mutex_t verrousSalons[NB_VERROUS_SALONS];
+static pthread_once_t initialisation = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Remplit un seau selon le temps écoulé. L'appelant garantit l'exclusion
+ * mutuelle sur le seau ; il peut le débiter directement, quitte à le rendre négatif.
+ *
+ * @param seau seau à remplir
+ * @param debit jetons ajoutés par seconde
+ * @param rafale contenance maximum du seau
+ * @param maintenant instant courant en µs
+ * @return les jetons disponibles.
+ */
+int64_t seauRemplir(SeauJetons *seau, int64_t debit, int64_t rafale, uint64_t maintenant)
+{
+	if (seau->dernier == 0)
+	{
+		seau->jetons = rafale;
+	}
+	else if (maintenant > seau->dernier)
+	{
+		seau->jetons += (int64_t)((maintenant - seau->dernier) * debit / 1000000);
+		if (seau->jetons > rafale)
+		{
+			seau->jetons = rafale;
+		}
+	}
+	seau->dernier = maintenant;
+	return seau->jetons;
+}
+
+/**
+ * @brief Remplit un seau selon le temps écoulé puis prélève le coût s'il est couvert.
+ * L'appelant garantit l'exclusion mutuelle sur le seau.
+ *
+ * @param seau seau à débiter
+ * @param debit jetons ajoutés par seconde
+ * @param rafale contenance maximum du seau
+ * @param cout jetons demandés
+ * @param maintenant instant courant en µs
+ * @return 0 si les jetons ont été prélevés, sinon l'attente (µs) avant qu'ils
+ *         soient disponibles ; -1 si le coût dépasse la contenance du seau.
+ */
+int64_t seauPrelever(SeauJetons *seau, int64_t debit, int64_t rafale, int64_t cout, uint64_t maintenant)
+{
+	if (cout > rafale)
+	{
+		return -1;
+	}
+	if (seauRemplir(seau, debit, rafale, maintenant) >= cout)
+	{
+		seau->jetons -= cout;
+		return 0;
+	}
+	return (cout - seau->jetons) * 1000000 / debit + 1;
+}
+
+/**
+ * @brief Rend des jetons prélevés pour un envoi finalement abandonné.
+ *
+ * @param seau seau à recréditer
+ * @param cout jetons rendus
+ */
+void seauRendre(SeauJetons *seau, int64_t cout)
+{
+	seau->jetons += cout;
+}
+
+/**
+ * @brief Initialise les verrous des seaux de salon.
+ */
+static void initialiser(void)
+{
+	for (int i = 0; i < NB_VERROUS_SALONS; i++)
+	{
+		pthread_mutex_init(&verrousSalons[i], NULL);
+	}
+}
+
+/**
+ * @brief Fixe les débits accordés ; 0 conserve la valeur par défaut.
+ *
+ * @param parConnexion octets par seconde pour chaque client
+ * @param parSalon octets par seconde pour chaque salon
+ */
+void debitConfigurer(int64_t parConnexion, int64_t parSalon)
+{
+	if (parConnexion > 0)
+	{
+		debitConnexion = parConnexion;
+	}
+	if (parSalon > 0)
+	{
+		debitSalon = parSalon;
+	}
+}
+
+/**
+ * @brief Donne le seau d'un salon, en allouant sa page au premier usage.
+ *
+ * @param idSalon identifiant du salon
+ * @return le seau du salon, NULL si la mémoire manque.
+ */
+static SeauJetons *seauSalon(int idSalon)
+{
+	_Atomic(SeauJetons *) *page = &pagesSalons[idSalon / TAILLE_PAGE_SALONS];
+	SeauJetons *seaux = atomic_load(page);
+	if (seaux == NULL)
+	{
+		SeauJetons *nouvelle = calloc(TAILLE_PAGE_SALONS, sizeof(SeauJetons));
+		if (nouvelle == NULL)
+		{
+			return NULL;
+		}
+		if (!atomic_compare_exchange_strong(page, &seaux, nouvelle))
+		{
+			// Un autre thread a alloué la page entre-temps
+			free(nouvelle);
+		}
+		else
+		{
+			seaux = nouvelle;
+		}
+	}
+	return &seaux[idSalon % TAILLE_PAGE_SALONS];
+}
+
+/**
+ * @brief Rappel de minuterie réveillant un expéditeur ralenti.
+ *
+ * @param clientParam numéro du client ralenti
+ * @return 0, la minuterie n'est pas réarmée.
+ */
+static unsigned int reveillerExpediteur(void *clientParam)
+{
+	Client *client = &tabClient[(long)clientParam];
+	pthread_mutex_lock(&client->mutexEnvoi);
+	client->estReveille = 1;
+	pthread_cond_signal(&client->condDebit);
+	pthread_mutex_unlock(&client->mutexEnvoi);
+	return 0;
+}
+
+/**
+ * @brief Met le thread d'un expéditeur en attente ; la roue de minuteries le réveille.
+ * La roue est suspendue pendant un redémarrage à chaud : une échéance de secours
+ * (ATTENTE_MAX) évite alors de bloquer la mise en pause du thread.
+ *
+ * @param numClient numéro du client ralenti
+ * @param attente durée en µs
+ */
+static void ralentir(int numClient, int64_t attente)
+{
+	Client *client = &tabClient[numClient];
+	struct timespec secours;
+	clock_gettime(CLOCK_MONOTONIC, &secours);
+	secours.tv_sec += ATTENTE_MAX / 1000000 + 1;
+
+	// Le rappel prend mutexEnvoi sous le verrou de la roue : on arme hors de mutexEnvoi
+	pthread_mutex_lock(&client->mutexEnvoi);
+	client->estReveille = 0;
+	pthread_mutex_unlock(&client->mutexEnvoi);
+	minuterieArmer(&client->minuterieDebit, (attente + 999) / 1000, reveillerExpediteur, (void *)(long)numClient);
+
+	pthread_mutex_lock(&client->mutexEnvoi);
+	while (!client->estReveille)
+	{
+		if (pthread_cond_timedwait(&client->condDebit, &client->mutexEnvoi, &secours) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&client->mutexEnvoi);
+	minuterieAnnuler(&client->minuterieDebit);
+}
+
+/**
+ * @brief Fait payer à un expéditeur le coût d'une diffusion, sur son seau et
+ * sur celui du salon. Si les jetons manquent, l'expéditeur attend au plus
+ * ATTENTE_MAX ; au-delà, le message doit être rejeté.
+ *
+ * @param numClient numéro de l'expéditeur
+ * @param idSalon salon de diffusion
+ * @param cout octets qui seront envoyés, tous destinataires confondus
+ * @return 0 si l'envoi est autorisé, -1 s'il doit être rejeté.
+ */
+int limiterDebit(int numClient, int idSalon, int64_t cout)
+{
+	pthread_once(&initialisation, initialiser);
+	SeauJetons *seauDuSalon = seauSalon(idSalon);
+	int estRalenti = 0;
+
+	while (1)
+	{
+		uint64_t maintenant = metriqueHorloge();
+
+		// Le seau du client n'est utilisé que par son propre thread
+		int64_t attente = seauPrelever(&tabClient[numClient].seauDebit, debitConnexion, debitConnexion * RAFALE, cout, maintenant);
+		if (attente == 0 && seauDuSalon != NULL)
+		{
+			pthread_mutex_t *verrou = &verrousSalons[idSalon % NB_VERROUS_SALONS];
+			pthread_mutex_lock(verrou);
+			attente = seauPrelever(seauDuSalon, debitSalon, debitSalon * RAFALE, cout, maintenant);
+			pthread_mutex_unlock(verrou);
+			if (attente != 0)
+			{
+				seauRendre(&tabClient[numClient].seauDebit, cout);
+			}
+		}
+		if (attente == 0)
+		{
+			return 0;
+		}
+
+		if (attente < 0 || attente > ATTENTE_MAX || estRalenti)
+		{
+			metriqueIncrementer(CPT_DEBIT_REJETS, 1);
+			journalEchantillonne(JOURNAL_AVERTISSEMENT, EVT_DEBIT, numClient, idSalon, cout, "rejet");
+			return -1;
+		}
+		metriqueIncrementer(CPT_DEBIT_RALENTIS, 1);
+		journalEchantillonne(JOURNAL_INFO, EVT_DEBIT, numClient, idSalon, cout, "ralenti");
+		ralentir(numClient, attente);
+		estRalenti = 1;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef DEBIT_H
+#define DEBIT_H
+
+#include <stdint.h>
+
+/**
+ * Limitation de débit par seaux à jetons, comptés en octets. Un expéditeur
+ * paie le coût réel de sa diffusion : nombre de destinataires × taille de la
+ * trame. Son seau et celui du salon doivent tous deux couvrir ce coût ; sinon
+ * l'expéditeur est ralenti, puis son message est rejeté. Les autres clients
+ * n'attendent jamais.
+ */
+
+/**
+ * @brief Seau à jetons. Un seau remis à zéro est plein à sa première utilisation.
+ *
+ * @param jetons octets disponibles
+ * @param dernier instant (µs) du dernier remplissage, 0 si jamais utilisé
+ */
+typedef struct SeauJetons SeauJetons;
+struct SeauJetons
+{
+	int64_t jetons;
+	uint64_t dernier;
+};
+
+int64_t seauRemplir(SeauJetons *seau, int64_t debit, int64_t rafale, uint64_t maintenant);
+int64_t seauPrelever(SeauJetons *seau, int64_t debit, int64_t rafale, int64_t cout, uint64_t maintenant);
+void seauRendre(SeauJetons *seau, int64_t cout);
+void debitConfigurer(int64_t parConnexion, int64_t parSalon);
+int limiterDebit(int numClient, int idSalon, int64_t cout);
+
+#endif
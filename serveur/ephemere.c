@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ephemere.h"
+#include "serveur.h"
+#include "metriques.h"
+#include "minuterie.h"
+
+/**
+ * @brief Dernier état publié par un client pour un type d'événement.
+ *
+ * @param estModifie 1 si l'état attend le prochain tick
+ * @param idSalon salon de l'expéditeur à la publication
+ * @param idPseudo identité de l'expéditeur
+ * @param valeur valeur de l'événement
+ */
+typedef struct EtatEphemere EtatEphemere;
+struct EtatEphemere
+{
+	int estModifie;
+	int idSalon;
+	int idPseudo;
+	uint32_t valeur;
+};
+
+/**
+ * - etats = dernier état de chaque client, par type d'événement
+ * - estPlanifie = 1 si la minuterie du prochain tick est armée
+ * - minuterieTick = minuterie du prochain tick, armée seulement quand un état attend
+ * - mutexEphemere = protège etats et estPlanifie
+ */
+static EtatEphemere etats[MAX_CLIENT][NB_TYPES_EPHEMERES];
+static int estPlanifie = 0;
+static Minuterie minuterieTick;
+static pthread_mutex_t mutexEphemere = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Envoie un état aux autres clients de son salon qui reçoivent les
+ * événements éphémères. Un client qui ne connaît pas encore l'expéditeur, ou
+ * dont la file n'est pas presque vide, ne le reçoit pas.
+ *
+ * @param numExpediteur client qui a publié l'état
+ * @param type type de l'événement
+ * @param etat état à diffuser
+ */
+static void diffuser(int numExpediteur, uint8_t type, const EtatEphemere *etat)
+{
+	uint8_t charge[TAILLE_EPHEMERE] = {etat->idPseudo >> 8, etat->idPseudo & 0xff, type,
+									   etat->valeur >> 24, (etat->valeur >> 16) & 0xff, (etat->valeur >> 8) & 0xff, etat->valeur & 0xff};
+	Message *message = NULL;
+	uint64_t bit = 1ULL << (etat->idPseudo % 64);
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		if (!tabClient[i].estOccupe || i == numExpediteur || tabClient[i].idSalon != etat->idSalon ||
+			!tabClient[i].recoitEphemeres || !(atomic_load(&tabClient[i].identitesConnues[etat->idPseudo / 64]) & bit))
+		{
+			continue;
+		}
+		if (message == NULL && (message = messageCreer(TRAME_EPHEMERE, 0, charge, sizeof(charge))) == NULL)
+		{
+			return;
+		}
+		metriqueIncrementer(fileEnfiler(i, message) == 0 ? CPT_EPHEMERES_ENVOYES : CPT_EPHEMERES_PERDUS, 1);
+	}
+	messageLiberer(message);
+}
+
+/**
+ * @brief Tick des événements éphémères, appelé par la roue de minuteries :
+ * diffuse les états publiés depuis le tick précédent.
+ *
+ * @return 0, la minuterie n'est réarmée qu'à la prochaine publication.
+ */
+static unsigned int tick(void *arg)
+{
+	(void)arg;
+	EtatEphemere aDiffuser[MAX_CLIENT][NB_TYPES_EPHEMERES];
+	pthread_mutex_lock(&mutexEphemere);
+	memcpy(aDiffuser, etats, sizeof(etats));
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		for (int t = 0; t < NB_TYPES_EPHEMERES; t++)
+		{
+			etats[i][t].estModifie = 0;
+		}
+	}
+	estPlanifie = 0;
+	pthread_mutex_unlock(&mutexEphemere);
+
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		for (int t = 0; t < NB_TYPES_EPHEMERES; t++)
+		{
+			if (aDiffuser[i][t].estModifie)
+			{
+				diffuser(i, t + 1, &aDiffuser[i][t]);
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Publie l'état d'un client pour un type d'événement. Il remplace
+ * l'état publié depuis le dernier tick, s'il y en a un.
+ *
+ * @param numClient client qui publie
+ * @param type type de l'événement (TypeEphemere)
+ * @param valeur valeur de l'événement
+ */
+void ephemerePublier(int numClient, uint8_t type, uint32_t valeur)
+{
+	if (type < 1 || type > NB_TYPES_EPHEMERES || tabClient[numClient].idPseudo < 0)
+	{
+		return;
+	}
+	metriqueIncrementer(CPT_EPHEMERES_RECUS, 1);
+
+	pthread_mutex_lock(&mutexEphemere);
+	EtatEphemere *etat = &etats[numClient][type - 1];
+	if (etat->estModifie)
+	{
+		metriqueIncrementer(CPT_EPHEMERES_FUSIONNES, 1);
+	}
+	etat->estModifie = 1;
+	etat->idSalon = tabClient[numClient].idSalon;
+	etat->idPseudo = tabClient[numClient].idPseudo;
+	etat->valeur = valeur;
+	int estAPlanifier = !estPlanifie;
+	estPlanifie = 1;
+	pthread_mutex_unlock(&mutexEphemere);
+
+	// Le tick prend mutexEphemere sous le verrou de la roue : on arme hors de mutexEphemere
+	if (estAPlanifier)
+	{
+		minuterieArmer(&minuterieTick, TICK_EPHEMERES, tick, NULL);
+	}
+}
+
+/**
+ * @brief Oublie les états en attente d'un client qui quitte le serveur.
+ *
+ * @param numClient client qui part
+ */
+void ephemereOublier(int numClient)
+{
+	pthread_mutex_lock(&mutexEphemere);
+	for (int t = 0; t < NB_TYPES_EPHEMERES; t++)
+	{
+		etats[numClient][t].estModifie = 0;
+	}
+	pthread_mutex_unlock(&mutexEphemere);
+}
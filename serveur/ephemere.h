@@ -0,0 +1,26 @@
+#ifndef EPHEMERE_H
+#define EPHEMERE_H
+
+#include <stdint.h>
+
+/**
+ * Événements éphémères (saisie en cours, marques de lecture) : ni journalisés,
+ * ni conservés dans l'historique, ni relayés aux autres nœuds. Un client garde
+ * au plus un état par type d'événement ; un tick le diffuse à son salon, et un
+ * état publié avant le tick remplace le précédent. Les trames ont leur propre
+ * classe de trafic et n'entrent que dans les files presque vides.
+ */
+
+/**
+ * - TICK_EPHEMERES = délai (ms) entre la première publication d'un état et sa diffusion
+ * - NB_TYPES_EPHEMERES = nombre de types d'événements (TypeEphemere, à partir de 1)
+ * - TAILLE_EPHEMERE = taille de la charge d'une trame TRAME_EPHEMERE du serveur
+ */
+#define TICK_EPHEMERES 100
+#define NB_TYPES_EPHEMERES 2
+#define TAILLE_EPHEMERE 7
+
+void ephemerePublier(int numClient, uint8_t type, uint32_t valeur);
+void ephemereOublier(int numClient);
+
+#endif
@@ -0,0 +1,1273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#include "serveur.h"
+#include "federation.h"
+#include "historique.h"
+#include "journal.h"
+#include "metriques.h"
+#include "persistance.h"
+#include "relais.h"
+
+/**
+ * - TAILLE_ENTETE_ENREGISTREMENT = type (1 octet) et longueur (2 octets) d'un enregistrement
+ * - TAILLE_TEXTE = taille maximum du texte d'une diffusion (pseudo, séparateur et message)
+ * - TAILLE_ENREGISTREMENT = taille maximum de la charge d'un enregistrement
+ * - AUCUN_LOT = valeur de debutLot quand aucun lot n'est ouvert
+ * - DELAI_BONJOUR = secondes accordées à un pair pour répondre pendant l'ouverture d'un lien
+ * - TAILLE_DEFI = octets aléatoires du défi envoyé à un pair entrant
+ * - TAILLE_SCEAU = taille du sceau HMAC-SHA256 qui répond au défi
+ * - TAILLE_SECRET = taille maximum du secret partagé de la fédération
+ */
+#define TAILLE_ENTETE_ENREGISTREMENT 3
+#define TAILLE_TEXTE (TAILLE_PSEUDO + 4 + TAILLE_MESSAGE)
+#define TAILLE_ENREGISTREMENT (2 * 256 + 2 + TAILLE_TEXTE + 1)
+#define AUCUN_LOT ((size_t)-1)
+#define DELAI_BONJOUR 5
+#define TAILLE_DEFI 32
+#define TAILLE_SCEAU 32
+#define TAILLE_SECRET 128
+
+/**
+ * @brief Types des enregistrements regroupés dans une trame TRAME_LOT.
+ *
+ * - ENR_BONJOUR = nom du nœud qui ouvre le lien, puis le sceau du défi reçu et de ce nom par le
+ *   secret partagé ; réponse à ENR_DEFI
+ * - ENR_PRESENCE = état d'un emplacement client du nœud émetteur (pseudo, salon)
+ * - ENR_DIFFUSION = message d'un salon, adressé à son nœud d'attache
+ * - ENR_LIVRAISON = message d'un salon, relayé par son nœud d'attache
+ * - ENR_DEFI = défi aléatoire (TAILLE_DEFI octets), premier enregistrement envoyé par le nœud qui accepte un lien
+ *
+ * Un message est fait du salon, de l'expéditeur, du texte, puis des drapeaux du
+ * fragment (DRAPEAU_SUITE), absents pour un nœud qui ne les connaît pas.
+ */
+enum TypeEnregistrement
+{
+	ENR_BONJOUR = 1,
+	ENR_PRESENCE = 2,
+	ENR_DIFFUSION = 3,
+	ENR_LIVRAISON = 4,
+	ENR_DEFI = 5
+};
+
+/**
+ * @brief Utilisateur connecté sur un autre nœud, indexé par son emplacement sur ce nœud.
+ *
+ * @param estPresent 1 si l'emplacement est occupé par un utilisateur nommé
+ * @param pseudo pseudo de l'utilisateur
+ * @param salon nom du salon de l'utilisateur
+ */
+typedef struct PresenceDistante PresenceDistante;
+struct PresenceDistante
+{
+	int estPresent;
+	char pseudo[TAILLE_PSEUDO];
+	char salon[TAILLE_NOM_SALON];
+};
+
+/**
+ * @brief Nœud de la fédération, tel que vu par le nœud local.
+ *
+ * @param nom nom du nœud, identique dans le fichier de fédération de tous les nœuds
+ * @param adresse adresse du port de fédération du nœud
+ * @param dS socket du lien vers le nœud, -1 s'il n'est pas relié
+ * @param generation incrémentée à chaque nouveau lien
+ * @param mutex protège dS, generation et les lots en attente
+ * @param mutexEcriture tenu pendant un envoi ; la socket n'est fermée que sous ce verrou
+ * @param cond signalée quand des lots sont en attente
+ * @param tampon lots en attente d'envoi, trames TRAME_LOT mises bout à bout
+ * @param rempli octets présents dans tampon
+ * @param debutLot position de l'en-tête du lot ouvert, AUCUN_LOT sinon
+ * @param presence utilisateurs du nœud, protégés par mutexPresence
+ */
+typedef struct Noeud Noeud;
+struct Noeud
+{
+	char nom[TAILLE_NOM_NOEUD];
+	struct sockaddr_in adresse;
+	int dS;
+	unsigned int generation;
+	pthread_mutex_t mutex;
+	pthread_mutex_t mutexEcriture;
+	pthread_cond_t cond;
+	uint8_t *tampon;
+	size_t rempli;
+	size_t debutLot;
+	PresenceDistante presence[MAX_CLIENT];
+};
+
+/**
+ * @brief Point de l'anneau de hachage cohérent.
+ *
+ * @param position position sur l'anneau
+ * @param noeud indice du nœud dans noeuds
+ */
+typedef struct PointAnneau PointAnneau;
+struct PointAnneau
+{
+	uint32_t position;
+	int noeud;
+};
+
+/**
+ * @brief Curseur de lecture dans un enregistrement reçu.
+ */
+typedef struct Lecture Lecture;
+struct Lecture
+{
+	const uint8_t *octets;
+	size_t reste;
+};
+
+/**
+ * - noeuds = nœuds de la fédération, dans l'ordre du fichier, nœud local compris
+ * - nbNoeuds = nombre de nœuds ; la fédération est inactive en dessous de 2
+ * - noeudLocal = indice du nœud local dans noeuds
+ * - anneau = points de tous les nœuds, triés par position
+ * - nbPoints = nombre de points de l'anneau
+ * - mutexPresence = protège la présence distante de tous les nœuds
+ * - mutexLivraison = tenu pendant le traitement d'un lot reçu, pour la barrière du relais
+ * - secret = secret partagé de la fédération, qui authentifie les liens entrants
+ * - longueurSecret = taille du secret
+ */
+static Noeud noeuds[MAX_NOEUDS];
+static int nbNoeuds = 0;
+static int noeudLocal = -1;
+static PointAnneau anneau[MAX_NOEUDS * POINTS_PAR_NOEUD];
+static int nbPoints = 0;
+static pthread_mutex_t mutexPresence = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mutexLivraison = PTHREAD_MUTEX_INITIALIZER;
+static char secret[TAILLE_SECRET];
+static size_t longueurSecret = 0;
+
+/**
+ * @brief Indique si le serveur fait partie d'une fédération.
+ *
+ * @return 1 si au moins un autre nœud est configuré, 0 sinon.
+ */
+int federationActive(void)
+{
+	return nbNoeuds > 1;
+}
+
+/**
+ * @brief Position d'un texte sur l'anneau. L'empreinte FNV seule répartit
+ * mal des noms proches : elle est brassée avant usage.
+ */
+static uint32_t hacher(const char *texte)
+{
+	uint32_t position = journalEmpreinte(texte, strlen(texte));
+	position ^= position >> 16;
+	position *= 0x85ebca6bu;
+	position ^= position >> 13;
+	position *= 0xc2b2ae35u;
+	position ^= position >> 16;
+	return position;
+}
+
+static int comparerPoints(const void *a, const void *b)
+{
+	uint32_t positionA = ((const PointAnneau *)a)->position;
+	uint32_t positionB = ((const PointAnneau *)b)->position;
+	return (positionA > positionB) - (positionA < positionB);
+}
+
+/**
+ * @brief Indique si un nœud distant est relié au nœud local.
+ */
+static int estRelie(int indice)
+{
+	pthread_mutex_lock(&noeuds[indice].mutex);
+	int relie = noeuds[indice].dS >= 0;
+	pthread_mutex_unlock(&noeuds[indice].mutex);
+	return relie;
+}
+
+/**
+ * @brief Choisit le nœud d'attache d'un salon : le premier point de l'anneau
+ * qui suit le nom du salon. Un nœud injoignable est sauté, ce qui ne déplace
+ * que les salons dont il était l'attache.
+ *
+ * @param salon nom du salon
+ * @return l'indice du nœud d'attache.
+ */
+static int noeudAttache(const char *salon)
+{
+	uint32_t position = hacher(salon);
+	int bas = 0;
+	int haut = nbPoints;
+	while (bas < haut)
+	{
+		int milieu = (bas + haut) / 2;
+		if (anneau[milieu].position < position)
+		{
+			bas = milieu + 1;
+		}
+		else
+		{
+			haut = milieu;
+		}
+	}
+	for (int i = 0; i < nbPoints; i++)
+	{
+		int noeud = anneau[(bas + i) % nbPoints].noeud;
+		if (noeud == noeudLocal || estRelie(noeud))
+		{
+			return noeud;
+		}
+	}
+	return noeudLocal;
+}
+
+/**
+ * @brief Copie le nom d'un salon local.
+ *
+ * @param idSalon identifiant local du salon
+ * @param dest tampon d'au moins TAILLE_NOM_SALON octets
+ */
+static void copierNomSalon(int idSalon, char *dest)
+{
+	pthread_mutex_lock(&mutexSalon);
+	snprintf(dest, TAILLE_NOM_SALON, "%s", idSalon >= 0 && idSalon < nbSalon ? tabSalon[idSalon].nom : "");
+	pthread_mutex_unlock(&mutexSalon);
+}
+
+/**
+ * @brief Ajoute une chaîne précédée de sa longueur sur un octet.
+ *
+ * @return la position qui suit la chaîne.
+ */
+static size_t ajouterChaine(uint8_t *charge, size_t position, const char *texte)
+{
+	size_t longueur = strnlen(texte, 255);
+	charge[position] = longueur;
+	memcpy(charge + position + 1, texte, longueur);
+	return position + 1 + longueur;
+}
+
+/**
+ * @brief Ajoute un texte précédé de sa longueur sur deux octets, tronqué à TAILLE_TEXTE.
+ *
+ * @return la position qui suit le texte.
+ */
+static size_t ajouterTexte(uint8_t *charge, size_t position, const char *texte)
+{
+	size_t longueur = strnlen(texte, TAILLE_TEXTE);
+	charge[position] = longueur >> 8;
+	charge[position + 1] = longueur & 0xff;
+	memcpy(charge + position + 2, texte, longueur);
+	return position + 2 + longueur;
+}
+
+static int lireOctet(Lecture *lecture, uint8_t *valeur)
+{
+	if (lecture->reste < 1)
+	{
+		return -1;
+	}
+	*valeur = lecture->octets[0];
+	lecture->octets++;
+	lecture->reste--;
+	return 0;
+}
+
+/**
+ * @brief Lit une chaîne de longueur connue et la termine par '\0'.
+ *
+ * @return 0 si tout se passe bien, -1 si l'enregistrement est mal formé.
+ */
+static int lireOctets(Lecture *lecture, size_t longueur, char *dest, size_t taille)
+{
+	if (lecture->reste < longueur || longueur >= taille)
+	{
+		return -1;
+	}
+	memcpy(dest, lecture->octets, longueur);
+	dest[longueur] = '\0';
+	lecture->octets += longueur;
+	lecture->reste -= longueur;
+	return 0;
+}
+
+static int lireChaine(Lecture *lecture, char *dest, size_t taille)
+{
+	uint8_t longueur;
+	if (lireOctet(lecture, &longueur) != 0)
+	{
+		return -1;
+	}
+	return lireOctets(lecture, longueur, dest, taille);
+}
+
+static int lireTexte(Lecture *lecture, char *dest, size_t taille)
+{
+	uint8_t fort, faible;
+	if (lireOctet(lecture, &fort) != 0 || lireOctet(lecture, &faible) != 0)
+	{
+		return -1;
+	}
+	return lireOctets(lecture, (fort << 8) | faible, dest, taille);
+}
+
+/**
+ * @brief Ajoute un enregistrement au lot ouvert vers un nœud, ou ouvre un
+ * nouveau lot quand il n'y a pas la place. Ne bloque jamais : le thread
+ * d'envoi du nœud emporte tout ce qui s'est accumulé en un seul envoi.
+ *
+ * @param indice nœud destinataire
+ * @param type type de l'enregistrement
+ * @param charge contenu de l'enregistrement
+ * @param longueur taille du contenu
+ * @return 0 si l'enregistrement est en attente, -1 si le nœud n'est pas relié
+ *         ou si ses lots en attente sont pleins.
+ */
+static int enfiler(int indice, uint8_t type, const uint8_t *charge, size_t longueur)
+{
+	Noeud *noeud = &noeuds[indice];
+	size_t taille = TAILLE_ENTETE_ENREGISTREMENT + longueur;
+
+	pthread_mutex_lock(&noeud->mutex);
+	if (noeud->dS < 0)
+	{
+		pthread_mutex_unlock(&noeud->mutex);
+		return -1;
+	}
+	int nouveauLot = noeud->debutLot == AUCUN_LOT ||
+					 noeud->rempli - noeud->debutLot - TAILLE_ENTETE_TRAME + taille > TAILLE_MAX_TRAME;
+	if (noeud->rempli + taille + (nouveauLot ? TAILLE_ENTETE_TRAME : 0) > TAILLE_TAMPON_PAIR)
+	{
+		// Un pair qui ne suit plus perd des enregistrements sans ralentir les clients
+		pthread_mutex_unlock(&noeud->mutex);
+		metriqueIncrementer(CPT_PERTES, 1);
+		return -1;
+	}
+	if (nouveauLot)
+	{
+		noeud->debutLot = noeud->rempli;
+		noeud->rempli += TAILLE_ENTETE_TRAME;
+	}
+	uint8_t *enregistrement = noeud->tampon + noeud->rempli;
+	enregistrement[0] = type;
+	enregistrement[1] = longueur >> 8;
+	enregistrement[2] = longueur & 0xff;
+	memcpy(enregistrement + TAILLE_ENTETE_ENREGISTREMENT, charge, longueur);
+	noeud->rempli += taille;
+	trameEcrireEntete(noeud->tampon + noeud->debutLot, TRAME_LOT, 0,
+					  noeud->rempli - noeud->debutLot - TAILLE_ENTETE_TRAME);
+	pthread_cond_signal(&noeud->cond);
+	pthread_mutex_unlock(&noeud->mutex);
+
+	metriqueIncrementer(CPT_FEDERATION_ENREGISTREMENTS, 1);
+	return 0;
+}
+
+/**
+ * @brief Encode l'état d'un emplacement client local. Appelée sous mutexTabClient.
+ *
+ * @return la taille de l'enregistrement.
+ */
+static size_t encoderPresence(int numClient, uint8_t *charge)
+{
+	Client *client = &tabClient[numClient];
+	int estPresent = client->estOccupe && client->pseudo != NULL && strcmp(client->pseudo, " ") != 0;
+	char salon[TAILLE_NOM_SALON] = "";
+	if (estPresent)
+	{
+		copierNomSalon(client->idSalon, salon);
+	}
+	charge[0] = numClient;
+	charge[1] = estPresent;
+	size_t position = ajouterChaine(charge, 2, estPresent ? client->pseudo : "");
+	return ajouterChaine(charge, position, salon);
+}
+
+/**
+ * @brief Enfile la présence d'un emplacement client pour tous les autres nœuds.
+ * Appelée sous mutexTabClient.
+ */
+static void repliquerPresence(int numClient)
+{
+	uint8_t charge[TAILLE_ENREGISTREMENT];
+	size_t longueur = encoderPresence(numClient, charge);
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		if (i != noeudLocal)
+		{
+			enfiler(i, ENR_PRESENCE, charge, longueur);
+		}
+	}
+}
+
+/**
+ * @brief Réplique sur tous les nœuds l'état d'un emplacement client : arrivée
+ * (pseudo choisi) ou changement de salon.
+ *
+ * @param numClient emplacement du client
+ */
+void federationAnnoncer(int numClient)
+{
+	if (!federationActive())
+	{
+		return;
+	}
+	// Sous mutexTabClient, pour ne pas croiser l'envoi de toute la présence à un nouveau lien
+	pthread_mutex_lock(&mutexTabClient);
+	repliquerPresence(numClient);
+	pthread_mutex_unlock(&mutexTabClient);
+}
+
+/**
+ * @brief Réplique le départ d'un client, sous mutexTabClient : l'emplacement
+ * vient d'être libéré et ne peut pas être réattribué avant l'annonce.
+ *
+ * @param numClient emplacement du client
+ */
+void federationAnnoncerDepart(int numClient)
+{
+	if (federationActive())
+	{
+		repliquerPresence(numClient);
+	}
+}
+
+/**
+ * @brief Envoie à un nœud qui vient d'être relié la présence de tous les clients locaux.
+ */
+static void annoncerTout(int indice)
+{
+	uint8_t charge[TAILLE_ENREGISTREMENT];
+	pthread_mutex_lock(&mutexTabClient);
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		if (tabClient[i].estOccupe)
+		{
+			enfiler(indice, ENR_PRESENCE, charge, encoderPresence(i, charge));
+		}
+	}
+	pthread_mutex_unlock(&mutexTabClient);
+}
+
+/**
+ * @brief Livre un message, ou un fragment de message, aux membres locaux d'un
+ * salon, sauf à son expéditeur.
+ */
+static void livrer(const char *salon, const char *expediteur, const char *texte, uint8_t drapeaux)
+{
+	int idSalon = chercherSalon(salon);
+	if (idSalon < 0)
+	{
+		// Aucun client local n'a jamais rejoint ce salon
+		return;
+	}
+	int idPseudo = identiteInterner(expediteur);
+	uint32_t idMessage = texte[0] != '\0' ? historiqueAjouter(idSalon, idPseudo, texte, strlen(texte)) : UINT32_MAX;
+	long numExpediteur = pseudoToInt((char *)expediteur);
+	envoiMessage(numExpediteur >= 0 ? tabClient[numExpediteur].dSC : -1, idSalon, idPseudo, expediteur, texte, drapeaux, idMessage);
+}
+
+/**
+ * @brief Traite un message en tant que nœud d'attache de son salon : livraison
+ * locale, puis relais à chaque nœud où le salon a des membres. Tous les
+ * messages d'un salon passant par son attache, tous les nœuds les voient dans le même ordre.
+ */
+static void relayer(const char *salon, const char *expediteur, const char *texte, uint8_t drapeaux)
+{
+	livrer(salon, expediteur, texte, drapeaux);
+
+	uint8_t charge[TAILLE_ENREGISTREMENT];
+	size_t position = ajouterChaine(charge, 0, salon);
+	position = ajouterChaine(charge, position, expediteur);
+	position = ajouterTexte(charge, position, texte);
+	charge[position++] = drapeaux;
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		if (i == noeudLocal)
+		{
+			continue;
+		}
+		int aDesMembres = 0;
+		pthread_mutex_lock(&mutexPresence);
+		for (int j = 0; j < MAX_CLIENT && !aDesMembres; j++)
+		{
+			aDesMembres = noeuds[i].presence[j].estPresent && strcmp(noeuds[i].presence[j].salon, salon) == 0;
+		}
+		pthread_mutex_unlock(&mutexPresence);
+		if (aDesMembres)
+		{
+			enfiler(i, ENR_LIVRAISON, charge, position);
+		}
+	}
+}
+
+/**
+ * @brief Diffuse le message d'un client dans son salon, sur toute la fédération.
+ * Sans fédération, c'est une simple diffusion locale.
+ *
+ * @param numClient expéditeur du message
+ * @param msg texte à diffuser, sans le pseudo de l'expéditeur
+ * @param drapeaux DRAPEAU_SUITE si ce n'est pas le dernier fragment du message, 0 sinon
+ */
+void federationDiffuser(int numClient, const char *msg, uint8_t drapeaux)
+{
+	if (!federationActive())
+	{
+		uint32_t idMessage = msg[0] != '\0' ? historiqueAjouter(tabClient[numClient].idSalon, tabClient[numClient].idPseudo, msg, strlen(msg))
+										  : UINT32_MAX;
+		envoiMessage(tabClient[numClient].dSC, tabClient[numClient].idSalon, tabClient[numClient].idPseudo,
+					 tabClient[numClient].pseudo, msg, drapeaux, idMessage);
+		return;
+	}
+
+	char salon[TAILLE_NOM_SALON];
+	copierNomSalon(tabClient[numClient].idSalon, salon);
+	int attache = noeudAttache(salon);
+	if (attache != noeudLocal)
+	{
+		uint8_t charge[TAILLE_ENREGISTREMENT];
+		size_t position = ajouterChaine(charge, 0, salon);
+		position = ajouterChaine(charge, position, tabClient[numClient].pseudo);
+		position = ajouterTexte(charge, position, msg);
+		charge[position++] = drapeaux;
+		if (enfiler(attache, ENR_DIFFUSION, charge, position) == 0 || estRelie(attache))
+		{
+			return;
+		}
+		// Lien perdu entre-temps : le nœud local fait office d'attache
+	}
+	relayer(salon, tabClient[numClient].pseudo, msg, drapeaux);
+}
+
+/**
+ * @brief Compte les membres d'un salon connectés sur les autres nœuds.
+ *
+ * @param idSalon identifiant local du salon
+ * @return le nombre de membres distants.
+ */
+int federationNbDestinataires(int idSalon)
+{
+	if (!federationActive())
+	{
+		return 0;
+	}
+	char salon[TAILLE_NOM_SALON];
+	copierNomSalon(idSalon, salon);
+	int nombre = 0;
+	pthread_mutex_lock(&mutexPresence);
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		for (int j = 0; j < MAX_CLIENT; j++)
+		{
+			if (noeuds[i].presence[j].estPresent && strcmp(noeuds[i].presence[j].salon, salon) == 0)
+			{
+				nombre++;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutexPresence);
+	return nombre;
+}
+
+/**
+ * @brief Indique si un pseudo est utilisé sur un autre nœud.
+ *
+ * @param pseudo pseudo à chercher
+ * @return 1 si le pseudo est connecté ailleurs, 0 sinon.
+ */
+int federationPseudoDistant(const char *pseudo)
+{
+	int trouve = 0;
+	pthread_mutex_lock(&mutexPresence);
+	for (int i = 0; i < nbNoeuds && !trouve; i++)
+	{
+		for (int j = 0; j < MAX_CLIENT && !trouve; j++)
+		{
+			trouve = noeuds[i].presence[j].estPresent && strcmp(noeuds[i].presence[j].pseudo, pseudo) == 0;
+		}
+	}
+	pthread_mutex_unlock(&mutexPresence);
+	return trouve;
+}
+
+/**
+ * @brief Liste les utilisateurs connectés sur les autres nœuds, une ligne par utilisateur.
+ *
+ * @param dest tampon de sortie, terminé par '\0'
+ * @param taille taille du tampon
+ * @return le nombre d'octets écrits.
+ */
+size_t federationEnLigne(char *dest, size_t taille)
+{
+	size_t ecrit = 0;
+	dest[0] = '\0';
+	pthread_mutex_lock(&mutexPresence);
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		for (int j = 0; j < MAX_CLIENT && ecrit < taille; j++)
+		{
+			if (noeuds[i].presence[j].estPresent)
+			{
+				int n = snprintf(dest + ecrit, taille - ecrit, "%s est en ligne (%s)\n",
+								 noeuds[i].presence[j].pseudo, noeuds[i].nom);
+				ecrit = n > 0 && ecrit + n < taille ? ecrit + n : taille - 1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutexPresence);
+	return ecrit;
+}
+
+/**
+ * @brief Jauge du nombre de nœuds reliés au nœud local.
+ *
+ * @return le nombre de pairs reliés.
+ */
+long jaugePairsConnectes()
+{
+	long nombre = 0;
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		if (i != noeudLocal && estRelie(i))
+		{
+			nombre++;
+		}
+	}
+	return nombre;
+}
+
+/**
+ * @brief Traite les enregistrements d'un lot reçu d'un nœud.
+ * Les livraisons attendent la fin d'un redémarrage à chaud en cours.
+ */
+static void traiterLot(int indice, const uint8_t *lot, size_t longueur)
+{
+	struct timespec pause = {0, 10 * 1000000L};
+	pthread_mutex_lock(&mutexLivraison);
+	while (relaisEnCours())
+	{
+		pthread_mutex_unlock(&mutexLivraison);
+		nanosleep(&pause, NULL);
+		pthread_mutex_lock(&mutexLivraison);
+	}
+
+	size_t position = 0;
+	while (position + TAILLE_ENTETE_ENREGISTREMENT <= longueur)
+	{
+		uint8_t type = lot[position];
+		size_t taille = (lot[position + 1] << 8) | lot[position + 2];
+		position += TAILLE_ENTETE_ENREGISTREMENT;
+		if (position + taille > longueur)
+		{
+			break;
+		}
+		Lecture lecture = {lot + position, taille};
+		position += taille;
+
+		if (type == ENR_PRESENCE)
+		{
+			uint8_t numClient, estPresent;
+			PresenceDistante presence;
+			if (lireOctet(&lecture, &numClient) == 0 && lireOctet(&lecture, &estPresent) == 0 && numClient < MAX_CLIENT &&
+				lireChaine(&lecture, presence.pseudo, sizeof(presence.pseudo)) == 0 &&
+				lireChaine(&lecture, presence.salon, sizeof(presence.salon)) == 0)
+			{
+				presence.estPresent = estPresent;
+				pthread_mutex_lock(&mutexPresence);
+				noeuds[indice].presence[numClient] = presence;
+				pthread_mutex_unlock(&mutexPresence);
+			}
+		}
+		else if (type == ENR_DIFFUSION || type == ENR_LIVRAISON)
+		{
+			char salon[TAILLE_NOM_SALON];
+			char expediteur[TAILLE_PSEUDO];
+			char texte[TAILLE_TEXTE + 1];
+			uint8_t drapeaux = 0;
+			if (lireChaine(&lecture, salon, sizeof(salon)) == 0 && lireChaine(&lecture, expediteur, sizeof(expediteur)) == 0 &&
+				lireTexte(&lecture, texte, sizeof(texte)) == 0)
+			{
+				lireOctet(&lecture, &drapeaux);
+				if (type == ENR_DIFFUSION)
+				{
+					relayer(salon, expediteur, texte, drapeaux & DRAPEAU_SUITE);
+				}
+				else
+				{
+					livrer(salon, expediteur, texte, drapeaux & DRAPEAU_SUITE);
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&mutexLivraison);
+}
+
+/**
+ * @brief Attend la fin du traitement d'un lot en cours, s'il y en a un.
+ * Utilisée par le relais : une fois relaisEnCours() vrai, aucun autre lot n'est traité.
+ */
+void federationBarriere(void)
+{
+	pthread_mutex_lock(&mutexLivraison);
+	pthread_mutex_unlock(&mutexLivraison);
+}
+
+/**
+ * @brief Envoie tous les octets d'un tampon.
+ *
+ * @return 0 si tout est parti, -1 sinon.
+ */
+static int envoyerTout(int dS, const uint8_t *octets, size_t longueur)
+{
+	while (longueur > 0)
+	{
+		ssize_t envoye = send(dS, octets, longueur, MSG_NOSIGNAL);
+		if (envoye <= 0)
+		{
+			return -1;
+		}
+		octets += envoye;
+		longueur -= envoye;
+	}
+	return 0;
+}
+
+/**
+ * @brief Fonction principale du thread d'envoi vers un nœud. Tout ce qui
+ * s'est accumulé pendant l'envoi précédent part en un seul envoi.
+ *
+ * @param arg indice du nœud
+ */
+static void *envoyerPair(void *arg)
+{
+	Noeud *noeud = &noeuds[(long)arg];
+	uint8_t *lots = malloc(TAILLE_TAMPON_PAIR);
+	while (1)
+	{
+		pthread_mutex_lock(&noeud->mutex);
+		while (noeud->rempli == 0)
+		{
+			pthread_cond_wait(&noeud->cond, &noeud->mutex);
+		}
+		pthread_mutex_unlock(&noeud->mutex);
+
+		pthread_mutex_lock(&noeud->mutexEcriture);
+		pthread_mutex_lock(&noeud->mutex);
+		uint8_t *echange = noeud->tampon;
+		noeud->tampon = lots;
+		lots = echange;
+		size_t longueur = noeud->rempli;
+		noeud->rempli = 0;
+		noeud->debutLot = AUCUN_LOT;
+		int dS = noeud->dS;
+		pthread_mutex_unlock(&noeud->mutex);
+
+		if (dS >= 0 && longueur > 0)
+		{
+			metriqueIncrementer(CPT_FEDERATION_LOTS, 1);
+			if (envoyerTout(dS, lots, longueur) != 0)
+			{
+				// Le thread de réception du lien verra la coupure
+				shutdown(dS, SHUT_RDWR);
+			}
+		}
+		pthread_mutex_unlock(&noeud->mutexEcriture);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Fait surveiller un lien par le noyau : un pair disparu sans
+ * fermer sa connexion est détecté en une dizaine de secondes.
+ */
+static void surveillerLien(int dS)
+{
+	int active = 1, inactivite = 5, intervalle = 2, essais = 3;
+	setsockopt(dS, SOL_SOCKET, SO_KEEPALIVE, &active, sizeof(active));
+	setsockopt(dS, IPPROTO_TCP, TCP_KEEPIDLE, &inactivite, sizeof(inactivite));
+	setsockopt(dS, IPPROTO_TCP, TCP_KEEPINTVL, &intervalle, sizeof(intervalle));
+	setsockopt(dS, IPPROTO_TCP, TCP_KEEPCNT, &essais, sizeof(essais));
+	setsockopt(dS, IPPROTO_TCP, TCP_NODELAY, &active, sizeof(active));
+}
+
+/**
+ * @brief Fait d'une socket le lien vers un nœud, puis reçoit ses lots
+ * jusqu'à la coupure. Un lien plus récent remplace l'ancien. La socket est
+ * fermée au retour.
+ *
+ * @param indice nœud à l'autre bout
+ * @param dSP socket du lien
+ * @param lecteur tampon de réception, qui peut déjà contenir des trames
+ */
+static void relier(int indice, int dSP, LecteurTrame *lecteur)
+{
+	Noeud *noeud = &noeuds[indice];
+	surveillerLien(dSP);
+
+	pthread_mutex_lock(&noeud->mutex);
+	int ancien = noeud->dS;
+	noeud->dS = dSP;
+	unsigned int generation = ++noeud->generation;
+	noeud->rempli = 0;
+	noeud->debutLot = AUCUN_LOT;
+	pthread_mutex_unlock(&noeud->mutex);
+	if (ancien >= 0)
+	{
+		shutdown(ancien, SHUT_RDWR);
+	}
+
+	// Le nœud renvoie toute sa présence sur le nouveau lien
+	pthread_mutex_lock(&mutexPresence);
+	memset(noeud->presence, 0, sizeof(noeud->presence));
+	pthread_mutex_unlock(&mutexPresence);
+	journalEcrire(JOURNAL_INFO, EVT_FEDERATION, indice, generation, 0, noeud->nom);
+	annoncerTout(indice);
+
+	EnteteTrame entete;
+	while (1)
+	{
+		int etat = lecteurTrameDisponible(lecteur, &entete);
+		if (etat == 1)
+		{
+			if (entete.type == TRAME_LOT)
+			{
+				traiterLot(indice, lecteur->tampon + TAILLE_ENTETE_TRAME, entete.longueur);
+			}
+			lecteurTrameConsommer(lecteur, &entete);
+			continue;
+		}
+		if (etat < 0 || lecteurTrameRemplir(lecteur, dSP) <= 0)
+		{
+			break;
+		}
+	}
+
+	// Coupure : les utilisateurs du nœud disparaissent, sauf si un lien plus récent existe
+	pthread_mutex_lock(&noeud->mutex);
+	int estCourant = noeud->generation == generation;
+	if (estCourant)
+	{
+		noeud->dS = -1;
+		noeud->rempli = 0;
+		noeud->debutLot = AUCUN_LOT;
+	}
+	pthread_mutex_unlock(&noeud->mutex);
+	if (estCourant)
+	{
+		pthread_mutex_lock(&mutexPresence);
+		memset(noeud->presence, 0, sizeof(noeud->presence));
+		pthread_mutex_unlock(&mutexPresence);
+		journalEcrire(JOURNAL_AVERTISSEMENT, EVT_FEDERATION, indice, generation, 0, "coupure");
+	}
+
+	shutdown(dSP, SHUT_RDWR);
+	pthread_mutex_lock(&noeud->mutexEcriture);
+	close(dSP);
+	pthread_mutex_unlock(&noeud->mutexEcriture);
+}
+
+/**
+ * @brief Prépare une trame TRAME_LOT qui ne contient qu'un enregistrement.
+ *
+ * @param trame tampon d'au moins TAILLE_ENTETE_TRAME + TAILLE_ENTETE_ENREGISTREMENT + longueur octets
+ * @return la taille de la trame.
+ */
+static size_t preparerEnregistrement(uint8_t *trame, uint8_t type, const uint8_t *charge, size_t longueur)
+{
+	uint8_t *enregistrement = trame + TAILLE_ENTETE_TRAME;
+	enregistrement[0] = type;
+	enregistrement[1] = longueur >> 8;
+	enregistrement[2] = longueur & 0xff;
+	memcpy(enregistrement + TAILLE_ENTETE_ENREGISTREMENT, charge, longueur);
+	trameEcrireEntete(trame, TRAME_LOT, 0, TAILLE_ENTETE_ENREGISTREMENT + longueur);
+	return TAILLE_ENTETE_TRAME + TAILLE_ENTETE_ENREGISTREMENT + longueur;
+}
+
+/**
+ * @brief Attend, au plus DELAI_BONJOUR secondes, le premier enregistrement
+ * d'un lien en cours d'ouverture. La trame reste dans le lecteur : l'appelant
+ * la consomme une fois l'enregistrement lu.
+ *
+ * @param type type d'enregistrement attendu
+ * @param entete en-tête de la trame reçue
+ * @param lecture contenu de l'enregistrement
+ * @return 0 si l'enregistrement attendu est arrivé, -1 sinon.
+ */
+static int attendreEnregistrement(int dSP, LecteurTrame *lecteur, uint8_t type, EnteteTrame *entete, Lecture *lecture)
+{
+	struct timeval delai = {DELAI_BONJOUR, 0};
+	setsockopt(dSP, SOL_SOCKET, SO_RCVTIMEO, &delai, sizeof(delai));
+	int etat;
+	while ((etat = lecteurTrameDisponible(lecteur, entete)) == 0 && lecteurTrameRemplir(lecteur, dSP) > 0)
+	{
+	}
+	delai.tv_sec = 0;
+	setsockopt(dSP, SOL_SOCKET, SO_RCVTIMEO, &delai, sizeof(delai));
+
+	if (etat != 1 || entete->type != TRAME_LOT || entete->longueur < TAILLE_ENTETE_ENREGISTREMENT)
+	{
+		return -1;
+	}
+	const uint8_t *enregistrement = lecteur->tampon + TAILLE_ENTETE_TRAME;
+	size_t taille = (enregistrement[1] << 8) | enregistrement[2];
+	if (enregistrement[0] != type || TAILLE_ENTETE_ENREGISTREMENT + taille > entete->longueur)
+	{
+		return -1;
+	}
+	lecture->octets = enregistrement + TAILLE_ENTETE_ENREGISTREMENT;
+	lecture->reste = taille;
+	return 0;
+}
+
+/**
+ * @brief Scelle un défi et un nom de nœud avec le secret de la fédération (HMAC-SHA256).
+ *
+ * @param sceau tampon de TAILLE_SCEAU octets
+ */
+static void sceller(const uint8_t *defi, const char *nom, uint8_t *sceau)
+{
+	uint8_t donnees[TAILLE_DEFI + TAILLE_NOM_NOEUD];
+	size_t longueurNom = strnlen(nom, TAILLE_NOM_NOEUD);
+	memcpy(donnees, defi, TAILLE_DEFI);
+	memcpy(donnees + TAILLE_DEFI, nom, longueurNom);
+	unsigned int taille = TAILLE_SCEAU;
+	HMAC(EVP_sha256(), secret, longueurSecret, donnees, TAILLE_DEFI + longueurNom, sceau, &taille);
+}
+
+/**
+ * @brief Ouvre un lien sortant : répond au défi du nœud distant par le nom
+ * du nœud local et son sceau.
+ *
+ * @return 0 si la réponse est partie, -1 sinon.
+ */
+static int presenter(int dSP, LecteurTrame *lecteur)
+{
+	EnteteTrame entete;
+	Lecture lecture;
+	uint8_t defi[TAILLE_DEFI];
+	lecteur->rempli = 0;
+	if (attendreEnregistrement(dSP, lecteur, ENR_DEFI, &entete, &lecture) != 0 || lecture.reste != TAILLE_DEFI)
+	{
+		return -1;
+	}
+	memcpy(defi, lecture.octets, TAILLE_DEFI);
+	lecteurTrameConsommer(lecteur, &entete);
+
+	uint8_t charge[1 + TAILLE_NOM_NOEUD + TAILLE_SCEAU];
+	size_t longueur = ajouterChaine(charge, 0, noeuds[noeudLocal].nom);
+	sceller(defi, noeuds[noeudLocal].nom, charge + longueur);
+	longueur += TAILLE_SCEAU;
+
+	uint8_t bonjour[TAILLE_ENTETE_TRAME + TAILLE_ENTETE_ENREGISTREMENT + sizeof(charge)];
+	return envoyerTout(dSP, bonjour, preparerEnregistrement(bonjour, ENR_BONJOUR, charge, longueur));
+}
+
+/**
+ * @brief Fonction principale d'un thread de connexion vers un nœud placé
+ * après le nœud local dans le fichier de fédération ; les nœuds placés avant
+ * se connectent eux-mêmes. La connexion est retentée tant qu'elle échoue.
+ *
+ * @param arg indice du nœud
+ */
+static void *connecterPair(void *arg)
+{
+	int indice = (long)arg;
+	LecteurTrame *lecteur = malloc(sizeof(LecteurTrame));
+
+	while (1)
+	{
+		int dSP = socket(PF_INET, SOCK_STREAM, 0);
+		if (dSP >= 0 && connect(dSP, (struct sockaddr *)&noeuds[indice].adresse, sizeof(struct sockaddr_in)) == 0 &&
+			presenter(dSP, lecteur) == 0)
+		{
+			relier(indice, dSP, lecteur);
+		}
+		else if (dSP >= 0)
+		{
+			close(dSP);
+		}
+		usleep(DELAI_RECONNEXION * 1000);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Cherche le nœud distant qui a une adresse IP donnée.
+ *
+ * @param nom nom annoncé par le pair, NULL pour accepter n'importe quel nœud à cette adresse
+ * @return l'indice du nœud, -1 si aucun nœud distant ne correspond.
+ */
+static int chercherPair(const struct sockaddr_in *adresse, const char *nom)
+{
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		if (i != noeudLocal && noeuds[i].adresse.sin_addr.s_addr == adresse->sin_addr.s_addr &&
+			(nom == NULL || strcmp(noeuds[i].nom, nom) == 0))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Fonction principale du thread d'un lien entrant : envoie un défi,
+ * puis identifie le nœud par sa réponse ENR_BONJOUR. Le lien n'est relié, et
+ * ne remplace le lien courant du nœud, que si le nom annoncé correspond à
+ * l'adresse du pair et que le sceau est celui du secret partagé.
+ *
+ * @param arg socket du lien
+ */
+static void *accueillirPair(void *arg)
+{
+	int dSP = (long)arg;
+	LecteurTrame *lecteur = malloc(sizeof(LecteurTrame));
+	lecteur->rempli = 0;
+
+	int indice = -1;
+	uint8_t defi[TAILLE_DEFI];
+	uint8_t trame[TAILLE_ENTETE_TRAME + TAILLE_ENTETE_ENREGISTREMENT + TAILLE_DEFI];
+	struct sockaddr_in adresse;
+	socklen_t taille = sizeof(adresse);
+	EnteteTrame entete;
+	Lecture lecture;
+	char nom[TAILLE_NOM_NOEUD];
+	uint8_t sceau[TAILLE_SCEAU];
+	if (getpeername(dSP, (struct sockaddr *)&adresse, &taille) == 0 && RAND_bytes(defi, TAILLE_DEFI) == 1 &&
+		envoyerTout(dSP, trame, preparerEnregistrement(trame, ENR_DEFI, defi, TAILLE_DEFI)) == 0 &&
+		attendreEnregistrement(dSP, lecteur, ENR_BONJOUR, &entete, &lecture) == 0 &&
+		lireChaine(&lecture, nom, sizeof(nom)) == 0 && lecture.reste == TAILLE_SCEAU)
+	{
+		sceller(defi, nom, sceau);
+		if (CRYPTO_memcmp(sceau, lecture.octets, TAILLE_SCEAU) == 0)
+		{
+			indice = chercherPair(&adresse, nom);
+		}
+		if (indice < 0)
+		{
+			journalEcrire(JOURNAL_AVERTISSEMENT, EVT_FEDERATION, -1, 0, 0, "pair refusé");
+		}
+	}
+
+	if (indice < 0)
+	{
+		close(dSP);
+	}
+	else
+	{
+		lecteurTrameConsommer(lecteur, &entete);
+		relier(indice, dSP, lecteur);
+	}
+	free(lecteur);
+	return NULL;
+}
+
+/**
+ * @brief Fonction principale du thread d'écoute des liens entrants.
+ * Le port est nommé sur l'adresse du nœud local, et seules les adresses des
+ * autres nœuds sont acceptées. Pendant un redémarrage à chaud, l'ancien
+ * processus tient encore le port : on réessaie jusqu'à pouvoir le nommer.
+ */
+static void *ecouterPairs(void *arg)
+{
+	(void)arg;
+	int dSE = socket(PF_INET, SOCK_STREAM, 0);
+	int active = 1;
+	setsockopt(dSE, SOL_SOCKET, SO_REUSEADDR, &active, sizeof(active));
+	struct sockaddr_in ad = noeuds[noeudLocal].adresse;
+	while (bind(dSE, (struct sockaddr *)&ad, sizeof(ad)) < 0)
+	{
+		sleep(1);
+	}
+	if (listen(dSE, MAX_NOEUDS) < 0)
+	{
+		perror("Problème au niveau du listen de la fédération");
+		return NULL;
+	}
+
+	while (1)
+	{
+		struct sockaddr_in adresse;
+		socklen_t taille = sizeof(adresse);
+		int dSP = accept(dSE, (struct sockaddr *)&adresse, &taille);
+		if (dSP < 0)
+		{
+			continue;
+		}
+		if (chercherPair(&adresse, NULL) < 0)
+		{
+			// Seuls les nœuds du fichier de fédération peuvent ouvrir un lien
+			journalEchantillonne(JOURNAL_AVERTISSEMENT, EVT_REFUS, ntohl(adresse.sin_addr.s_addr), 0, 0, NULL);
+			close(dSP);
+			continue;
+		}
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, accueillirPair, (void *)(long)dSP) != 0)
+		{
+			close(dSP);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Lit le fichier de fédération : une ligne « nom hôte port » par nœud,
+ * dans le même ordre sur tous les nœuds, et une ligne « secret valeur »
+ * identique partout ; les lignes commençant par # sont ignorées.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int lireFichier(const char *fichier)
+{
+	FILE *flux = fopen(fichier, "r");
+	if (flux == NULL)
+	{
+		perror("Erreur ouverture du fichier de fédération");
+		return -1;
+	}
+	char ligne[256];
+	while (fgets(ligne, sizeof(ligne), flux) != NULL)
+	{
+		char nom[TAILLE_NOM_NOEUD];
+		char hote[128];
+		char port[8];
+		int nbChamps = ligne[0] == '#' ? 0 : sscanf(ligne, "%31s %127s %7s", nom, hote, port);
+		if (nbChamps == 2 && strcmp(nom, "secret") == 0)
+		{
+			longueurSecret = snprintf(secret, sizeof(secret), "%s", hote);
+			continue;
+		}
+		if (nbChamps != 3)
+		{
+			continue;
+		}
+		if (nbNoeuds == MAX_NOEUDS)
+		{
+			fprintf(stderr, "Fédération limitée à %d nœuds\n", MAX_NOEUDS);
+			break;
+		}
+
+		struct addrinfo indices = {0};
+		struct addrinfo *resultat;
+		indices.ai_family = AF_INET;
+		indices.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(hote, port, &indices, &resultat) != 0)
+		{
+			fprintf(stderr, "Nœud %s : hôte %s inconnu\n", nom, hote);
+			fclose(flux);
+			return -1;
+		}
+		Noeud *noeud = &noeuds[nbNoeuds++];
+		snprintf(noeud->nom, sizeof(noeud->nom), "%s", nom);
+		memcpy(&noeud->adresse, resultat->ai_addr, sizeof(struct sockaddr_in));
+		freeaddrinfo(resultat);
+	}
+	fclose(flux);
+	return 0;
+}
+
+/**
+ * @brief Rejoint la fédération décrite par un fichier : construit l'anneau,
+ * ouvre le port de fédération et relie le nœud local à tous les autres.
+ *
+ * @param fichier fichier de fédération, NULL pour un serveur seul
+ * @param nom nom du nœud local dans ce fichier
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int federationDemarrer(const char *fichier, const char *nom)
+{
+	if (fichier == NULL)
+	{
+		return 0;
+	}
+	if (nom == NULL || lireFichier(fichier) != 0)
+	{
+		return -1;
+	}
+	if (longueurSecret == 0)
+	{
+		fprintf(stderr, "Fichier de fédération sans ligne « secret valeur »\n");
+		return -1;
+	}
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		if (strcmp(noeuds[i].nom, nom) == 0)
+		{
+			noeudLocal = i;
+		}
+	}
+	if (noeudLocal < 0)
+	{
+		fprintf(stderr, "Nœud %s absent du fichier de fédération\n", nom);
+		return -1;
+	}
+
+	// Anneau de hachage cohérent : plusieurs points par nœud pour équilibrer les salons
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		for (int j = 0; j < POINTS_PAR_NOEUD; j++)
+		{
+			char point[TAILLE_NOM_NOEUD + 8];
+			snprintf(point, sizeof(point), "%s#%d", noeuds[i].nom, j);
+			anneau[nbPoints].position = hacher(point);
+			anneau[nbPoints].noeud = i;
+			nbPoints++;
+		}
+	}
+	qsort(anneau, nbPoints, sizeof(PointAnneau), comparerPoints);
+
+	for (int i = 0; i < nbNoeuds; i++)
+	{
+		noeuds[i].dS = -1;
+		noeuds[i].debutLot = AUCUN_LOT;
+		pthread_mutex_init(&noeuds[i].mutex, NULL);
+		pthread_mutex_init(&noeuds[i].mutexEcriture, NULL);
+		pthread_cond_init(&noeuds[i].cond, NULL);
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, ecouterPairs, NULL) != 0)
+	{
+		perror("Erreur thread fédération");
+		return -1;
+	}
+	pthread_detach(thread);
+	for (long i = 0; i < nbNoeuds; i++)
+	{
+		if (i == noeudLocal)
+		{
+			continue;
+		}
+		noeuds[i].tampon = malloc(TAILLE_TAMPON_PAIR);
+		if (noeuds[i].tampon == NULL || pthread_create(&thread, NULL, envoyerPair, (void *)i) != 0)
+		{
+			perror("Erreur thread fédération");
+			return -1;
+		}
+		pthread_detach(thread);
+		if (i > noeudLocal)
+		{
+			if (pthread_create(&thread, NULL, connecterPair, (void *)i) != 0)
+			{
+				perror("Erreur thread fédération");
+				return -1;
+			}
+			pthread_detach(thread);
+		}
+	}
+	printf("Nœud %s d'une fédération de %d nœuds\n", nom, nbNoeuds);
+	return 0;
+}
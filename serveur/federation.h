@@ -0,0 +1,40 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fédération : plusieurs processus serveur forment un maillage TCP. Chaque
+ * salon a un nœud d'attache, choisi par hachage cohérent de son nom, qui
+ * ordonne ses diffusions et les relaie aux nœuds où le salon a des membres.
+ * Les échanges entre nœuds sont regroupés en lots ; la présence des
+ * utilisateurs est répliquée sur tous les nœuds.
+ */
+
+/**
+ * - MAX_NOEUDS = nombre maximum de nœuds dans la fédération
+ * - POINTS_PAR_NOEUD = points de chaque nœud sur l'anneau de hachage cohérent
+ * - TAILLE_NOM_NOEUD = taille maximum du nom d'un nœud
+ * - DELAI_RECONNEXION = délai (ms) entre deux tentatives de connexion à un pair
+ * - TAILLE_TAMPON_PAIR = octets de lots en attente d'envoi vers un pair
+ */
+#define MAX_NOEUDS 16
+#define POINTS_PAR_NOEUD 64
+#define TAILLE_NOM_NOEUD 32
+#define DELAI_RECONNEXION 1000
+#define TAILLE_TAMPON_PAIR (256 * 1024)
+
+int federationDemarrer(const char *fichier, const char *nom);
+int federationActive(void);
+void federationAnnoncer(int numClient);
+void federationAnnoncerDepart(int numClient);
+void federationRetirer(int numClient);
+void federationDiffuser(int numClient, const char *msg, uint8_t drapeaux);
+int federationNbDestinataires(int idSalon);
+int federationPseudoDistant(const char *pseudo);
+size_t federationEnLigne(char *dest, size_t taille);
+void federationBarriere(void);
+long jaugePairsConnectes();
+
+#endif
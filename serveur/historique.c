@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "historique.h"
+#include "memoire.h"
+#include "identite.h"
+
+/**
+ * @brief Bloc de texte des messages. Les blocs sont chaînés du plus ancien
+ * au plus récent, pour être libérés quand leurs messages sont évincés.
+ *
+ * @param suivant bloc plus récent, NULL pour le bloc en cours de remplissage
+ * @param fin identifiant qui suit le dernier message du bloc
+ * @param texte textes des messages, mis bout à bout
+ */
+typedef struct BlocTexte BlocTexte;
+struct BlocTexte
+{
+	BlocTexte *suivant;
+	uint32_t fin;
+	char texte[TAILLE_BLOC_TEXTE];
+};
+
+/**
+ * - pages = table des messages, par pages allouées à la demande ; la page p est en pages[p % NB_PAGES_HISTORIQUE]
+ * - premierBloc = plus ancien bloc de texte conservé
+ * - bloc = bloc de texte en cours de remplissage
+ * - rempliBloc = octets utilisés dans ce bloc
+ * - nbMessages = messages publiés ; un message d'identifiant inférieur se lit sans verrou d'ajout
+ * - premier = identifiant du plus ancien message conservé, premier message d'un bloc de texte
+ * - retention = messages conservés au plus
+ * - mutexHistorique = protège l'ajout des messages
+ * - verrouEviction = lecture pour utiliser des messages, écriture pour en évincer
+ * - condHistorique = signalée à chaque nouveau message
+ * - epoque = époque de l'historique, tirée au premier besoin, jamais 0
+ */
+static MessageHistorique *pages[NB_PAGES_HISTORIQUE];
+static BlocTexte *premierBloc = NULL;
+static BlocTexte *bloc = NULL;
+static size_t rempliBloc = TAILLE_BLOC_TEXTE;
+static _Atomic uint32_t nbMessages = 0;
+static _Atomic uint32_t premier = 0;
+static uint32_t retention = RETENTION_HISTORIQUE;
+static pthread_mutex_t mutexHistorique = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t verrouEviction = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_cond_t condHistorique = PTHREAD_COND_INITIALIZER;
+static _Atomic uint32_t epoque = 0;
+
+/**
+ * @brief Fixe le nombre de messages conservés, avant le premier ajout, dans
+ * la limite de ce que tiennent NB_PAGES_HISTORIQUE pages.
+ *
+ * @param messages nombre de messages à conserver
+ */
+void historiqueConfigurer(uint32_t messages)
+{
+	uint32_t maximum = (NB_PAGES_HISTORIQUE - 2) * TAILLE_PAGE_HISTORIQUE;
+	retention = messages < maximum ? messages : maximum;
+}
+
+/**
+ * @brief Nombre de messages conservés au plus.
+ *
+ * @return la rétention, en messages.
+ */
+uint32_t historiqueRetention(void)
+{
+	return retention;
+}
+
+/**
+ * @brief Évince le plus ancien bloc de texte et ses messages, puis libère les
+ * pages qui ne contiennent plus que des messages évincés. Appelée sous
+ * mutexHistorique, jamais pour le bloc en cours de remplissage. Attend que
+ * les lecteurs en cours aient fini ; la libération se fait hors du verrou
+ * d'éviction, aucun lecteur ne pouvant plus atteindre ces messages.
+ *
+ * @param liberes mémoire libérée, augmentée des pages et du bloc rendus
+ * @return le nombre de messages évincés.
+ */
+static uint32_t evincerBloc(int64_t *liberes)
+{
+	BlocTexte *ancien = premierBloc;
+	uint32_t debut = atomic_load_explicit(&premier, memory_order_relaxed);
+	pthread_rwlock_wrlock(&verrouEviction);
+	premierBloc = ancien->suivant;
+	atomic_store_explicit(&premier, ancien->fin, memory_order_release);
+	pthread_rwlock_unlock(&verrouEviction);
+
+	for (uint32_t page = debut / TAILLE_PAGE_HISTORIQUE; page < ancien->fin / TAILLE_PAGE_HISTORIQUE; page++)
+	{
+		free(pages[page % NB_PAGES_HISTORIQUE]);
+		pages[page % NB_PAGES_HISTORIQUE] = NULL;
+		*liberes += sizeof(MessageHistorique) * TAILLE_PAGE_HISTORIQUE;
+	}
+	uint32_t evinces = ancien->fin - debut;
+	free(ancien);
+	*liberes += sizeof(BlocTexte);
+	return evinces;
+}
+
+/**
+ * @brief Évince les plus anciens messages jusqu'à libérer assez de mémoire,
+ * sur demande du délestage. Le bloc de texte en cours de remplissage reste.
+ * À appeler sans tenir mutexHistorique ni historiqueVerrouiller() : l'éviction
+ * attend sur verrouEviction que les lecteurs aient fini.
+ *
+ * @param octets mémoire à libérer
+ * @return le nombre de messages évincés.
+ */
+uint32_t historiqueDelester(int64_t octets)
+{
+	uint32_t evinces = 0;
+	int64_t liberes = 0;
+	pthread_mutex_lock(&mutexHistorique);
+	while (liberes < octets && premierBloc != NULL && premierBloc != bloc)
+	{
+		evinces += evincerBloc(&liberes);
+	}
+	pthread_mutex_unlock(&mutexHistorique);
+	memoirePartager(COMPTE_HISTORIQUE, -liberes);
+	return evinces;
+}
+
+/**
+ * @brief Ajoute un message à l'historique. Au-delà de la rétention, les
+ * plus anciens blocs de texte sont évincés avec leurs messages : à appeler
+ * sans tenir historiqueVerrouiller().
+ *
+ * @param idSalon salon du message
+ * @param idPseudo identité de l'expéditeur
+ * @param texte texte du message
+ * @param longueur taille du texte, au plus TAILLE_BLOC_TEXTE
+ * @return l'identifiant du message, UINT32_MAX si les identifiants sont épuisés ou si la mémoire manque.
+ */
+uint32_t historiqueAjouter(int idSalon, int idPseudo, const char *texte, size_t longueur)
+{
+	if (longueur > TAILLE_BLOC_TEXTE)
+	{
+		longueur = TAILLE_BLOC_TEXTE;
+	}
+
+	pthread_mutex_lock(&mutexHistorique);
+	uint32_t id = atomic_load_explicit(&nbMessages, memory_order_relaxed);
+	// UINT32_MAX reste libre pour désigner « aucun message »
+	if (id >= UINT32_MAX - 1)
+	{
+		pthread_mutex_unlock(&mutexHistorique);
+		return UINT32_MAX;
+	}
+	int64_t liberes = 0;
+	while (id - atomic_load_explicit(&premier, memory_order_relaxed) >= retention && premierBloc != bloc)
+	{
+		evincerBloc(&liberes);
+	}
+	memoirePartager(COMPTE_HISTORIQUE, -liberes);
+	MessageHistorique **emplacement = &pages[(id / TAILLE_PAGE_HISTORIQUE) % NB_PAGES_HISTORIQUE];
+	if (id % TAILLE_PAGE_HISTORIQUE == 0)
+	{
+		// La case de l'anneau est libre, sauf si le bloc en cours remonte à un tour entier
+		if (*emplacement != NULL)
+		{
+			pthread_mutex_unlock(&mutexHistorique);
+			return UINT32_MAX;
+		}
+		*emplacement = malloc(sizeof(MessageHistorique) * TAILLE_PAGE_HISTORIQUE);
+		if (*emplacement != NULL)
+		{
+			memoirePartager(COMPTE_HISTORIQUE, sizeof(MessageHistorique) * TAILLE_PAGE_HISTORIQUE);
+		}
+	}
+	if (rempliBloc + longueur > TAILLE_BLOC_TEXTE)
+	{
+		// L'ancien bloc reste en place : les messages qu'il contient restent lisibles
+		BlocTexte *nouveau = malloc(sizeof(BlocTexte));
+		if (nouveau != NULL)
+		{
+			memoirePartager(COMPTE_HISTORIQUE, sizeof(BlocTexte));
+			nouveau->suivant = NULL;
+			nouveau->fin = id;
+			if (bloc != NULL)
+			{
+				bloc->suivant = nouveau;
+			}
+			else
+			{
+				premierBloc = nouveau;
+			}
+			bloc = nouveau;
+			rempliBloc = 0;
+		}
+	}
+	if (*emplacement == NULL || bloc == NULL || rempliBloc + longueur > TAILLE_BLOC_TEXTE)
+	{
+		pthread_mutex_unlock(&mutexHistorique);
+		return UINT32_MAX;
+	}
+
+	MessageHistorique *message = &(*emplacement)[id % TAILLE_PAGE_HISTORIQUE];
+	memcpy(bloc->texte + rempliBloc, texte, longueur);
+	message->idSalon = idSalon;
+	message->idPseudo = idPseudo;
+	message->longueur = longueur;
+	message->texte = bloc->texte + rempliBloc;
+	rempliBloc += longueur;
+	bloc->fin = id + 1;
+
+	// Publication : le message est complet avant que nbMessages ne le compte
+	atomic_store_explicit(&nbMessages, id + 1, memory_order_release);
+	pthread_cond_broadcast(&condHistorique);
+	pthread_mutex_unlock(&mutexHistorique);
+	return id;
+}
+
+/**
+ * @brief Lit un message publié et encore conservé. Appelée sous historiqueVerrouiller().
+ *
+ * @param id identifiant du message
+ * @return le message, NULL s'il n'existe pas ou s'il a été évincé.
+ */
+const MessageHistorique *historiqueLire(uint32_t id)
+{
+	if (id >= atomic_load_explicit(&nbMessages, memory_order_acquire) || id < atomic_load_explicit(&premier, memory_order_acquire))
+	{
+		return NULL;
+	}
+	return &pages[(id / TAILLE_PAGE_HISTORIQUE) % NB_PAGES_HISTORIQUE][id % TAILLE_PAGE_HISTORIQUE];
+}
+
+/**
+ * @brief Nombre de messages publiés.
+ *
+ * @return le nombre de messages de l'historique.
+ */
+uint32_t historiqueNbMessages(void)
+{
+	return atomic_load_explicit(&nbMessages, memory_order_acquire);
+}
+
+/**
+ * @brief Identifiant du plus ancien message conservé.
+ *
+ * @return l'identifiant du premier message encore lisible.
+ */
+uint32_t historiquePremier(void)
+{
+	return atomic_load_explicit(&premier, memory_order_acquire);
+}
+
+/**
+ * @brief Empêche l'éviction des messages jusqu'à historiqueDeverrouiller().
+ * Les ajouts ne sont pas bloqués, sauf celui qui ouvre une page à évincer.
+ */
+void historiqueVerrouiller(void)
+{
+	pthread_rwlock_rdlock(&verrouEviction);
+}
+
+void historiqueDeverrouiller(void)
+{
+	pthread_rwlock_unlock(&verrouEviction);
+}
+
+/**
+ * @brief Attend que l'historique compte plus de deja messages.
+ *
+ * @param deja nombre de messages déjà vus par l'appelant
+ * @return le nombre de messages publiés, supérieur à deja.
+ */
+uint32_t historiqueAttendre(uint32_t deja)
+{
+	pthread_mutex_lock(&mutexHistorique);
+	while (atomic_load_explicit(&nbMessages, memory_order_relaxed) <= deja)
+	{
+		pthread_cond_wait(&condHistorique, &mutexHistorique);
+	}
+	uint32_t nombre = atomic_load_explicit(&nbMessages, memory_order_relaxed);
+	pthread_mutex_unlock(&mutexHistorique);
+	return nombre;
+}
+
+/**
+ * @brief Donne les derniers messages conservés d'un salon qui précèdent un
+ * identifiant. Appelée sous historiqueVerrouiller().
+ *
+ * @param idSalon salon des messages
+ * @param avant en entrée, seuls les messages d'identifiant inférieur sont retenus (UINT32_MAX pour
+ *        tous) ; en sortie, identifiant où reprendre pour les messages plus anciens, 0 s'il n'y en a plus
+ *        (ou s'ils ont été évincés)
+ * @param ids identifiants trouvés, du plus ancien au plus récent
+ * @param maximum nombre maximum de messages
+ * @param portee nombre maximum de messages de l'historique parcourus, en partant de avant
+ * @return le nombre de messages trouvés.
+ */
+int historiqueDerniers(int idSalon, uint32_t *avant, uint32_t *ids, int maximum, uint32_t portee)
+{
+	uint32_t fin = historiqueNbMessages();
+	fin = *avant < fin ? *avant : fin;
+	uint32_t plancher = historiquePremier();
+	uint32_t debut = fin > portee ? fin - portee : 0;
+	debut = debut > plancher ? debut : plancher;
+	int nombre = 0;
+	uint32_t id;
+	for (id = fin; id > debut && nombre < maximum; id--)
+	{
+		if (historiqueLire(id - 1)->idSalon == idSalon)
+		{
+			ids[nombre++] = id - 1;
+		}
+	}
+	*avant = id > plancher ? id : 0;
+	for (int i = 0; i < nombre / 2; i++)
+	{
+		uint32_t echange = ids[i];
+		ids[i] = ids[nombre - 1 - i];
+		ids[nombre - 1 - i] = echange;
+	}
+	return nombre;
+}
+
+/**
+ * @brief Donne les premiers messages conservés d'un salon qui suivent un
+ * identifiant. Appelée sous historiqueVerrouiller().
+ *
+ * @param idSalon salon des messages
+ * @param apres en entrée, seuls les messages d'identifiant supérieur sont retenus ; en sortie,
+ *        identifiant après lequel reprendre, UINT32_MAX si tout l'historique a été parcouru
+ * @param ids identifiants trouvés, du plus ancien au plus récent
+ * @param maximum nombre maximum de messages
+ * @param portee nombre maximum de messages de l'historique parcourus, en partant de apres
+ * @return le nombre de messages trouvés.
+ */
+int historiqueSuivants(int idSalon, uint32_t *apres, uint32_t *ids, int maximum, uint32_t portee)
+{
+	uint32_t fin = historiqueNbMessages();
+	uint32_t debut = *apres < fin ? *apres + 1 : fin;
+	uint32_t plancher = historiquePremier();
+	debut = debut > plancher ? debut : plancher;
+	fin = fin - debut > portee ? debut + portee : fin;
+	int nombre = 0;
+	uint32_t id;
+	for (id = debut; id < fin && nombre < maximum; id++)
+	{
+		if (historiqueLire(id)->idSalon == idSalon)
+		{
+			ids[nombre++] = id;
+		}
+	}
+	*apres = id < historiqueNbMessages() ? id - 1 : UINT32_MAX;
+	return nombre;
+}
+
+/**
+ * @brief Époque de l'historique : les identifiants de messages, qui repartent
+ * de 0 à chaque démarrage du serveur, ne désignent les mêmes messages que pour
+ * une même époque.
+ *
+ * @return l'époque, tirée au hasard au premier appel.
+ */
+uint32_t historiqueEpoque(void)
+{
+	uint32_t valeur = atomic_load(&epoque);
+	if (valeur == 0)
+	{
+		uint32_t tiree;
+		if (getrandom(&tiree, sizeof(tiree), 0) != sizeof(tiree))
+		{
+			tiree = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+		}
+		tiree = tiree != 0 ? tiree : 1;
+		atomic_compare_exchange_strong(&epoque, &valeur, tiree);
+		valeur = atomic_load(&epoque);
+	}
+	return valeur;
+}
+
+/**
+ * @brief Écrit un message de l'historique sous la forme « pseudo : texte »,
+ * sans retour à la ligne final.
+ *
+ * @param destination buffer de sortie
+ * @param taille taille du buffer
+ * @param message message à écrire
+ * @return le nombre d'octets écrits (tronqué à taille - 1).
+ */
+int historiqueFormater(char *destination, size_t taille, const MessageHistorique *message)
+{
+	int longueur = message->longueur;
+	while (longueur > 0 && message->texte[longueur - 1] == '\n')
+	{
+		longueur--;
+	}
+	const char *pseudo = identitePseudo(message->idPseudo);
+	int ecrit = pseudo != NULL ? snprintf(destination, taille, "%s : %.*s", pseudo, longueur, message->texte)
+							   : snprintf(destination, taille, "%.*s", longueur, message->texte);
+	return ecrit < (int)taille ? ecrit : (int)taille - 1;
+}
+
+/**
+ * @brief Jauge du nombre de messages conservés dans l'historique.
+ *
+ * @return le nombre de messages.
+ */
+long jaugeHistorique()
+{
+	uint32_t plancher = historiquePremier();
+	return historiqueNbMessages() - plancher;
+}
@@ -0,0 +1,64 @@
+#ifndef HISTORIQUE_H
+#define HISTORIQUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Historique des salons : chaque message diffusé reçoit un identifiant
+ * croissant et est conservé en mémoire, dans des pages et des blocs de texte
+ * qui ne sont jamais déplacés. Un message publié se lit sans bloquer les
+ * ajouts. Au-delà de la rétention, ou à la demande du délestage mémoire, les
+ * blocs de texte les plus anciens sont libérés avec leurs messages et les pages devenues vides : un lecteur tient
+ * historiqueVerrouiller() tant qu'il utilise des messages.
+ */
+
+/**
+ * - TAILLE_PAGE_HISTORIQUE = messages par page de la table des messages
+ * - NB_PAGES_HISTORIQUE = nombre maximum de pages conservées, réutilisées en anneau
+ * - TAILLE_BLOC_TEXTE = taille d'un bloc de texte des messages
+ * - MESSAGES_RELECTURE = derniers messages d'un salon rejoués au client qui y arrive
+ * - PORTEE_RELECTURE = derniers messages de l'historique parcourus pour les trouver
+ * - RETENTION_HISTORIQUE = messages conservés par défaut, évincés par blocs de texte entiers
+ */
+#define TAILLE_PAGE_HISTORIQUE 65536
+#define NB_PAGES_HISTORIQUE 16384
+#define TAILLE_BLOC_TEXTE (1024 * 1024)
+#define MESSAGES_RELECTURE 200
+#define PORTEE_RELECTURE 65536
+#define RETENTION_HISTORIQUE (4 * TAILLE_PAGE_HISTORIQUE)
+
+/**
+ * @brief Message conservé dans l'historique.
+ *
+ * @param idSalon salon dans lequel le message a été diffusé
+ * @param idPseudo identité de l'expéditeur, -1 si la table des identités était pleine
+ * @param longueur taille du texte
+ * @param texte texte du message, sans le pseudo de l'expéditeur, non terminé par '\0'
+ */
+typedef struct MessageHistorique MessageHistorique;
+struct MessageHistorique
+{
+	int idSalon;
+	int idPseudo;
+	uint32_t longueur;
+	const char *texte;
+};
+
+void historiqueConfigurer(uint32_t retention);
+uint32_t historiqueRetention(void);
+uint32_t historiqueDelester(int64_t octets);
+uint32_t historiqueAjouter(int idSalon, int idPseudo, const char *texte, size_t longueur);
+const MessageHistorique *historiqueLire(uint32_t id);
+uint32_t historiqueNbMessages(void);
+uint32_t historiquePremier(void);
+void historiqueVerrouiller(void);
+void historiqueDeverrouiller(void);
+uint32_t historiqueAttendre(uint32_t deja);
+int historiqueDerniers(int idSalon, uint32_t *avant, uint32_t *ids, int maximum, uint32_t portee);
+int historiqueSuivants(int idSalon, uint32_t *apres, uint32_t *ids, int maximum, uint32_t portee);
+uint32_t historiqueEpoque(void);
+int historiqueFormater(char *destination, size_t taille, const MessageHistorique *message);
+long jaugeHistorique();
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "identite.h"
+#include "journal.h"
+#include "memoire.h"
+#include "serveur.h"
+
+/**
+ * - TAILLE_TABLE_IDENTITES = cases de la table de hachage des pseudos (puissance de 2)
+ */
+#define TAILLE_TABLE_IDENTITES (2 * MAX_IDENTITES)
+
+/**
+ * - pseudos = pseudo de chaque identité, jamais modifié une fois publié
+ * - table = table à adressage ouvert : identifiant + 1 par case, 0 si la case est libre
+ * - nbIdentites = identités attribuées
+ * - mutexIdentites = protège l'attribution ; la recherche se fait sans verrou
+ */
+static char pseudos[MAX_IDENTITES][TAILLE_PSEUDO];
+static _Atomic int table[TAILLE_TABLE_IDENTITES];
+static _Atomic int nbIdentites = 0;
+static pthread_mutex_t mutexIdentites = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Cherche un pseudo dans la table.
+ *
+ * @param pseudo pseudo cherché
+ * @param caseLibre case où l'insérer s'il est absent
+ * @return son identifiant, -1 s'il est absent.
+ */
+static int chercher(const char *pseudo, uint32_t *caseLibre)
+{
+	uint32_t masque = TAILLE_TABLE_IDENTITES - 1;
+	uint32_t i = journalEmpreinte(pseudo, strlen(pseudo)) & masque;
+	int entree;
+	while ((entree = atomic_load_explicit(&table[i], memory_order_acquire)) != 0)
+	{
+		if (strcmp(pseudos[entree - 1], pseudo) == 0)
+		{
+			return entree - 1;
+		}
+		i = (i + 1) & masque;
+	}
+	*caseLibre = i;
+	return -1;
+}
+
+/**
+ * @brief Donne l'identifiant d'un pseudo, en lui en attribuant un à sa première apparition.
+ *
+ * @param pseudo pseudo de l'utilisateur
+ * @return son identifiant, -1 si la table est pleine.
+ */
+int identiteInterner(const char *pseudo)
+{
+	uint32_t caseLibre;
+	int id = chercher(pseudo, &caseLibre);
+	if (id >= 0)
+	{
+		return id;
+	}
+
+	pthread_mutex_lock(&mutexIdentites);
+	// Un autre thread a pu l'ajouter entre-temps
+	id = chercher(pseudo, &caseLibre);
+	if (id < 0 && atomic_load(&nbIdentites) < MAX_IDENTITES)
+	{
+		id = atomic_load(&nbIdentites);
+		strncpy(pseudos[id], pseudo, TAILLE_PSEUDO - 1);
+		atomic_store(&nbIdentites, id + 1);
+		// Le pseudo est écrit avant que la case ne le rende visible
+		atomic_store_explicit(&table[caseLibre], id + 1, memory_order_release);
+		// Pseudo et deux cases de table par identité : la table reste à moitié vide
+		memoirePartager(COMPTE_IDENTITES, TAILLE_PSEUDO + 2 * sizeof(int));
+	}
+	pthread_mutex_unlock(&mutexIdentites);
+	return id;
+}
+
+/**
+ * @brief Donne le pseudo d'une identité.
+ *
+ * @param id identifiant attribué par identiteInterner
+ * @return le pseudo, NULL si l'identifiant n'est pas attribué.
+ */
+const char *identitePseudo(int id)
+{
+	if (id < 0 || id >= atomic_load(&nbIdentites))
+	{
+		return NULL;
+	}
+	return pseudos[id];
+}
+
+/**
+ * @brief Jauge du nombre d'identités attribuées.
+ *
+ * @return le nombre d'identités.
+ */
+long jaugeIdentites()
+{
+	return atomic_load(&nbIdentites);
+}
@@ -0,0 +1,24 @@
+#ifndef IDENTITE_H
+#define IDENTITE_H
+
+/**
+ * Identités des utilisateurs : chaque pseudo vu par le serveur (client local
+ * ou expéditeur d'un autre nœud) est conservé une seule fois et reçoit un
+ * identifiant numérique, valable jusqu'à l'arrêt du serveur. Les messages
+ * diffusés aux clients qui l'ont négocié ne portent que cet identifiant ; le
+ * pseudo leur est envoyé une fois, dans une trame TRAME_IDENTITE. Leur
+ * mémoire est imputée au plafond global ; bornée par MAX_IDENTITES, elle
+ * n'est jamais délestée.
+ */
+
+/**
+ * - MAX_IDENTITES = nombre maximum d'identités (identifiant sur 16 bits) ; au-delà,
+ *   les messages repartent avec le pseudo en toutes lettres
+ */
+#define MAX_IDENTITES 65536
+
+int identiteInterner(const char *pseudo);
+const char *identitePseudo(int id);
+long jaugeIdentites();
+
+#endif
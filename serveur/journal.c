@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "journal.h"
+#include "metriques.h"
+
+/**
+ * @brief Enregistrement binaire écrit par les threads du serveur.
+ * Il est mis en forme plus tard par le thread de vidage.
+ *
+ * @param horodatage date de l'événement, en microsecondes depuis l'epoch
+ * @param thread identifiant système du thread émetteur
+ * @param niveau gravité de l'enregistrement
+ * @param evenement type de l'événement
+ * @param valeurs valeurs numériques propres à l'événement
+ * @param texte court texte libre (pseudo, nom de commande...), jamais un contenu de message
+ */
+typedef struct Enregistrement Enregistrement;
+struct Enregistrement
+{
+	uint64_t horodatage;
+	int32_t thread;
+	uint8_t niveau;
+	uint8_t evenement;
+	int64_t valeurs[3];
+	char texte[32];
+};
+
+/**
+ * - TAILLE_ANNEAU = nombre d'enregistrements par thread (puissance de 2)
+ * - TAILLE_FICHIER_MAX = taille à partir de laquelle le fichier de journal tourne
+ * - NB_ROTATIONS = nombre d'anciens fichiers conservés
+ * - PERIODE_VIDAGE = intervalle entre deux vidages, en millisecondes
+ */
+#define TAILLE_ANNEAU 1024
+#define TAILLE_FICHIER_MAX (16 * 1024 * 1024)
+#define NB_ROTATIONS 5
+#define PERIODE_VIDAGE 50
+
+/**
+ * @brief Anneau à un producteur (le thread propriétaire) et un consommateur
+ * (le thread de vidage). Un anneau abandonné par un thread terminé est repris
+ * par un nouveau thread une fois vidé.
+ *
+ * @param tete prochaine case écrite par le producteur
+ * @param queue prochaine case lue par le consommateur
+ * @param pertes enregistrements perdus car l'anneau était plein
+ * @param estAbandonne 1 si le thread propriétaire est terminé ; 0 sinon
+ * @param echantillon compteurs locaux servant à l'échantillonnage, par événement
+ * @param suivant anneau suivant dans la liste globale
+ */
+typedef struct Anneau Anneau;
+struct Anneau
+{
+	_Alignas(64) atomic_uint_fast64_t tete;
+	_Alignas(64) atomic_uint_fast64_t queue;
+	atomic_uint_fast64_t pertes;
+	atomic_int estAbandonne;
+	uint64_t echantillon[NB_EVENEMENTS];
+	Anneau *suivant;
+	Enregistrement cases[TAILLE_ANNEAU];
+};
+
+/**
+ * - listeAnneaux = liste de tous les anneaux créés
+ * - anneauCourant = anneau du thread courant
+ * - niveauMinimum = niveau en dessous duquel rien n'est enregistré
+ * - tauxEchantillonnage = un enregistrement échantillonné sur N est conservé
+ * - sortie = fichier de journal courant (stdout si aucun dossier n'est donné)
+ * - mutexVidage = un seul consommateur à la fois vide les anneaux
+ */
+static _Atomic(Anneau *) listeAnneaux = NULL;
+static __thread Anneau *anneauCourant = NULL;
+static __thread int32_t idThread = 0;
+static pthread_key_t cleAnneau;
+static pthread_once_t cleAnneauInitialisee = PTHREAD_ONCE_INIT;
+static atomic_int niveauMinimum = JOURNAL_INFO;
+static int tauxEchantillonnage = 1;
+static FILE *sortie = NULL;
+static char cheminFichier[256];
+static long tailleFichier = 0;
+static pthread_mutex_t mutexVidage = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *nomNiveaux[] = {"DEBUG", "INFO", "AVERT", "ERREUR"};
+
+static const char *nomEvenements[NB_EVENEMENTS] = {
+	"demarrage", "connexion", "pseudo", "deconnexion", "message_recu",
+	"diffusion", "commande", "erreur_reseau", "pertes_journal", "relais", "instantane", "expiration", "debit", "refus", "federation", "fusion_index", "memoire", "tls"};
+
+static const char *nomValeurs[NB_EVENEMENTS][3] = {
+	{"port", NULL, NULL},
+	{"client", "connectes", NULL},
+	{"client", "connectes", NULL},
+	{"client", "connectes", NULL},
+	{"client", "octets", "empreinte"},
+	{"client", "salon", "destinataires"},
+	{"client", "duree_us", NULL},
+	{"client", "errno", NULL},
+	{"nombre", NULL, NULL},
+	{"sessions", NULL, NULL},
+	{"sequence", "salons", NULL},
+	{"client", "silence_ms", NULL},
+	{"client", "salon", "cout"},
+	{"adresse", "reessai_s", NULL},
+	{"noeud", "generation", NULL},
+	{"niveau", "messages", "duree_us"},
+	{"client", "octets", "total"},
+	{"client", "noyau_emission", "noyau_reception"}};
+
+/**
+ * @brief Marque l'anneau d'un thread terminé comme abandonné.
+ */
+static void abandonnerAnneau(void *anneau)
+{
+	atomic_store_explicit(&((Anneau *)anneau)->estAbandonne, 1, memory_order_release);
+}
+
+static void creerCleAnneau(void)
+{
+	pthread_key_create(&cleAnneau, abandonnerAnneau);
+}
+
+/**
+ * @brief Donne l'anneau du thread courant, en reprenant un anneau abandonné et vidé si possible.
+ */
+static Anneau *anneauDuThread(void)
+{
+	if (anneauCourant != NULL)
+	{
+		return anneauCourant;
+	}
+	pthread_once(&cleAnneauInitialisee, creerCleAnneau);
+	idThread = syscall(SYS_gettid);
+
+	Anneau *anneau = atomic_load_explicit(&listeAnneaux, memory_order_acquire);
+	while (anneau != NULL)
+	{
+		int abandonne = 1;
+		if (atomic_load_explicit(&anneau->queue, memory_order_acquire) == atomic_load_explicit(&anneau->tete, memory_order_relaxed) &&
+			atomic_compare_exchange_strong(&anneau->estAbandonne, &abandonne, 0))
+		{
+			break;
+		}
+		anneau = anneau->suivant;
+	}
+
+	if (anneau == NULL)
+	{
+		anneau = aligned_alloc(64, sizeof(Anneau));
+		if (anneau == NULL)
+		{
+			return NULL;
+		}
+		memset(anneau, 0, sizeof(Anneau));
+		anneau->suivant = atomic_load_explicit(&listeAnneaux, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak(&listeAnneaux, &anneau->suivant, anneau))
+		{
+		}
+	}
+
+	pthread_setspecific(cleAnneau, anneau);
+	anneauCourant = anneau;
+	return anneau;
+}
+
+/**
+ * @brief Empreinte FNV-1a d'un contenu, pour corréler des messages sans les écrire.
+ *
+ * @param contenu contenu à résumer
+ * @param longueur longueur du contenu
+ * @return l'empreinte sur 32 bits.
+ */
+uint32_t journalEmpreinte(const char *contenu, size_t longueur)
+{
+	uint32_t empreinte = 2166136261u;
+	for (size_t i = 0; i < longueur; i++)
+	{
+		empreinte = (empreinte ^ (unsigned char)contenu[i]) * 16777619u;
+	}
+	return empreinte;
+}
+
+/**
+ * @brief Écrit un enregistrement dans l'anneau du thread courant.
+ * Ne bloque jamais : si l'anneau est plein, l'enregistrement est compté comme perdu.
+ *
+ * @param niveau gravité de l'enregistrement
+ * @param evenement type de l'événement
+ * @param a première valeur
+ * @param b deuxième valeur
+ * @param c troisième valeur
+ * @param texte court texte libre ou NULL
+ */
+void journalEcrire(enum NiveauJournal niveau, enum EvenementJournal evenement,
+				   int64_t a, int64_t b, int64_t c, const char *texte)
+{
+	if ((int)niveau < atomic_load_explicit(&niveauMinimum, memory_order_relaxed))
+	{
+		return;
+	}
+	Anneau *anneau = anneauDuThread();
+	if (anneau == NULL)
+	{
+		return;
+	}
+
+	uint_fast64_t tete = atomic_load_explicit(&anneau->tete, memory_order_relaxed);
+	if (tete - atomic_load_explicit(&anneau->queue, memory_order_acquire) >= TAILLE_ANNEAU)
+	{
+		atomic_fetch_add_explicit(&anneau->pertes, 1, memory_order_relaxed);
+		return;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	Enregistrement *e = &anneau->cases[tete & (TAILLE_ANNEAU - 1)];
+	e->horodatage = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	e->thread = idThread;
+	e->niveau = niveau;
+	e->evenement = evenement;
+	e->valeurs[0] = a;
+	e->valeurs[1] = b;
+	e->valeurs[2] = c;
+	e->texte[0] = '\0';
+	if (texte != NULL)
+	{
+		strncat(e->texte, texte, sizeof(e->texte) - 1);
+	}
+
+	atomic_store_explicit(&anneau->tete, tete + 1, memory_order_release);
+}
+
+/**
+ * @brief Comme journalEcrire, mais ne conserve qu'un enregistrement sur N
+ * pour les niveaux inférieurs à AVERT. Destiné aux événements fréquents du
+ * chemin des messages.
+ */
+void journalEchantillonne(enum NiveauJournal niveau, enum EvenementJournal evenement,
+						  int64_t a, int64_t b, int64_t c, const char *texte)
+{
+	if ((int)niveau < atomic_load_explicit(&niveauMinimum, memory_order_relaxed))
+	{
+		return;
+	}
+	if (niveau < JOURNAL_AVERTISSEMENT && tauxEchantillonnage > 1)
+	{
+		Anneau *anneau = anneauDuThread();
+		if (anneau == NULL || anneau->echantillon[evenement]++ % tauxEchantillonnage != 0)
+		{
+			return;
+		}
+	}
+	journalEcrire(niveau, evenement, a, b, c, texte);
+}
+
+/**
+ * @brief Fait tourner les fichiers : serveur.log devient serveur.log.1, etc.
+ */
+static void rotation(void)
+{
+	char ancien[300];
+	char nouveau[300];
+
+	fclose(sortie);
+	for (int i = NB_ROTATIONS - 1; i >= 1; i--)
+	{
+		snprintf(ancien, sizeof(ancien), "%s.%d", cheminFichier, i);
+		snprintf(nouveau, sizeof(nouveau), "%s.%d", cheminFichier, i + 1);
+		rename(ancien, nouveau);
+	}
+	snprintf(nouveau, sizeof(nouveau), "%s.1", cheminFichier);
+	rename(cheminFichier, nouveau);
+
+	sortie = fopen(cheminFichier, "a");
+	if (sortie == NULL)
+	{
+		sortie = stderr;
+	}
+	tailleFichier = 0;
+}
+
+/**
+ * @brief Met en forme un enregistrement sur une ligne clé=valeur.
+ */
+static void ecrireLigne(const Enregistrement *e)
+{
+	time_t secondes = e->horodatage / 1000000;
+	struct tm date;
+	gmtime_r(&secondes, &date);
+
+	char ligne[256];
+	int n = strftime(ligne, sizeof(ligne), "%Y-%m-%dT%H:%M:%S", &date);
+	n += snprintf(ligne + n, sizeof(ligne) - n, ".%06luZ %s %s thread=%d", (unsigned long)(e->horodatage % 1000000),
+				  nomNiveaux[e->niveau], nomEvenements[e->evenement], e->thread);
+	for (int v = 0; v < 3 && n < (int)sizeof(ligne); v++)
+	{
+		if (nomValeurs[e->evenement][v] != NULL)
+		{
+			n += snprintf(ligne + n, sizeof(ligne) - n, " %s=%ld", nomValeurs[e->evenement][v], (long)e->valeurs[v]);
+		}
+	}
+	if (e->texte[0] != '\0' && n < (int)sizeof(ligne))
+	{
+		n += snprintf(ligne + n, sizeof(ligne) - n, " texte=\"%s\"", e->texte);
+	}
+
+	tailleFichier += fprintf(sortie, "%s\n", ligne);
+}
+
+/**
+ * @brief Vide tous les anneaux dans le fichier de journal.
+ * Appelée périodiquement par le thread de vidage et à la sortie du programme.
+ */
+void journalVider(void)
+{
+	if (sortie == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&mutexVidage);
+	for (Anneau *anneau = atomic_load_explicit(&listeAnneaux, memory_order_acquire); anneau != NULL; anneau = anneau->suivant)
+	{
+		uint_fast64_t queue = atomic_load_explicit(&anneau->queue, memory_order_relaxed);
+		uint_fast64_t tete = atomic_load_explicit(&anneau->tete, memory_order_acquire);
+		while (queue != tete)
+		{
+			ecrireLigne(&anneau->cases[queue & (TAILLE_ANNEAU - 1)]);
+			queue++;
+		}
+		atomic_store_explicit(&anneau->queue, queue, memory_order_release);
+
+		uint_fast64_t pertes = atomic_exchange_explicit(&anneau->pertes, 0, memory_order_relaxed);
+		if (pertes > 0)
+		{
+			Enregistrement e = {0};
+			e.niveau = JOURNAL_AVERTISSEMENT;
+			e.evenement = EVT_PERTES;
+			e.valeurs[0] = pertes;
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			e.horodatage = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+			ecrireLigne(&e);
+			metriqueIncrementer(CPT_PERTES_JOURNAL, pertes);
+		}
+	}
+	fflush(sortie);
+	if (cheminFichier[0] != '\0' && tailleFichier >= TAILLE_FICHIER_MAX)
+	{
+		rotation();
+	}
+	pthread_mutex_unlock(&mutexVidage);
+}
+
+/**
+ * @brief Fonction principale du thread de vidage.
+ */
+static void *vidageThread(void *arg)
+{
+	struct timespec periode = {0, PERIODE_VIDAGE * 1000000L};
+	while (1)
+	{
+		nanosleep(&periode, NULL);
+		journalVider();
+	}
+	return NULL;
+}
+
+/**
+ * @brief Convertit un nom de niveau (debug, info, avert, erreur).
+ *
+ * @param nom nom du niveau
+ * @return le niveau, -1 si le nom est inconnu.
+ */
+int journalNiveauDepuisNom(const char *nom)
+{
+	for (int i = 0; i <= JOURNAL_ERREUR; i++)
+	{
+		if (strcasecmp(nom, nomNiveaux[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Ouvre le journal et démarre le thread de vidage.
+ *
+ * @param dossier dossier des fichiers de journal, NULL pour écrire sur la sortie standard
+ * @param niveau niveau minimum enregistré
+ * @param echantillonnage un événement fréquent sur N est conservé
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int journalDemarrer(const char *dossier, enum NiveauJournal niveau, int echantillonnage)
+{
+	atomic_store(&niveauMinimum, niveau);
+	tauxEchantillonnage = echantillonnage > 0 ? echantillonnage : 1;
+
+	if (dossier == NULL)
+	{
+		sortie = stdout;
+	}
+	else
+	{
+		mkdir(dossier, 0755);
+		snprintf(cheminFichier, sizeof(cheminFichier), "%s/serveur.log", dossier);
+		sortie = fopen(cheminFichier, "a");
+		if (sortie == NULL)
+		{
+			perror("Impossible d'ouvrir le fichier de journal");
+			return -1;
+		}
+		tailleFichier = ftell(sortie);
+	}
+	atexit(journalVider);
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, vidageThread, NULL) != 0)
+	{
+		perror("Erreur thread journal");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Niveaux de gravité des enregistrements du journal.
+ */
+enum NiveauJournal
+{
+	JOURNAL_DEBUG,
+	JOURNAL_INFO,
+	JOURNAL_AVERTISSEMENT,
+	JOURNAL_ERREUR
+};
+
+/**
+ * @brief Événements journalisés. Chaque événement porte jusqu'à trois valeurs
+ * numériques, nommées dans journal.c, et un court texte qui ne contient jamais
+ * le contenu d'un message.
+ */
+enum EvenementJournal
+{
+	EVT_DEMARRAGE,
+	EVT_CONNEXION,
+	EVT_PSEUDO,
+	EVT_DECONNEXION,
+	EVT_MESSAGE_RECU,
+	EVT_DIFFUSION,
+	EVT_COMMANDE,
+	EVT_ERREUR_RESEAU,
+	EVT_PERTES,
+	EVT_RELAIS,
+	EVT_INSTANTANE,
+	EVT_EXPIRATION,
+	EVT_DEBIT,
+	EVT_REFUS,
+	EVT_FEDERATION,
+	EVT_FUSION_INDEX,
+	EVT_MEMOIRE,
+	EVT_TLS,
+	NB_EVENEMENTS
+};
+
+int journalDemarrer(const char *dossier, enum NiveauJournal niveau, int echantillonnage);
+int journalNiveauDepuisNom(const char *nom);
+void journalEcrire(enum NiveauJournal niveau, enum EvenementJournal evenement,
+				   int64_t a, int64_t b, int64_t c, const char *texte);
+void journalEchantillonne(enum NiveauJournal niveau, enum EvenementJournal evenement,
+						  int64_t a, int64_t b, int64_t c, const char *texte);
+uint32_t journalEmpreinte(const char *contenu, size_t longueur);
+void journalVider(void);
+
+#endif
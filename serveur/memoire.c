@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "serveur.h"
+#include "memoire.h"
+#include "historique.h"
+#include "metriques.h"
+#include "journal.h"
+
+/**
+ * - memoireConnexion = budget de chaque connexion
+ * - plafond = plafond de la mémoire des connexions et de la mémoire partagée
+ * - octetsClient = mémoire imputée à chaque connexion
+ * - octetsPartages = mémoire imputée à chaque compte partagé
+ * - octetsTotal = somme de octetsClient et de octetsPartages
+ * - estDeleste = 1 pour une connexion déjà déconnectée par le délestage, dont la mémoire va être rendue
+ * - mutexDelestage = un seul délestage à la fois
+ * - estEvictionDemandee = 1 quand le thread d'éviction doit ramener la mémoire partagée à sa part
+ * - mutexEviction = protège l'attente du thread d'éviction
+ * - condEviction = signalée quand une éviction est demandée
+ */
+static size_t memoireConnexion = MEMOIRE_CONNEXION;
+static size_t plafond = MEMOIRE_PLAFOND;
+static _Atomic int64_t octetsClient[MAX_CLIENT];
+static _Atomic int64_t octetsPartages[NB_COMPTES];
+static _Atomic int64_t octetsTotal = 0;
+static atomic_int estDeleste[MAX_CLIENT];
+static pthread_mutex_t mutexDelestage = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int estEvictionDemandee = 0;
+static pthread_mutex_t mutexEviction = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condEviction = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Fixe le budget d'une connexion et le plafond global.
+ *
+ * @param connexion octets qu'une connexion peut se faire allouer, 0 pour la valeur par défaut
+ * @param maximum octets que les connexions et la mémoire partagée peuvent se faire allouer, 0 pour la valeur par défaut
+ */
+void memoireConfigurer(size_t connexion, size_t maximum)
+{
+	if (connexion > 0)
+	{
+		memoireConnexion = connexion;
+	}
+	if (maximum > 0)
+	{
+		plafond = maximum;
+	}
+}
+
+/**
+ * @brief Impute, sans condition, des octets à une connexion (négatif pour en rendre).
+ *
+ * @param numClient numéro du client
+ * @param octets octets imputés
+ */
+void memoireImputer(int numClient, int64_t octets)
+{
+	atomic_fetch_add(&octetsClient[numClient], octets);
+	atomic_fetch_add(&octetsTotal, octets);
+}
+
+/**
+ * @brief Impute, sans condition, des octets à un compte partagé (négatif pour
+ * en rendre). Le délestage ramène ensuite la mémoire partagée à sa part du plafond.
+ *
+ * @param compte COMPTE_HISTORIQUE, COMPTE_INDEX ou COMPTE_IDENTITES
+ * @param octets octets imputés
+ */
+void memoirePartager(int compte, int64_t octets)
+{
+	atomic_fetch_add(&octetsPartages[compte], octets);
+	atomic_fetch_add(&octetsTotal, octets);
+}
+
+/**
+ * @brief Mémoire imputée à tous les comptes partagés.
+ */
+static int64_t partages(void)
+{
+	int64_t total = 0;
+	for (int compte = 0; compte < NB_COMPTES; compte++)
+	{
+		total += atomic_load(&octetsPartages[compte]);
+	}
+	return total;
+}
+
+/**
+ * @brief Mémoire que le délestage des connexions doit ramener sous le plafond :
+ * la mémoire partagée au-delà de sa part n'en fait pas partie, le thread
+ * d'éviction va la rendre.
+ */
+static int64_t horsEviction(void)
+{
+	int64_t exces = partages() - (int64_t)plafond * PART_PARTAGEE / 100;
+	return atomic_load(&octetsTotal) - (exces > 0 ? exces : 0);
+}
+
+/**
+ * @brief Ouvre le compte d'une connexion qui vient d'être enregistrée, nouvelle
+ * ou reprise, avec le coût de ses tampons de réception.
+ *
+ * @param numClient numéro du client
+ */
+void memoireOuvrir(int numClient)
+{
+	int64_t ancien = atomic_exchange(&octetsClient[numClient], MEMOIRE_FIXE);
+	atomic_fetch_add(&octetsTotal, (int64_t)MEMOIRE_FIXE - ancien);
+	atomic_store(&estDeleste[numClient], 0);
+}
+
+/**
+ * @brief Ouvre le compte d'une nouvelle connexion si le plafond global permet
+ * le coût de ses tampons de réception ; sinon la connexion doit être refusée.
+ * La mémoire partagée au-delà de sa part, que le thread d'éviction va rendre,
+ * ne fait pas refuser.
+ *
+ * @param numClient numéro du client
+ * @return 0 si le compte est ouvert, -1 si la connexion doit être refusée.
+ */
+int memoireAdmettre(int numClient)
+{
+	// Imputation d'abord, annulée si elle dépasse, comme pour memoireReserver
+	memoireOuvrir(numClient);
+	if (horsEviction() > (int64_t)plafond)
+	{
+		memoireFermer(numClient);
+		metriqueIncrementer(CPT_MEMOIRE_REFUS, 1);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Ferme le compte d'une connexion, après que sa file a été vidée.
+ *
+ * @param numClient numéro du client
+ */
+void memoireFermer(int numClient)
+{
+	atomic_fetch_sub(&octetsTotal, atomic_exchange(&octetsClient[numClient], 0));
+}
+
+/**
+ * @brief Impute des octets à une connexion si son budget et le plafond global
+ * le permettent.
+ *
+ * @param numClient numéro du client
+ * @param octets octets demandés
+ * @return 0 si les octets sont imputés, -1 si l'allocation doit être refusée.
+ */
+int memoireReserver(int numClient, size_t octets)
+{
+	// Imputation d'abord, annulée si elle dépasse : deux réservations simultanées ne franchissent pas ensemble le plafond
+	int64_t client = atomic_fetch_add(&octetsClient[numClient], octets) + (int64_t)octets;
+	int64_t total = atomic_fetch_add(&octetsTotal, octets) + (int64_t)octets;
+	if (client > (int64_t)memoireConnexion || total > (int64_t)plafond)
+	{
+		memoireRendre(numClient, octets);
+		metriqueIncrementer(CPT_MEMOIRE_REFUS, 1);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Rend des octets imputés à une connexion.
+ *
+ * @param numClient numéro du client
+ * @param octets octets libérés
+ */
+void memoireRendre(int numClient, size_t octets)
+{
+	memoireImputer(numClient, -(int64_t)octets);
+}
+
+/**
+ * @brief Pression mémoire des connexions et de la mémoire partagée.
+ *
+ * @return la part du plafond utilisée, en pourcentage.
+ */
+int memoirePression(void)
+{
+	int64_t total = atomic_load(&octetsTotal);
+	return total > 0 ? (int)(total * 100 / (int64_t)plafond) : 0;
+}
+
+/**
+ * @brief Cherche la connexion active qui consomme le plus de mémoire.
+ *
+ * @param estDelesteeExclue 1 pour ignorer les connexions déjà déconnectées par le délestage
+ * @return son numéro, -1 s'il n'y en a pas.
+ */
+static int plusGrosse(int estDelesteeExclue)
+{
+	int pire = -1;
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		if (tabClient[i].estOccupe && !(estDelesteeExclue && atomic_load(&estDeleste[i])) &&
+			(pire < 0 || atomic_load(&octetsClient[i]) > atomic_load(&octetsClient[pire])))
+		{
+			pire = i;
+		}
+	}
+	return pire;
+}
+
+/**
+ * @brief Fonction principale du thread d'éviction : réveillé par le délestage,
+ * il fait perdre à l'historique ses plus anciens messages jusqu'à ramener la
+ * mémoire partagée à sa part du plafond. L'éviction attend que les lecteurs de
+ * l'historique aient rendu historiqueVerrouiller() ; elle ne peut donc pas se
+ * faire dans fileEnfiler, que ces lecteurs appellent.
+ */
+static void *evictionThread(void *arg)
+{
+	(void)arg;
+	while (1)
+	{
+		pthread_mutex_lock(&mutexEviction);
+		while (!atomic_load(&estEvictionDemandee))
+		{
+			pthread_cond_wait(&condEviction, &mutexEviction);
+		}
+		pthread_mutex_unlock(&mutexEviction);
+		// Une demande faite pendant l'éviction en relance une autre
+		atomic_store(&estEvictionDemandee, 0);
+
+		int64_t exces = partages() - (int64_t)plafond * PART_PARTAGEE / 100;
+		uint32_t evinces = exces > 0 ? historiqueDelester(exces) : 0;
+		if (evinces > 0)
+		{
+			metriqueIncrementer(CPT_DELESTAGE_HISTORIQUE, evinces);
+			journalEcrire(JOURNAL_INFO, EVT_MEMOIRE, -1, atomic_load(&octetsPartages[COMPTE_HISTORIQUE]), atomic_load(&octetsTotal), "historique");
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Démarre le thread d'éviction de l'historique.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int memoireDemarrer(void)
+{
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, evictionThread, NULL) != 0)
+	{
+		perror("Erreur thread d'éviction de l'historique");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
+
+/**
+ * @brief Déleste quand la mémoire partagée dépasse sa part du plafond, ou que
+ * le total approche du plafond. Le thread d'éviction est d'abord réveillé pour
+ * que l'historique perde ses plus anciens messages. Les événements éphémères
+ * sont déjà refusés par fileEnfiler ; ici, les files perdent ensuite leurs
+ * trames éphémères et vrac en attente, de la plus chargée à la moins chargée,
+ * puis, si le plafond reste atteint, les connexions qui consomment le plus sont
+ * déconnectées jusqu'à ce que la mémoire qu'elles vont rendre suffise.
+ * À appeler sans tenir de mutexEnvoi. L'appelant peut tenir
+ * historiqueVerrouiller() (verrouEviction en lecture) : le délestage ne prend
+ * ni mutexHistorique ni verrouEviction.
+ */
+void memoireDelester(void)
+{
+	if (partages() > (int64_t)plafond * PART_PARTAGEE / 100 && !atomic_exchange(&estEvictionDemandee, 1))
+	{
+		pthread_mutex_lock(&mutexEviction);
+		pthread_cond_signal(&condEviction);
+		pthread_mutex_unlock(&mutexEviction);
+	}
+	int64_t seuilElagage = (int64_t)plafond * PRESSION_ELAGAGE / 100;
+	if (horsEviction() < seuilElagage || pthread_mutex_trylock(&mutexDelestage) != 0)
+	{
+		return;
+	}
+
+	int estElague[MAX_CLIENT] = {0};
+	for (int n = 0; n < MAX_CLIENT && horsEviction() >= seuilElagage; n++)
+	{
+		int pire = -1;
+		for (int i = 0; i < MAX_CLIENT; i++)
+		{
+			if (tabClient[i].estOccupe && !estElague[i] &&
+				(pire < 0 || atomic_load(&octetsClient[i]) > atomic_load(&octetsClient[pire])))
+			{
+				pire = i;
+			}
+		}
+		if (pire < 0)
+		{
+			break;
+		}
+		estElague[pire] = 1;
+		int nombre = fileElaguer(pire);
+		if (nombre > 0)
+		{
+			metriqueIncrementer(CPT_DELESTAGE_TRAMES, nombre);
+			journalEcrire(JOURNAL_AVERTISSEMENT, EVT_MEMOIRE, pire, atomic_load(&octetsClient[pire]), atomic_load(&octetsTotal), "elagage");
+		}
+	}
+
+	// La mémoire d'une connexion déconnectée n'est rendue qu'à la fin de son thread : on en tient compte.
+	// La mémoire partagée au-delà de sa part (évictions en cours, bloc de texte en cours, index pas encore
+	// purgé) ne fait pas déconnecter.
+	int64_t aRendre = 0;
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		if (tabClient[i].estOccupe && atomic_load(&estDeleste[i]))
+		{
+			aRendre += atomic_load(&octetsClient[i]);
+		}
+	}
+	while (horsEviction() - aRendre >= (int64_t)plafond)
+	{
+		int pire = plusGrosse(1);
+		if (pire < 0)
+		{
+			break;
+		}
+		atomic_store(&estDeleste[pire], 1);
+		aRendre += atomic_load(&octetsClient[pire]);
+		metriqueIncrementer(CPT_DELESTAGE_DECONNEXIONS, 1);
+		journalEcrire(JOURNAL_AVERTISSEMENT, EVT_MEMOIRE, pire, atomic_load(&octetsClient[pire]), atomic_load(&octetsTotal), "deconnexion");
+		shutdown(tabClient[pire].dSC, SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&mutexDelestage);
+}
+
+/**
+ * @brief Écrit l'état de la mémoire des connexions, destiné à la commande stats.
+ *
+ * @param tampon buffer de sortie
+ * @param taille taille du buffer
+ * @return le nombre d'octets écrits (tronqué à taille - 1).
+ */
+size_t memoireResume(char *tampon, size_t taille)
+{
+	if (taille == 0)
+	{
+		return 0;
+	}
+	int ecrit = snprintf(tampon, taille, "mémoire %ld o / %zu o (%d %%), historique %ld o, index %ld o, identités %ld o, budget %zu o par connexion :",
+						 (long)atomic_load(&octetsTotal), plafond, memoirePression(), (long)atomic_load(&octetsPartages[COMPTE_HISTORIQUE]),
+						 (long)atomic_load(&octetsPartages[COMPTE_INDEX]), (long)atomic_load(&octetsPartages[COMPTE_IDENTITES]), memoireConnexion);
+	for (int i = 0; i < MAX_CLIENT && ecrit >= 0 && (size_t)ecrit < taille; i++)
+	{
+		if (tabClient[i].estOccupe)
+		{
+			ecrit += snprintf(tampon + ecrit, taille - ecrit, " %d=%ld", i, (long)atomic_load(&octetsClient[i]));
+		}
+	}
+	if (ecrit >= 0 && (size_t)ecrit < taille)
+	{
+		ecrit += snprintf(tampon + ecrit, taille - ecrit, "\n");
+	}
+	return ecrit < 0 ? 0 : (size_t)ecrit < taille ? (size_t)ecrit : taille - 1;
+}
+
+/**
+ * @brief Jauge de la mémoire imputée au plafond : connexions et mémoire partagée.
+ */
+long jaugeMemoire(void)
+{
+	return atomic_load(&octetsTotal);
+}
+
+/**
+ * @brief Jauge de la mémoire de la connexion qui consomme le plus.
+ */
+long jaugeMemoireConnexionMax(void)
+{
+	int pire = plusGrosse(0);
+	return pire >= 0 ? atomic_load(&octetsClient[pire]) : 0;
+}
+
+/**
+ * @brief Jauge de la mémoire partagée : historique, index de recherche et identités.
+ */
+long jaugeMemoirePartagee(void)
+{
+	return partages();
+}
@@ -0,0 +1,63 @@
+#ifndef MEMOIRE_H
+#define MEMOIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Comptabilité mémoire des connexions : chaque allocation faite pour un
+ * client (tampons de réception, trames en file, flux de compression, réponses
+ * des commandes) est imputée à son budget, et le total de toutes les
+ * connexions est plafonné. La mémoire partagée entre les connexions
+ * (historique, index de recherche, identités) est imputée au même plafond :
+ * au-delà de sa part, un thread dédié fait perdre à l'historique ses plus
+ * anciens messages, et l'index les segments qui les couvraient. Quand le total approche du plafond, le
+ * serveur déleste dans l'ordre : il cesse de mettre en file les événements
+ * éphémères, puis élague les trames éphémères et vrac en attente, et enfin
+ * déconnecte les connexions qui consomment le plus.
+ */
+
+/**
+ * - MEMOIRE_CONNEXION = budget par défaut d'une connexion
+ * - MEMOIRE_PLAFOND = plafond par défaut de la mémoire des connexions et de la mémoire partagée
+ * - MEMOIRE_FIXE = coût d'une connexion ouverte : lecteur de trames, pseudo et fragment de message
+ * - PRESSION_EPHEMERES = pourcentage du plafond au-delà duquel les événements éphémères ne sont plus mis en file
+ * - PRESSION_ELAGAGE = pourcentage du plafond au-delà duquel les files perdent leurs trames éphémères et vrac
+ * - PART_PARTAGEE = pourcentage du plafond au-delà duquel la mémoire partagée est délestée
+ */
+#define MEMOIRE_CONNEXION (1024 * 1024)
+#define MEMOIRE_PLAFOND (96 * 1024 * 1024)
+#define MEMOIRE_FIXE (sizeof(LecteurTrame) + TAILLE_PSEUDO + TAILLE_MESSAGE)
+#define PRESSION_EPHEMERES 60
+#define PRESSION_ELAGAGE 80
+#define PART_PARTAGEE 40
+
+/**
+ * @brief Comptes de la mémoire partagée entre les connexions.
+ *
+ * - COMPTE_HISTORIQUE = pages et blocs de texte de l'historique, délestés par éviction
+ * - COMPTE_INDEX = index de recherche, libéré avec les messages évincés
+ * - COMPTE_IDENTITES = pseudos internés, bornés par MAX_IDENTITES
+ */
+#define COMPTE_HISTORIQUE 0
+#define COMPTE_INDEX 1
+#define COMPTE_IDENTITES 2
+#define NB_COMPTES 3
+
+void memoireConfigurer(size_t connexion, size_t plafond);
+void memoireOuvrir(int numClient);
+int memoireAdmettre(int numClient);
+void memoireFermer(int numClient);
+int memoireReserver(int numClient, size_t octets);
+void memoireImputer(int numClient, int64_t octets);
+void memoireRendre(int numClient, size_t octets);
+void memoirePartager(int compte, int64_t octets);
+int memoirePression(void);
+int memoireDemarrer(void);
+void memoireDelester(void);
+size_t memoireResume(char *tampon, size_t taille);
+long jaugeMemoire(void);
+long jaugeMemoireConnexionMax(void);
+long jaugeMemoirePartagee(void);
+
+#endif
@@ -0,0 +1,613 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "metriques.h"
+
+/**
+ * @brief Bloc de métriques propre à un thread.
+ *
+ * Un seul thread écrit dans un bloc à un instant donné : les incréments sont
+ * de simples lecture/écriture relâchées, sans instruction atomique verrouillée.
+ * Quand le thread se termine, son bloc est marqué libre et repris tel quel par
+ * le prochain thread : les valeurs restent cumulées.
+ *
+ * @param compteurs valeurs des compteurs cumulés
+ * @param seaux nombre d'observations par seau pour chaque histogramme
+ * @param sommes somme des observations pour chaque histogramme
+ * @param estLibre 1 si aucun thread n'utilise le bloc ; 0 sinon
+ * @param suivant bloc suivant dans la liste globale
+ */
+typedef struct BlocMetriques BlocMetriques;
+struct BlocMetriques
+{
+	_Alignas(64) _Atomic uint64_t compteurs[NB_COMPTEURS];
+	_Atomic uint64_t seaux[NB_HISTOGRAMMES][NB_SEAUX];
+	_Atomic uint64_t sommes[NB_HISTOGRAMMES];
+	atomic_int estLibre;
+	BlocMetriques *suivant;
+};
+
+/**
+ * @brief Jauge lue au moment de l'export.
+ *
+ * @param nom nom de la métrique
+ * @param aide description de la métrique
+ * @param lire fonction renvoyant la valeur courante
+ */
+typedef struct Jauge Jauge;
+struct Jauge
+{
+	const char *nom;
+	const char *aide;
+	long (*lire)(void);
+};
+
+/**
+ * @brief Commande d'exploitation servie par la socket d'administration.
+ *
+ * @param nom nom de la commande, premier mot de la requête
+ * @param executer fonction écrivant la réponse, à partir des mots suivants
+ */
+typedef struct CommandeAdmin CommandeAdmin;
+struct CommandeAdmin
+{
+	const char *nom;
+	size_t (*executer)(char *arguments, char *tampon, size_t taille);
+};
+
+/**
+ * - MAX_JAUGES = nombre maximum de jauges enregistrées
+ * - MAX_COMMANDES = nombre maximum de commandes d'administration enregistrées
+ */
+#define MAX_JAUGES 12
+#define MAX_COMMANDES 4
+
+/**
+ * - listeBlocs = liste de tous les blocs de métriques créés
+ * - blocCourant = bloc du thread courant
+ * - cleBloc = clé permettant de libérer le bloc à la fin du thread
+ * - tabJauge = jauges enregistrées par le serveur
+ * - tabCommande = commandes d'exploitation enregistrées par le serveur
+ * - cheminAdmin = chemin de la socket d'administration
+ */
+static _Atomic(BlocMetriques *) listeBlocs = NULL;
+static __thread BlocMetriques *blocCourant = NULL;
+static pthread_key_t cleBloc;
+static pthread_once_t cleBlocInitialisee = PTHREAD_ONCE_INIT;
+static Jauge tabJauge[MAX_JAUGES];
+static int nbJauges = 0;
+static CommandeAdmin tabCommande[MAX_COMMANDES];
+static int nbCommandes = 0;
+static char cheminAdmin[108];
+
+static const char *nomCompteurs[NB_COMPTEURS] = {
+	"messagerie_connexions_acceptees_total",
+	"messagerie_messages_recus_total",
+	"messagerie_messages_envoyes_total",
+	"messagerie_octets_recus_total",
+	"messagerie_octets_envoyes_total",
+	"messagerie_commandes_total",
+	"messagerie_pertes_total",
+	"messagerie_pertes_journal_total",
+	"messagerie_expirations_total",
+	"messagerie_debit_ralentis_total",
+	"messagerie_debit_rejets_total",
+	"messagerie_connexions_refusees_total",
+	"messagerie_federation_enregistrements_total",
+	"messagerie_federation_lots_total",
+	"messagerie_compression_octets_entree_total",
+	"messagerie_compression_octets_sortie_total",
+	"messagerie_compression_microsecondes_total",
+	"messagerie_ephemeres_recus_total",
+	"messagerie_ephemeres_fusionnes_total",
+	"messagerie_ephemeres_envoyes_total",
+	"messagerie_ephemeres_perdus_total",
+	"messagerie_memoire_refus_total",
+	"messagerie_delestage_ephemeres_total",
+	"messagerie_delestage_trames_total",
+	"messagerie_delestage_deconnexions_total",
+	"messagerie_delestage_historique_total",
+	"messagerie_tls_poignees_total",
+	"messagerie_tls_echecs_total",
+	"messagerie_tls_noyau_emission_total",
+	"messagerie_tls_noyau_reception_total"};
+
+static const char *aideCompteurs[NB_COMPTEURS] = {
+	"Connexions acceptées",
+	"Messages reçus des clients",
+	"Messages envoyés aux clients",
+	"Octets reçus des clients",
+	"Octets envoyés aux clients",
+	"Commandes traitées",
+	"Messages non remis",
+	"Enregistrements de journal perdus (anneau plein)",
+	"Clients déconnectés par une minuterie (silence, inactivité, pseudo)",
+	"Diffusions retardées par la limite de débit",
+	"Diffusions rejetées par la limite de débit",
+	"Connexions refusées à l'admission (serveur complet, adresse plafonnée)",
+	"Enregistrements envoyés aux autres nœuds de la fédération",
+	"Envois groupés de lots aux autres nœuds de la fédération",
+	"Octets de trames volumineuses passés au compresseur",
+	"Octets compressés envoyés à la place",
+	"Temps processeur passé à compresser et à enrichir les dictionnaires",
+	"Événements éphémères reçus des clients (saisie, lecture)",
+	"Événements éphémères remplacés par un état plus récent avant leur diffusion",
+	"Événements éphémères mis en file pour un destinataire",
+	"Événements éphémères non remis, file du destinataire trop chargée",
+	"Allocations refusées, budget de la connexion ou plafond mémoire atteint",
+	"Événements éphémères non mis en file, pression mémoire",
+	"Trames éphémères et vrac retirées des files, pression mémoire",
+	"Connexions fermées pour ramener la mémoire sous le plafond",
+	"Messages évincés de l'historique pour ramener la mémoire partagée à sa part du plafond",
+	"Poignées de main TLS réussies",
+	"Poignées de main TLS échouées ou interrompues",
+	"Connexions TLS dont le noyau chiffre les enregistrements émis (kTLS)",
+	"Connexions TLS dont le noyau déchiffre les enregistrements reçus (kTLS)"};
+
+static const char *nomHistogrammes[NB_HISTOGRAMMES] = {
+	"messagerie_diffusion_microsecondes",
+	"messagerie_commande_microsecondes",
+	"messagerie_attente_interactif_microsecondes",
+	"messagerie_recherche_microsecondes"};
+
+static const char *aideHistogrammes[NB_HISTOGRAMMES] = {
+	"Durée de diffusion d'un message dans un salon",
+	"Durée de traitement d'une commande",
+	"Attente d'un message interactif entre sa création et son envoi complet à un client",
+	"Durée d'une recherche plein texte dans l'historique d'un salon"};
+
+/**
+ * @brief Libère le bloc d'un thread qui se termine.
+ *
+ * @param bloc bloc du thread
+ */
+static void libererBloc(void *bloc)
+{
+	atomic_store_explicit(&((BlocMetriques *)bloc)->estLibre, 1, memory_order_release);
+}
+
+static void creerCleBloc(void)
+{
+	pthread_key_create(&cleBloc, libererBloc);
+}
+
+/**
+ * @brief Donne le bloc du thread courant, en reprenant un bloc libre si possible.
+ *
+ * @return le bloc du thread courant.
+ */
+static BlocMetriques *blocDuThread(void)
+{
+	if (blocCourant != NULL)
+	{
+		return blocCourant;
+	}
+	pthread_once(&cleBlocInitialisee, creerCleBloc);
+
+	BlocMetriques *bloc = atomic_load_explicit(&listeBlocs, memory_order_acquire);
+	while (bloc != NULL)
+	{
+		int libre = 1;
+		if (atomic_compare_exchange_strong(&bloc->estLibre, &libre, 0))
+		{
+			break;
+		}
+		bloc = bloc->suivant;
+	}
+
+	if (bloc == NULL)
+	{
+		bloc = aligned_alloc(64, sizeof(BlocMetriques));
+		if (bloc == NULL)
+		{
+			perror("Erreur d'allocation des métriques");
+			exit(-1);
+		}
+		memset(bloc, 0, sizeof(BlocMetriques));
+		bloc->suivant = atomic_load_explicit(&listeBlocs, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak(&listeBlocs, &bloc->suivant, bloc))
+		{
+		}
+	}
+
+	pthread_setspecific(cleBloc, bloc);
+	blocCourant = bloc;
+	return bloc;
+}
+
+/**
+ * @brief Ajoute une valeur à une case écrite par un seul thread.
+ */
+static inline void ajouter(_Atomic uint64_t *cible, uint64_t valeur)
+{
+	atomic_store_explicit(cible, atomic_load_explicit(cible, memory_order_relaxed) + valeur, memory_order_relaxed);
+}
+
+/**
+ * @brief Incrémente un compteur dans le bloc du thread courant.
+ *
+ * @param compteur compteur à incrémenter
+ * @param valeur valeur à ajouter
+ */
+void metriqueIncrementer(enum Compteur compteur, uint64_t valeur)
+{
+	ajouter(&blocDuThread()->compteurs[compteur], valeur);
+}
+
+/**
+ * @brief Enregistre une observation dans un histogramme.
+ *
+ * @param histogramme histogramme concerné
+ * @param microsecondes valeur observée
+ */
+void metriqueObserver(enum Histogramme histogramme, uint64_t microsecondes)
+{
+	BlocMetriques *bloc = blocDuThread();
+	int seau = microsecondes <= 1 ? 0 : 64 - __builtin_clzll(microsecondes - 1);
+	if (seau >= NB_SEAUX)
+	{
+		seau = NB_SEAUX - 1;
+	}
+	ajouter(&bloc->seaux[histogramme][seau], 1);
+	ajouter(&bloc->sommes[histogramme], microsecondes);
+}
+
+/**
+ * @brief Horloge monotone pour mesurer les durées.
+ *
+ * @return le temps courant en microsecondes.
+ */
+uint64_t metriqueHorloge(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Enregistre une jauge lue à chaque export.
+ * À appeler avant le démarrage des threads.
+ *
+ * @param nom nom de la métrique
+ * @param aide description de la métrique
+ * @param lire fonction renvoyant la valeur courante
+ */
+void metriquesAjouterJauge(const char *nom, const char *aide, long (*lire)(void))
+{
+	if (nbJauges < MAX_JAUGES)
+	{
+		tabJauge[nbJauges].nom = nom;
+		tabJauge[nbJauges].aide = aide;
+		tabJauge[nbJauges].lire = lire;
+		nbJauges++;
+	}
+}
+
+/**
+ * @brief Enregistre une commande d'exploitation, servie seulement par la socket
+ * d'administration : son accès est protégé par les droits du fichier.
+ * À appeler avant le démarrage des threads.
+ *
+ * @param nom nom de la commande
+ * @param executer fonction écrivant la réponse dans un buffer et renvoyant sa longueur
+ */
+void metriquesAjouterCommande(const char *nom, size_t (*executer)(char *arguments, char *tampon, size_t taille))
+{
+	if (nbCommandes < MAX_COMMANDES)
+	{
+		tabCommande[nbCommandes].nom = nom;
+		tabCommande[nbCommandes].executer = executer;
+		nbCommandes++;
+	}
+}
+
+/**
+ * @brief Additionne les blocs de tous les threads.
+ */
+static void sommer(uint64_t compteurs[NB_COMPTEURS], uint64_t seaux[NB_HISTOGRAMMES][NB_SEAUX], uint64_t sommes[NB_HISTOGRAMMES])
+{
+	memset(compteurs, 0, sizeof(uint64_t) * NB_COMPTEURS);
+	memset(seaux, 0, sizeof(uint64_t) * NB_HISTOGRAMMES * NB_SEAUX);
+	memset(sommes, 0, sizeof(uint64_t) * NB_HISTOGRAMMES);
+
+	for (BlocMetriques *bloc = atomic_load_explicit(&listeBlocs, memory_order_acquire); bloc != NULL; bloc = bloc->suivant)
+	{
+		for (int c = 0; c < NB_COMPTEURS; c++)
+		{
+			compteurs[c] += atomic_load_explicit(&bloc->compteurs[c], memory_order_relaxed);
+		}
+		for (int h = 0; h < NB_HISTOGRAMMES; h++)
+		{
+			for (int s = 0; s < NB_SEAUX; s++)
+			{
+				seaux[h][s] += atomic_load_explicit(&bloc->seaux[h][s], memory_order_relaxed);
+			}
+			sommes[h] += atomic_load_explicit(&bloc->sommes[h], memory_order_relaxed);
+		}
+	}
+}
+
+/**
+ * @brief Ajoute du texte formaté au tampon sans jamais le dépasser.
+ */
+#define AJOUTER(...)                                                    \
+	do                                                                  \
+	{                                                                   \
+		if (ecrit < taille)                                             \
+		{                                                               \
+			int n = snprintf(tampon + ecrit, taille - ecrit, __VA_ARGS__); \
+			ecrit += n > 0 ? (size_t)n : 0;                             \
+		}                                                               \
+	} while (0)
+
+/**
+ * @brief Écrit toutes les métriques au format texte de Prometheus.
+ *
+ * @param tampon buffer de sortie
+ * @param taille taille du buffer
+ * @return le nombre d'octets écrits (tronqué à taille - 1).
+ */
+size_t metriquesFormater(char *tampon, size_t taille)
+{
+	uint64_t compteurs[NB_COMPTEURS];
+	uint64_t seaux[NB_HISTOGRAMMES][NB_SEAUX];
+	uint64_t sommes[NB_HISTOGRAMMES];
+	sommer(compteurs, seaux, sommes);
+
+	size_t ecrit = 0;
+	for (int c = 0; c < NB_COMPTEURS; c++)
+	{
+		AJOUTER("# HELP %s %s\n# TYPE %s counter\n%s %lu\n", nomCompteurs[c], aideCompteurs[c],
+				nomCompteurs[c], nomCompteurs[c], (unsigned long)compteurs[c]);
+	}
+	for (int j = 0; j < nbJauges; j++)
+	{
+		AJOUTER("# HELP %s %s\n# TYPE %s gauge\n%s %ld\n", tabJauge[j].nom, tabJauge[j].aide,
+				tabJauge[j].nom, tabJauge[j].nom, tabJauge[j].lire());
+	}
+	for (int h = 0; h < NB_HISTOGRAMMES; h++)
+	{
+		AJOUTER("# HELP %s %s\n# TYPE %s histogram\n", nomHistogrammes[h], aideHistogrammes[h], nomHistogrammes[h]);
+		uint64_t cumul = 0;
+		for (int s = 0; s < NB_SEAUX - 1; s++)
+		{
+			cumul += seaux[h][s];
+			AJOUTER("%s_bucket{le=\"%lu\"} %lu\n", nomHistogrammes[h], 1UL << s, (unsigned long)cumul);
+		}
+		cumul += seaux[h][NB_SEAUX - 1];
+		AJOUTER("%s_bucket{le=\"+Inf\"} %lu\n", nomHistogrammes[h], (unsigned long)cumul);
+		AJOUTER("%s_sum %lu\n%s_count %lu\n", nomHistogrammes[h], (unsigned long)sommes[h],
+				nomHistogrammes[h], (unsigned long)cumul);
+	}
+	return ecrit < taille ? ecrit : taille - 1;
+}
+
+/**
+ * @brief Donne la borne supérieure du seau contenant le quantile demandé.
+ */
+static unsigned long quantile(uint64_t seaux[NB_SEAUX], double q)
+{
+	uint64_t total = 0;
+	for (int s = 0; s < NB_SEAUX; s++)
+	{
+		total += seaux[s];
+	}
+	uint64_t rang = (uint64_t)(q * total);
+	uint64_t cumul = 0;
+	for (int s = 0; s < NB_SEAUX; s++)
+	{
+		cumul += seaux[s];
+		if (cumul > rang)
+		{
+			return 1UL << s;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Écrit un résumé court des métriques, destiné à la commande stats.
+ *
+ * @param tampon buffer de sortie
+ * @param taille taille du buffer
+ * @return le nombre d'octets écrits (tronqué à taille - 1).
+ */
+size_t metriquesResume(char *tampon, size_t taille)
+{
+	uint64_t compteurs[NB_COMPTEURS];
+	uint64_t seaux[NB_HISTOGRAMMES][NB_SEAUX];
+	uint64_t sommes[NB_HISTOGRAMMES];
+	sommer(compteurs, seaux, sommes);
+
+	size_t ecrit = 0;
+	AJOUTER("Statistiques du serveur :\n");
+	AJOUTER("connexions %lu | reçus %lu (%lu o) | envoyés %lu (%lu o) | commandes %lu | pertes %lu\n",
+			(unsigned long)compteurs[CPT_CONNEXIONS_ACCEPTEES], (unsigned long)compteurs[CPT_MESSAGES_RECUS],
+			(unsigned long)compteurs[CPT_OCTETS_RECUS], (unsigned long)compteurs[CPT_MESSAGES_ENVOYES],
+			(unsigned long)compteurs[CPT_OCTETS_ENVOYES], (unsigned long)compteurs[CPT_COMMANDES],
+			(unsigned long)compteurs[CPT_PERTES]);
+	AJOUTER("compression %lu o -> %lu o, %lu µs cpu\n",
+			(unsigned long)compteurs[CPT_COMPRESSION_OCTETS_ENTREE], (unsigned long)compteurs[CPT_COMPRESSION_OCTETS_SORTIE],
+			(unsigned long)compteurs[CPT_COMPRESSION_MICROSECONDES]);
+	AJOUTER("éphémères reçus %lu | fusionnés %lu | envoyés %lu | perdus %lu\n",
+			(unsigned long)compteurs[CPT_EPHEMERES_RECUS], (unsigned long)compteurs[CPT_EPHEMERES_FUSIONNES],
+			(unsigned long)compteurs[CPT_EPHEMERES_ENVOYES], (unsigned long)compteurs[CPT_EPHEMERES_PERDUS]);
+	AJOUTER("mémoire refus %lu | délestage éphémères %lu | trames élaguées %lu | déconnexions %lu | historique %lu\n",
+			(unsigned long)compteurs[CPT_MEMOIRE_REFUS], (unsigned long)compteurs[CPT_DELESTAGE_EPHEMERES],
+			(unsigned long)compteurs[CPT_DELESTAGE_TRAMES], (unsigned long)compteurs[CPT_DELESTAGE_DECONNEXIONS],
+			(unsigned long)compteurs[CPT_DELESTAGE_HISTORIQUE]);
+	AJOUTER("tls poignées %lu | échecs %lu | kTLS émission %lu | réception %lu\n",
+			(unsigned long)compteurs[CPT_TLS_POIGNEES], (unsigned long)compteurs[CPT_TLS_ECHECS],
+			(unsigned long)compteurs[CPT_TLS_NOYAU_EMISSION], (unsigned long)compteurs[CPT_TLS_NOYAU_RECEPTION]);
+	for (int j = 0; j < nbJauges; j++)
+	{
+		AJOUTER("%s %ld\n", tabJauge[j].nom + strlen("messagerie_"), tabJauge[j].lire());
+	}
+	AJOUTER("diffusion p50 <= %lu µs, p99 <= %lu µs\n", quantile(seaux[HIST_DIFFUSION], 0.5), quantile(seaux[HIST_DIFFUSION], 0.99));
+	AJOUTER("commande p50 <= %lu µs, p99 <= %lu µs\n", quantile(seaux[HIST_COMMANDE], 0.5), quantile(seaux[HIST_COMMANDE], 0.99));
+	AJOUTER("attente interactif p50 <= %lu µs, p99 <= %lu µs\n", quantile(seaux[HIST_ATTENTE_INTERACTIF], 0.5), quantile(seaux[HIST_ATTENTE_INTERACTIF], 0.99));
+	AJOUTER("recherche p50 <= %lu µs, p99 <= %lu µs\n", quantile(seaux[HIST_RECHERCHE], 0.5), quantile(seaux[HIST_RECHERCHE], 0.99));
+	return ecrit < taille ? ecrit : taille - 1;
+}
+
+/**
+ * @brief Fonction principale du thread de la socket d'administration.
+ * Chaque connexion reçoit une réponse puis est fermée. La requête est une ligne
+ * « commande arguments » ou une requête HTTP « GET /commande/arguments »
+ * (curl --unix-socket), dont la réponse est alors précédée d'un en-tête HTTP.
+ * Sans requête, ou pour /metrics, la réponse est l'export complet.
+ *
+ * @param dSAdmin socket d'écoute d'administration
+ */
+static void *administrationThread(void *dSAdmin)
+{
+	int dSA = (long)dSAdmin;
+	size_t taille = 64 * 1024;
+	char *tampon = malloc(taille);
+	if (tampon == NULL)
+	{
+		perror("Erreur d'allocation de l'export des métriques");
+		return NULL;
+	}
+
+	while (1)
+	{
+		int dSC = accept(dSA, NULL, NULL);
+		if (dSC < 0)
+		{
+			continue;
+		}
+
+		// On laisse un court délai au client pour envoyer une éventuelle requête
+		char requete[256];
+		ssize_t lu = 0;
+		struct pollfd attente = {dSC, POLLIN, 0};
+		if (poll(&attente, 1, 100) > 0)
+		{
+			lu = recv(dSC, requete, sizeof(requete) - 1, 0);
+		}
+
+		requete[lu > 0 ? lu : 0] = '\0';
+
+		// La cible « /commande/arguments » devient « commande arguments », les %XX décodés
+		int estHttp = strncmp(requete, "GET ", 4) == 0;
+		char *cible = requete + (estHttp ? 4 : 0);
+		cible[strcspn(cible, estHttp ? " \r\n" : "\r\n")] = '\0';
+		char *ecrit = cible;
+		for (char *c = cible; *c != '\0'; c++)
+		{
+			unsigned int octet;
+			if (estHttp && c[0] == '%' && isxdigit((unsigned char)c[1]) && isxdigit((unsigned char)c[2]) &&
+				sscanf(c + 1, "%2x", &octet) == 1 && octet != 0)
+			{
+				*ecrit++ = (char)octet;
+				c += 2;
+			}
+			else
+			{
+				*ecrit++ = *c == '/' ? ' ' : *c;
+			}
+		}
+		*ecrit = '\0';
+		char *suite;
+		char *nom = strtok_r(cible, " ", &suite);
+
+		const char *type = "text/plain; version=0.0.4";
+		const char *etat = "200 OK";
+		size_t longueur;
+		int c = 0;
+		while (nom != NULL && c < nbCommandes && strcmp(nom, tabCommande[c].nom) != 0)
+		{
+			c++;
+		}
+		if (nom == NULL || strcmp(nom, "metrics") == 0)
+		{
+			longueur = metriquesFormater(tampon, taille);
+		}
+		else if (c < nbCommandes)
+		{
+			type = "text/plain; charset=utf-8";
+			longueur = tabCommande[c].executer(suite, tampon, taille);
+		}
+		else
+		{
+			type = "text/plain; charset=utf-8";
+			etat = "404 Not Found";
+			longueur = snprintf(tampon, taille, "Commande inconnue : %s\n", nom);
+		}
+		if (estHttp)
+		{
+			char entete[160];
+			int n = snprintf(entete, sizeof(entete),
+							 "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n", etat, type, longueur);
+			send(dSC, entete, n, MSG_NOSIGNAL);
+		}
+		send(dSC, tampon, longueur, MSG_NOSIGNAL);
+		close(dSC);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Supprime le fichier de la socket d'administration à la sortie.
+ */
+static void supprimerSocketAdmin(void)
+{
+	unlink(cheminAdmin);
+}
+
+/**
+ * @brief Crée la socket UNIX d'administration et démarre son thread.
+ *
+ * @param chemin chemin de la socket à créer
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int metriquesDemarrerSocketAdmin(const char *chemin)
+{
+	struct sockaddr_un ad;
+	memset(&ad, 0, sizeof(ad));
+	ad.sun_family = AF_UNIX;
+	if (strlen(chemin) >= sizeof(ad.sun_path))
+	{
+		fprintf(stderr, "Chemin de socket d'administration trop long\n");
+		return -1;
+	}
+	strcpy(ad.sun_path, chemin);
+	strcpy(cheminAdmin, chemin);
+
+	int dSA = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (dSA < 0)
+	{
+		perror("Problème de création de la socket d'administration");
+		return -1;
+	}
+	unlink(chemin);
+	// Seul le compte du serveur peut s'y connecter : c'est ce qui protège les commandes d'exploitation
+	if (bind(dSA, (struct sockaddr *)&ad, sizeof(ad)) < 0 || chmod(chemin, S_IRUSR | S_IWUSR) < 0 || listen(dSA, 4) < 0)
+	{
+		perror("Problème de nommage de la socket d'administration");
+		close(dSA);
+		return -1;
+	}
+	atexit(supprimerSocketAdmin);
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, administrationThread, (void *)(long)dSA) != 0)
+	{
+		perror("Erreur thread administration");
+		close(dSA);
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef METRIQUES_H
+#define METRIQUES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Compteurs cumulés exposés par le serveur.
+ *
+ * Chaque thread écrit dans son propre bloc de compteurs, sans verrou ;
+ * la lecture additionne les blocs de tous les threads.
+ */
+enum Compteur
+{
+	CPT_CONNEXIONS_ACCEPTEES,
+	CPT_MESSAGES_RECUS,
+	CPT_MESSAGES_ENVOYES,
+	CPT_OCTETS_RECUS,
+	CPT_OCTETS_ENVOYES,
+	CPT_COMMANDES,
+	CPT_PERTES,
+	CPT_PERTES_JOURNAL,
+	CPT_EXPIRATIONS,
+	CPT_DEBIT_RALENTIS,
+	CPT_DEBIT_REJETS,
+	CPT_CONNEXIONS_REFUSEES,
+	CPT_FEDERATION_ENREGISTREMENTS,
+	CPT_FEDERATION_LOTS,
+	CPT_COMPRESSION_OCTETS_ENTREE,
+	CPT_COMPRESSION_OCTETS_SORTIE,
+	CPT_COMPRESSION_MICROSECONDES,
+	CPT_EPHEMERES_RECUS,
+	CPT_EPHEMERES_FUSIONNES,
+	CPT_EPHEMERES_ENVOYES,
+	CPT_EPHEMERES_PERDUS,
+	CPT_MEMOIRE_REFUS,
+	CPT_DELESTAGE_EPHEMERES,
+	CPT_DELESTAGE_TRAMES,
+	CPT_DELESTAGE_DECONNEXIONS,
+	CPT_DELESTAGE_HISTORIQUE,
+	CPT_TLS_POIGNEES,
+	CPT_TLS_ECHECS,
+	CPT_TLS_NOYAU_EMISSION,
+	CPT_TLS_NOYAU_RECEPTION,
+	NB_COMPTEURS
+};
+
+/**
+ * @brief Histogrammes de latence, en microsecondes.
+ */
+enum Histogramme
+{
+	HIST_DIFFUSION,
+	HIST_COMMANDE,
+	HIST_ATTENTE_INTERACTIF,
+	HIST_RECHERCHE,
+	NB_HISTOGRAMMES
+};
+
+/**
+ * - NB_SEAUX = nombre de seaux par histogramme, le seau i compte les valeurs <= 2^i µs,
+ *   le dernier seau compte tout le reste (+Inf)
+ */
+#define NB_SEAUX 24
+
+void metriqueIncrementer(enum Compteur compteur, uint64_t valeur);
+void metriqueObserver(enum Histogramme histogramme, uint64_t microsecondes);
+uint64_t metriqueHorloge(void);
+void metriquesAjouterJauge(const char *nom, const char *aide, long (*lire)(void));
+size_t metriquesFormater(char *tampon, size_t taille);
+size_t metriquesResume(char *tampon, size_t taille);
+void metriquesAjouterCommande(const char *nom, size_t (*executer)(char *arguments, char *tampon, size_t taille));
+int metriquesDemarrerSocketAdmin(const char *chemin);
+
+#endif
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "minuterie.h"
+#include "relais.h"
+
+/**
+ * - BITS_NIVEAU = log2 du nombre de cases par niveau
+ * - NB_CASES = nombre de cases par niveau
+ * - NB_NIVEAUX = nombre de niveaux de la roue
+ * - DUREE_TIC = durée d'un tic en millisecondes
+ * - DELAI_MAX = plus grand délai représentable, en tics
+ */
+#define BITS_NIVEAU 6
+#define NB_CASES (1 << BITS_NIVEAU)
+#define MASQUE_CASE (NB_CASES - 1)
+#define NB_NIVEAUX 4
+#define DUREE_TIC 10
+#define DELAI_MAX ((1ULL << (BITS_NIVEAU * NB_NIVEAUX)) - 1)
+
+/**
+ * - cases = têtes de liste de chaque case, par niveau
+ * - courant = dernier tic traité
+ * - mutexRoue = protège la roue ; les rappels sont exécutés sous ce verrou
+ */
+static Minuterie *cases[NB_NIVEAUX][NB_CASES];
+static uint64_t courant = 0;
+static pthread_mutex_t mutexRoue = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Insère une minuterie dans la case correspondant à son échéance.
+ * Une échéance égale au tic courant n'arrive qu'en redescendant d'un niveau
+ * supérieur, juste avant que la case du tic ne soit traitée. Appelée sous mutexRoue.
+ */
+static void inserer(Minuterie *minuterie)
+{
+	if (minuterie->echeance < courant)
+	{
+		minuterie->echeance = courant;
+	}
+	uint64_t delai = minuterie->echeance - courant;
+	if (delai > DELAI_MAX)
+	{
+		minuterie->echeance = courant + DELAI_MAX;
+		delai = DELAI_MAX;
+	}
+
+	int niveau = 0;
+	while (niveau < NB_NIVEAUX - 1 && (delai >> (BITS_NIVEAU * (niveau + 1))) != 0)
+	{
+		niveau++;
+	}
+	Minuterie **tete = &cases[niveau][(minuterie->echeance >> (BITS_NIVEAU * niveau)) & MASQUE_CASE];
+
+	minuterie->precedente = NULL;
+	minuterie->suivante = *tete;
+	if (*tete != NULL)
+	{
+		(*tete)->precedente = minuterie;
+	}
+	*tete = minuterie;
+	minuterie->estArmee = 1;
+}
+
+/**
+ * @brief Retire une minuterie de sa case. Appelée sous mutexRoue.
+ */
+static void retirer(Minuterie *minuterie)
+{
+	if (minuterie->precedente != NULL)
+	{
+		minuterie->precedente->suivante = minuterie->suivante;
+	}
+	else
+	{
+		// En tête de case : la case est celle de son échéance, à l'un des niveaux
+		int niveau = 0;
+		while (niveau < NB_NIVEAUX - 1 && cases[niveau][(minuterie->echeance >> (BITS_NIVEAU * niveau)) & MASQUE_CASE] != minuterie)
+		{
+			niveau++;
+		}
+		cases[niveau][(minuterie->echeance >> (BITS_NIVEAU * niveau)) & MASQUE_CASE] = minuterie->suivante;
+	}
+	if (minuterie->suivante != NULL)
+	{
+		minuterie->suivante->precedente = minuterie->precedente;
+	}
+	minuterie->precedente = NULL;
+	minuterie->suivante = NULL;
+	minuterie->estArmee = 0;
+}
+
+/**
+ * @brief Convertit un délai en millisecondes en échéance, au plus tôt au tic suivant.
+ * Appelée sous mutexRoue.
+ */
+static uint64_t echeanceDepuisDelai(unsigned int delai)
+{
+	uint64_t tics = (delai + DUREE_TIC - 1) / DUREE_TIC;
+	return courant + (tics > 0 ? tics : 1);
+}
+
+/**
+ * @brief Arme (ou réarme) une minuterie.
+ *
+ * @param minuterie minuterie à armer
+ * @param delai délai avant l'échéance, en millisecondes
+ * @param rappel fonction appelée à l'échéance
+ * @param arg argument passé au rappel
+ */
+void minuterieArmer(Minuterie *minuterie, unsigned int delai, RappelMinuterie rappel, void *arg)
+{
+	pthread_mutex_lock(&mutexRoue);
+	if (minuterie->estArmee)
+	{
+		retirer(minuterie);
+	}
+	minuterie->rappel = rappel;
+	minuterie->arg = arg;
+	minuterie->echeance = echeanceDepuisDelai(delai);
+	inserer(minuterie);
+	pthread_mutex_unlock(&mutexRoue);
+}
+
+/**
+ * @brief Annule une minuterie. Au retour, son rappel n'est pas en cours
+ * d'exécution et ne sera plus appelé.
+ *
+ * @param minuterie minuterie à annuler
+ */
+void minuterieAnnuler(Minuterie *minuterie)
+{
+	pthread_mutex_lock(&mutexRoue);
+	if (minuterie->estArmee)
+	{
+		retirer(minuterie);
+	}
+	pthread_mutex_unlock(&mutexRoue);
+}
+
+/**
+ * @brief Attend la fin du rappel en cours, s'il y en a un.
+ * Utilisée par le relais : une fois relaisEnCours() vrai, aucun autre rappel ne démarre.
+ */
+void minuteriesBarriere(void)
+{
+	pthread_mutex_lock(&mutexRoue);
+	pthread_mutex_unlock(&mutexRoue);
+}
+
+/**
+ * @brief Avance la roue d'un tic : redescend les minuteries des niveaux
+ * supérieurs arrivés à échéance de case, puis exécute celles du tic.
+ * Appelée sous mutexRoue.
+ */
+static void avancer(void)
+{
+	courant++;
+
+	for (int niveau = 1; niveau < NB_NIVEAUX; niveau++)
+	{
+		if ((courant & ((1ULL << (BITS_NIVEAU * niveau)) - 1)) != 0)
+		{
+			break;
+		}
+		int indice = (courant >> (BITS_NIVEAU * niveau)) & MASQUE_CASE;
+		Minuterie *liste = cases[niveau][indice];
+		cases[niveau][indice] = NULL;
+		while (liste != NULL)
+		{
+			Minuterie *suivante = liste->suivante;
+			inserer(liste);
+			liste = suivante;
+		}
+	}
+
+	int indice = courant & MASQUE_CASE;
+	while (cases[0][indice] != NULL)
+	{
+		Minuterie *minuterie = cases[0][indice];
+		retirer(minuterie);
+		unsigned int delai = minuterie->rappel(minuterie->arg);
+		if (delai > 0 && !minuterie->estArmee)
+		{
+			minuterie->echeance = echeanceDepuisDelai(delai);
+			inserer(minuterie);
+		}
+	}
+}
+
+/**
+ * @brief Ajoute un tic à un instant.
+ */
+static void ajouterTic(struct timespec *instant)
+{
+	instant->tv_nsec += DUREE_TIC * 1000000L;
+	if (instant->tv_nsec >= 1000000000L)
+	{
+		instant->tv_sec++;
+		instant->tv_nsec -= 1000000000L;
+	}
+}
+
+/**
+ * @brief Fonction principale du thread de la roue. Rattrape les tics en
+ * retard et se suspend pendant un redémarrage à chaud.
+ */
+static void *roueThread(void *arg)
+{
+	// prochain = instant du prochain tic à traiter
+	struct timespec prochain;
+	clock_gettime(CLOCK_MONOTONIC, &prochain);
+	ajouterTic(&prochain);
+	while (1)
+	{
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &prochain, NULL);
+
+		struct timespec maintenant;
+		clock_gettime(CLOCK_MONOTONIC, &maintenant);
+		pthread_mutex_lock(&mutexRoue);
+		while (!relaisEnCours() &&
+			   (maintenant.tv_sec > prochain.tv_sec || (maintenant.tv_sec == prochain.tv_sec && maintenant.tv_nsec >= prochain.tv_nsec)))
+		{
+			avancer();
+			ajouterTic(&prochain);
+		}
+		pthread_mutex_unlock(&mutexRoue);
+
+		// On ne rattrape pas les tics perdus pendant une pause
+		if (relaisEnCours())
+		{
+			prochain = maintenant;
+			ajouterTic(&prochain);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Démarre le thread de la roue.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int minuteriesDemarrer(void)
+{
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, roueThread, NULL) != 0)
+	{
+		perror("Erreur thread minuteries");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
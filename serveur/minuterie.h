@@ -0,0 +1,47 @@
+#ifndef MINUTERIE_H
+#define MINUTERIE_H
+
+#include <stdint.h>
+
+/**
+ * Roue de minuteries hiérarchique : 4 niveaux de 64 cases, un tic toutes les
+ * 10 ms. L'armement et l'annulation sont en O(1) ; une minuterie ne coûte
+ * qu'un maillon intégré à la structure qui la porte.
+ */
+
+typedef struct Minuterie Minuterie;
+
+/**
+ * @brief Fonction appelée à l'échéance, depuis le thread de la roue.
+ * Elle doit rester courte et ne jamais bloquer.
+ *
+ * @return le délai en millisecondes avant le prochain appel, 0 pour ne pas réarmer.
+ */
+typedef unsigned int (*RappelMinuterie)(void *arg);
+
+/**
+ * @brief Minuterie intégrée à la structure qu'elle surveille.
+ *
+ * @param precedente maillon précédent dans la case de la roue
+ * @param suivante maillon suivant dans la case de la roue
+ * @param echeance tic auquel la minuterie expire
+ * @param rappel fonction appelée à l'échéance
+ * @param arg argument passé au rappel
+ * @param estArmee 1 si la minuterie est dans la roue ; 0 sinon
+ */
+struct Minuterie
+{
+	Minuterie *precedente;
+	Minuterie *suivante;
+	uint64_t echeance;
+	RappelMinuterie rappel;
+	void *arg;
+	int estArmee;
+};
+
+int minuteriesDemarrer(void);
+void minuterieArmer(Minuterie *minuterie, unsigned int delai, RappelMinuterie rappel, void *arg);
+void minuterieAnnuler(Minuterie *minuterie);
+void minuteriesBarriere(void);
+
+#endif
@@ -0,0 +1,1057 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "serveur.h"
+#include "journal.h"
+#include "persistance.h"
+
+/**
+ * - MAGIE_INSTANTANE = identifiant du format d'instantané
+ * - VERSION_INSTANTANE = version du format, à incrémenter à chaque changement de disposition
+ * - NOM_INSTANTANE = nom du fichier d'instantané dans le dossier d'état
+ * - FORMAT_SEGMENT = nom d'un segment du journal d'état, selon sa première séquence
+ * - TAILLE_DESCRIPTION = taille maximum de la description d'un salon
+ * - TAILLE_DOSSIER_ETAT = taille maximum du chemin du dossier d'état, fin de chaîne comprise
+ * - TAILLE_NOM_ETAT = taille maximum du nom d'un fichier du dossier d'état
+ * - TAILLE_CHEMIN_ETAT = taille d'un chemin de fichier d'état, qui ne peut donc pas être tronqué
+ */
+#define MAGIE_INSTANTANE "MSGI"
+#define VERSION_INSTANTANE 2
+#define NOM_INSTANTANE "salons.instantane"
+#define FORMAT_SEGMENT "salons-%020lu.journal"
+#define TAILLE_DESCRIPTION 200
+#define TAILLE_DOSSIER_ETAT 200
+#define TAILLE_NOM_ETAT 64
+#define TAILLE_CHEMIN_ETAT (TAILLE_DOSSIER_ETAT + TAILLE_NOM_ETAT)
+
+/**
+ * @brief Sections d'un instantané. Les index sont des tables de hachage à
+ * adressage ouvert dont les cases contiennent un indice d'enregistrement.
+ */
+enum TypeSection
+{
+	SECTION_SALONS,
+	SECTION_INDEX_SALONS,
+	SECTION_ADHESIONS,
+	SECTION_INDEX_ADHESIONS,
+	SECTION_CHAINES,
+	NB_SECTIONS
+};
+
+/**
+ * @brief Types d'enregistrement du journal d'état.
+ */
+enum TypeEtat
+{
+	ETAT_SALON = 1,
+	ETAT_ADHESION = 2,
+	ETAT_LIMITE = 3
+};
+
+/**
+ * @brief Position d'une section dans le fichier d'instantané.
+ *
+ * @param type type de la section
+ * @param nombre nombre d'éléments (capacité pour un index)
+ * @param decalage position de la section depuis le début du fichier, alignée sur 8 octets
+ * @param taille taille de la section en octets
+ */
+typedef struct Section Section;
+struct Section
+{
+	uint32_t type;
+	uint32_t nombre;
+	uint64_t decalage;
+	uint64_t taille;
+};
+
+/**
+ * @brief En-tête d'un instantané.
+ *
+ * @param magie MAGIE_INSTANTANE
+ * @param version VERSION_INSTANTANE
+ * @param sequence dernière séquence du journal d'état incluse dans l'instantané
+ * @param nbSections NB_SECTIONS
+ * @param sections table des sections
+ */
+typedef struct EnteteInstantane EnteteInstantane;
+struct EnteteInstantane
+{
+	char magie[4];
+	uint32_t version;
+	uint64_t sequence;
+	uint32_t nbSections;
+	uint32_t reserve;
+	Section sections[NB_SECTIONS];
+};
+
+/**
+ * @brief Salon dans un instantané ; les chaînes sont des positions dans la section des chaînes.
+ * Un instantané de version 1 s'arrête avant tailleMaxMessage.
+ */
+typedef struct SalonInstantane SalonInstantane;
+struct SalonInstantane
+{
+	int32_t idSalon;
+	int32_t nbPlace;
+	uint32_t nom;
+	uint32_t description;
+	int32_t tailleMaxMessage;
+	uint32_t reserve;
+};
+
+/**
+ * @brief Adhésion dans un instantané : dernier salon rejoint par un pseudo.
+ */
+typedef struct AdhesionInstantane AdhesionInstantane;
+struct AdhesionInstantane
+{
+	uint32_t pseudo;
+	int32_t idSalon;
+};
+
+/**
+ * @brief En-tête d'un enregistrement du journal d'état, suivi de deux chaînes
+ * sans zéro final (nom et description d'un salon, ou pseudo).
+ */
+typedef struct EnregistrementEtat EnregistrementEtat;
+struct EnregistrementEtat
+{
+	uint64_t sequence;
+	uint8_t type;
+	uint8_t longueurA;
+	uint8_t longueurB;
+	uint8_t reserve;
+	int32_t idSalon;
+	int32_t valeur;
+};
+
+/**
+ * @brief Dernier salon rejoint par un utilisateur.
+ */
+typedef struct Adhesion Adhesion;
+struct Adhesion
+{
+	const char *pseudo;
+	int idSalon;
+};
+
+/**
+ * @brief Table de hachage à adressage ouvert ; une case vaut -1 si elle est vide.
+ */
+typedef struct Index Index;
+struct Index
+{
+	int32_t *cases;
+	uint32_t capacite;
+	uint32_t nombre;
+};
+
+/**
+ * - tabAdhesion = dernier salon de chaque pseudo connu
+ * - indexSalons = nom de salon -> indice dans tabSalon
+ * - indexAdhesions = pseudo -> indice dans tabAdhesion
+ * - dEtat = segment courant du journal d'état, -1 si la persistance est désactivée
+ * - sequence = séquence du dernier enregistrement d'état
+ * - sequenceInstantane = séquence incluse dans le dernier instantané écrit
+ */
+static Adhesion *tabAdhesion = NULL;
+static int nbAdhesion = 0;
+static int capaciteAdhesion = 0;
+static int capaciteSalon = 0;
+static Index indexSalons = {NULL, 0, 0};
+static Index indexAdhesions = {NULL, 0, 0};
+static char dossierEtat[TAILLE_DOSSIER_ETAT];
+static int dEtat = -1;
+static uint64_t sequence = 0;
+static uint64_t sequenceInstantane = 0;
+
+/**
+ * @brief Hachage FNV-1a d'une chaîne.
+ */
+static uint32_t hacher(const char *cle)
+{
+	uint32_t h = 2166136261u;
+	while (*cle)
+	{
+		h = (h ^ (unsigned char)*cle++) * 16777619u;
+	}
+	return h;
+}
+
+static const char *cleSalon(int32_t indice)
+{
+	return tabSalon[indice].nom;
+}
+
+static const char *cleAdhesion(int32_t indice)
+{
+	return tabAdhesion[indice].pseudo;
+}
+
+/**
+ * @brief Cherche une clé dans un index.
+ *
+ * @return l'indice de l'enregistrement, -1 s'il n'existe pas.
+ */
+static int32_t indexChercher(const Index *index, const char *cle, const char *(*cleDe)(int32_t))
+{
+	if (index->capacite == 0)
+	{
+		return -1;
+	}
+	uint32_t masque = index->capacite - 1;
+	for (uint32_t i = hacher(cle) & masque;; i = (i + 1) & masque)
+	{
+		int32_t indice = index->cases[i];
+		if (indice < 0 || strcmp(cleDe(indice), cle) == 0)
+		{
+			return indice;
+		}
+	}
+}
+
+/**
+ * @brief Place un indice dans la première case libre, sans agrandir.
+ */
+static void indexPlacer(Index *index, int32_t indice, const char *(*cleDe)(int32_t))
+{
+	uint32_t masque = index->capacite - 1;
+	uint32_t i = hacher(cleDe(indice)) & masque;
+	while (index->cases[i] >= 0)
+	{
+		i = (i + 1) & masque;
+	}
+	index->cases[i] = indice;
+}
+
+/**
+ * @brief Ajoute un enregistrement à un index, en doublant sa capacité au-delà de 70 % de remplissage.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int indexInserer(Index *index, int32_t indice, const char *(*cleDe)(int32_t))
+{
+	if ((index->nombre + 1) * 10 >= index->capacite * 7)
+	{
+		uint32_t capacite = index->capacite == 0 ? 16 : index->capacite * 2;
+		int32_t *cases = malloc(sizeof(int32_t) * capacite);
+		if (cases == NULL)
+		{
+			return -1;
+		}
+		memset(cases, 0xff, sizeof(int32_t) * capacite);
+
+		Index agrandi = {cases, capacite, index->nombre};
+		for (uint32_t i = 0; i < index->capacite; i++)
+		{
+			if (index->cases[i] >= 0)
+			{
+				indexPlacer(&agrandi, index->cases[i], cleDe);
+			}
+		}
+		free(index->cases);
+		*index = agrandi;
+	}
+	indexPlacer(index, indice, cleDe);
+	index->nombre++;
+	return 0;
+}
+
+/**
+ * @brief Ajoute un salon à la table. Les chaînes ne sont pas copiées.
+ *
+ * @return l'identifiant du salon, -1 en cas d'erreur.
+ */
+static int ajouterSalon(const char *nom, const char *description, int nbPlace)
+{
+	if (nbSalon >= MAX_SALON)
+	{
+		return -1;
+	}
+	if (nbSalon == capaciteSalon)
+	{
+		int capacite = capaciteSalon == 0 ? 16 : capaciteSalon * 2;
+		Salon *agrandi = realloc(tabSalon, sizeof(Salon) * capacite);
+		if (agrandi == NULL)
+		{
+			return -1;
+		}
+		tabSalon = agrandi;
+		capaciteSalon = capacite;
+	}
+
+	Salon *salon = &tabSalon[nbSalon];
+	salon->idSalon = nbSalon;
+	salon->estOccupe = 1;
+	salon->nom = (char *)nom;
+	salon->description = (char *)description;
+	salon->nbPlace = nbPlace;
+	salon->tailleMaxMessage = 0;
+	if (indexInserer(&indexSalons, nbSalon, cleSalon) != 0)
+	{
+		return -1;
+	}
+	return nbSalon++;
+}
+
+/**
+ * @brief Met à jour le salon d'un pseudo. Le pseudo est copié s'il est nouveau
+ * et que copier vaut 1.
+ */
+static void ajouterAdhesion(const char *pseudo, int idSalon, int copier)
+{
+	int32_t indice = indexChercher(&indexAdhesions, pseudo, cleAdhesion);
+	if (indice >= 0)
+	{
+		tabAdhesion[indice].idSalon = idSalon;
+		return;
+	}
+
+	if (nbAdhesion == capaciteAdhesion)
+	{
+		int capacite = capaciteAdhesion == 0 ? 16 : capaciteAdhesion * 2;
+		Adhesion *agrandi = realloc(tabAdhesion, sizeof(Adhesion) * capacite);
+		if (agrandi == NULL)
+		{
+			return;
+		}
+		tabAdhesion = agrandi;
+		capaciteAdhesion = capacite;
+	}
+	tabAdhesion[nbAdhesion].pseudo = copier ? strdup(pseudo) : pseudo;
+	tabAdhesion[nbAdhesion].idSalon = idSalon;
+	if (tabAdhesion[nbAdhesion].pseudo != NULL && indexInserer(&indexAdhesions, nbAdhesion, cleAdhesion) == 0)
+	{
+		nbAdhesion++;
+	}
+}
+
+/**
+ * @brief Ajoute un enregistrement au journal d'état. Appelée sous mutexSalon.
+ */
+static void journaliserEtat(uint8_t type, int32_t idSalon, int32_t valeur, const char *a, const char *b)
+{
+	sequence++;
+	if (dEtat < 0)
+	{
+		return;
+	}
+
+	EnregistrementEtat e;
+	memset(&e, 0, sizeof(e));
+	e.sequence = sequence;
+	e.type = type;
+	e.longueurA = a != NULL ? strlen(a) : 0;
+	e.longueurB = b != NULL ? strlen(b) : 0;
+	e.idSalon = idSalon;
+	e.valeur = valeur;
+
+	struct iovec iov[3] = {{&e, sizeof(e)}, {(void *)a, e.longueurA}, {(void *)b, e.longueurB}};
+	if (writev(dEtat, iov, 3) < 0)
+	{
+		perror("Erreur d'écriture du journal d'état");
+	}
+}
+
+/**
+ * @brief Crée un salon, ou donne celui qui porte déjà ce nom.
+ *
+ * @param nom nom du salon (tronqué à TAILLE_NOM_SALON - 1 caractères)
+ * @param description description du salon (tronquée à TAILLE_DESCRIPTION - 1 caractères)
+ * @param nbPlace nombre de places du salon
+ * @return l'identifiant du salon, -1 en cas d'erreur.
+ */
+int creerSalon(const char *nom, const char *description, int nbPlace)
+{
+	char *copieNom = strndup(nom, TAILLE_NOM_SALON - 1);
+	if (copieNom == NULL)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&mutexSalon);
+	int idSalon = indexChercher(&indexSalons, copieNom, cleSalon);
+	if (idSalon >= 0)
+	{
+		pthread_mutex_unlock(&mutexSalon);
+		free(copieNom);
+		return idSalon;
+	}
+
+	char *copieDescription = strndup(description, TAILLE_DESCRIPTION - 1);
+	idSalon = copieDescription != NULL ? ajouterSalon(copieNom, copieDescription, nbPlace) : -1;
+	if (idSalon >= 0)
+	{
+		journaliserEtat(ETAT_SALON, idSalon, nbPlace, copieNom, copieDescription);
+	}
+	else
+	{
+		free(copieNom);
+		free(copieDescription);
+	}
+	pthread_mutex_unlock(&mutexSalon);
+	return idSalon;
+}
+
+/**
+ * @brief Cherche un salon par son nom.
+ *
+ * @param nom nom du salon
+ * @return l'identifiant du salon, -1 s'il n'existe pas.
+ */
+int chercherSalon(const char *nom)
+{
+	pthread_mutex_lock(&mutexSalon);
+	int idSalon = indexChercher(&indexSalons, nom, cleSalon);
+	pthread_mutex_unlock(&mutexSalon);
+	return idSalon;
+}
+
+/**
+ * @brief Fixe la taille maximum d'un message dans un salon.
+ *
+ * @param idSalon salon à modifier
+ * @param tailleMax taille maximum en octets, 0 pour la valeur par défaut du serveur
+ */
+void limiterSalon(int idSalon, int tailleMax)
+{
+	pthread_mutex_lock(&mutexSalon);
+	if (idSalon >= 0 && idSalon < nbSalon && tabSalon[idSalon].tailleMaxMessage != tailleMax)
+	{
+		tabSalon[idSalon].tailleMaxMessage = tailleMax;
+		journaliserEtat(ETAT_LIMITE, idSalon, tailleMax, NULL, NULL);
+	}
+	pthread_mutex_unlock(&mutexSalon);
+}
+
+/**
+ * @brief Donne la taille maximum d'un message dans un salon.
+ *
+ * @param idSalon salon du message
+ * @return la taille en octets : celle du salon, ou limiteMessage s'il n'en a pas.
+ */
+size_t limiteDuSalon(int idSalon)
+{
+	pthread_mutex_lock(&mutexSalon);
+	int tailleMax = idSalon >= 0 && idSalon < nbSalon ? tabSalon[idSalon].tailleMaxMessage : 0;
+	pthread_mutex_unlock(&mutexSalon);
+	return tailleMax > 0 ? (size_t)tailleMax : limiteMessage;
+}
+
+/**
+ * @brief Donne le dernier salon rejoint par un pseudo.
+ *
+ * @param pseudo pseudo de l'utilisateur
+ * @return l'identifiant du salon, -1 si le pseudo est inconnu.
+ */
+int salonDuPseudo(const char *pseudo)
+{
+	pthread_mutex_lock(&mutexSalon);
+	int32_t indice = indexChercher(&indexAdhesions, pseudo, cleAdhesion);
+	int idSalon = indice >= 0 ? tabAdhesion[indice].idSalon : -1;
+	pthread_mutex_unlock(&mutexSalon);
+	return idSalon;
+}
+
+/**
+ * @brief Enregistre le salon rejoint par un utilisateur.
+ *
+ * @param pseudo pseudo de l'utilisateur
+ * @param idSalon salon rejoint
+ */
+void enregistrerAdhesion(const char *pseudo, int idSalon)
+{
+	pthread_mutex_lock(&mutexSalon);
+	int32_t indice = indexChercher(&indexAdhesions, pseudo, cleAdhesion);
+	if (indice < 0 || tabAdhesion[indice].idSalon != idSalon)
+	{
+		ajouterAdhesion(pseudo, idSalon, 1);
+		journaliserEtat(ETAT_ADHESION, idSalon, 0, pseudo, NULL);
+	}
+	pthread_mutex_unlock(&mutexSalon);
+}
+
+/**
+ * @brief Vérifie qu'une section tient dans le fichier et a la taille attendue.
+ */
+static int sectionValide(const Section *section, size_t tailleFichier, size_t tailleElement)
+{
+	return section->decalage <= tailleFichier && section->taille <= tailleFichier - section->decalage &&
+		   (tailleElement == 0 || section->taille == (uint64_t)section->nombre * tailleElement);
+}
+
+/**
+ * @brief Projette le dernier instantané en mémoire et reconstruit les tables.
+ * Les chaînes restent dans la projection, qui n'est jamais libérée ; les index
+ * sont copiés tels quels, sans être recalculés.
+ *
+ * @return 0 si l'instantané est chargé ou absent, -1 s'il est invalide.
+ */
+static int chargerInstantane(void)
+{
+	char chemin[TAILLE_CHEMIN_ETAT];
+	snprintf(chemin, sizeof(chemin), "%s/%s", dossierEtat, NOM_INSTANTANE);
+	int fd = open(chemin, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+	struct stat infos;
+	if (fstat(fd, &infos) < 0 || (size_t)infos.st_size < sizeof(EnteteInstantane))
+	{
+		close(fd);
+		return -1;
+	}
+	size_t taille = infos.st_size;
+	const char *carte = mmap(NULL, taille, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (carte == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	const EnteteInstantane *entete = (const EnteteInstantane *)carte;
+	const Section *sections = entete->sections;
+	size_t tailleSalon = entete->version == 1 ? offsetof(SalonInstantane, tailleMaxMessage) : sizeof(SalonInstantane);
+	if (memcmp(entete->magie, MAGIE_INSTANTANE, 4) != 0 || entete->version < 1 || entete->version > VERSION_INSTANTANE ||
+		entete->nbSections != NB_SECTIONS ||
+		!sectionValide(&sections[SECTION_SALONS], taille, tailleSalon) ||
+		!sectionValide(&sections[SECTION_INDEX_SALONS], taille, sizeof(int32_t)) ||
+		!sectionValide(&sections[SECTION_ADHESIONS], taille, sizeof(AdhesionInstantane)) ||
+		!sectionValide(&sections[SECTION_INDEX_ADHESIONS], taille, sizeof(int32_t)) ||
+		!sectionValide(&sections[SECTION_CHAINES], taille, 0) || sections[SECTION_CHAINES].taille == 0 ||
+		carte[sections[SECTION_CHAINES].decalage + sections[SECTION_CHAINES].taille - 1] != '\0')
+	{
+		fprintf(stderr, "Instantané invalide : %s\n", chemin);
+		munmap((void *)carte, taille);
+		return -1;
+	}
+
+	const char *chaines = carte + sections[SECTION_CHAINES].decalage;
+	uint64_t tailleChaines = sections[SECTION_CHAINES].taille;
+
+	// Salons
+	const char *salons = carte + sections[SECTION_SALONS].decalage;
+	uint32_t n = sections[SECTION_SALONS].nombre;
+	capaciteSalon = 16;
+	while ((uint32_t)capaciteSalon < n)
+	{
+		capaciteSalon *= 2;
+	}
+	tabSalon = malloc(sizeof(Salon) * capaciteSalon);
+	for (uint32_t i = 0; i < n; i++)
+	{
+		const SalonInstantane *salon = (const SalonInstantane *)(salons + i * tailleSalon);
+		if (salon->nom >= tailleChaines || salon->description >= tailleChaines)
+		{
+			fprintf(stderr, "Instantané invalide : %s\n", chemin);
+			munmap((void *)carte, taille);
+			return -1;
+		}
+		tabSalon[i].idSalon = i;
+		tabSalon[i].estOccupe = 1;
+		tabSalon[i].nom = (char *)chaines + salon->nom;
+		tabSalon[i].description = (char *)chaines + salon->description;
+		tabSalon[i].nbPlace = salon->nbPlace;
+		tabSalon[i].tailleMaxMessage = entete->version == 1 ? 0 : salon->tailleMaxMessage;
+	}
+	nbSalon = n;
+
+	// Adhésions
+	const AdhesionInstantane *adhesions = (const AdhesionInstantane *)(carte + sections[SECTION_ADHESIONS].decalage);
+	uint32_t m = sections[SECTION_ADHESIONS].nombre;
+	capaciteAdhesion = 16;
+	while ((uint32_t)capaciteAdhesion < m)
+	{
+		capaciteAdhesion *= 2;
+	}
+	tabAdhesion = malloc(sizeof(Adhesion) * capaciteAdhesion);
+	for (uint32_t i = 0; i < m; i++)
+	{
+		if (adhesions[i].pseudo >= tailleChaines || adhesions[i].idSalon < 0 || (uint32_t)adhesions[i].idSalon >= n)
+		{
+			fprintf(stderr, "Instantané invalide : %s\n", chemin);
+			munmap((void *)carte, taille);
+			return -1;
+		}
+		tabAdhesion[i].pseudo = chaines + adhesions[i].pseudo;
+		tabAdhesion[i].idSalon = adhesions[i].idSalon;
+	}
+	nbAdhesion = m;
+
+	// Index, copiés sans recalcul des hachages
+	Index *index[2] = {&indexSalons, &indexAdhesions};
+	int sectionIndex[2] = {SECTION_INDEX_SALONS, SECTION_INDEX_ADHESIONS};
+	uint32_t nombres[2] = {n, m};
+	for (int k = 0; k < 2; k++)
+	{
+		const Section *section = &sections[sectionIndex[k]];
+		if (section->nombre == 0)
+		{
+			continue;
+		}
+		if ((section->nombre & (section->nombre - 1)) != 0)
+		{
+			munmap((void *)carte, taille);
+			return -1;
+		}
+		// Chaque case est libre ou désigne un enregistrement, et au moins une
+		// case libre arrête les sondages
+		const int32_t *cases = (const int32_t *)(carte + section->decalage);
+		uint32_t libres = 0;
+		for (uint32_t i = 0; i < section->nombre; i++)
+		{
+			if (cases[i] == -1)
+			{
+				libres++;
+			}
+			else if (cases[i] < 0 || (uint32_t)cases[i] >= nombres[k])
+			{
+				libres = 0;
+				break;
+			}
+		}
+		if (libres == 0)
+		{
+			fprintf(stderr, "Instantané invalide : %s\n", chemin);
+			munmap((void *)carte, taille);
+			return -1;
+		}
+		index[k]->cases = malloc(section->taille);
+		memcpy(index[k]->cases, cases, section->taille);
+		index[k]->capacite = section->nombre;
+		index[k]->nombre = nombres[k];
+	}
+
+	sequence = entete->sequence;
+	sequenceInstantane = sequence;
+	return 0;
+}
+
+/**
+ * @brief Compare deux débuts de segment, pour le tri.
+ */
+static int comparerSegments(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Liste les segments du journal d'état, triés par première séquence.
+ *
+ * @param debuts tableau alloué des premières séquences, à libérer par l'appelant
+ * @return le nombre de segments.
+ */
+static int listerSegments(uint64_t **debuts)
+{
+	int nombre = 0;
+	int capacite = 16;
+	*debuts = malloc(sizeof(uint64_t) * capacite);
+
+	DIR *dossier = opendir(dossierEtat);
+	struct dirent *entree;
+	while (dossier != NULL && (entree = readdir(dossier)) != NULL)
+	{
+		unsigned long debut;
+		if (sscanf(entree->d_name, FORMAT_SEGMENT, &debut) != 1)
+		{
+			continue;
+		}
+		if (nombre == capacite)
+		{
+			capacite *= 2;
+			*debuts = realloc(*debuts, sizeof(uint64_t) * capacite);
+		}
+		(*debuts)[nombre++] = debut;
+	}
+	if (dossier != NULL)
+	{
+		closedir(dossier);
+	}
+	qsort(*debuts, nombre, sizeof(uint64_t), comparerSegments);
+	return nombre;
+}
+
+/**
+ * @brief Rejoue les enregistrements d'un segment postérieurs à la séquence courante.
+ * Un enregistrement incomplet en fin de fichier (arrêt brutal) est ignoré.
+ */
+static void rejouerSegment(uint64_t debut)
+{
+	char chemin[TAILLE_CHEMIN_ETAT];
+	char nomSegment[TAILLE_NOM_ETAT];
+	snprintf(nomSegment, sizeof(nomSegment), FORMAT_SEGMENT, (unsigned long)debut);
+	snprintf(chemin, sizeof(chemin), "%s/%s", dossierEtat, nomSegment);
+	FILE *segment = fopen(chemin, "r");
+	if (segment == NULL)
+	{
+		return;
+	}
+
+	EnregistrementEtat e;
+	char a[256];
+	char b[256];
+	while (fread(&e, sizeof(e), 1, segment) == 1)
+	{
+		if (fread(a, 1, e.longueurA, segment) != e.longueurA || fread(b, 1, e.longueurB, segment) != e.longueurB)
+		{
+			break;
+		}
+		a[e.longueurA] = '\0';
+		b[e.longueurB] = '\0';
+		if (e.sequence <= sequence)
+		{
+			continue;
+		}
+
+		if (e.type == ETAT_SALON && e.idSalon == nbSalon)
+		{
+			char *nom = strdup(a);
+			char *description = strdup(b);
+			if (nom == NULL || description == NULL || ajouterSalon(nom, description, e.valeur) < 0)
+			{
+				free(nom);
+				free(description);
+			}
+		}
+		else if (e.type == ETAT_ADHESION && e.idSalon >= 0 && e.idSalon < nbSalon)
+		{
+			ajouterAdhesion(a, e.idSalon, 1);
+		}
+		else if (e.type == ETAT_LIMITE && e.idSalon >= 0 && e.idSalon < nbSalon)
+		{
+			tabSalon[e.idSalon].tailleMaxMessage = e.valeur;
+		}
+		sequence = e.sequence;
+	}
+	fclose(segment);
+}
+
+/**
+ * @brief Ouvre un nouveau segment du journal d'état.
+ */
+static int ouvrirSegment(uint64_t debut)
+{
+	char chemin[TAILLE_CHEMIN_ETAT];
+	char nomSegment[TAILLE_NOM_ETAT];
+	snprintf(nomSegment, sizeof(nomSegment), FORMAT_SEGMENT, (unsigned long)debut);
+	snprintf(chemin, sizeof(chemin), "%s/%s", dossierEtat, nomSegment);
+	dEtat = open(chemin, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (dEtat < 0)
+	{
+		perror("Impossible d'ouvrir le journal d'état");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Charge l'état persistant des salons : instantané puis fin du journal.
+ *
+ * @param dossier dossier de l'état, NULL pour garder l'état en mémoire seulement
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int persistanceCharger(const char *dossier)
+{
+	if (dossier == NULL)
+	{
+		return 0;
+	}
+	if (strlen(dossier) >= sizeof(dossierEtat))
+	{
+		fprintf(stderr, "Chemin du dossier d'état trop long (%zu caractères au plus) : %s\n", sizeof(dossierEtat) - 1, dossier);
+		return -1;
+	}
+	snprintf(dossierEtat, sizeof(dossierEtat), "%s", dossier);
+	mkdir(dossierEtat, 0755);
+
+	pthread_mutex_lock(&mutexSalon);
+	if (chargerInstantane() != 0)
+	{
+		pthread_mutex_unlock(&mutexSalon);
+		return -1;
+	}
+
+	uint64_t *debuts;
+	int nbSegments = listerSegments(&debuts);
+	for (int i = 0; i < nbSegments; i++)
+	{
+		// Un segment entièrement couvert par l'instantané est sauté d'office
+		if (i + 1 < nbSegments && debuts[i + 1] <= sequence + 1)
+		{
+			continue;
+		}
+		rejouerSegment(debuts[i]);
+	}
+	free(debuts);
+
+	int resultat = ouvrirSegment(sequence + 1);
+	pthread_mutex_unlock(&mutexSalon);
+	return resultat;
+}
+
+/**
+ * @brief Écrivain bufferisé utilisé par le processus fils, sans allocation.
+ */
+static char tamponEcriture[1 << 16];
+static size_t remplissage = 0;
+static uint64_t position = 0;
+static int erreurEcriture = 0;
+
+static void vider(int fd)
+{
+	size_t ecrit = 0;
+	while (ecrit < remplissage && !erreurEcriture)
+	{
+		ssize_t n = write(fd, tamponEcriture + ecrit, remplissage - ecrit);
+		if (n <= 0)
+		{
+			erreurEcriture = 1;
+		}
+		else
+		{
+			ecrit += n;
+		}
+	}
+	remplissage = 0;
+}
+
+static void ecrire(int fd, const void *donnees, size_t longueur)
+{
+	const char *octets = donnees;
+	position += longueur;
+	while (longueur > 0)
+	{
+		size_t morceau = sizeof(tamponEcriture) - remplissage;
+		if (morceau > longueur)
+		{
+			morceau = longueur;
+		}
+		memcpy(tamponEcriture + remplissage, octets, morceau);
+		remplissage += morceau;
+		octets += morceau;
+		longueur -= morceau;
+		if (remplissage == sizeof(tamponEcriture))
+		{
+			vider(fd);
+		}
+	}
+}
+
+static void aligner(int fd)
+{
+	static const char zeros[8] = {0};
+	ecrire(fd, zeros, (8 - position % 8) % 8);
+}
+
+static uint64_t aligne(uint64_t valeur)
+{
+	return (valeur + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief Écrit l'instantané dans un fichier temporaire puis le renomme.
+ * Exécutée dans le processus fils : la mémoire est une copie figée du parent.
+ *
+ * @param sequenceInstantanee dernière séquence incluse
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int ecrireInstantane(uint64_t sequenceInstantanee)
+{
+	char chemin[TAILLE_CHEMIN_ETAT];
+	char temporaire[TAILLE_CHEMIN_ETAT + 8];
+	snprintf(chemin, sizeof(chemin), "%s/%s", dossierEtat, NOM_INSTANTANE);
+	snprintf(temporaire, sizeof(temporaire), "%s.tmp", chemin);
+	int fd = open(temporaire, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	// Disposition des sections
+	uint64_t tailleChaines = 0;
+	for (int i = 0; i < nbSalon; i++)
+	{
+		tailleChaines += strlen(tabSalon[i].nom) + 1 + strlen(tabSalon[i].description) + 1;
+	}
+	for (int i = 0; i < nbAdhesion; i++)
+	{
+		tailleChaines += strlen(tabAdhesion[i].pseudo) + 1;
+	}
+
+	EnteteInstantane entete;
+	memset(&entete, 0, sizeof(entete));
+	memcpy(entete.magie, MAGIE_INSTANTANE, 4);
+	entete.version = VERSION_INSTANTANE;
+	entete.sequence = sequenceInstantanee;
+	entete.nbSections = NB_SECTIONS;
+
+	uint32_t nombres[NB_SECTIONS] = {nbSalon, indexSalons.capacite, nbAdhesion, indexAdhesions.capacite, 0};
+	uint64_t tailles[NB_SECTIONS] = {
+		(uint64_t)nbSalon * sizeof(SalonInstantane), (uint64_t)indexSalons.capacite * sizeof(int32_t),
+		(uint64_t)nbAdhesion * sizeof(AdhesionInstantane), (uint64_t)indexAdhesions.capacite * sizeof(int32_t),
+		tailleChaines};
+	uint64_t decalage = aligne(sizeof(entete));
+	for (int s = 0; s < NB_SECTIONS; s++)
+	{
+		entete.sections[s].type = s;
+		entete.sections[s].nombre = nombres[s];
+		entete.sections[s].decalage = decalage;
+		entete.sections[s].taille = tailles[s];
+		decalage = aligne(decalage + tailles[s]);
+	}
+
+	position = 0;
+	ecrire(fd, &entete, sizeof(entete));
+	aligner(fd);
+
+	// Salons, avec la position de leurs chaînes
+	uint32_t chaine = 0;
+	for (int i = 0; i < nbSalon; i++)
+	{
+		SalonInstantane salon = {tabSalon[i].idSalon, tabSalon[i].nbPlace, 0, 0, tabSalon[i].tailleMaxMessage, 0};
+		salon.nom = chaine;
+		chaine += strlen(tabSalon[i].nom) + 1;
+		salon.description = chaine;
+		chaine += strlen(tabSalon[i].description) + 1;
+		ecrire(fd, &salon, sizeof(salon));
+	}
+	aligner(fd);
+	ecrire(fd, indexSalons.cases, tailles[SECTION_INDEX_SALONS]);
+	aligner(fd);
+
+	for (int i = 0; i < nbAdhesion; i++)
+	{
+		AdhesionInstantane adhesion = {chaine, tabAdhesion[i].idSalon};
+		chaine += strlen(tabAdhesion[i].pseudo) + 1;
+		ecrire(fd, &adhesion, sizeof(adhesion));
+	}
+	aligner(fd);
+	ecrire(fd, indexAdhesions.cases, tailles[SECTION_INDEX_ADHESIONS]);
+	aligner(fd);
+
+	// Chaînes, dans le même ordre
+	for (int i = 0; i < nbSalon; i++)
+	{
+		ecrire(fd, tabSalon[i].nom, strlen(tabSalon[i].nom) + 1);
+		ecrire(fd, tabSalon[i].description, strlen(tabSalon[i].description) + 1);
+	}
+	for (int i = 0; i < nbAdhesion; i++)
+	{
+		ecrire(fd, tabAdhesion[i].pseudo, strlen(tabAdhesion[i].pseudo) + 1);
+	}
+	vider(fd);
+
+	if (erreurEcriture || fsync(fd) != 0)
+	{
+		close(fd);
+		unlink(temporaire);
+		return -1;
+	}
+	close(fd);
+	return rename(temporaire, chemin);
+}
+
+/**
+ * @brief Supprime les segments entièrement couverts par l'instantané.
+ *
+ * @param limite première séquence du segment courant
+ */
+static void supprimerSegments(uint64_t limite)
+{
+	uint64_t *debuts;
+	int nbSegments = listerSegments(&debuts);
+	for (int i = 0; i < nbSegments; i++)
+	{
+		if (debuts[i] < limite)
+		{
+			char chemin[TAILLE_CHEMIN_ETAT];
+			char nomSegment[TAILLE_NOM_ETAT];
+			snprintf(nomSegment, sizeof(nomSegment), FORMAT_SEGMENT, (unsigned long)debuts[i]);
+			snprintf(chemin, sizeof(chemin), "%s/%s", dossierEtat, nomSegment);
+			unlink(chemin);
+		}
+	}
+	free(debuts);
+}
+
+/**
+ * @brief Fonction principale du thread d'instantanés.
+ * Le segment courant est fermé et un processus fils, qui voit une copie figée
+ * des tables, écrit l'instantané pendant que le serveur continue de servir.
+ *
+ * @param periodeParam intervalle entre deux instantanés, en secondes
+ */
+static void *instantaneThread(void *periodeParam)
+{
+	int periode = (long)periodeParam;
+	while (1)
+	{
+		sleep(periode);
+
+		pthread_mutex_lock(&mutexSalon);
+		if (sequence == sequenceInstantane)
+		{
+			pthread_mutex_unlock(&mutexSalon);
+			continue;
+		}
+		uint64_t sequenceInstantanee = sequence;
+		close(dEtat);
+		ouvrirSegment(sequenceInstantanee + 1);
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			_exit(ecrireInstantane(sequenceInstantanee) == 0 ? 0 : 1);
+		}
+		int salons = nbSalon;
+		pthread_mutex_unlock(&mutexSalon);
+
+		int statut = 0;
+		if (pid > 0 && waitpid(pid, &statut, 0) == pid && WIFEXITED(statut) && WEXITSTATUS(statut) == 0)
+		{
+			sequenceInstantane = sequenceInstantanee;
+			supprimerSegments(sequenceInstantanee + 1);
+			journalEcrire(JOURNAL_INFO, EVT_INSTANTANE, sequenceInstantanee, salons, 0, NULL);
+		}
+		else
+		{
+			journalEcrire(JOURNAL_AVERTISSEMENT, EVT_INSTANTANE, sequenceInstantanee, salons, 0, "echec");
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Démarre les instantanés périodiques si la persistance est active.
+ *
+ * @param periode intervalle entre deux instantanés, en secondes
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int persistanceDemarrer(int periode)
+{
+	if (dEtat < 0)
+	{
+		return 0;
+	}
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, instantaneThread, (void *)(long)(periode > 0 ? periode : 1)) != 0)
+	{
+		perror("Erreur thread instantané");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef PERSISTANCE_H
+#define PERSISTANCE_H
+
+#include <stddef.h>
+
+/**
+ * État persistant des salons : chaque modification est ajoutée à un journal
+ * d'état, et un instantané de la table des salons et de ses index est écrit
+ * périodiquement par un processus fils (copie sur écriture). Au démarrage,
+ * l'instantané est projeté en mémoire puis seule la fin du journal est rejouée.
+ */
+
+int persistanceCharger(const char *dossier);
+int persistanceDemarrer(int periode);
+int creerSalon(const char *nom, const char *description, int nbPlace);
+int chercherSalon(const char *nom);
+void limiterSalon(int idSalon, int tailleMax);
+size_t limiteDuSalon(int idSalon);
+int salonDuPseudo(const char *pseudo);
+void enregistrerAdhesion(const char *pseudo, int idSalon);
+
+#endif
@@ -0,0 +1,1054 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "recherche.h"
+#include "historique.h"
+#include "identite.h"
+#include "journal.h"
+#include "memoire.h"
+#include "metriques.h"
+
+/**
+ * - MAX_TERMES_MESSAGE = nombre maximum de termes distincts indexés par message
+ * - NIVEAU_MAX_FUSION = niveau au-delà duquel les segments ne sont plus fusionnés
+ *   (un segment de ce niveau couvre MESSAGES_PAR_SEGMENT × FACTEUR_FUSION^niveau messages)
+ * - CAPACITE_CONSTRUCTION = nombre initial de cases de la table d'un segment en construction
+ */
+#define MAX_TERMES_MESSAGE 128
+#define NIVEAU_MAX_FUSION 5
+#define CAPACITE_CONSTRUCTION 1024
+
+/**
+ * @brief Terme d'un segment immuable.
+ *
+ * @param texte position du terme dans les textes du segment
+ * @param postings position de sa liste dans les listes du segment
+ * @param longueur taille de sa liste, en octets
+ * @param nombre nombre d'identifiants de sa liste
+ */
+typedef struct Terme Terme;
+struct Terme
+{
+	uint32_t texte;
+	uint32_t postings;
+	uint32_t longueur;
+	uint32_t nombre;
+};
+
+/**
+ * @brief Segment immuable de l'index d'un salon.
+ *
+ * @param niveau 0 pour un segment scellé, n + 1 pour la fusion de segments de niveau n
+ * @param nbMessages messages couverts par le segment
+ * @param premier identifiant du plus ancien message couvert
+ * @param dernier identifiant du plus récent message couvert ; le segment est
+ *        libéré quand ce message est évincé de l'historique
+ * @param nbTermes nombre de termes
+ * @param termes termes, triés par texte
+ * @param textes textes des termes, terminés par '\0'
+ * @param postings listes d'identifiants : écarts croissants encodés en varint
+ * @param octets mémoire du segment, imputée au compte de l'index
+ */
+typedef struct Segment Segment;
+struct Segment
+{
+	int niveau;
+	uint32_t nbMessages;
+	uint32_t premier;
+	uint32_t dernier;
+	uint32_t nbTermes;
+	Terme *termes;
+	char *textes;
+	uint8_t *postings;
+	size_t octets;
+};
+
+/**
+ * @brief Terme du segment en construction.
+ *
+ * @param texte le terme, chaîne vide si la case est libre
+ * @param postings liste d'identifiants, au même format que dans un segment
+ * @param longueur octets utilisés dans postings
+ * @param capacite octets alloués pour postings
+ * @param nombre nombre d'identifiants de la liste
+ * @param dernier dernier identifiant de la liste
+ */
+typedef struct TermeConstruction TermeConstruction;
+struct TermeConstruction
+{
+	char texte[TAILLE_TERME + 1];
+	uint8_t *postings;
+	uint32_t longueur;
+	uint32_t capacite;
+	uint32_t nombre;
+	uint32_t dernier;
+};
+
+/**
+ * @brief Segment en construction : table à adressage ouvert des termes,
+ * identifiants du premier et du dernier message indexés, et mémoire allouée,
+ * imputée au compte de l'index.
+ */
+typedef struct Construction Construction;
+struct Construction
+{
+	TermeConstruction *cases;
+	uint32_t capacite;
+	uint32_t nbTermes;
+	uint32_t nbMessages;
+	uint32_t premier;
+	uint32_t dernier;
+	size_t octets;
+};
+
+/**
+ * @brief Index d'un salon.
+ *
+ * @param verrou lecture pour les recherches, écriture pour l'indexation et le remplacement de segments
+ * @param segments segments immuables, du plus ancien au plus récent
+ * @param nbSegments nombre de segments
+ * @param capaciteSegments taille du tableau segments
+ * @param construction segment en construction, modifié par le seul thread d'indexation
+ * @param estAFusionner 1 si l'index est dans la file du thread de fusion
+ * @param suivantAFusionner index suivant dans cette file
+ */
+typedef struct IndexSalon IndexSalon;
+struct IndexSalon
+{
+	pthread_rwlock_t verrou;
+	Segment **segments;
+	int nbSegments;
+	int capaciteSegments;
+	Construction construction;
+	int estAFusionner;
+	IndexSalon *suivantAFusionner;
+};
+
+/**
+ * @brief Liste d'identifiants trouvée pour un terme.
+ */
+typedef struct Liste Liste;
+struct Liste
+{
+	const uint8_t *octets;
+	uint32_t longueur;
+	uint32_t nombre;
+};
+
+/**
+ * @brief Tampon qui grandit à la demande.
+ */
+typedef struct Tampon Tampon;
+struct Tampon
+{
+	uint8_t *octets;
+	size_t longueur;
+	size_t capacite;
+};
+
+/**
+ * - indexSalons = index de chaque salon, par identifiant ; un index n'est jamais libéré
+ * - nbIndexSalons = taille du tableau indexSalons
+ * - mutexIndex = protège indexSalons
+ * - nbIndexes = messages de l'historique déjà indexés
+ * - premierAFusionner = file des index où une fusion est peut-être possible
+ * - mutexFusion = protège cette file
+ * - condFusion = signalée quand un index entre dans la file
+ */
+static IndexSalon **indexSalons = NULL;
+static int nbIndexSalons = 0;
+static pthread_mutex_t mutexIndex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint32_t nbIndexes = 0;
+static IndexSalon *premierAFusionner = NULL;
+static pthread_mutex_t mutexFusion = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condFusion = PTHREAD_COND_INITIALIZER;
+
+static size_t ecrireVarint(uint8_t *destination, uint32_t valeur)
+{
+	size_t n = 0;
+	while (valeur >= 0x80)
+	{
+		destination[n++] = (valeur & 0x7f) | 0x80;
+		valeur >>= 7;
+	}
+	destination[n++] = valeur;
+	return n;
+}
+
+static uint32_t lireVarint(const uint8_t **position)
+{
+	uint32_t valeur = 0;
+	int decalage = 0;
+	uint8_t octet;
+	do
+	{
+		octet = *(*position)++;
+		valeur |= (uint32_t)(octet & 0x7f) << decalage;
+		decalage += 7;
+	} while (octet & 0x80);
+	return valeur;
+}
+
+static int tamponReserver(Tampon *tampon, size_t taille)
+{
+	if (tampon->longueur + taille <= tampon->capacite)
+	{
+		return 0;
+	}
+	size_t capacite = tampon->capacite > 0 ? tampon->capacite : 4096;
+	while (capacite < tampon->longueur + taille)
+	{
+		capacite *= 2;
+	}
+	uint8_t *octets = realloc(tampon->octets, capacite);
+	if (octets == NULL)
+	{
+		return -1;
+	}
+	tampon->octets = octets;
+	tampon->capacite = capacite;
+	return 0;
+}
+
+static int estCaractereTerme(unsigned char c)
+{
+	// Les octets UTF-8 (accents) font partie des termes
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+/**
+ * @brief Découpe un texte en termes distincts : suites de lettres et de
+ * chiffres, en minuscules (accents latins compris), d'au moins deux octets.
+ *
+ * @param texte texte à découper
+ * @param longueur taille du texte
+ * @param termes termes trouvés
+ * @param maximum nombre maximum de termes
+ * @return le nombre de termes.
+ */
+static int decouper(const char *texte, size_t longueur, char termes[][TAILLE_TERME + 1], int maximum)
+{
+	int nombre = 0;
+	size_t i = 0;
+	while (i < longueur && nombre < maximum)
+	{
+		while (i < longueur && !estCaractereTerme(texte[i]))
+		{
+			i++;
+		}
+		size_t n = 0;
+		while (i < longueur && estCaractereTerme(texte[i]))
+		{
+			unsigned char c = texte[i];
+			if (n < TAILLE_TERME)
+			{
+				termes[nombre][n++] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+			}
+			i++;
+			// Majuscules accentuées latines (U+00C0 à U+00DE, sauf ×) : C3 80..9E devient C3 A0..BE
+			if (c == 0xc3 && i < longueur && (unsigned char)texte[i] >= 0x80 && (unsigned char)texte[i] <= 0x9e && (unsigned char)texte[i] != 0x97)
+			{
+				if (n < TAILLE_TERME)
+				{
+					termes[nombre][n++] = texte[i] + 0x20;
+				}
+				i++;
+			}
+		}
+		if (n < 2)
+		{
+			continue;
+		}
+		termes[nombre][n] = '\0';
+
+		int estNouveau = 1;
+		for (int j = 0; j < nombre && estNouveau; j++)
+		{
+			estNouveau = strcmp(termes[j], termes[nombre]) != 0;
+		}
+		nombre += estNouveau;
+	}
+	return nombre;
+}
+
+/**
+ * @brief Donne l'index d'un salon.
+ *
+ * @param idSalon identifiant du salon
+ * @param creer 1 pour créer l'index s'il n'existe pas
+ * @return l'index, NULL s'il n'existe pas ou si la mémoire manque.
+ */
+static IndexSalon *indexDuSalon(int idSalon, int creer)
+{
+	if (idSalon < 0)
+	{
+		return NULL;
+	}
+	pthread_mutex_lock(&mutexIndex);
+	if (idSalon >= nbIndexSalons && creer)
+	{
+		int taille = nbIndexSalons > 0 ? nbIndexSalons : 16;
+		while (taille <= idSalon)
+		{
+			taille *= 2;
+		}
+		IndexSalon **agrandi = realloc(indexSalons, sizeof(IndexSalon *) * taille);
+		if (agrandi != NULL)
+		{
+			memset(agrandi + nbIndexSalons, 0, sizeof(IndexSalon *) * (taille - nbIndexSalons));
+			indexSalons = agrandi;
+			nbIndexSalons = taille;
+		}
+	}
+	IndexSalon *index = idSalon < nbIndexSalons ? indexSalons[idSalon] : NULL;
+	if (index == NULL && creer && idSalon < nbIndexSalons)
+	{
+		index = calloc(1, sizeof(IndexSalon));
+		if (index != NULL)
+		{
+			pthread_rwlock_init(&index->verrou, NULL);
+			indexSalons[idSalon] = index;
+		}
+	}
+	pthread_mutex_unlock(&mutexIndex);
+	return index;
+}
+
+/**
+ * @brief Cherche la case d'un terme dans un segment en construction,
+ * ou la case libre où l'insérer.
+ */
+static TermeConstruction *caseConstruction(const Construction *construction, const char *terme)
+{
+	uint32_t masque = construction->capacite - 1;
+	uint32_t i = journalEmpreinte(terme, strlen(terme)) & masque;
+	while (construction->cases[i].texte[0] != '\0' && strcmp(construction->cases[i].texte, terme) != 0)
+	{
+		i = (i + 1) & masque;
+	}
+	return &construction->cases[i];
+}
+
+/**
+ * @brief Double la table d'un segment en construction. Appelée sous le verrou en écriture.
+ *
+ * @return 0 si tout se passe bien, -1 si la mémoire manque.
+ */
+static int agrandirConstruction(Construction *construction)
+{
+	Construction agrandie = *construction;
+	agrandie.capacite = construction->capacite > 0 ? construction->capacite * 2 : CAPACITE_CONSTRUCTION;
+	agrandie.cases = calloc(agrandie.capacite, sizeof(TermeConstruction));
+	if (agrandie.cases == NULL)
+	{
+		return -1;
+	}
+	for (uint32_t i = 0; i < construction->capacite; i++)
+	{
+		if (construction->cases[i].texte[0] != '\0')
+		{
+			*caseConstruction(&agrandie, construction->cases[i].texte) = construction->cases[i];
+		}
+	}
+	free(construction->cases);
+	agrandie.octets += (agrandie.capacite - construction->capacite) * sizeof(TermeConstruction);
+	memoirePartager(COMPTE_INDEX, (agrandie.capacite - construction->capacite) * sizeof(TermeConstruction));
+	*construction = agrandie;
+	return 0;
+}
+
+/**
+ * @brief Ajoute un identifiant à la liste d'un terme du segment en construction.
+ * Appelée sous le verrou en écriture.
+ */
+static void ajouterPosting(Construction *construction, const char *terme, uint32_t id)
+{
+	if ((construction->nbTermes + 1) * 2 > construction->capacite && agrandirConstruction(construction) != 0)
+	{
+		return;
+	}
+	TermeConstruction *entree = caseConstruction(construction, terme);
+	if (entree->texte[0] == '\0')
+	{
+		strcpy(entree->texte, terme);
+		construction->nbTermes++;
+	}
+	else if (entree->nombre > 0 && entree->dernier == id)
+	{
+		// Mot déjà vu dans ce message (le pseudo le répète)
+		return;
+	}
+	if (entree->longueur + 5 > entree->capacite)
+	{
+		uint32_t capacite = entree->capacite > 0 ? entree->capacite * 2 : 16;
+		uint8_t *postings = realloc(entree->postings, capacite);
+		if (postings == NULL)
+		{
+			return;
+		}
+		construction->octets += capacite - entree->capacite;
+		memoirePartager(COMPTE_INDEX, capacite - entree->capacite);
+		entree->postings = postings;
+		entree->capacite = capacite;
+	}
+	entree->longueur += ecrireVarint(entree->postings + entree->longueur, id - entree->dernier);
+	entree->dernier = id;
+	entree->nombre++;
+}
+
+static void libererConstruction(Construction *construction)
+{
+	for (uint32_t i = 0; i < construction->capacite; i++)
+	{
+		free(construction->cases[i].postings);
+	}
+	free(construction->cases);
+	memoirePartager(COMPTE_INDEX, -(int64_t)construction->octets);
+}
+
+static void libererSegment(Segment *segment)
+{
+	free(segment->termes);
+	free(segment->textes);
+	free(segment->postings);
+	memoirePartager(COMPTE_INDEX, -(int64_t)segment->octets);
+	free(segment);
+}
+
+static int comparerTermesConstruction(const void *a, const void *b)
+{
+	return strcmp((*(TermeConstruction *const *)a)->texte, (*(TermeConstruction *const *)b)->texte);
+}
+
+/**
+ * @brief Construit un segment immuable à partir du segment en construction.
+ * Seul le thread d'indexation modifie la construction : il la lit ici sans verrou.
+ *
+ * @return le segment, NULL si la mémoire manque.
+ */
+static Segment *sceller(const Construction *construction)
+{
+	TermeConstruction **tries = malloc(sizeof(TermeConstruction *) * (construction->nbTermes + 1));
+	Segment *segment = calloc(1, sizeof(Segment));
+	if (tries == NULL || segment == NULL)
+	{
+		free(tries);
+		free(segment);
+		return NULL;
+	}
+
+	size_t tailleTextes = 0;
+	size_t taillePostings = 0;
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < construction->capacite; i++)
+	{
+		if (construction->cases[i].texte[0] != '\0')
+		{
+			tries[n++] = &construction->cases[i];
+			tailleTextes += strlen(construction->cases[i].texte) + 1;
+			taillePostings += construction->cases[i].longueur;
+		}
+	}
+	qsort(tries, n, sizeof(TermeConstruction *), comparerTermesConstruction);
+
+	segment->termes = malloc(sizeof(Terme) * (n + 1));
+	segment->textes = malloc(tailleTextes + 1);
+	segment->postings = malloc(taillePostings + 1);
+	if (segment->termes == NULL || segment->textes == NULL || segment->postings == NULL)
+	{
+		free(tries);
+		libererSegment(segment);
+		return NULL;
+	}
+
+	size_t positionTexte = 0;
+	size_t positionPostings = 0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		size_t longueurTexte = strlen(tries[i]->texte) + 1;
+		segment->termes[i].texte = positionTexte;
+		segment->termes[i].postings = positionPostings;
+		segment->termes[i].longueur = tries[i]->longueur;
+		segment->termes[i].nombre = tries[i]->nombre;
+		memcpy(segment->textes + positionTexte, tries[i]->texte, longueurTexte);
+		memcpy(segment->postings + positionPostings, tries[i]->postings, tries[i]->longueur);
+		positionTexte += longueurTexte;
+		positionPostings += tries[i]->longueur;
+	}
+	segment->nbTermes = n;
+	segment->nbMessages = construction->nbMessages;
+	segment->premier = construction->premier;
+	segment->dernier = construction->dernier;
+	segment->octets = sizeof(Segment) + sizeof(Terme) * (n + 1) + tailleTextes + taillePostings + 2;
+	memoirePartager(COMPTE_INDEX, segment->octets);
+	free(tries);
+	return segment;
+}
+
+/**
+ * @brief Fusionne des segments consécutifs en un seul, sans verrou : les
+ * segments sont immuables. Les listes d'un même terme sont mises bout à bout,
+ * les segments couvrant des identifiants croissants.
+ *
+ * @param sources segments, du plus ancien au plus récent
+ * @param nombre nombre de segments
+ * @return le segment fusionné, NULL si la mémoire manque.
+ */
+static Segment *fusionner(Segment **sources, int nombre)
+{
+	uint32_t positions[FACTEUR_FUSION] = {0};
+	Tampon termes = {0};
+	Tampon textes = {0};
+	Tampon postings = {0};
+	Segment *segment = calloc(1, sizeof(Segment));
+	int estEchec = segment == NULL;
+
+	while (!estEchec)
+	{
+		// Plus petit terme parmi les têtes des segments
+		const char *plusPetit = NULL;
+		for (int k = 0; k < nombre; k++)
+		{
+			if (positions[k] < sources[k]->nbTermes)
+			{
+				const char *texte = sources[k]->textes + sources[k]->termes[positions[k]].texte;
+				if (plusPetit == NULL || strcmp(texte, plusPetit) < 0)
+				{
+					plusPetit = texte;
+				}
+			}
+		}
+		if (plusPetit == NULL)
+		{
+			break;
+		}
+
+		size_t longueurTexte = strlen(plusPetit) + 1;
+		Terme terme = {textes.longueur, postings.longueur, 0, 0};
+		if (tamponReserver(&textes, longueurTexte) != 0 || tamponReserver(&termes, sizeof(Terme)) != 0)
+		{
+			estEchec = 1;
+			break;
+		}
+		memcpy(textes.octets + textes.longueur, plusPetit, longueurTexte);
+		textes.longueur += longueurTexte;
+
+		uint32_t dernier = 0;
+		for (int k = 0; k < nombre && !estEchec; k++)
+		{
+			if (positions[k] >= sources[k]->nbTermes)
+			{
+				continue;
+			}
+			const Terme *source = &sources[k]->termes[positions[k]];
+			if (strcmp(sources[k]->textes + source->texte, plusPetit) != 0)
+			{
+				continue;
+			}
+			// Réencodage : le premier écart d'une liste part de 0, pas du dernier identifiant précédent
+			if (tamponReserver(&postings, (size_t)source->nombre * 5) != 0)
+			{
+				estEchec = 1;
+				break;
+			}
+			const uint8_t *lecture = sources[k]->postings + source->postings;
+			uint32_t valeur = 0;
+			for (uint32_t i = 0; i < source->nombre; i++)
+			{
+				valeur += lireVarint(&lecture);
+				postings.longueur += ecrireVarint(postings.octets + postings.longueur, valeur - dernier);
+				dernier = valeur;
+			}
+			terme.nombre += source->nombre;
+			positions[k]++;
+		}
+		terme.longueur = postings.longueur - terme.postings;
+		memcpy(termes.octets + termes.longueur, &terme, sizeof(Terme));
+		termes.longueur += sizeof(Terme);
+	}
+
+	if (estEchec)
+	{
+		free(termes.octets);
+		free(textes.octets);
+		free(postings.octets);
+		free(segment);
+		return NULL;
+	}
+	segment->niveau = sources[0]->niveau + 1;
+	segment->premier = sources[0]->premier;
+	segment->dernier = sources[nombre - 1]->dernier;
+	for (int k = 0; k < nombre; k++)
+	{
+		segment->nbMessages += sources[k]->nbMessages;
+	}
+	segment->nbTermes = termes.longueur / sizeof(Terme);
+	segment->termes = (Terme *)termes.octets;
+	segment->textes = (char *)textes.octets;
+	segment->postings = postings.octets;
+	segment->octets = sizeof(Segment) + termes.capacite + textes.capacite + postings.capacite;
+	memoirePartager(COMPTE_INDEX, segment->octets);
+	return segment;
+}
+
+/**
+ * @brief Met un index dans la file du thread de fusion.
+ */
+static void demanderFusion(IndexSalon *index)
+{
+	pthread_mutex_lock(&mutexFusion);
+	if (!index->estAFusionner)
+	{
+		index->estAFusionner = 1;
+		index->suivantAFusionner = premierAFusionner;
+		premierAFusionner = index;
+		pthread_cond_signal(&condFusion);
+	}
+	pthread_mutex_unlock(&mutexFusion);
+}
+
+/**
+ * @brief Scelle le segment en construction d'un index et le remplace par un segment vide.
+ */
+static void scellerConstruction(IndexSalon *index)
+{
+	Segment *segment = sceller(&index->construction);
+	if (segment == NULL)
+	{
+		return;
+	}
+
+	pthread_rwlock_wrlock(&index->verrou);
+	if (index->nbSegments == index->capaciteSegments)
+	{
+		int capacite = index->capaciteSegments > 0 ? index->capaciteSegments * 2 : 8;
+		Segment **segments = realloc(index->segments, sizeof(Segment *) * capacite);
+		if (segments == NULL)
+		{
+			pthread_rwlock_unlock(&index->verrou);
+			libererSegment(segment);
+			return;
+		}
+		index->segments = segments;
+		index->capaciteSegments = capacite;
+	}
+	index->segments[index->nbSegments++] = segment;
+	Construction ancienne = index->construction;
+	memset(&index->construction, 0, sizeof(Construction));
+	pthread_rwlock_unlock(&index->verrou);
+
+	libererConstruction(&ancienne);
+	demanderFusion(index);
+}
+
+/**
+ * @brief Indexe un message de l'historique.
+ *
+ * @param id identifiant du message
+ */
+static void indexerMessage(uint32_t id)
+{
+	historiqueVerrouiller();
+	const MessageHistorique *message = historiqueLire(id);
+	IndexSalon *index = message != NULL ? indexDuSalon(message->idSalon, 1) : NULL;
+	if (index == NULL)
+	{
+		historiqueDeverrouiller();
+		return;
+	}
+
+	// Découpage hors verrou : les recherches ne sont bloquées que le temps des ajouts
+	char termes[MAX_TERMES_MESSAGE][TAILLE_TERME + 1];
+	int nbTermes = decouper(message->texte, message->longueur, termes, MAX_TERMES_MESSAGE);
+	const char *pseudo = identitePseudo(message->idPseudo);
+	if (pseudo != NULL)
+	{
+		// Le pseudo de l'expéditeur est cherchable comme un mot du message
+		nbTermes += decouper(pseudo, strlen(pseudo), termes + nbTermes, MAX_TERMES_MESSAGE - nbTermes);
+	}
+	historiqueDeverrouiller();
+
+	pthread_rwlock_wrlock(&index->verrou);
+	for (int i = 0; i < nbTermes; i++)
+	{
+		ajouterPosting(&index->construction, termes[i], id);
+	}
+	if (index->construction.nbMessages == 0)
+	{
+		index->construction.premier = id;
+	}
+	index->construction.dernier = id;
+	index->construction.nbMessages++;
+	int estPlein = index->construction.nbMessages >= MESSAGES_PAR_SEGMENT;
+	pthread_rwlock_unlock(&index->verrou);
+
+	if (estPlein)
+	{
+		scellerConstruction(index);
+	}
+}
+
+/**
+ * @brief Fusionne, dans un index, la plus ancienne suite de FACTEUR_FUSION
+ * segments de même niveau. Le thread d'indexation ne fait qu'ajouter des
+ * segments en fin de tableau : les segments fusionnés n'ont pas bougé entre-temps.
+ * Un segment fusionné couvre au plus le quart de la rétention de l'historique,
+ * pour être libéré peu après ses messages.
+ *
+ * @return 0 si une fusion a eu lieu, -1 sinon.
+ */
+static int fusionnerSalon(IndexSalon *index)
+{
+	Segment *sources[FACTEUR_FUSION];
+	int debut = -1;
+
+	uint32_t etendue = historiqueRetention() / FACTEUR_FUSION;
+	pthread_rwlock_rdlock(&index->verrou);
+	for (int i = 0; i + FACTEUR_FUSION <= index->nbSegments && debut < 0; i++)
+	{
+		int niveau = index->segments[i]->niveau;
+		int estSuite = niveau < NIVEAU_MAX_FUSION && index->segments[i + FACTEUR_FUSION - 1]->dernier - index->segments[i]->premier < etendue;
+		for (int k = 1; k < FACTEUR_FUSION && estSuite; k++)
+		{
+			estSuite = index->segments[i + k]->niveau == niveau;
+		}
+		if (estSuite)
+		{
+			debut = i;
+			memcpy(sources, index->segments + i, sizeof(sources));
+		}
+	}
+	pthread_rwlock_unlock(&index->verrou);
+	if (debut < 0)
+	{
+		return -1;
+	}
+
+	uint64_t depart = metriqueHorloge();
+	Segment *fusion = fusionner(sources, FACTEUR_FUSION);
+	if (fusion == NULL)
+	{
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&index->verrou);
+	index->segments[debut] = fusion;
+	memmove(index->segments + debut + 1, index->segments + debut + FACTEUR_FUSION,
+			sizeof(Segment *) * (index->nbSegments - debut - FACTEUR_FUSION));
+	index->nbSegments -= FACTEUR_FUSION - 1;
+	pthread_rwlock_unlock(&index->verrou);
+
+	// Plus aucune recherche ne peut lire les anciens segments
+	for (int k = 0; k < FACTEUR_FUSION; k++)
+	{
+		libererSegment(sources[k]);
+	}
+	journalEcrire(JOURNAL_DEBUG, EVT_FUSION_INDEX, fusion->niveau, fusion->nbMessages, metriqueHorloge() - depart, NULL);
+	return 0;
+}
+
+/**
+ * @brief Libère les plus anciens segments d'un index dont tous les messages
+ * ont été évincés de l'historique. Seul le thread de fusion retire des
+ * segments : les fusions en cours ne sont pas dérangées.
+ */
+static void purgerSalon(IndexSalon *index)
+{
+	uint32_t plancher = historiquePremier();
+	while (1)
+	{
+		pthread_rwlock_wrlock(&index->verrou);
+		Segment *segment = index->nbSegments > 0 && index->segments[0]->dernier < plancher ? index->segments[0] : NULL;
+		if (segment != NULL)
+		{
+			memmove(index->segments, index->segments + 1, sizeof(Segment *) * (index->nbSegments - 1));
+			index->nbSegments--;
+		}
+		pthread_rwlock_unlock(&index->verrou);
+		if (segment == NULL)
+		{
+			return;
+		}
+		libererSegment(segment);
+	}
+}
+
+/**
+ * @brief Fonction principale du thread d'indexation : suit l'historique, et
+ * fait purger tous les index quand des messages en sont évincés.
+ */
+static void *indexeurThread(void *arg)
+{
+	(void)arg;
+	uint32_t suivant = 0;
+	uint32_t plancher = 0;
+	while (1)
+	{
+		uint32_t nombre = historiqueAttendre(suivant);
+		if (historiquePremier() != plancher)
+		{
+			plancher = historiquePremier();
+			suivant = suivant > plancher ? suivant : plancher;
+			pthread_mutex_lock(&mutexIndex);
+			for (int i = 0; i < nbIndexSalons; i++)
+			{
+				if (indexSalons[i] != NULL)
+				{
+					demanderFusion(indexSalons[i]);
+				}
+			}
+			pthread_mutex_unlock(&mutexIndex);
+		}
+		for (; suivant < nombre; suivant++)
+		{
+			indexerMessage(suivant);
+		}
+		atomic_store(&nbIndexes, suivant);
+	}
+	return NULL;
+}
+
+/**
+ * @brief Fonction principale du thread de fusion des segments.
+ */
+static void *fusionThread(void *arg)
+{
+	(void)arg;
+	while (1)
+	{
+		pthread_mutex_lock(&mutexFusion);
+		while (premierAFusionner == NULL)
+		{
+			pthread_cond_wait(&condFusion, &mutexFusion);
+		}
+		IndexSalon *index = premierAFusionner;
+		premierAFusionner = index->suivantAFusionner;
+		index->estAFusionner = 0;
+		pthread_mutex_unlock(&mutexFusion);
+
+		// Une fusion peut en permettre une autre au niveau supérieur
+		purgerSalon(index);
+		while (fusionnerSalon(index) == 0)
+		{
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Cherche la liste d'un terme dans un segment immuable.
+ *
+ * @return 1 si le terme est présent, 0 sinon.
+ */
+static int listeSegment(const Segment *segment, const char *terme, Liste *liste)
+{
+	uint32_t bas = 0;
+	uint32_t haut = segment->nbTermes;
+	while (bas < haut)
+	{
+		uint32_t milieu = (bas + haut) / 2;
+		int ordre = strcmp(segment->textes + segment->termes[milieu].texte, terme);
+		if (ordre == 0)
+		{
+			liste->octets = segment->postings + segment->termes[milieu].postings;
+			liste->longueur = segment->termes[milieu].longueur;
+			liste->nombre = segment->termes[milieu].nombre;
+			return 1;
+		}
+		if (ordre < 0)
+		{
+			bas = milieu + 1;
+		}
+		else
+		{
+			haut = milieu;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Cherche la liste d'un terme dans le segment en construction.
+ *
+ * @return 1 si le terme est présent, 0 sinon.
+ */
+static int listeConstruction(const Construction *construction, const char *terme, Liste *liste)
+{
+	if (construction->capacite == 0)
+	{
+		return 0;
+	}
+	const TermeConstruction *entree = caseConstruction(construction, terme);
+	if (entree->texte[0] == '\0' || entree->nombre == 0)
+	{
+		return 0;
+	}
+	liste->octets = entree->postings;
+	liste->longueur = entree->longueur;
+	liste->nombre = entree->nombre;
+	return 1;
+}
+
+/**
+ * @brief Intersecte les listes des termes d'une requête dans un segment, et
+ * ajoute aux résultats les identifiants communs encore dans l'historique, du
+ * plus récent au plus ancien. La liste la plus courte donne les candidats,
+ * filtrés par les autres listes.
+ *
+ * @param plancher identifiant du plus ancien message conservé
+
+ * @return le nombre total de résultats.
+ */
+static int intersecter(const Liste *listes, int nbListes, uint32_t plancher, uint32_t *resultats, int trouves, int maximum)
+{
+	int plusCourte = 0;
+	for (int i = 1; i < nbListes; i++)
+	{
+		if (listes[i].nombre < listes[plusCourte].nombre)
+		{
+			plusCourte = i;
+		}
+	}
+	uint32_t *candidats = malloc(sizeof(uint32_t) * listes[plusCourte].nombre);
+	if (candidats == NULL)
+	{
+		return trouves;
+	}
+	const uint8_t *lecture = listes[plusCourte].octets;
+	uint32_t valeur = 0;
+	for (uint32_t i = 0; i < listes[plusCourte].nombre; i++)
+	{
+		valeur += lireVarint(&lecture);
+		candidats[i] = valeur;
+	}
+	uint32_t nbCandidats = listes[plusCourte].nombre;
+
+	for (int l = 0; l < nbListes && nbCandidats > 0; l++)
+	{
+		if (l == plusCourte)
+		{
+			continue;
+		}
+		lecture = listes[l].octets;
+		uint32_t restants = listes[l].nombre;
+		uint32_t courant = 0;
+		int estLu = 0;
+		uint32_t gardes = 0;
+		valeur = 0;
+		for (uint32_t i = 0; i < nbCandidats; i++)
+		{
+			while ((!estLu || courant < candidats[i]) && restants > 0)
+			{
+				valeur += lireVarint(&lecture);
+				courant = valeur;
+				estLu = 1;
+				restants--;
+			}
+			if (estLu && courant == candidats[i])
+			{
+				candidats[gardes++] = candidats[i];
+			}
+			else if (restants == 0 && (!estLu || courant < candidats[i]))
+			{
+				break;
+			}
+		}
+		nbCandidats = gardes;
+	}
+
+	for (uint32_t i = nbCandidats; i > 0 && trouves < maximum && candidats[i - 1] >= plancher; i--)
+	{
+		resultats[trouves++] = candidats[i - 1];
+	}
+	free(candidats);
+	return trouves;
+}
+
+/**
+ * @brief Cherche dans l'historique d'un salon les messages contenant tous
+ * les termes d'une requête, du plus récent au plus ancien. Appelée sous
+ * historiqueVerrouiller() : les résultats sont encore lisibles.
+ *
+ * @param idSalon salon dans lequel chercher
+ * @param requete termes à chercher
+ * @param resultats identifiants des messages trouvés
+ * @param maximum nombre maximum de résultats
+ * @return le nombre de résultats.
+ */
+int rechercher(int idSalon, const char *requete, uint32_t *resultats, int maximum)
+{
+	char termes[MAX_TERMES_REQUETE][TAILLE_TERME + 1];
+	int nbTermes = decouper(requete, strlen(requete), termes, MAX_TERMES_REQUETE);
+	IndexSalon *index = indexDuSalon(idSalon, 0);
+	if (nbTermes == 0 || index == NULL)
+	{
+		return 0;
+	}
+
+	Liste listes[MAX_TERMES_REQUETE];
+	int trouves = 0;
+	uint32_t plancher = historiquePremier();
+	pthread_rwlock_rdlock(&index->verrou);
+
+	// Le segment en construction contient les messages les plus récents
+	int estComplet = 1;
+	for (int t = 0; t < nbTermes && estComplet; t++)
+	{
+		estComplet = listeConstruction(&index->construction, termes[t], &listes[t]);
+	}
+	if (estComplet)
+	{
+		trouves = intersecter(listes, nbTermes, plancher, resultats, trouves, maximum);
+	}
+
+	for (int s = index->nbSegments - 1; s >= 0 && trouves < maximum && index->segments[s]->dernier >= plancher; s--)
+	{
+		estComplet = 1;
+		for (int t = 0; t < nbTermes && estComplet; t++)
+		{
+			estComplet = listeSegment(index->segments[s], termes[t], &listes[t]);
+		}
+		if (estComplet)
+		{
+			trouves = intersecter(listes, nbTermes, plancher, resultats, trouves, maximum);
+		}
+	}
+	pthread_rwlock_unlock(&index->verrou);
+	return trouves;
+}
+
+/**
+ * @brief Jauge des messages de l'historique pas encore indexés.
+ *
+ * @return le nombre de messages en attente d'indexation.
+ */
+long jaugeRetardIndex()
+{
+	return historiqueNbMessages() - atomic_load(&nbIndexes);
+}
+
+/**
+ * @brief Démarre les threads d'indexation et de fusion.
+ *
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int rechercheDemarrer(void)
+{
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, indexeurThread, NULL) != 0)
+	{
+		perror("Erreur thread d'indexation");
+		return -1;
+	}
+	pthread_detach(thread);
+	if (pthread_create(&thread, NULL, fusionThread, NULL) != 0)
+	{
+		perror("Erreur thread de fusion de l'index");
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
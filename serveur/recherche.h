@@ -0,0 +1,32 @@
+#ifndef RECHERCHE_H
+#define RECHERCHE_H
+
+#include <stdint.h>
+
+/**
+ * Recherche plein texte dans l'historique : un index inversé par salon
+ * associe chaque terme à la liste compressée (écarts en varint) des
+ * identifiants des messages qui le contiennent. Un thread d'indexation suit
+ * l'historique et remplit un segment en construction ; les segments pleins
+ * deviennent immuables et sont fusionnés par un second thread. Les
+ * recherches ne bloquent jamais l'arrivée des messages.
+ */
+
+/**
+ * - MESSAGES_PAR_SEGMENT = messages d'un segment avant qu'il ne devienne immuable
+ * - FACTEUR_FUSION = nombre de segments de même niveau fusionnés en un seul
+ * - TAILLE_TERME = taille maximum d'un terme indexé (plus long, il est tronqué)
+ * - MAX_TERMES_REQUETE = nombre maximum de termes d'une recherche
+ * - MAX_RESULTATS = nombre maximum de résultats rendus par /chercher
+ */
+#define MESSAGES_PAR_SEGMENT 4096
+#define FACTEUR_FUSION 4
+#define TAILLE_TERME 32
+#define MAX_TERMES_REQUETE 8
+#define MAX_RESULTATS 10
+
+int rechercheDemarrer(void);
+int rechercher(int idSalon, const char *requete, uint32_t *resultats, int maximum);
+long jaugeRetardIndex();
+
+#endif
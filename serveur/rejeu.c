@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+/**
+ * Rejoue une capture du serveur (option -c) contre un serveur local : chaque
+ * connexion capturée est rouverte et ses trames renvoyées, à la vitesse de la
+ * capture, plus vite, ou sans attente. Les réponses du serveur sont lues et
+ * comptées, sans être interprétées. Le serveur visé doit accepter autant de
+ * connexions locales que la capture en a ouvertes (option -p 0).
+ */
+
+/**
+ * - PERIODE_LECTURE = en vitesse maximale, nombre d'enregistrements entre deux lectures des réponses
+ * - DELAI_FIN = temps laissé au serveur pour répondre après le dernier enregistrement, en ms
+ */
+#define PERIODE_LECTURE 256
+#define DELAI_FIN 1000
+
+/**
+ * - connexions = socket de chaque connexion capturée, -1 si elle n'est pas ouverte
+ * - nbConnexions = taille du tableau connexions
+ * - nbOuvertes = nombre de connexions ouvertes
+ * - octetsRecus = octets reçus du serveur
+ */
+static int *connexions = NULL;
+static uint32_t nbConnexions = 0;
+static uint32_t nbOuvertes = 0;
+static uint64_t octetsRecus = 0;
+
+/**
+ * @brief Horloge monotone, en microsecondes.
+ */
+static uint64_t horloge(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Lit un entier en ordre réseau.
+ */
+static uint64_t lireEntier(const uint8_t *octets, int taille)
+{
+	uint64_t valeur = 0;
+	for (int i = 0; i < taille; i++)
+	{
+		valeur = (valeur << 8) | octets[i];
+	}
+	return valeur;
+}
+
+/**
+ * @brief Ouvre une connexion au serveur pour une connexion capturée.
+ *
+ * @param id identifiant de la connexion dans la capture
+ * @param adresse adresse du serveur
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int ouvrir(uint32_t id, const struct sockaddr_in *adresse)
+{
+	if (id >= nbConnexions)
+	{
+		uint32_t nouvelleTaille = id * 2 + 16;
+		int *agrandi = realloc(connexions, sizeof(int) * nouvelleTaille);
+		if (agrandi == NULL)
+		{
+			return -1;
+		}
+		for (uint32_t i = nbConnexions; i < nouvelleTaille; i++)
+		{
+			agrandi[i] = -1;
+		}
+		connexions = agrandi;
+		nbConnexions = nouvelleTaille;
+	}
+	int dS = socket(PF_INET, SOCK_STREAM, 0);
+	if (dS < 0 || connect(dS, (const struct sockaddr *)adresse, sizeof(*adresse)) < 0)
+	{
+		if (dS >= 0)
+		{
+			close(dS);
+		}
+		return -1;
+	}
+	connexions[id] = dS;
+	nbOuvertes++;
+	return 0;
+}
+
+/**
+ * @brief Ferme la connexion d'une connexion capturée, si elle est ouverte.
+ *
+ * @param id identifiant de la connexion dans la capture
+ */
+static void fermer(uint32_t id)
+{
+	if (id < nbConnexions && connexions[id] >= 0)
+	{
+		close(connexions[id]);
+		connexions[id] = -1;
+		nbOuvertes--;
+	}
+}
+
+/**
+ * @brief Lit les réponses disponibles sur toutes les connexions ouvertes, en
+ * attendant au plus delai millisecondes qu'il en arrive. Une connexion fermée
+ * par le serveur est fermée de notre côté.
+ *
+ * @param delai attente maximum, en millisecondes
+ */
+static void lireReponses(int delai)
+{
+	struct pollfd *attentes = malloc(sizeof(struct pollfd) * (nbOuvertes + 1));
+	uint32_t *ids = malloc(sizeof(uint32_t) * (nbOuvertes + 1));
+	if (attentes == NULL || ids == NULL)
+	{
+		free(attentes);
+		free(ids);
+		return;
+	}
+	int nb = 0;
+	for (uint32_t i = 0; i < nbConnexions && nb < (int)nbOuvertes; i++)
+	{
+		if (connexions[i] >= 0)
+		{
+			attentes[nb].fd = connexions[i];
+			attentes[nb].events = POLLIN;
+			ids[nb] = i;
+			nb++;
+		}
+	}
+	if (poll(attentes, nb, delai) > 0)
+	{
+		char tampon[65536];
+		for (int i = 0; i < nb; i++)
+		{
+			if (attentes[i].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				ssize_t recu;
+				while ((recu = recv(attentes[i].fd, tampon, sizeof(tampon), MSG_DONTWAIT)) > 0)
+				{
+					octetsRecus += recu;
+				}
+				if (recu == 0 || (recu == -1 && errno != EAGAIN && errno != EINTR))
+				{
+					fermer(ids[i]);
+				}
+			}
+		}
+	}
+	free(attentes);
+	free(ids);
+}
+
+/**
+ * @brief Envoie une trame capturée sur sa connexion.
+ *
+ * @return 0 si tout se passe bien, -1 si la connexion n'est pas ouverte ou a été perdue.
+ */
+static int envoyer(uint32_t id, uint8_t type, uint8_t drapeaux, const uint8_t *charge, uint16_t longueur)
+{
+	if (id >= nbConnexions || connexions[id] < 0)
+	{
+		return -1;
+	}
+	uint8_t trame[TAILLE_ENTETE_TRAME + TAILLE_MAX_TRAME];
+	trameEcrireEntete(trame, type, drapeaux, longueur);
+	memcpy(trame + TAILLE_ENTETE_TRAME, charge, longueur);
+	size_t envoye = 0;
+	while (envoye < TAILLE_ENTETE_TRAME + (size_t)longueur)
+	{
+		ssize_t n = send(connexions[id], trame + envoye, TAILLE_ENTETE_TRAME + longueur - envoye, MSG_NOSIGNAL);
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			fermer(id);
+			return -1;
+		}
+		envoye += n;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	double vitesse = 1;
+	int option;
+	while ((option = getopt(argc, argv, "v:")) != -1)
+	{
+		if (option == 'v')
+		{
+			vitesse = atof(optarg);
+		}
+	}
+	if (argc - optind < 3 || vitesse < 0)
+	{
+		fprintf(stderr, "Erreur : Lancez avec ./rejeu [-v vitesse] fichier_capture adresse port\n"
+						"  vitesse : 1 temps réel (défaut), 10 dix fois plus vite, 0 sans attente\n");
+		exit(-1);
+	}
+
+	struct sockaddr_in adresse;
+	adresse.sin_family = AF_INET;
+	adresse.sin_port = htons(atoi(argv[optind + 2]));
+	if (inet_pton(AF_INET, argv[optind + 1], &adresse.sin_addr) != 1)
+	{
+		fprintf(stderr, "Adresse invalide : %s\n", argv[optind + 1]);
+		exit(-1);
+	}
+
+	int fd = open(argv[optind], O_RDONLY);
+	struct stat infos;
+	if (fd < 0 || fstat(fd, &infos) < 0)
+	{
+		perror("Impossible d'ouvrir la capture");
+		exit(-1);
+	}
+	size_t taille = infos.st_size;
+	const uint8_t *carte = taille > 0 ? mmap(NULL, taille, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (carte == MAP_FAILED || taille < TAILLE_MAGIE_CAPTURE + 8 || memcmp(carte, MAGIE_CAPTURE, TAILLE_MAGIE_CAPTURE) != 0)
+	{
+		fprintf(stderr, "Capture illisible : %s\n", argv[optind]);
+		exit(-1);
+	}
+
+	uint64_t nbEnregistrements = 0;
+	uint64_t nbTrames = 0;
+	uint64_t nbPerdues = 0;
+	uint64_t nbEchecs = 0;
+	uint64_t octetsEnvoyes = 0;
+	uint64_t dateCapture = 0;
+	uint64_t retardMax = 0;
+	uint64_t retardTotal = 0;
+	uint64_t debut = horloge();
+	size_t position = TAILLE_MAGIE_CAPTURE + 8;
+
+	while (position + TAILLE_ENREGISTREMENT_CAPTURE <= taille)
+	{
+		const uint8_t *e = carte + position;
+		uint16_t longueur = lireEntier(e + 13, 2);
+		if (position + TAILLE_ENREGISTREMENT_CAPTURE + longueur > taille)
+		{
+			break;
+		}
+		position += TAILLE_ENREGISTREMENT_CAPTURE + longueur;
+		uint32_t id = lireEntier(e + 4, 4);
+		nbEnregistrements++;
+
+		// Chaque enregistrement part à sa date dans la capture, divisée par la vitesse
+		dateCapture += lireEntier(e, 4);
+		if (vitesse > 0)
+		{
+			uint64_t echeance = debut + (uint64_t)(dateCapture / vitesse);
+			uint64_t maintenant;
+			while ((maintenant = horloge()) < echeance)
+			{
+				lireReponses((echeance - maintenant + 999) / 1000);
+			}
+			uint64_t retard = maintenant - echeance;
+			retardTotal += retard;
+			retardMax = retard > retardMax ? retard : retardMax;
+		}
+		else if (nbEnregistrements % PERIODE_LECTURE == 0)
+		{
+			lireReponses(0);
+		}
+
+		switch (e[10])
+		{
+		case CAPTURE_CONNEXION:
+			if (ouvrir(id, &adresse) != 0)
+			{
+				nbEchecs++;
+			}
+			break;
+		case CAPTURE_TRAME:
+			if (envoyer(id, e[11], e[12], e + TAILLE_ENREGISTREMENT_CAPTURE, longueur) == 0)
+			{
+				nbTrames++;
+				octetsEnvoyes += TAILLE_ENTETE_TRAME + longueur;
+			}
+			else
+			{
+				nbPerdues++;
+			}
+			break;
+		case CAPTURE_DECONNEXION:
+			fermer(id);
+			break;
+		default:
+			break;
+		}
+	}
+	uint64_t duree = horloge() - debut;
+
+	// Les dernières réponses du serveur sont comptées avant de tout fermer
+	uint64_t fin = horloge() + DELAI_FIN * 1000ULL;
+	while (nbOuvertes > 0 && horloge() < fin)
+	{
+		lireReponses(DELAI_FIN / 10);
+	}
+	for (uint32_t i = 0; i < nbConnexions; i++)
+	{
+		fermer(i);
+	}
+
+	printf("%lu enregistrement(s) rejoué(s) en %.3f s (capture : %.3f s)\n", (unsigned long)nbEnregistrements,
+		   duree / 1e6, dateCapture / 1e6);
+	printf("trames envoyées %lu (%.0f/s) | octets envoyés %lu | octets reçus %lu\n", (unsigned long)nbTrames,
+		   duree > 0 ? nbTrames * 1e6 / duree : 0.0, (unsigned long)octetsEnvoyes, (unsigned long)octetsRecus);
+	printf("trames perdues %lu | connexions refusées %lu\n", (unsigned long)nbPerdues, (unsigned long)nbEchecs);
+	if (vitesse > 0 && nbEnregistrements > 0)
+	{
+		printf("retard sur la capture : moyen %lu µs, max %lu µs\n", (unsigned long)(retardTotal / nbEnregistrements),
+			   (unsigned long)retardMax);
+	}
+	return 0;
+}
@@ -0,0 +1,564 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "serveur.h"
+#include "journal.h"
+#include "relais.h"
+#include "memoire.h"
+#include "chiffrement.h"
+#include "minuterie.h"
+#include "federation.h"
+
+/**
+ * - MAGIE_RELAIS = identifiant du protocole de relais
+ * - VERSION_RELAIS = version du format des sessions transmises
+ * - TAILLE_PAQUET_RELAIS = taille maximum d'un paquet de session
+ * - DELAI_GEL = temps maximum accordé aux threads pour se mettre en pause, en millisecondes
+ */
+#define MAGIE_RELAIS "MSGR"
+#define VERSION_RELAIS 5
+#define TAILLE_PAQUET_RELAIS (64 * 1024)
+#define DELAI_GEL 5000
+
+/**
+ * @brief Premier paquet du relais, accompagné de la socket d'écoute.
+ *
+ * @param magie MAGIE_RELAIS
+ * @param version VERSION_RELAIS
+ * @param nbSessions nombre de paquets de session qui suivent
+ */
+typedef struct EnteteRelais EnteteRelais;
+struct EnteteRelais
+{
+	char magie[4];
+	uint32_t version;
+	uint32_t nbSessions;
+};
+
+/**
+ * @brief Paquet décrivant la session d'un client, accompagné de sa socket.
+ * Il est suivi du pseudo et des octets reçus qui ne forment pas encore une
+ * trame complète ; la file d'envoi suit dans des paquets séparés.
+ *
+ * @param numClient indice du client dans tabClient
+ * @param idSalon salon du client
+ * @param longueurPseudo longueur du pseudo, 0 si le client ne l'a pas encore choisi
+ * @param longueurEntree nombre d'octets en attente dans le tampon de réception
+ * @param longueurFile nombre d'octets de la file d'envoi, transmis par paquets de TAILLE_PAQUET_RELAIS
+ * @param etatChiffrement état TLS de la connexion (CHIFFREMENT_*), 0 si elle est en clair
+ * @param estIdentifie 1 si le client reçoit les messages par identifiant d'expéditeur
+ * @param recoitEphemeres 1 si le client reçoit les événements éphémères
+ * @param recoitHistorique 1 si le client reçoit l'historique en pages TRAME_HISTORIQUE
+ */
+typedef struct SessionRelais SessionRelais;
+struct SessionRelais
+{
+	int32_t numClient;
+	int32_t idSalon;
+	uint32_t longueurPseudo;
+	uint32_t longueurEntree;
+	uint32_t longueurFile;
+	uint32_t etatChiffrement;
+	int32_t estIdentifie;
+	int32_t recoitEphemeres;
+	int32_t recoitHistorique;
+};
+
+/**
+ * - enRelais = 1 pendant qu'une transmission est en cours ; les threads se mettent en pause
+ * - nbGeles = nombre de threads en pause
+ * - principalGele = 1 si le thread principal (accept) est en pause
+ * - threadPrincipal = thread exécutant la boucle d'acceptation
+ */
+static atomic_int enRelais = 0;
+static pthread_mutex_t mutexRelais = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t condRelais = PTHREAD_COND_INITIALIZER;
+static int nbGeles = 0;
+static int principalGele = 0;
+static pthread_t threadPrincipal;
+
+/**
+ * @brief Gestionnaire vide : le signal sert seulement à interrompre recv, accept et sem_wait.
+ */
+static void signalRelais(int sig_num)
+{
+}
+
+/**
+ * @brief Indique si une transmission vers un nouveau processus est en cours.
+ *
+ * @return 1 si un relais est en cours, 0 sinon.
+ */
+int relaisEnCours(void)
+{
+	return atomic_load(&enRelais);
+}
+
+/**
+ * @brief Met le thread appelant en pause tant que le relais est en cours.
+ * Si la transmission réussit, le processus se termine sans que le thread ne
+ * reprenne ; si elle échoue, le thread reprend son travail normalement.
+ */
+void relaisAttendre(void)
+{
+	int estPrincipal = pthread_equal(pthread_self(), threadPrincipal);
+
+	pthread_mutex_lock(&mutexRelais);
+	nbGeles++;
+	if (estPrincipal)
+	{
+		principalGele = 1;
+	}
+	pthread_cond_broadcast(&condRelais);
+	while (atomic_load(&enRelais))
+	{
+		pthread_cond_wait(&condRelais, &mutexRelais);
+	}
+	nbGeles--;
+	if (estPrincipal)
+	{
+		principalGele = 0;
+	}
+	pthread_mutex_unlock(&mutexRelais);
+}
+
+/**
+ * @brief Met en pause le thread principal puis les threads des clients.
+ * Les signaux sont renvoyés régulièrement car un thread peut le recevoir
+ * juste avant d'entrer dans un appel bloquant.
+ *
+ * @return 0 si tous les threads sont en pause, -1 si le délai est dépassé.
+ */
+static int geler(void)
+{
+	struct timespec pause = {0, 10 * 1000000L};
+	atomic_store(&enRelais, 1);
+
+	for (int attente = 0; attente < DELAI_GEL; attente += 10)
+	{
+		pthread_mutex_lock(&mutexRelais);
+		int geles = nbGeles;
+		int principal = principalGele;
+		pthread_mutex_unlock(&mutexRelais);
+
+		if (!principal)
+		{
+			// Tant que le thread principal tourne, un client peut être en cours d'enregistrement
+			pthread_kill(threadPrincipal, SIGUSR1);
+		}
+		else
+		{
+			pthread_mutex_lock(&mutexTabClient);
+			int attendus = 1;
+			for (int i = 0; i < MAX_CLIENT; i++)
+			{
+				if (tabClient[i].estOccupe)
+				{
+					attendus++;
+					pthread_kill(tabThread[i], SIGUSR1);
+				}
+			}
+			pthread_mutex_unlock(&mutexTabClient);
+
+			if (geles >= attendus)
+			{
+				return 0;
+			}
+		}
+		nanosleep(&pause, NULL);
+	}
+	return -1;
+}
+
+/**
+ * @brief Relance les threads mis en pause après un relais annulé.
+ */
+static void degeler(void)
+{
+	pthread_mutex_lock(&mutexRelais);
+	atomic_store(&enRelais, 0);
+	pthread_cond_broadcast(&condRelais);
+	pthread_mutex_unlock(&mutexRelais);
+}
+
+/**
+ * @brief Envoie un paquet sur la socket de relais, avec un descripteur en donnée annexe.
+ *
+ * @param dSR socket de relais
+ * @param donnees contenu du paquet
+ * @param longueur longueur du paquet
+ * @param descripteur descripteur à transmettre
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+static int envoyerAvecDescripteur(int dSR, const void *donnees, size_t longueur, int descripteur)
+{
+	union
+	{
+		struct cmsghdr entete;
+		char espace[CMSG_SPACE(sizeof(int))];
+	} controle;
+	struct iovec iov = {(void *)donnees, longueur};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = controle.espace;
+	msg.msg_controllen = sizeof(controle.espace);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &descripteur, sizeof(int));
+
+	return sendmsg(dSR, &msg, MSG_NOSIGNAL) == (ssize_t)longueur ? 0 : -1;
+}
+
+/**
+ * @brief Reçoit un paquet de la socket de relais et le descripteur qui l'accompagne.
+ *
+ * @param dSR socket de relais
+ * @param donnees buffer où stocker le paquet
+ * @param taille taille du buffer
+ * @param descripteur descripteur reçu, -1 si le paquet n'en contient pas
+ * @return la longueur du paquet, -1 en cas d'erreur.
+ */
+static ssize_t recevoirAvecDescripteur(int dSR, void *donnees, size_t taille, int *descripteur)
+{
+	union
+	{
+		struct cmsghdr entete;
+		char espace[CMSG_SPACE(sizeof(int))];
+	} controle;
+	struct iovec iov = {donnees, taille};
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = controle.espace;
+	msg.msg_controllen = sizeof(controle.espace);
+
+	ssize_t recu = recvmsg(dSR, &msg, MSG_CMSG_CLOEXEC);
+	*descripteur = -1;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (recu > 0 && cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+	{
+		memcpy(descripteur, CMSG_DATA(cmsg), sizeof(int));
+	}
+	return recu;
+}
+
+/**
+ * @brief Transmet la socket d'écoute puis chaque session au nouveau processus.
+ * Tous les threads doivent être en pause.
+ *
+ * @param dSR socket de relais connectée au nouveau processus
+ * @return le nombre de sessions transmises, -1 en cas d'erreur.
+ */
+static int transmettre(int dSR)
+{
+	char *paquet = malloc(TAILLE_PAQUET_RELAIS);
+	if (paquet == NULL)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&mutexTabClient);
+	EnteteRelais entete;
+	memcpy(entete.magie, MAGIE_RELAIS, 4);
+	entete.version = VERSION_RELAIS;
+	entete.nbSessions = 0;
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		entete.nbSessions += tabClient[i].estOccupe;
+	}
+
+	int resultat = envoyerAvecDescripteur(dSR, &entete, sizeof(entete), dS);
+	for (int i = 0; i < MAX_CLIENT && resultat == 0; i++)
+	{
+		if (!tabClient[i].estOccupe)
+		{
+			continue;
+		}
+		SessionRelais session;
+		session.numClient = i;
+		session.idSalon = tabClient[i].idSalon;
+		session.longueurPseudo = strcmp(tabClient[i].pseudo, " ") == 0 ? 0 : strlen(tabClient[i].pseudo);
+		session.longueurEntree = tabClient[i].lecteur->rempli;
+		session.longueurFile = tabClient[i].file.octets;
+		session.etatChiffrement = chiffrementEtat(i);
+		session.estIdentifie = tabClient[i].estIdentifie;
+		session.recoitEphemeres = tabClient[i].recoitEphemeres;
+		session.recoitHistorique = tabClient[i].recoitHistorique;
+
+		memcpy(paquet, &session, sizeof(session));
+		memcpy(paquet + sizeof(session), tabClient[i].pseudo, session.longueurPseudo);
+		memcpy(paquet + sizeof(session) + session.longueurPseudo, tabClient[i].lecteur->tampon, session.longueurEntree);
+		resultat = envoyerAvecDescripteur(dSR, paquet, sizeof(session) + session.longueurPseudo + session.longueurEntree,
+										  tabClient[i].dSC);
+
+		// Les travailleurs d'envoi sont arrêtés : la file ne bouge plus
+		for (size_t debut = 0; debut < session.longueurFile && resultat == 0; debut += TAILLE_PAQUET_RELAIS)
+		{
+			size_t longueur = fileLire(i, debut, (uint8_t *)paquet, TAILLE_PAQUET_RELAIS);
+			resultat = send(dSR, paquet, longueur, MSG_NOSIGNAL) == (ssize_t)longueur ? 0 : -1;
+		}
+	}
+	pthread_mutex_unlock(&mutexTabClient);
+
+	free(paquet);
+	return resultat == 0 ? (int)entete.nbSessions : -1;
+}
+
+/**
+ * @brief Fonction principale du thread qui attend un nouveau processus.
+ * Sur demande, met le serveur en pause, transmet l'état puis termine le
+ * processus sans fermer les connexions. En cas d'échec, le service reprend.
+ *
+ * @param dSEcoute socket UNIX d'écoute du relais
+ */
+static void *relaisThread(void *dSEcoute)
+{
+	int dSE = (long)dSEcoute;
+	while (1)
+	{
+		int dSR = accept(dSE, NULL, NULL);
+		if (dSR < 0)
+		{
+			continue;
+		}
+
+		char demande[8] = {0};
+		if (recv(dSR, demande, sizeof(demande), 0) <= 0 || strncmp(demande, "RELAIS", 6) != 0)
+		{
+			close(dSR);
+			continue;
+		}
+
+		journalEcrire(JOURNAL_INFO, EVT_RELAIS, 0, 0, 0, "demande");
+		// Une fois les threads en pause, on attend aussi la fin d'un éventuel rappel de minuterie
+		// et d'un éventuel lot reçu d'un autre nœud
+		int nbSessions = -1;
+		if (geler() == 0)
+		{
+			minuteriesBarriere();
+			federationBarriere();
+			nbSessions = transmettre(dSR);
+		}
+
+		char reponse[4] = {0};
+		if (nbSessions >= 0 && recv(dSR, reponse, sizeof(reponse), 0) == 2 && memcmp(reponse, "OK", 2) == 0)
+		{
+			// Le nouveau processus a repris les connexions : on part sans les fermer
+			journalEcrire(JOURNAL_INFO, EVT_RELAIS, nbSessions, 0, 0, "termine");
+			journalVider();
+			_exit(0);
+		}
+
+		journalEcrire(JOURNAL_AVERTISSEMENT, EVT_RELAIS, 0, 0, 0, "annule");
+		close(dSR);
+		degeler();
+	}
+	return NULL;
+}
+
+/**
+ * @brief Prépare l'adresse UNIX du relais.
+ */
+static int adresseRelais(const char *chemin, struct sockaddr_un *ad)
+{
+	memset(ad, 0, sizeof(*ad));
+	ad->sun_family = AF_UNIX;
+	if (strlen(chemin) >= sizeof(ad->sun_path))
+	{
+		fprintf(stderr, "Chemin de socket de relais trop long\n");
+		return -1;
+	}
+	strcpy(ad->sun_path, chemin);
+	return 0;
+}
+
+/**
+ * @brief Écoute les demandes de redémarrage à chaud.
+ * À appeler depuis le thread principal, qui sera mis en pause pendant un relais.
+ *
+ * @param chemin chemin de la socket UNIX de relais
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int relaisDemarrer(const char *chemin)
+{
+	threadPrincipal = pthread_self();
+
+	// Pas de SA_RESTART : le signal doit interrompre les appels bloquants
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = signalRelais;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+
+	struct sockaddr_un ad;
+	if (adresseRelais(chemin, &ad) != 0)
+	{
+		return -1;
+	}
+	int dSE = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (dSE < 0)
+	{
+		perror("Problème de création de la socket de relais");
+		return -1;
+	}
+	unlink(chemin);
+	if (bind(dSE, (struct sockaddr *)&ad, sizeof(ad)) < 0 || listen(dSE, 1) < 0)
+	{
+		perror("Problème de nommage de la socket de relais");
+		close(dSE);
+		return -1;
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, relaisThread, (void *)(long)dSE) != 0)
+	{
+		perror("Erreur thread relais");
+		close(dSE);
+		return -1;
+	}
+	pthread_detach(thread);
+	return 0;
+}
+
+/**
+ * @brief Reçoit les paquets de la file d'envoi d'une session et les remet,
+ * tels quels, dans la file du client.
+ *
+ * @param dSR socket de relais
+ * @param paquet buffer de TAILLE_PAQUET_RELAIS octets
+ * @param longueur nombre d'octets de la file
+ * @param numClient client destinataire, -1 pour ignorer la file
+ */
+static void recevoirFile(int dSR, char *paquet, uint32_t longueur, int numClient)
+{
+	for (uint32_t recus = 0; recus < longueur;)
+	{
+		ssize_t n = recv(dSR, paquet, TAILLE_PAQUET_RELAIS, 0);
+		if (n <= 0)
+		{
+			return;
+		}
+		Message *message = numClient >= 0 ? messageCreerBrut(paquet, n) : NULL;
+		if (message != NULL)
+		{
+			fileEnfiler(numClient, message);
+			messageLiberer(message);
+		}
+		recus += n;
+	}
+}
+
+/**
+ * @brief Reprend le service d'un processus en cours d'exécution.
+ * Remplit tabClient avec les sessions reçues ; l'appelant démarre ensuite
+ * un thread de communication pour chaque client occupé.
+ *
+ * @param chemin chemin de la socket UNIX de relais de l'ancien processus
+ * @return la socket d'écoute reçue, -1 en cas d'échec.
+ */
+int relaisReprendre(const char *chemin)
+{
+	struct sockaddr_un ad;
+	if (adresseRelais(chemin, &ad) != 0)
+	{
+		return -1;
+	}
+	int dSR = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (dSR < 0 || connect(dSR, (struct sockaddr *)&ad, sizeof(ad)) < 0)
+	{
+		perror("Impossible de joindre le serveur en service");
+		return -1;
+	}
+	send(dSR, "RELAIS", 6, MSG_NOSIGNAL);
+
+	char *paquet = malloc(TAILLE_PAQUET_RELAIS);
+	EnteteRelais entete;
+	int dSEcoute = -1;
+	if (paquet == NULL || recevoirAvecDescripteur(dSR, &entete, sizeof(entete), &dSEcoute) != sizeof(entete) ||
+		memcmp(entete.magie, MAGIE_RELAIS, 4) != 0 || entete.version != VERSION_RELAIS || dSEcoute < 0)
+	{
+		fprintf(stderr, "Relais refusé ou incompatible\n");
+		free(paquet);
+		close(dSR);
+		return -1;
+	}
+
+	for (uint32_t n = 0; n < entete.nbSessions; n++)
+	{
+		int dSC = -1;
+		ssize_t recu = recevoirAvecDescripteur(dSR, paquet, TAILLE_PAQUET_RELAIS, &dSC);
+		SessionRelais session;
+		if (recu < (ssize_t)sizeof(session) || dSC < 0)
+		{
+			fprintf(stderr, "Session de relais invalide\n");
+			free(paquet);
+			close(dSR);
+			return -1;
+		}
+		memcpy(&session, paquet, sizeof(session));
+
+		int numClient = session.numClient;
+		if (numClient < 0 || numClient >= MAX_CLIENT || tabClient[numClient].estOccupe)
+		{
+			numClient = donnerNumClient();
+		}
+		// Une session TLS dont un sens est chiffré par OpenSSL garde son état dans l'ancien processus : elle est perdue
+		if (numClient < 0 || session.longueurPseudo >= TAILLE_PSEUDO || session.longueurEntree > TAILLE_ENTETE_TRAME + TAILLE_MAX_TRAME ||
+			sizeof(session) + session.longueurPseudo + session.longueurEntree > (size_t)recu ||
+			chiffrementReprendre(numClient, session.etatChiffrement) != 0)
+		{
+			recevoirFile(dSR, paquet, session.longueurFile, -1);
+			close(dSC);
+			continue;
+		}
+
+		tabClient[numClient].estOccupe = 1;
+		tabClient[numClient].dSC = dSC;
+		tabClient[numClient].idSalon = session.idSalon;
+		// Le client garde ce qu'il a négocié ; ses identités, attribuées par l'ancien processus,
+		// lui seront renvoyées avant leur premier usage
+		tabClient[numClient].estIdentifie = session.estIdentifie != 0;
+		tabClient[numClient].recoitEphemeres = session.estIdentifie && session.recoitEphemeres;
+		tabClient[numClient].recoitHistorique = session.estIdentifie && session.recoitHistorique;
+		memset(tabClient[numClient].identitesConnues, 0, sizeof(tabClient[numClient].identitesConnues));
+		tabClient[numClient].pseudo = malloc(sizeof(char) * TAILLE_PSEUDO);
+		if (session.longueurPseudo == 0)
+		{
+			strcpy(tabClient[numClient].pseudo, " ");
+		}
+		else
+		{
+			memcpy(tabClient[numClient].pseudo, paquet + sizeof(session), session.longueurPseudo);
+			tabClient[numClient].pseudo[session.longueurPseudo] = '\0';
+		}
+		tabClient[numClient].lecteur = malloc(sizeof(LecteurTrame));
+		tabClient[numClient].lecteur->rempli = session.longueurEntree;
+		memcpy(tabClient[numClient].lecteur->tampon, paquet + sizeof(session) + session.longueurPseudo, session.longueurEntree);
+		// La file reprise est imputée au budget du client, comme ses tampons
+		memoireOuvrir(numClient);
+		recevoirFile(dSR, paquet, session.longueurFile, numClient);
+	}
+
+	// L'ancien processus peut partir
+	send(dSR, "OK", 2, MSG_NOSIGNAL);
+	close(dSR);
+	free(paquet);
+	journalEcrire(JOURNAL_INFO, EVT_RELAIS, entete.nbSessions, 0, 0, "repris");
+	return dSEcoute;
+}
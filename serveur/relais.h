@@ -0,0 +1,15 @@
+#ifndef RELAIS_H
+#define RELAIS_H
+
+/**
+ * Redémarrage à chaud : le processus en service transmet sa socket d'écoute,
+ * les sockets de ses clients et l'état de leur session au nouveau binaire par
+ * une socket UNIX (SCM_RIGHTS). Les clients restent connectés.
+ */
+
+int relaisDemarrer(const char *chemin);
+int relaisReprendre(const char *chemin);
+int relaisEnCours(void);
+void relaisAttendre(void);
+
+#endif
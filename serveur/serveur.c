@@ -10,62 +10,31 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <dirent.h>
-
-/**
- * @brief Structure Client pour regrouper toutes les informations du client.
- *
- * @param estOccupe 1 si le Client est connecté au serveur ; 0 sinon
- * @param dSC Socket de transmission des messages classiques au Client
- * @param pseudo Appellation que le Client rentre à sa première connexion
- * @param dSCFC Socket de transfert des fichiers
- * @param nomFichier Nomination du fichier choisi par le client pour le transfert
- */
-typedef struct Client Client;
-struct Client
-{
-	int estOccupe;
-	long dSC;
-	int idSalon;
-	char *pseudo;
-	long dSCFC;
-	char nomFichier[100];
-};
-
-/**
- *  @brief Définition d'une structure Salon pour regrouper toutes les informations d'un salon.
- *
- * @param idSalon Identifiant du salon
- * @param estOccupe 1 si le salon existe ; 0 sinon
- * @param nom Appellation du salon, donné à la création (max 20)
- * @param description Description du salon, donné à la création (max 200)
- * @param nbPlace Nombre de place que peut accepter le salon, donné à la création
- */
-
-typedef struct Salon Salon;
-struct Salon
-{
-	int idSalon;
-	int estOccupe;
-	char *nom;
-	char *description;
-	int nbPlace;
-};
-
-/**
- * - MAX_CLIENT = nombre maximum de clients acceptés sur le serveur
- * - MAX_SALON = nombre maximum de salons sur le serveur
- * - TAILLE_PSEUDO = taille maximum du pseudo
- * - TAILLE_MESSAGE = taille maximum d'un message
- */
-#define MAX_CLIENT 7
-#define MAX_SALON 3
-#define TAILLE_PSEUDO 20
-#define TAILLE_MESSAGE 500
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include <errno.h>
+#include <netinet/tcp.h>
+
+#include "serveur.h"
+#include "journal.h"
+#include "metriques.h"
+#include "persistance.h"
+#include "relais.h"
+#include "minuterie.h"
+#include "admission.h"
+#include "federation.h"
+#include "historique.h"
+#include "recherche.h"
+#include "ephemere.h"
+#include "capture.h"
+#include "memoire.h"
+#include "chiffrement.h"
 
 /**
  * - tabClient = tableau répertoriant les clients connectés
  * - tabThread = tableau des threads associés au traitement de chaque client
- * - tabSalon = tableau répertoriant les salons existants
+ * - tabSalon = tableau répertoriant les salons existants, agrandi par persistance.c
+ * - nbSalon = nombre de salons existants
  * - nbClients = nombre de clients actuellement connectés
  * - dS_fichier = socket de connexion pour le transfert de fichiers
  * - dS = socket de connexion entre les clients et le serveur
@@ -74,11 +43,14 @@ struct Salon
  * - semaphoreThread = sémpahore pour gérer les threads
  * - mutexTabClient = mutexTabClient pour la modification de tabClient[]
  * - mutexSalon = mutexTabSalon pour la modification de tabSalon[]
+ * - delaiInactivite = secondes sans message avant déconnexion d'un client, 0 pour jamais
+ * - limiteMessage = taille maximum d'un message dans un salon qui n'a pas sa propre limite
  */
 
 Client tabClient[MAX_CLIENT];
 pthread_t tabThread[MAX_CLIENT];
-Salon tabSalon[MAX_SALON];
+Salon *tabSalon = NULL;
+int nbSalon = 0;
 long nbClient = 0;
 int dS_fichier;
 int dS;
@@ -87,23 +59,8 @@ sem_t semaphoreNbClients;
 sem_t semaphoreThread;
 pthread_mutex_t mutexTabClient;
 pthread_mutex_t mutexSalon;
-
-// Déclaration des fonctions
-int donnerNumClient();
-int verifPseudo(char *pseudo);
-long pseudoTodSC(char *pseudo);
-void envoi(int dS, char *msg, int id);
-void envoiATous(char *msg);
-void envoiPrive(char *pseudoRecepteur, char *msg);
-void reception(int dS, char *rep, ssize_t size);
-int finDeCommunication(char *msg);
-void *copieFichierThread(void *clientIndex);
-void *envoieFichierThread(void *clientIndex);
-int nbChiffreDansNombre(int nombre);
-void endOfThread(int numclient);
-int utilisationCommande(char *msg, char *pseudoEnvoyeur);
-void *communication(void *clientParam);
-void sigintHandler(int sig_num);
+unsigned int delaiInactivite = 0;
+size_t limiteMessage = LIMITE_MESSAGE;
 
 /**
  * @brief Fonction pour gérer les indices du tableau de clients.
@@ -126,7 +83,7 @@ int donnerNumClient()
 }
 
 /**
- * @brief Fonctions pour vérifier que le pseudo est unique.
+ * @brief Fonctions pour vérifier que le pseudo est unique, sur toute la fédération.
  *
  * @param pseudo pseudo à vérifier
  * @return un entier ;
@@ -144,7 +101,7 @@ int verifPseudo(char *pseudo)
 		}
 		i++;
 	}
-	return 0;
+	return federationPseudoDistant(pseudo);
 }
 
 /**
@@ -169,27 +126,353 @@ long pseudoToInt(char *pseudo)
 }
 
 /**
- * @brief Envoie un message à toutes les sockets présentes dans le tableau des clients pour un même idSalon
- * et teste que tout se passe bien.
+ * @brief Met une trame dans la file d'envoi d'un client.
  *
- * @param dS expéditeur du message
- * @param msg message à envoyer
- * @param idSalon id du salon sur lequel envoyé le message
+ * @param numClient indice du client destinataire
+ * @param type type de la trame
+ * @param charge charge utile de la trame
+ * @param longueur taille de la charge utile, tronquée à TAILLE_MAX_TRAME
+ * @return 0 si la trame est en file, -1 si elle est perdue (file pleine).
+ */
+int envoyerTrame(int numClient, uint8_t type, const char *charge, size_t longueur)
+{
+	Message *message = messageCreer(type, 0, charge, longueur);
+	if (message == NULL)
+	{
+		return -1;
+	}
+	int resultat = fileEnfiler(numClient, message);
+	messageLiberer(message);
+	return resultat;
+}
+
+/**
+ * @brief Met une réponse volumineuse (historique, résultats de recherche) dans
+ * la classe vrac de la file d'un client : elle passe après la discussion, et
+ * elle est compressée si le client l'a négocié.
+ *
+ * @param numClient indice du client destinataire
+ * @param charge texte de la réponse
+ * @param longueur taille du texte, tronquée à TAILLE_MAX_TRAME
+ * @return 0 si la trame est en file, -1 si elle est perdue (file pleine).
+ */
+int envoiVolumineux(int numClient, const char *charge, size_t longueur)
+{
+	Message *message = messageCreer(TRAME_TEXTE, 0, charge, longueur);
+	if (message == NULL)
+	{
+		return -1;
+	}
+	message->classe = CLASSE_VRAC;
+	int resultat = fileEnfiler(numClient, message);
+	messageLiberer(message);
+	metriqueIncrementer(resultat == 0 ? CPT_MESSAGES_ENVOYES : CPT_PERTES, 1);
+	return resultat;
+}
+
+/**
+ * @brief Indique qu'un client connaît le pseudo d'une identité, en lui
+ * envoyant d'abord sa trame TRAME_IDENTITE s'il ne l'a pas encore reçue. Le
+ * bit n'est posé qu'une fois la trame en file : un autre thread qui ne le voit
+ * pas encore envoie la trame une seconde fois, ce qui est sans effet.
+ *
+ * @param numClient indice du client destinataire
+ * @param idPseudo identité à faire connaître
+ * @param identite trame TRAME_IDENTITE, construite à la demande
+ * @return 0 si le client connaît l'identité, -1 si sa file est pleine.
+ */
+static int faireConnaitre(int numClient, int idPseudo, Message **identite)
+{
+	uint64_t bit = 1ULL << (idPseudo % 64);
+	if (atomic_load(&tabClient[numClient].identitesConnues[idPseudo / 64]) & bit)
+	{
+		return 0;
+	}
+	if (*identite == NULL)
+	{
+		uint8_t identifiant[TAILLE_IDENTIFIANT] = {idPseudo >> 8, idPseudo & 0xff};
+		const char *pseudo = identitePseudo(idPseudo);
+		*identite = messageCreerPrefixe(TRAME_IDENTITE, 0, identifiant, TAILLE_IDENTIFIANT, pseudo, strlen(pseudo));
+	}
+	if (*identite == NULL || fileEnfiler(numClient, *identite) == -1)
+	{
+		return -1;
+	}
+	atomic_fetch_or(&tabClient[numClient].identitesConnues[idPseudo / 64], bit);
+	return 0;
+}
+
+/**
+ * @brief Envoie à un client une page de l'historique de son salon : les
+ * messages qui précèdent un identifiant, ou qui le suivent, autant qu'en tient
+ * une trame, en gardant les plus proches de l'identifiant. Les identités des
+ * expéditeurs sont envoyées d'abord. La page part même vide : le client
+ * attend sa réponse.
+ *
+ * @param numClient indice du client
+ * @param repere seuls les messages d'identifiant inférieur (supérieur avec DRAPEAU_APRES) sont envoyés ;
+ *        UINT32_MAX pour les derniers
+ * @param maximum nombre maximum de messages, au plus MESSAGES_RELECTURE
+ * @param drapeaux DRAPEAU_ANCIENS ou DRAPEAU_APRES, selon la demande du client
+ * @return 0 si la page est en file, -1 si elle est perdue.
+ */
+int envoiPageHistorique(int numClient, uint32_t repere, int maximum, uint8_t drapeaux)
+{
+	uint32_t ids[MESSAGES_RELECTURE];
+	int estApres = (drapeaux & DRAPEAU_APRES) != 0;
+	maximum = maximum < MESSAGES_RELECTURE ? maximum : MESSAGES_RELECTURE;
+	// Les messages trouvés ne peuvent pas être évincés avant d'être copiés dans la page
+	historiqueVerrouiller();
+	int nombre = estApres ? historiqueSuivants(tabClient[numClient].idSalon, &repere, ids, maximum, PORTEE_RELECTURE)
+						  : historiqueDerniers(tabClient[numClient].idSalon, &repere, ids, maximum, PORTEE_RELECTURE);
+
+	// Les messages les plus éloignés du repère qui ne tiennent pas dans la trame restent pour la page
+	// suivante ; un message trop grand pour une trame, seul en tête de page, est sauté
+	size_t taille = TAILLE_ENTETE_HISTORIQUE;
+	int premier = 0;
+	int dernier = nombre;
+	if (estApres)
+	{
+		while (premier < nombre && taille + TAILLE_ENTREE_HISTORIQUE + historiqueLire(ids[premier])->longueur <= TAILLE_MAX_TRAME)
+		{
+			taille += TAILLE_ENTREE_HISTORIQUE + historiqueLire(ids[premier++])->longueur;
+		}
+		if (premier < nombre)
+		{
+			repere = ids[premier > 0 ? premier - 1 : 0];
+		}
+		dernier = premier;
+		premier = 0;
+	}
+	else
+	{
+		while (premier < dernier && taille + TAILLE_ENTREE_HISTORIQUE + historiqueLire(ids[dernier - 1])->longueur <= TAILLE_MAX_TRAME)
+		{
+			taille += TAILLE_ENTREE_HISTORIQUE + historiqueLire(ids[--dernier])->longueur;
+		}
+		if (dernier > 0)
+		{
+			repere = ids[dernier < nombre ? dernier : nombre - 1];
+		}
+		premier = dernier;
+		dernier = nombre;
+	}
+
+	// La page est imputée au budget mémoire du client le temps de l'assembler
+	if (memoireReserver(numClient, taille) != 0)
+	{
+		historiqueDeverrouiller();
+		return -1;
+	}
+	uint8_t *page = malloc(taille);
+	if (page == NULL)
+	{
+		historiqueDeverrouiller();
+		memoireRendre(numClient, taille);
+		return -1;
+	}
+	page[0] = repere >> 24;
+	page[1] = repere >> 16;
+	page[2] = repere >> 8;
+	page[3] = repere;
+	size_t rempli = TAILLE_ENTETE_HISTORIQUE;
+	for (int i = premier; i < dernier; i++)
+	{
+		const MessageHistorique *message = historiqueLire(ids[i]);
+		int idPseudo = message->idPseudo >= 0 ? message->idPseudo : 0xffff;
+		Message *identite = NULL;
+		if (message->idPseudo >= 0 && faireConnaitre(numClient, message->idPseudo, &identite) == -1)
+		{
+			idPseudo = 0xffff;
+		}
+		messageLiberer(identite);
+		uint8_t *entree = page + rempli;
+		entree[0] = ids[i] >> 24;
+		entree[1] = ids[i] >> 16;
+		entree[2] = ids[i] >> 8;
+		entree[3] = ids[i];
+		entree[4] = idPseudo >> 8;
+		entree[5] = idPseudo & 0xff;
+		entree[6] = message->longueur >> 8;
+		entree[7] = message->longueur & 0xff;
+		memcpy(entree + TAILLE_ENTREE_HISTORIQUE, message->texte, message->longueur);
+		rempli += TAILLE_ENTREE_HISTORIQUE + message->longueur;
+	}
+	historiqueDeverrouiller();
+
+	// Une page passe après la discussion, comme les autres réponses volumineuses
+	Message *trame = messageCreer(TRAME_HISTORIQUE, drapeaux, page, rempli);
+	free(page);
+	memoireRendre(numClient, taille);
+	if (trame == NULL)
+	{
+		return -1;
+	}
+	int resultat = fileEnfiler(numClient, trame);
+	messageLiberer(trame);
+	metriqueIncrementer(resultat == 0 ? CPT_MESSAGES_ENVOYES : CPT_PERTES, 1);
+	return resultat;
+}
+
+/**
+ * @brief Rejoue à un client qui arrive dans un salon ses derniers messages,
+ * regroupés en trames aussi grandes que possible. Le client qui l'a négocié
+ * ne reçoit que TRAME_SALON : il garde l'historique de ses salons et ne
+ * demande que ce qui lui manque.
+ *
+ * @param numClient indice du client
+ */
+void rejouerHistorique(int numClient)
+{
+	if (tabClient[numClient].recoitHistorique)
+	{
+		uint8_t annonce[8 + TAILLE_NOM_SALON];
+		uint32_t epoque = historiqueEpoque();
+		uint32_t nombre = historiqueNbMessages();
+		for (int i = 0; i < 4; i++)
+		{
+			annonce[i] = epoque >> (24 - 8 * i);
+			annonce[4 + i] = nombre >> (24 - 8 * i);
+		}
+		pthread_mutex_lock(&mutexSalon);
+		int idSalon = tabClient[numClient].idSalon;
+		int longueur = snprintf((char *)annonce + 8, TAILLE_NOM_SALON, "%s", idSalon >= 0 && idSalon < nbSalon ? tabSalon[idSalon].nom : "");
+		pthread_mutex_unlock(&mutexSalon);
+		envoyerTrame(numClient, TRAME_SALON, (const char *)annonce, 8 + (longueur < TAILLE_NOM_SALON ? longueur : TAILLE_NOM_SALON - 1));
+		return;
+	}
+
+	uint32_t ids[MESSAGES_RELECTURE];
+	uint32_t avant = UINT32_MAX;
+	historiqueVerrouiller();
+	int nombre = historiqueDerniers(tabClient[numClient].idSalon, &avant, ids, MESSAGES_RELECTURE, PORTEE_RELECTURE);
+	char *trame = nombre > 0 ? malloc(TAILLE_MAX_TRAME) : NULL;
+	if (trame == NULL)
+	{
+		historiqueDeverrouiller();
+		return;
+	}
+	size_t rempli = snprintf(trame, TAILLE_MAX_TRAME, "-- %d dernier(s) message(s) du salon --\n", nombre);
+	for (int i = 0; i < nombre; i++)
+	{
+		// Une ligne au plus : pseudo, message et retour à la ligne
+		if (rempli + TAILLE_PSEUDO + TAILLE_MESSAGE + 4 > TAILLE_MAX_TRAME)
+		{
+			envoiVolumineux(numClient, trame, rempli);
+			rempli = 0;
+		}
+		rempli += historiqueFormater(trame + rempli, TAILLE_PSEUDO + TAILLE_MESSAGE + 3, historiqueLire(ids[i]));
+		trame[rempli++] = '\n';
+	}
+	historiqueDeverrouiller();
+	envoiVolumineux(numClient, trame, rempli);
+	free(trame);
+}
+
+/**
+ * @brief Compte les destinataires d'une diffusion dans un salon.
+ *
+ * @param dS socket de l'expéditeur, qui ne reçoit pas son propre message
+ * @param idSalon salon de diffusion
+ * @return le nombre de destinataires.
  */
-void envoi(int dS, char *msg, int idSalon)
+int nbDestinataires(int dS, int idSalon)
 {
+	int nombre = 0;
 	for (int i = 0; i < MAX_CLIENT; i++)
 	{
-		// On n'envoie pas au client qui a écrit le message
 		if (tabClient[i].estOccupe && dS != tabClient[i].dSC && idSalon == tabClient[i].idSalon && strcmp(tabClient[i].pseudo, " ") != 0)
 		{
-			if (send(tabClient[i].dSC, msg, strlen(msg) + 1, 0) == -1)
+			nombre++;
+		}
+	}
+	return nombre;
+}
+
+/**
+ * @brief Diffuse un message, ou un fragment de message, aux clients d'un
+ * salon. Les clients qui l'ont négocié reçoivent l'identifiant de
+ * l'expéditeur et le texte, avec DRAPEAU_SUITE si le message continue ; les
+ * autres reçoivent chaque fragment comme une ligne « pseudo : texte ». Ceux
+ * qui gardent l'historique reçoivent aussi l'identifiant du message, et
+ * l'expéditeur son propre message, en écho, pour le ranger. Chaque forme est
+ * construite au plus une fois et partagée entre les files.
+ *
+ * @param dS socket de l'expéditeur, qui ne reçoit son propre message qu'en écho (-1 s'il est distant)
+ * @param idSalon id du salon sur lequel envoyer le message
+ * @param idPseudo identité de l'expéditeur, -1 si la table des identités est pleine
+ * @param pseudo pseudo de l'expéditeur
+ * @param texte texte du message ; vide pour clore un message interrompu
+ * @param drapeaux DRAPEAU_SUITE si ce n'est pas le dernier fragment du message, 0 sinon
+ * @param idMessage identifiant du message dans l'historique, UINT32_MAX s'il n'y est pas
+ */
+void envoiMessage(int dS, int idSalon, int idPseudo, const char *pseudo, const char *texte, uint8_t drapeaux, uint32_t idMessage)
+{
+	size_t longueur = strlen(texte);
+	Message *complet = NULL;
+	Message *compact = NULL;
+	Message *numerote = NULL;
+	Message *echo = NULL;
+	Message *identite = NULL;
+	uint8_t prefixeNumerote[TAILLE_IDENTIFIANT + TAILLE_NUMERO] = {idPseudo >> 8, idPseudo & 0xff, idMessage >> 24, idMessage >> 16, idMessage >> 8, idMessage};
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		// Le client qui a écrit le message ne le reçoit qu'en écho, s'il garde l'historique
+		int estEcho = dS == tabClient[i].dSC;
+		if (!tabClient[i].estOccupe || idSalon != tabClient[i].idSalon || strcmp(tabClient[i].pseudo, " ") == 0 ||
+			(estEcho && (!tabClient[i].recoitHistorique || idMessage == UINT32_MAX || idPseudo < 0)))
+		{
+			continue;
+		}
+
+		Message **forme = &complet;
+		if (estEcho)
+		{
+			forme = &echo;
+			if (echo == NULL)
 			{
-				perror("Erreur au send");
-				exit(-1);
+				echo = messageCreerPrefixe(TRAME_MESSAGE, drapeaux | DRAPEAU_ECHO, prefixeNumerote, sizeof(prefixeNumerote), texte, longueur);
 			}
 		}
+		else if (tabClient[i].estIdentifie && idPseudo >= 0)
+		{
+			forme = tabClient[i].recoitHistorique ? &numerote : &compact;
+			if (*forme == NULL)
+			{
+				*forme = messageCreerPrefixe(TRAME_MESSAGE, drapeaux, prefixeNumerote,
+											 tabClient[i].recoitHistorique ? sizeof(prefixeNumerote) : TAILLE_IDENTIFIANT, texte, longueur);
+			}
+			if (faireConnaitre(i, idPseudo, &identite) == -1)
+			{
+				metriqueIncrementer(CPT_PERTES, 1);
+				continue;
+			}
+		}
+		else if (longueur == 0)
+		{
+			// Fin d'un message interrompu : rien à afficher sans les fragments
+			continue;
+		}
+		else if (complet == NULL)
+		{
+			char prefixe[TAILLE_PSEUDO + 4];
+			int longueurPrefixe = snprintf(prefixe, sizeof(prefixe), "%s : ", pseudo);
+			complet = messageCreerPrefixe(TRAME_TEXTE, 0, prefixe, longueurPrefixe, texte, longueur);
+		}
+
+		// Un destinataire qui ne lit plus perd ses messages sans gêner les autres
+		if (*forme == NULL || fileEnfiler(i, *forme) == -1)
+		{
+			metriqueIncrementer(CPT_PERTES, 1);
+			continue;
+		}
+		metriqueIncrementer(CPT_MESSAGES_ENVOYES, 1);
 	}
+	messageLiberer(complet);
+	messageLiberer(compact);
+	messageLiberer(numerote);
+	messageLiberer(echo);
+	messageLiberer(identite);
 }
 
 /**
@@ -200,18 +483,24 @@ void envoi(int dS, char *msg, int idSalon)
  */
 void envoiATous(char *msg)
 {
+	Message *message = messageCreer(TRAME_TEXTE, 0, msg, strlen(msg));
+	if (message == NULL)
+	{
+		return;
+	}
 	for (int i = 0; i < MAX_CLIENT; i++)
 	{
-		// On n'envoie pas au client qui a écrit le message
 		if (tabClient[i].estOccupe)
 		{
-			if (send(tabClient[i].dSC, msg, strlen(msg) + 1, 0) == -1)
+			if (fileEnfiler(i, message) == -1)
 			{
-				perror("Erreur à l'envoi à tout le monde");
-				exit(-1);
+				metriqueIncrementer(CPT_PERTES, 1);
+				continue;
 			}
+			metriqueIncrementer(CPT_MESSAGES_ENVOYES, 1);
 		}
 	}
+	messageLiberer(message);
 }
 
 /**
@@ -229,30 +518,135 @@ void envoiPrive(char *pseudoRecepteur, char *msg)
 		perror("Pseudo pas trouvé");
 		exit(-1);
 	}
-	long dSC = tabClient[i].dSC;
-	if (send(dSC, msg, strlen(msg) + 1, 0) == -1)
+	if (envoyerTrame(i, TRAME_TEXTE, msg, strlen(msg)) == -1)
 	{
-		perror("Erreur à l'envoi du mp");
-		exit(-1);
+		metriqueIncrementer(CPT_PERTES, 1);
+		return;
 	}
+	metriqueIncrementer(CPT_MESSAGES_ENVOYES, 1);
 }
 
 /**
- * @brief Receptionne un message d'une socket et teste que tout se passe bien.
+ * @brief Receptionne le prochain fragment de texte d'un client. Les trames de
+ * contrôle (ping, pong) sont traitées au passage et mettent à jour l'activité du client.
+ * Une trame plus longue que le buffer est rendue en plusieurs fragments, coupés
+ * entre deux caractères ; drapeaux du client porte alors DRAPEAU_SUITE.
  *
- * @param dS socket sur laquelle recevoir
- * @param rep buffer où stocker le message reçu
- * @param size taille maximum du message à recevoir
+ * @param numClient indice du client
+ * @param rep buffer où stocker le fragment reçu, terminé par '\0'
+ * @param size taille du buffer
+ * @return la longueur du fragment, -1 si la connexion est fermée, perdue ou invalide.
  */
-void reception(int dS, char *rep, ssize_t size)
+ssize_t reception(int numClient, char *rep, ssize_t size)
 {
-	if (recv(dS, rep, size, 0) == -1)
+	LecteurTrame *lecteur = tabClient[numClient].lecteur;
+	EnteteTrame entete;
+	while (1)
 	{
-		perror("Erreur à la réception");
-		exit(-1);
+		int etat = lecteurTrameDisponible(lecteur, &entete);
+		if (etat < 0)
+		{
+			journalEcrire(JOURNAL_AVERTISSEMENT, EVT_ERREUR_RESEAU, numClient, EPROTO, 0, "trame");
+			return -1;
+		}
+		if (etat == 1)
+		{
+			const char *charge = (const char *)lecteur->tampon + TAILLE_ENTETE_TRAME;
+			uint64_t maintenant = metriqueHorloge();
+			if (tabClient[numClient].decalageTrame == 0)
+			{
+				captureTrame(numClient, &entete, charge);
+			}
+			atomic_store(&tabClient[numClient].derniereActivite, maintenant);
+
+			if (entete.type == TRAME_TEXTE)
+			{
+				size_t decalage = tabClient[numClient].decalageTrame;
+				size_t reste = entete.longueur - decalage;
+				size_t longueur = reste < (size_t)size - 1 ? reste : texteCoupure(charge + decalage, size - 1);
+				memcpy(rep, charge + decalage, longueur);
+				rep[longueur] = '\0';
+				tabClient[numClient].drapeaux = entete.drapeaux;
+				if (longueur < reste)
+				{
+					// La trame reste dans le lecteur jusqu'à son dernier fragment
+					tabClient[numClient].decalageTrame = decalage + longueur;
+					tabClient[numClient].drapeaux |= DRAPEAU_SUITE;
+				}
+				else
+				{
+					tabClient[numClient].decalageTrame = 0;
+					lecteurTrameConsommer(lecteur, &entete);
+				}
+				atomic_store(&tabClient[numClient].dernierMessage, maintenant);
+				return longueur;
+			}
+			if (entete.type == TRAME_PING)
+			{
+				envoyerTrame(numClient, TRAME_PONG, NULL, 0);
+			}
+			if (entete.type == TRAME_EPHEMERE && entete.longueur >= 1)
+			{
+				// Une marque de lecture est datée par la position de l'historique
+				uint8_t type = charge[0];
+				uint32_t valeur = type == EPHEMERE_LECTURE ? historiqueNbMessages() : entete.longueur >= 2 && charge[1] != 0;
+				ephemerePublier(numClient, type, valeur);
+			}
+			if (entete.type == TRAME_HISTORIQUE && entete.longueur >= TAILLE_DEMANDE_HISTORIQUE && tabClient[numClient].recoitHistorique)
+			{
+				const uint8_t *demande = (const uint8_t *)charge;
+				uint32_t repere = ((uint32_t)demande[0] << 24) | (demande[1] << 16) | (demande[2] << 8) | demande[3];
+				envoiPageHistorique(numClient, repere, (demande[4] << 8) | demande[5], entete.drapeaux & DRAPEAU_APRES ? DRAPEAU_APRES : DRAPEAU_ANCIENS);
+			}
+			lecteurTrameConsommer(lecteur, &entete);
+			continue;
+		}
+
+		// Un redémarrage à chaud met le thread en pause avant qu'il ne lise la socket
+		if (relaisEnCours())
+		{
+			relaisAttendre();
+		}
+		ssize_t recu = chiffrementRemplir(numClient, lecteur);
+		if (recu == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (recu <= 0)
+		{
+			// Fermeture par le client, ou shutdown() par une minuterie
+			return -1;
+		}
+		metriqueIncrementer(CPT_OCTETS_RECUS, recu);
 	}
 }
 
+/**
+ * @brief Receptionne un message entier, tronqué à la taille du buffer : ses
+ * fragments suivants sont lus et ignorés. Les drapeaux du client restent ceux
+ * du premier fragment, sans DRAPEAU_SUITE.
+ *
+ * @param numClient indice du client
+ * @param rep buffer où stocker le message reçu, terminé par '\0'
+ * @param size taille du buffer
+ * @return la longueur du message, -1 si la connexion est fermée, perdue ou invalide.
+ */
+static ssize_t receptionEntiere(int numClient, char *rep, ssize_t size)
+{
+	ssize_t longueur = reception(numClient, rep, size);
+	uint8_t drapeaux = tabClient[numClient].drapeaux;
+	char reste[TAILLE_MESSAGE];
+	while (longueur >= 0 && (tabClient[numClient].drapeaux & DRAPEAU_SUITE))
+	{
+		if (reception(numClient, reste, sizeof(reste)) < 0)
+		{
+			return -1;
+		}
+	}
+	tabClient[numClient].drapeaux = drapeaux & ~DRAPEAU_SUITE;
+	return longueur;
+}
+
 /**
  * @brief Fonction pour vérifier si un client souhaite quitter la communication.
  *
@@ -308,32 +702,71 @@ void endOfThread(int numclient)
  */
 int utilisationCommande(char *msg, char *pseudoEnvoyeur)
 {
-	char *strToken = strtok(msg, " ");
+	// strtok_r : chaque client a son propre thread
+	char *suite;
+	char *strToken = strtok_r(msg, " ", &suite);
+	if (strToken == NULL)
+	{
+		return 0;
+	}
 	if (strcmp(strToken, "/estConnecte") == 0)
 	{
 		// Récupération du pseudo
-		char *pseudoAVerif = (char *)malloc(sizeof(char) * TAILLE_PSEUDO);
-		pseudoAVerif = strtok(NULL, " ");
-		pseudoAVerif = strtok(pseudoAVerif, "\n");
-
-		// Préparation du message à envoyer
-		char *msgAEnvoyer = (char *)malloc(sizeof(char) * (TAILLE_PSEUDO + 20));
-		strcat(msgAEnvoyer, pseudoAVerif);
+		char *pseudoAVerif = strtok_r(NULL, " \n", &suite);
+		if (pseudoAVerif == NULL)
+		{
+			envoiPrive(pseudoEnvoyeur, "Utilisation : /estConnecte pseudo\n");
+			return 1;
+		}
 
+		// Préparation du message à envoyer, le pseudo tronqué à sa taille maximale
+		char msgAEnvoyer[TAILLE_PSEUDO + 24];
 		if (verifPseudo(pseudoAVerif))
 		{
-			// Envoi du message au destinataire
-			strcat(msgAEnvoyer, " est en ligne");
-			envoiPrive(pseudoEnvoyeur, msgAEnvoyer);
+			snprintf(msgAEnvoyer, sizeof(msgAEnvoyer), "%.*s est en ligne", TAILLE_PSEUDO, pseudoAVerif);
 		}
 		else
 		{
-			// Envoi du message au destinataire
-			strcat(msgAEnvoyer, " n'est pas en ligne\n");
-			envoiPrive(pseudoEnvoyeur, msgAEnvoyer);
+			snprintf(msgAEnvoyer, sizeof(msgAEnvoyer), "%.*s n'est pas en ligne\n", TAILLE_PSEUDO, pseudoAVerif);
 		}
 
-		free(msgAEnvoyer);
+		// Envoi du message au destinataire
+		envoiPrive(pseudoEnvoyeur, msgAEnvoyer);
+		return 1;
+	}
+	else if (strcmp(strToken, "/mp") == 0)
+	{
+		char *pseudoRecepteur = strtok_r(NULL, " \n", &suite);
+		char *texte = strtok_r(NULL, "\n", &suite);
+		if (pseudoRecepteur == NULL || texte == NULL)
+		{
+			envoiPrive(pseudoEnvoyeur, "Utilisation : /mp pseudo message\n");
+			return 1;
+		}
+
+		// Le destinataire peut partir entre-temps : pas d'envoiPrive, qui le suppose connecté
+		int numEnvoyeur = pseudoToInt(pseudoEnvoyeur);
+		int numRecepteur = pseudoToInt(pseudoRecepteur);
+		char msgAEnvoyer[TAILLE_PSEUDO + TAILLE_MESSAGE + 16];
+		int longueur = snprintf(msgAEnvoyer, sizeof(msgAEnvoyer), "[mp] %s : %s\n", pseudoEnvoyeur, texte);
+		longueur = longueur < (int)sizeof(msgAEnvoyer) ? longueur : (int)sizeof(msgAEnvoyer) - 1;
+		if (numRecepteur == -1)
+		{
+			snprintf(msgAEnvoyer, sizeof(msgAEnvoyer), "%.*s n'est pas en ligne sur ce serveur\n", TAILLE_PSEUDO, pseudoRecepteur);
+			envoiPrive(pseudoEnvoyeur, msgAEnvoyer);
+		}
+		else if (limiterDebit(numEnvoyeur, tabClient[numEnvoyeur].idSalon, TAILLE_ENTETE_TRAME + longueur) != 0)
+		{
+			envoiPrive(pseudoEnvoyeur, "Message non distribué : vous écrivez trop vite\n");
+		}
+		else if (envoyerTrame(numRecepteur, TRAME_TEXTE, msgAEnvoyer, longueur) == -1)
+		{
+			metriqueIncrementer(CPT_PERTES, 1);
+		}
+		else
+		{
+			metriqueIncrementer(CPT_MESSAGES_ENVOYES, 1);
+		}
 		return 1;
 	}
 	else if (strcmp(strToken, "/aide") == 0)
@@ -342,30 +775,50 @@ int utilisationCommande(char *msg, char *pseudoEnvoyeur)
 		FILE *fichierCom = NULL;
 		fichierCom = fopen("commande.txt", "r");
 
-		fseek(fichierCom, 0, SEEK_END);
-		int longueur = ftell(fichierCom);
-		fseek(fichierCom, 0, SEEK_SET);
-
 		if (fichierCom != NULL)
 		{
-			char *toutFichier = (char *)malloc(longueur);
-			fread(toutFichier, sizeof(char), longueur, fichierCom);
-
-			envoiPrive(pseudoEnvoyeur, toutFichier);
+			fseek(fichierCom, 0, SEEK_END);
+			int longueur = ftell(fichierCom);
+			fseek(fichierCom, 0, SEEK_SET);
 
-			free(toutFichier);
+			// Le tampon est imputé au budget mémoire du client le temps de la réponse
+			int numClient = pseudoToInt(pseudoEnvoyeur);
+			if (longueur >= 0 && numClient >= 0 && memoireReserver(numClient, longueur + 1) == 0)
+			{
+				char *toutFichier = (char *)malloc(longueur + 1);
+				if (toutFichier != NULL)
+				{
+					toutFichier[fread(toutFichier, sizeof(char), longueur, fichierCom)] = '\0';
+					envoiPrive(pseudoEnvoyeur, toutFichier);
+					free(toutFichier);
+				}
+				memoireRendre(numClient, longueur + 1);
+			}
+			fclose(fichierCom);
 		}
 		else
 		{
 			// On affiche un message d'erreur si le fichier n'a pas réussi a être ouvert
 			printf("Impossible d\'ouvrir le fichier de commande pour l\'aide");
 		}
-		fclose(fichierCom);
 		return 1;
 	}
 	else if (strcmp(strToken, "/enLigne") == 0)
 	{
-		char *chaineEnLigne = malloc(sizeof(char) * (TAILLE_PSEUDO + 15) * 20); // Tous les 20 utilisateurs envoie de la chaine concaténée
+		// Le tampon est imputé au budget mémoire du client le temps de la réponse
+		size_t tailleEnLigne = sizeof(char) * (TAILLE_PSEUDO + 15) * 20;
+		int numClient = pseudoToInt(pseudoEnvoyeur);
+		if (numClient < 0 || memoireReserver(numClient, tailleEnLigne) != 0)
+		{
+			return 1;
+		}
+		char *chaineEnLigne = malloc(tailleEnLigne); // Tous les 20 utilisateurs envoie de la chaine concaténée
+		if (chaineEnLigne == NULL)
+		{
+			memoireRendre(numClient, tailleEnLigne);
+			return 1;
+		}
+		chaineEnLigne[0] = '\0';
 		int compteur = 0;
 
 		for (int i = 0; i < MAX_CLIENT; i++)
@@ -393,9 +846,83 @@ int utilisationCommande(char *msg, char *pseudoEnvoyeur)
 			envoiPrive(pseudoEnvoyeur, chaineEnLigne);
 		}
 		free(chaineEnLigne);
+		memoireRendre(numClient, tailleEnLigne);
+
+		// Utilisateurs des autres nœuds de la fédération
+		char distants[MAX_NOEUDS * MAX_CLIENT * (TAILLE_PSEUDO + TAILLE_NOM_NOEUD + 20)];
+		if (federationEnLigne(distants, sizeof(distants)) > 0)
+		{
+			envoiPrive(pseudoEnvoyeur, distants);
+		}
 
 		return 1;
 	}
+	else if (strcmp(strToken, "/rejoindre") == 0 || strcmp(strToken, "/rejoindre\n") == 0)
+	{
+		// Rejoint un salon, en le créant s'il n'existe pas encore
+		char *nomSalon = strtok_r(NULL, " \n", &suite);
+		if (nomSalon == NULL)
+		{
+			envoiPrive(pseudoEnvoyeur, "Utilisation : /rejoindre nomSalon\n");
+			return 1;
+		}
+
+		int idSalon = creerSalon(nomSalon, "", MAX_CLIENT);
+		if (idSalon < 0)
+		{
+			envoiPrive(pseudoEnvoyeur, "Impossible de créer le salon\n");
+			return 1;
+		}
+
+		int numClient = pseudoToInt(pseudoEnvoyeur);
+		tabClient[numClient].idSalon = idSalon;
+		enregistrerAdhesion(pseudoEnvoyeur, idSalon);
+		federationAnnoncer(numClient);
+
+		char reponse[TAILLE_PSEUDO + 40];
+		snprintf(reponse, sizeof(reponse), "Vous avez rejoint le salon %s\n", nomSalon);
+		envoiPrive(pseudoEnvoyeur, reponse);
+		rejouerHistorique(numClient);
+		return 1;
+	}
+	else if (strcmp(strToken, "/limite") == 0 || strcmp(strToken, "/limite\n") == 0)
+	{
+		// Taille maximum d'un message dans le salon courant ; elle se change sur la socket d'administration
+		int idSalon = tabClient[pseudoToInt(pseudoEnvoyeur)].idSalon;
+		char reponse[80];
+		snprintf(reponse, sizeof(reponse), "Ce salon accepte %zu octets par message\n", limiteDuSalon(idSalon));
+		envoiPrive(pseudoEnvoyeur, reponse);
+		return 1;
+	}
+	else if (strcmp(strToken, "/chercher") == 0 || strcmp(strToken, "/chercher\n") == 0)
+	{
+		// Recherche dans l'historique du salon courant
+		char *requete = strtok_r(NULL, "\n", &suite);
+		if (requete == NULL)
+		{
+			envoiPrive(pseudoEnvoyeur, "Utilisation : /chercher mot [mot...]\n");
+			return 1;
+		}
+
+		uint32_t resultats[MAX_RESULTATS];
+		uint64_t depart = metriqueHorloge();
+		historiqueVerrouiller();
+		int nbResultats = rechercher(tabClient[pseudoToInt(pseudoEnvoyeur)].idSalon, requete, resultats, MAX_RESULTATS);
+		uint64_t duree = metriqueHorloge() - depart;
+		metriqueObserver(HIST_RECHERCHE, duree);
+
+		char reponse[MAX_RESULTATS * (TAILLE_PSEUDO + TAILLE_MESSAGE + 20) + 64];
+		size_t position = snprintf(reponse, sizeof(reponse), "%d résultat(s) en %lu µs\n", nbResultats, (unsigned long)duree);
+		for (int i = 0; i < nbResultats; i++)
+		{
+			position += snprintf(reponse + position, sizeof(reponse) - position, "[#%u] ", resultats[i]);
+			position += historiqueFormater(reponse + position, TAILLE_PSEUDO + TAILLE_MESSAGE + 3, historiqueLire(resultats[i]));
+			reponse[position++] = '\n';
+		}
+		historiqueDeverrouiller();
+		envoiVolumineux(pseudoToInt(pseudoEnvoyeur), reponse, position);
+		return 1;
+	}
 	else if (strToken[0] == '/')
 	{
 		envoiPrive(pseudoEnvoyeur, "Faites \"/aide\" pour avoir accès aux commandes disponibles et leur fonctionnement\n");
@@ -406,106 +933,334 @@ int utilisationCommande(char *msg, char *pseudoEnvoyeur)
 }
 
 /**
- * @brief Fonction principale de communication entre un
- * client et le serveur.
+ * @brief Demande son pseudo à un nouveau client, jusqu'à en obtenir un libre,
+ * puis annonce son arrivée.
  *
- * @param clientParam numéro du client en question
+ * @param numClient numéro du client en question
+ * @return 0 si le client a choisi son pseudo, -1 s'il est parti avant.
  */
-void *communication(void *clientParam)
+int choisirPseudo(int numClient)
 {
-
-	int numClient = (long)clientParam;
-
 	// Réception du pseudo
 	char *pseudo = (char *)malloc(sizeof(char) * (TAILLE_PSEUDO + 29)); // voir Ligne 1330
-	reception(tabClient[numClient].dSC, pseudo, sizeof(char) * TAILLE_PSEUDO);
-	pseudo = strtok(pseudo, "\n");
+	char *tampon = pseudo;
+	char *suite;
+	if (receptionEntiere(numClient, pseudo, sizeof(char) * TAILLE_PSEUDO) < 0)
+	{
+		free(tampon);
+		return -1;
+	}
+	pseudo = strtok_r(pseudo, "\n", &suite);
 
 	while (pseudo == NULL || verifPseudo(pseudo))
 	{
-		send(tabClient[numClient].dSC, "Pseudo déjà existant\n", strlen("Pseudo déjà existant\n") + 1, 0);
-		reception(tabClient[numClient].dSC, pseudo, sizeof(char) * TAILLE_PSEUDO);
-		pseudo = strtok(pseudo, "\n");
+		envoyerTrame(numClient, TRAME_TEXTE, "Pseudo déjà existant\n", strlen("Pseudo déjà existant\n"));
+		pseudo = tampon;
+		if (receptionEntiere(numClient, pseudo, sizeof(char) * TAILLE_PSEUDO) < 0)
+		{
+			free(tampon);
+			return -1;
+		}
+		pseudo = strtok_r(pseudo, "\n", &suite);
 	}
 
-	tabClient[numClient].pseudo = (char *)malloc(sizeof(char) * TAILLE_PSEUDO);
+	// Le client qui garde une table des identités l'a signalé sur la trame de son pseudo,
+	// avant de recevoir son premier message
+	memset(tabClient[numClient].identitesConnues, 0, sizeof(tabClient[numClient].identitesConnues));
+	tabClient[numClient].estIdentifie = (tabClient[numClient].drapeaux & DRAPEAU_IDENTITES) != 0;
+	tabClient[numClient].recoitEphemeres = tabClient[numClient].estIdentifie && (tabClient[numClient].drapeaux & DRAPEAU_EPHEMERES);
+	tabClient[numClient].recoitHistorique = tabClient[numClient].estIdentifie && (tabClient[numClient].drapeaux & DRAPEAU_HISTORIQUE);
+	tabClient[numClient].idPseudo = identiteInterner(pseudo);
 	strcpy(tabClient[numClient].pseudo, pseudo);
-	tabClient[numClient].idSalon = 0;
+
+	// Un utilisateur connu retrouve le dernier salon qu'il a rejoint
+	int idSalon = salonDuPseudo(pseudo);
+	tabClient[numClient].idSalon = idSalon >= 0 ? idSalon : 0;
+	federationAnnoncer(numClient);
+
+	// Le client qui sait décompresser l'a signalé sur la trame de son pseudo
+	if (tabClient[numClient].drapeaux & DRAPEAU_DEFLATE)
+	{
+		envoyerTrame(numClient, TRAME_COMPRESSION, NULL, 0);
+	}
 
 	// On envoie un message pour dire au client qu'il est bien connecté
-	char *repServ = (char *)malloc(sizeof(char) * 61);
-	repServ = "Entrer /aide pour avoir la liste des commandes disponibles\n"; // 61
+	char *repServ = "Entrer /aide pour avoir la liste des commandes disponibles\n"; // 61
 	envoiPrive(pseudo, repServ);
+	rejouerHistorique(numClient);
 
 	// On vérifie que ce n'est pas le pseudo par défaut
 	if (strcmp(pseudo, "FinClient") != 0)
 	{
 		// On envoie un message pour avertir les autres clients de l'arrivée du nouveau client
-		strcat(pseudo, " a rejoint la communication\n"); // 29
-		envoi(tabClient[numClient].dSC, pseudo, 0);
+		federationDiffuser(numClient, "** a rejoint la communication **\n", 0);
+	}
+	free(tampon);
+	return 0;
+}
+
+/**
+ * @brief Fonction principale de communication entre un
+ * client et le serveur.
+ *
+ * @param clientParam numéro du client en question
+ */
+void *communication(void *clientParam)
+{
+
+	int numClient = (long)clientParam;
+
+	// Poignée de main TLS d'abord, sous la même minuterie que le choix du pseudo
+	if (chiffrementAccepter(numClient) != 0)
+	{
+		finClient(numClient);
+		return NULL;
+	}
+
+	// Un client repris lors d'un redémarrage à chaud a déjà choisi son pseudo
+	if (strcmp(tabClient[numClient].pseudo, " ") == 0 && choisirPseudo(numClient) != 0)
+	{
+		// Parti, ou pas de pseudo dans le délai imparti
+		finClient(numClient);
+		return NULL;
 	}
+	minuterieAnnuler(&tabClient[numClient].minuteriePoignee);
 
 	// On a un client en plus sur le serveur, on incrémente
 	pthread_mutex_lock(&mutexTabClient);
 	nbClient += 1;
 	pthread_mutex_unlock(&mutexTabClient);
 
-	printf("Clients connectés : %ld\n", nbClient);
+	journalEcrire(JOURNAL_INFO, EVT_PSEUDO, numClient, nbClient, 0, tabClient[numClient].pseudo);
 
 	int estFin = 0;
 	char *pseudoEnvoyeur = tabClient[numClient].pseudo;
 
+	// Un seul buffer par connexion : un long message est relayé fragment par fragment, sans être rassemblé
+	char *msgReceived = (char *)malloc(sizeof(char) * TAILLE_MESSAGE);
+	int estSuite = 0;
+	int estIgnore = 0;
+	size_t tailleMessage = 0;
+	size_t limite = 0;
+
 	while (!estFin)
 	{
-		// Réception du message
-		char *msgReceived = (char *)malloc(sizeof(char) * TAILLE_MESSAGE);
-		reception(tabClient[numClient].dSC, msgReceived, sizeof(char) * TAILLE_MESSAGE);
-		printf("\nMessage recu: %s \n", msgReceived);
+		// Réception du prochain fragment ; estSuite dit si le message continue après lui
+		ssize_t longueurRecue = reception(numClient, msgReceived, sizeof(char) * TAILLE_MESSAGE);
+		int estDebut = !estSuite;
+		estSuite = longueurRecue >= 0 && (tabClient[numClient].drapeaux & DRAPEAU_SUITE);
+		if (longueurRecue < 0)
+		{
+			// Connexion perdue : un message entamé est clos, puis on prévient le salon comme pour un /fin
+			if (!estDebut && !estIgnore)
+			{
+				federationDiffuser(numClient, "", 0);
+			}
+			strcpy(msgReceived, "/fin\n");
+			longueurRecue = strlen(msgReceived);
+			estDebut = 1;
+		}
+		else if (longueurRecue == 0 && estDebut && !estSuite)
+		{
+			continue;
+		}
+
+		if (estDebut)
+		{
+			metriqueIncrementer(CPT_MESSAGES_RECUS, 1);
+
+			// Le contenu n'est jamais journalisé, seulement sa taille et son empreinte
+			journalEchantillonne(JOURNAL_INFO, EVT_MESSAGE_RECU, numClient, longueurRecue,
+								 journalEmpreinte(msgReceived, longueurRecue), NULL);
 
-		// On verifie si le client veut terminer la communication
-		estFin = finDeCommunication(msgReceived);
+			// On verifie si le client veut terminer la communication
+			estFin = finDeCommunication(msgReceived);
 
-		// On vérifie si le client utilise une des commandes
-		char *msgToVerif = (char *)malloc(sizeof(char) * strlen(msgReceived));
-		strcpy(msgToVerif, msgReceived);
+			// On vérifie si le client utilise une des commandes ; une commande tient dans un fragment, la suite est ignorée
+			char *msgToVerif = (char *)malloc(sizeof(char) * (strlen(msgReceived) + 1));
+			strcpy(msgToVerif, msgReceived);
+
+			uint64_t debut = metriqueHorloge();
+			if (utilisationCommande(msgToVerif, pseudoEnvoyeur))
+			{
+				uint64_t duree = metriqueHorloge() - debut;
+				metriqueIncrementer(CPT_COMMANDES, 1);
+				metriqueObserver(HIST_COMMANDE, duree);
+				msgToVerif[strcspn(msgToVerif, "\n")] = '\0';
+				journalEcrire(JOURNAL_DEBUG, EVT_COMMANDE, numClient, duree, 0, msgToVerif);
+				free(msgToVerif);
+				estIgnore = estSuite;
+				continue;
+			}
+			free(msgToVerif);
 
-		if (utilisationCommande(msgToVerif, pseudoEnvoyeur))
+			estIgnore = 0;
+			tailleMessage = 0;
+			limite = limiteDuSalon(tabClient[numClient].idSalon);
+		}
+		else if (estIgnore)
 		{
-			free(msgReceived);
 			continue;
 		}
 
-		// Ajout du pseudo de l'expéditeur devant le message à envoyer
-		char *msgAEnvoyer = (char *)malloc(sizeof(char) * (TAILLE_PSEUDO + 4 + strlen(msgReceived)));
-		strcpy(msgAEnvoyer, pseudoEnvoyeur);
-		strcat(msgAEnvoyer, " : ");
-		strcat(msgAEnvoyer, msgReceived);
-		free(msgReceived);
-
-		// Envoi du message aux autres clients
-		printf("Envoi du message aux %ld clients. \n", nbClient - 1);
-		envoi(tabClient[numClient].dSC, msgAEnvoyer, tabClient[numClient].idSalon);
+		// Au-delà de la limite du salon, le message est coupé : ce fragment devient son dernier
+		uint8_t drapeaux = estSuite ? DRAPEAU_SUITE : 0;
+		if (tailleMessage + longueurRecue > limite)
+		{
+			longueurRecue = texteCoupure(msgReceived, limite - tailleMessage);
+			msgReceived[longueurRecue] = '\0';
+			drapeaux = 0;
+			estIgnore = estSuite;
+			char avis[80];
+			snprintf(avis, sizeof(avis), "Message tronqué : ce salon accepte %zu octets par message\n", limite);
+			envoiPrive(pseudoEnvoyeur, avis);
+		}
+		tailleMessage += longueurRecue;
+
+		// L'expéditeur paie toute sa diffusion : destinataires, ici et sur les autres nœuds, × taille de la trame
+		// (la plus grande des deux formes, avec le pseudo en toutes lettres)
+		int64_t cout = (int64_t)(nbDestinataires(tabClient[numClient].dSC, tabClient[numClient].idSalon) +
+								 federationNbDestinataires(tabClient[numClient].idSalon)) *
+					   (TAILLE_ENTETE_TRAME + strlen(pseudoEnvoyeur) + 3 + longueurRecue);
+		if (cout > 0 && limiterDebit(numClient, tabClient[numClient].idSalon, cout) != 0)
+		{
+			envoiPrive(pseudoEnvoyeur, "Message non distribué : vous écrivez trop vite\n");
+			// Un message déjà entamé est clos chez les destinataires, et sa suite ignorée
+			if (!estDebut)
+			{
+				federationDiffuser(numClient, "", 0);
+			}
+			estIgnore = estSuite;
+			continue;
+		}
 
-		free(msgAEnvoyer);
+		// Envoi du fragment aux autres clients, par le nœud d'attache du salon en fédération
+		journalEchantillonne(JOURNAL_INFO, EVT_DIFFUSION, numClient, tabClient[numClient].idSalon, nbClient - 1, NULL);
+		uint64_t debut = metriqueHorloge();
+		federationDiffuser(numClient, msgReceived, drapeaux);
+		metriqueObserver(HIST_DIFFUSION, metriqueHorloge() - debut);
 	}
+	free(msgReceived);
 
-	// Fermeture du socket client
 	pthread_mutex_lock(&mutexTabClient);
 	nbClient = nbClient - 1;
-	tabClient[numClient].estOccupe = 0;
+	pthread_mutex_unlock(&mutexTabClient);
+	finClient(numClient);
+
+	return NULL;
+}
+
+/**
+ * @brief Libère l'emplacement d'un client qui quitte le serveur : ses
+ * minuteries sont annulées avant que l'emplacement ne puisse être réutilisé.
+ *
+ * @param numClient numéro du client en question
+ */
+void finClient(int numClient)
+{
+	minuterieAnnuler(&tabClient[numClient].minuterieVie);
+	minuterieAnnuler(&tabClient[numClient].minuteriePoignee);
+	minuterieAnnuler(&tabClient[numClient].minuterieDebit);
+	ephemereOublier(numClient);
+	captureDeconnexion(numClient);
+	fileVider(numClient);
+	chiffrementFermer(numClient);
+	memoireFermer(numClient);
+
+	// Fermeture du socket client
+	pthread_mutex_lock(&mutexTabClient);
+	long dSC = tabClient[numClient].dSC;
+	uint32_t adresse = tabClient[numClient].adresse;
+	free(tabClient[numClient].lecteur);
+	tabClient[numClient].lecteur = NULL;
 	free(tabClient[numClient].pseudo);
+	tabClient[numClient].estOccupe = 0;
+	// Le départ est annoncé avant que l'emplacement ne puisse être réattribué
+	federationAnnoncerDepart(numClient);
 	pthread_mutex_unlock(&mutexTabClient);
+	journalEcrire(JOURNAL_INFO, EVT_DECONNEXION, numClient, nbClient, 0, NULL);
 
-	shutdown(tabClient[numClient].dSC, 2);
+	shutdown(dSC, 2);
+	close(dSC);
 
-	// On relache le sémaphore pour les clients en attente
-	sem_post(&semaphoreNbClients);
+	// On rend sa place, et celle de son adresse
+	admissionRendre(adresse);
 
 	// On incrémente le sémaphore des threads
 	sem_wait(&semaphoreThread);
 	endOfThread(numClient);
+}
 
-	return NULL;
+/**
+ * @brief Prépare la socket et les minuteries d'un client qui vient d'être
+ * enregistré, nouveau ou repris lors d'un redémarrage à chaud.
+ *
+ * @param numClient numéro du client en question
+ */
+void preparerClient(long numClient)
+{
+	uint64_t maintenant = metriqueHorloge();
+	atomic_store(&tabClient[numClient].derniereActivite, maintenant);
+	atomic_store(&tabClient[numClient].dernierMessage, maintenant);
+	memset(&tabClient[numClient].seauDebit, 0, sizeof(SeauJetons));
+	tabClient[numClient].decalageTrame = 0;
+	// Les identités sont attribuées par chaque processus : un client repris reçoit la sienne du nouveau
+	tabClient[numClient].idPseudo = strcmp(tabClient[numClient].pseudo, " ") != 0 ? identiteInterner(tabClient[numClient].pseudo) : -1;
+	sortiePreparerSocket(tabClient[numClient].dSC);
+	captureConnexion(numClient);
+	minuterieArmer(&tabClient[numClient].minuterieVie, INTERVALLE_PING, verifierVie, (void *)numClient);
+	if (strcmp(tabClient[numClient].pseudo, " ") == 0)
+	{
+		minuterieArmer(&tabClient[numClient].minuteriePoignee, DELAI_POIGNEE, expirerPoignee, (void *)numClient);
+	}
+}
+
+/**
+ * @brief Minuterie de vie d'un client, appelée toutes les INTERVALLE_PING ms :
+ * envoie un ping à un client silencieux, et déconnecte un client qui ne répond
+ * plus ou qui n'a rien écrit depuis delaiInactivite secondes.
+ * La déconnexion passe par shutdown(), qui réveille le thread du client.
+ *
+ * @param clientParam numéro du client en question
+ * @return le délai avant le prochain appel, 0 si le client est déconnecté.
+ */
+unsigned int verifierVie(void *clientParam)
+{
+	int numClient = (long)clientParam;
+	uint64_t maintenant = metriqueHorloge();
+	uint64_t silence = (maintenant - atomic_load(&tabClient[numClient].derniereActivite)) / 1000;
+	uint64_t inactivite = (maintenant - atomic_load(&tabClient[numClient].dernierMessage)) / 1000;
+
+	if (silence >= DELAI_SILENCE || (delaiInactivite > 0 && inactivite >= delaiInactivite * 1000ULL))
+	{
+		journalEcrire(JOURNAL_INFO, EVT_EXPIRATION, numClient, silence, 0,
+					  silence >= DELAI_SILENCE ? "silence" : "inactivite");
+		metriqueIncrementer(CPT_EXPIRATIONS, 1);
+		shutdown(tabClient[numClient].dSC, SHUT_RDWR);
+		return 0;
+	}
+
+	if (silence >= INTERVALLE_PING)
+	{
+		envoyerTrame(numClient, TRAME_PING, NULL, 0);
+	}
+	return INTERVALLE_PING;
+}
+
+/**
+ * @brief Minuterie de la poignée de main : un client qui n'a pas choisi de
+ * pseudo dans le délai libère sa place.
+ *
+ * @param clientParam numéro du client en question
+ * @return 0, la minuterie n'est pas réarmée.
+ */
+unsigned int expirerPoignee(void *clientParam)
+{
+	int numClient = (long)clientParam;
+	journalEcrire(JOURNAL_INFO, EVT_EXPIRATION, numClient, DELAI_POIGNEE, 0, "pseudo");
+	metriqueIncrementer(CPT_EXPIRATIONS, 1);
+	shutdown(tabClient[numClient].dSC, SHUT_RDWR);
+	return 0;
 }
 
 /**
@@ -521,6 +1276,7 @@ void sigintHandler(int sig_num)
 	{
 		envoiATous("LE SERVEUR S'EST MOMENTANEMENT ARRETE, DECONNEXION...\n");
 		envoiATous("Tout ce message est le code secret pour désactiver les clients");
+		sortieAttendreVide(1000);
 
 		int i = 0;
 		while (i < MAX_CLIENT)
@@ -542,55 +1298,333 @@ void sigintHandler(int sig_num)
 	exit(1);
 }
 
+/**
+ * @brief Jauge du nombre de clients ayant terminé leur connexion.
+ *
+ * @return le nombre de clients connectés.
+ */
+long jaugeClientsConnectes()
+{
+	return nbClient;
+}
+
+/**
+ * @brief Jauge du nombre de places encore disponibles sur le serveur.
+ *
+ * @return la valeur courante de semaphoreNbClients.
+ */
+long jaugePlacesLibres()
+{
+	int valeur = 0;
+	sem_getvalue(&semaphoreNbClients, &valeur);
+	return valeur;
+}
+
+/**
+ * @brief Jauge de la profondeur des files d'envoi, c'est-à-dire des octets
+ * en attente dans les sockets des clients et pas encore acquittés.
+ *
+ * @return la somme des octets en attente d'envoi.
+ */
+long jaugeFileEnvoi()
+{
+	long total = 0;
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		int enAttente = 0;
+		if (tabClient[i].estOccupe && ioctl(tabClient[i].dSC, SIOCOUTQ, &enAttente) == 0)
+		{
+			total += enAttente;
+		}
+	}
+	return total;
+}
+
+/**
+ * @brief Commande stats de la socket d'administration : résumé des métriques
+ * et de la mémoire imputée.
+ *
+ * @param arguments mots suivant la commande, ignorés
+ * @param tampon buffer de la réponse
+ * @param taille taille du buffer
+ * @return la longueur de la réponse.
+ */
+size_t commandeStats(char *arguments, char *tampon, size_t taille)
+{
+	size_t longueur = metriquesResume(tampon, taille);
+	return longueur + memoireResume(tampon + longueur, taille - longueur);
+}
+
+/**
+ * @brief Commande limite de la socket d'administration : « limite salon [octets] »
+ * donne la taille maximum d'un message dans le salon, et la change si elle est
+ * donnée (0 pour revenir à la valeur par défaut du serveur).
+ *
+ * @param arguments nom du salon, puis taille éventuelle
+ * @param tampon buffer de la réponse
+ * @param taille taille du buffer
+ * @return la longueur de la réponse.
+ */
+size_t commandeLimite(char *arguments, char *tampon, size_t taille)
+{
+	char *suite;
+	char *nomSalon = strtok_r(arguments, " ", &suite);
+	char *octets = strtok_r(NULL, " ", &suite);
+	int idSalon = nomSalon != NULL ? chercherSalon(nomSalon) : -1;
+	int n;
+	if (nomSalon == NULL)
+	{
+		n = snprintf(tampon, taille, "Utilisation : limite salon [octets]\n");
+	}
+	else if (idSalon < 0)
+	{
+		n = snprintf(tampon, taille, "Salon inconnu : %s\n", nomSalon);
+	}
+	else
+	{
+		if (octets != NULL)
+		{
+			limiterSalon(idSalon, atoi(octets) > 0 ? atoi(octets) : 0);
+		}
+		n = snprintf(tampon, taille, "Le salon %s accepte %zu octets par message\n", nomSalon, limiteDuSalon(idSalon));
+	}
+	return n < 0 ? 0 : (size_t)n < taille ? (size_t)n : taille - 1;
+}
+
 /*
  * _____________________ MAIN _____________________
  */
 // argv[1] = port
+// -a chemin = socket UNIX d'administration exposant les métriques et les commandes stats et limite
+// -j dossier = dossier des fichiers de journal (sortie standard par défaut)
+// -n niveau = niveau minimum journalisé : debug, info, avert ou erreur
+// -e N = ne journalise qu'un message reçu ou diffusé sur N
+// -r chemin = socket UNIX de relais pour le redémarrage à chaud (/tmp/messagerie-[port].relais par défaut)
+// -d dossier = dossier de l'état persistant des salons (état en mémoire seulement par défaut)
+// -s secondes = intervalle entre deux instantanés de l'état (300 par défaut)
+// -i secondes = déconnecte les clients qui n'ont rien écrit depuis ce délai (jamais par défaut)
+// -l octets = débit de diffusion accordé à chaque client, en octets par seconde (32 Kio par défaut)
+// -L octets = débit de diffusion accordé à chaque salon, en octets par seconde (256 Kio par défaut)
+// -b octets = budget d'envoi de chaque travailleur d'envoi, en octets par seconde (64 Mio par défaut)
+// -p N = connexions simultanées autorisées par adresse IP, 0 pour ne pas plafonner (3 par défaut)
+// -F fichier = fichier de fédération, une ligne « nom hôte port » par nœud et une ligne « secret valeur » (serveur seul par défaut)
+// -N nom = nom du nœud local dans le fichier de fédération
+// -m octets = taille maximum d'un message dans un salon qui n'a pas la sienne (64 Kio par défaut)
+// -M octets = budget mémoire de chaque connexion (1 Mio par défaut)
+// -P octets = plafond de la mémoire des connexions, de l'historique, de l'index et des identités (96 Mio par défaut)
+// -c fichier = capture du trafic entrant, rejouable par ./rejeu
+// -T certificat = certificat PEM du serveur : les clients se connectent en TLS (en clair par défaut)
+// -K cle = clé privée PEM du certificat (le fichier du certificat par défaut)
+// -H N = messages conservés au plus dans l'historique des salons (262144 par défaut)
+// -R = reprend les connexions du serveur en service sur la socket de relais au lieu d'ouvrir le port
 
 int main(int argc, char *argv[])
 {
+	char *cheminAdmin = NULL;
+	char *dossierJournal = NULL;
+	int niveauJournal = JOURNAL_INFO;
+	int echantillonnage = 1;
+	char cheminRelais[108] = "";
+	int estReprise = 0;
+	char *dossierEtat = NULL;
+	int periodeInstantane = 300;
+	int64_t debitParConnexion = 0;
+	int64_t debitParSalon = 0;
+	int64_t budgetEnvoi = 0;
+	char *fichierFederation = NULL;
+	char *nomNoeud = NULL;
+	size_t memoireConnexion = 0;
+	size_t plafondMemoire = 0;
+	char *fichierCapture = NULL;
+	char *certificat = NULL;
+	char *cle = NULL;
+	long retentionHistorique = 0;
+	int option;
+	while ((option = getopt(argc, argv, "a:j:n:e:r:Rd:s:i:l:L:b:p:F:N:m:M:P:c:T:K:H:")) != -1)
+	{
+		switch (option)
+		{
+		case 'a':
+			cheminAdmin = optarg;
+			break;
+		case 'j':
+			dossierJournal = optarg;
+			break;
+		case 'n':
+			niveauJournal = journalNiveauDepuisNom(optarg);
+			if (niveauJournal < 0)
+			{
+				fprintf(stderr, "Niveau de journal inconnu : %s\n", optarg);
+				exit(-1);
+			}
+			break;
+		case 'e':
+			echantillonnage = atoi(optarg);
+			break;
+		case 'r':
+			snprintf(cheminRelais, sizeof(cheminRelais), "%s", optarg);
+			break;
+		case 'R':
+			estReprise = 1;
+			break;
+		case 'd':
+			dossierEtat = optarg;
+			break;
+		case 's':
+			periodeInstantane = atoi(optarg);
+			break;
+		case 'i':
+			delaiInactivite = atoi(optarg);
+			break;
+		case 'l':
+			debitParConnexion = atoll(optarg);
+			break;
+		case 'L':
+			debitParSalon = atoll(optarg);
+			break;
+		case 'b':
+			budgetEnvoi = atoll(optarg);
+			break;
+		case 'p':
+			admissionConfigurer(atoi(optarg));
+			break;
+		case 'F':
+			fichierFederation = optarg;
+			break;
+		case 'N':
+			nomNoeud = optarg;
+			break;
+		case 'm':
+			limiteMessage = atoll(optarg) > 0 ? (size_t)atoll(optarg) : LIMITE_MESSAGE;
+			break;
+		case 'M':
+			memoireConnexion = atoll(optarg);
+			break;
+		case 'P':
+			plafondMemoire = atoll(optarg);
+			break;
+		case 'c':
+			fichierCapture = optarg;
+			break;
+		case 'T':
+			certificat = optarg;
+			break;
+		case 'K':
+			cle = optarg;
+			break;
+		case 'H':
+			retentionHistorique = atol(optarg);
+			break;
+		default:
+			break;
+		}
+	}
+
 	// Verification du nombre de paramètres
-	if (argc < 2)
+	if (optind >= argc)
 	{
-		perror("Erreur : Lancez avec ./serveur [votre_port] ");
+		perror("Erreur : Lancez avec ./serveur [votre_port] [-a socket_admin] [-j dossier_journal] [-n niveau] [-e echantillonnage] [-r socket_relais] [-R] [-d dossier_etat] [-s periode_instantane] [-i delai_inactivite] [-l debit_client] [-L debit_salon] [-b budget_envoi] [-p max_par_adresse] [-F fichier_federation -N nom_noeud] [-m taille_message] [-M memoire_connexion] [-P plafond_memoire] [-c fichier_capture] [-T certificat [-K cle]] [-H retention_historique]");
 		exit(-1);
 	}
 
 	printf("Début programme\n");
 
-	portServeur = atoi(argv[1]);
+	portServeur = atoi(argv[optind]);
+	if (cheminRelais[0] == '\0')
+	{
+		snprintf(cheminRelais, sizeof(cheminRelais), "/tmp/messagerie-%d.relais", portServeur);
+	}
+
+	// Journal asynchrone, vidé par un thread dédié
+	if (journalDemarrer(dossierJournal, niveauJournal, echantillonnage) != 0)
+	{
+		exit(-1);
+	}
+	journalEcrire(JOURNAL_INFO, EVT_DEMARRAGE, portServeur, 0, 0, NULL);
+
+	// Capture du trafic entrant, avant la reprise qui ouvre déjà des connexions
+	if (fichierCapture != NULL && captureDemarrer(fichierCapture) != 0)
+	{
+		exit(-1);
+	}
 
 	// Fin avec Ctrl + C
 	signal(SIGINT, sigintHandler);
 
-	// Création du salon général de discussion
-	tabSalon[0].idSalon = 0;
-	tabSalon[0].estOccupe = 1;
-	tabSalon[0].nom = "Chat_général";
-	tabSalon[0].description = "Salon général par défaut";
-	tabSalon[0].nbPlace = MAX_CLIENT;
+	// La condition de ralentissement utilise l'horloge monotone, comme la roue de minuteries
+	pthread_condattr_t attributs;
+	pthread_condattr_init(&attributs);
+	pthread_condattr_setclock(&attributs, CLOCK_MONOTONIC);
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		pthread_mutex_init(&tabClient[i].mutexEnvoi, NULL);
+		pthread_cond_init(&tabClient[i].condDebit, &attributs);
+	}
+	debitConfigurer(debitParConnexion, debitParSalon);
 
-	// Création de la socket
-	dS = socket(PF_INET, SOCK_STREAM, 0);
-	if (dS < 0)
+	// Transport chiffré, avant la reprise qui peut déjà recevoir des connexions chiffrées
+	if (certificat != NULL && chiffrementConfigurer(certificat, cle != NULL ? cle : certificat) != 0)
 	{
-		perror("Problème de création de socket serveur");
 		exit(-1);
 	}
-	printf("Socket Créé\n");
 
-	// Nommage de la socket
-	struct sockaddr_in ad;
-	ad.sin_family = AF_INET;
-	ad.sin_addr.s_addr = INADDR_ANY;
-	ad.sin_port = htons(atoi(argv[1]));
+	// Travailleurs d'envoi, avant la reprise qui peut déjà remplir des files
+	memoireConfigurer(memoireConnexion, plafondMemoire);
+	if (sortieDemarrer(budgetEnvoi) != 0)
+	{
+		exit(-1);
+	}
 
-	if (bind(dS, (struct sockaddr *)&ad, sizeof(ad)) < 0)
+	if (estReprise)
+	{
+		// Redémarrage à chaud : la socket d'écoute et les clients viennent de l'ancien processus
+		dS = relaisReprendre(cheminRelais);
+		if (dS < 0)
+		{
+			exit(-1);
+		}
+		printf("Connexions reprises\n");
+	}
+	else
+	{
+		// Création de la socket
+		dS = socket(PF_INET, SOCK_STREAM, 0);
+		if (dS < 0)
+		{
+			perror("Problème de création de socket serveur");
+			exit(-1);
+		}
+		printf("Socket Créé\n");
+
+		// Nommage de la socket
+		struct sockaddr_in ad;
+		ad.sin_family = AF_INET;
+		ad.sin_addr.s_addr = INADDR_ANY;
+		ad.sin_port = htons(portServeur);
+
+		if (bind(dS, (struct sockaddr *)&ad, sizeof(ad)) < 0)
+		{
+			perror("Erreur lors du nommage de la socket");
+			exit(-1);
+		}
+		printf("Socket nommée\n");
+	}
+
+	// Chargement de l'état des salons : instantané puis fin du journal d'état
+	uint64_t debutChargement = metriqueHorloge();
+	if (persistanceCharger(dossierEtat) != 0)
 	{
-		perror("Erreur lors du nommage de la socket");
 		exit(-1);
 	}
-	printf("Socket nommée\n");
+
+	// Création du salon général de discussion, s'il n'a pas été rechargé
+	if (creerSalon("Chat_général", "Salon général par défaut", MAX_CLIENT) != 0)
+	{
+		fprintf(stderr, "Le salon général doit être le premier salon\n");
+		exit(-1);
+	}
+	printf("%d salon(s) chargé(s) en %lu µs\n", nbSalon, (unsigned long)(metriqueHorloge() - debutChargement));
+	persistanceDemarrer(periodeInstantane);
 
 	// Initialisation du sémaphore pour gérer les clients
 	sem_init(&semaphoreNbClients, PTHREAD_PROCESS_SHARED, MAX_CLIENT);
@@ -598,39 +1632,175 @@ int main(int argc, char *argv[])
 	// Initialisation du sémaphore pour gérer les threads
 	sem_init(&semaphoreThread, PTHREAD_PROCESS_SHARED, 1);
 
-	// Passage de la socket en mode écoute
-	if (listen(dS, 7) < 0)
+	// Exposition des métriques sur la socket d'administration
+	metriquesAjouterJauge("messagerie_clients_connectes", "Clients connectés", jaugeClientsConnectes);
+	metriquesAjouterJauge("messagerie_places_libres", "Places encore disponibles", jaugePlacesLibres);
+	metriquesAjouterJauge("messagerie_file_envoi_octets", "Octets en attente dans les sockets des clients", jaugeFileEnvoi);
+	metriquesAjouterJauge("messagerie_file_applicative_octets", "Octets en attente dans les files d'envoi du serveur", jaugeFileApplicative);
+	metriquesAjouterJauge("messagerie_federation_pairs_connectes", "Nœuds de la fédération reliés", jaugePairsConnectes);
+	metriquesAjouterJauge("messagerie_historique_messages", "Messages conservés dans l'historique des salons", jaugeHistorique);
+	metriquesAjouterJauge("messagerie_identites", "Pseudos ayant reçu un identifiant numérique", jaugeIdentites);
+	metriquesAjouterJauge("messagerie_index_retard_messages", "Messages de l'historique pas encore indexés pour /chercher", jaugeRetardIndex);
+	metriquesAjouterJauge("messagerie_memoire_octets", "Mémoire imputée au plafond : connexions, historique, index et identités", jaugeMemoire);
+	metriquesAjouterJauge("messagerie_memoire_partagee_octets", "Mémoire de l'historique, de l'index de recherche et des identités", jaugeMemoirePartagee);
+	metriquesAjouterJauge("messagerie_memoire_connexion_max_octets", "Mémoire imputée à la connexion qui consomme le plus", jaugeMemoireConnexionMax);
+	metriquesAjouterCommande("stats", commandeStats);
+	metriquesAjouterCommande("limite", commandeLimite);
+	if (cheminAdmin != NULL && metriquesDemarrerSocketAdmin(cheminAdmin) == 0)
+	{
+		printf("Socket d'administration : %s\n", cheminAdmin);
+	}
+
+	// Pings, délais de silence, d'inactivité et de choix du pseudo
+	if (minuteriesDemarrer() != 0)
 	{
-		perror("Problème au niveau du listen");
 		exit(-1);
 	}
-	printf("Mode écoute\n");
+
+	// Rétention de l'historique, puis son indexation pour /chercher
+	if (retentionHistorique > 0)
+	{
+		historiqueConfigurer(retentionHistorique < UINT32_MAX ? retentionHistorique : UINT32_MAX);
+	}
+	if (rechercheDemarrer() != 0 || memoireDemarrer() != 0)
+	{
+		exit(-1);
+	}
+
+	// Maillage avec les autres nœuds, avant que les clients repris ne s'annoncent
+	if (federationDemarrer(fichierFederation, nomNoeud) != 0)
+	{
+		exit(-1);
+	}
+
+	if (estReprise)
+	{
+		// Relance des threads de communication des clients repris
+		for (long numClient = 0; numClient < MAX_CLIENT; numClient++)
+		{
+			if (tabClient[numClient].estOccupe)
+			{
+				// Le serveur précédent les avait admis : on les recompte sans plafond
+				struct sockaddr_in aC;
+				socklen_t lg = sizeof(struct sockaddr_in);
+				tabClient[numClient].adresse = 0;
+				if (getpeername(tabClient[numClient].dSC, (struct sockaddr *)&aC, &lg) == 0)
+				{
+					tabClient[numClient].adresse = aC.sin_addr.s_addr;
+				}
+				admissionReprendre(tabClient[numClient].adresse);
+				preparerClient(numClient);
+				// Le nouveau processus a sa propre époque d'historique : le client qui garde
+				// l'historique de son salon apprend qu'il doit le redemander
+				if (tabClient[numClient].recoitHistorique)
+				{
+					rejouerHistorique(numClient);
+				}
+				if (pthread_create(&tabThread[numClient], NULL, communication, (void *)numClient) == -1)
+				{
+					perror("Erreur thread create");
+				}
+			}
+		}
+	}
+	else
+	{
+		// Passage de la socket en mode écoute
+		// Les connexions en surnombre sont refusées après accept : la file
+		// d'écoute n'a plus à servir de salle d'attente, mais doit absorber les rafales
+		if (listen(dS, TAILLE_FILE_ECOUTE) < 0)
+		{
+			perror("Problème au niveau du listen");
+			exit(-1);
+		}
+		// Le noyau ne présente une connexion qu'une fois ses premières données
+		// arrivées : une connexion muette n'occupe jamais le thread d'acceptation
+		int delaiDiffere = DELAI_ACCEPTATION_DIFFEREE;
+		if (setsockopt(dS, IPPROTO_TCP, TCP_DEFER_ACCEPT, &delaiDiffere, sizeof(delaiDiffere)) < 0)
+		{
+			perror("Erreur setsockopt TCP_DEFER_ACCEPT");
+		}
+		printf("Mode écoute\n");
+	}
+
+	// Attente d'un futur binaire pour le redémarrage à chaud
+	if (relaisDemarrer(cheminRelais) == 0)
+	{
+		printf("Socket de relais : %s\n", cheminRelais);
+	}
 
 	while (1)
 	{
-		// Vérifions si on peut accepter un client
-		// On attends la disponibilité du sémaphore
-		sem_wait(&semaphoreNbClients);
+		// Pendant un redémarrage à chaud, on n'accepte plus personne
+		if (relaisEnCours())
+		{
+			relaisAttendre();
+		}
 
-		// Acceptons une connexion
+		// Acceptons une connexion, même si le serveur est complet
 		struct sockaddr_in aC;
 		socklen_t lg = sizeof(struct sockaddr_in);
 		int dSC = accept(dS, (struct sockaddr *)&aC, &lg);
+		if (dSC < 0 && (errno == EINTR || errno == ECONNABORTED))
+		{
+			continue;
+		}
+		if (dSC < 0 && (errno == EMFILE || errno == ENFILE))
+		{
+			// Plus de descripteurs : on laisse la connexion dans la file d'écoute
+			perror("Problème lors de l'acceptation du client");
+			usleep(100000);
+			continue;
+		}
 		if (dSC < 0)
 		{
 			perror("Problème lors de l'acceptation du client\n");
 			exit(-1);
 		}
-		printf("Client %ld connecté\n", nbClient);
 
-		// Enregistrement du client
+		// Vérifions si on peut servir ce client ; sinon on lui dit quand revenir
+		int reessai = admissionPrendre(aC.sin_addr.s_addr);
+		if (reessai != 0)
+		{
+			metriqueIncrementer(CPT_CONNEXIONS_REFUSEES, 1);
+			journalEchantillonne(JOURNAL_AVERTISSEMENT, EVT_REFUS, ntohl(aC.sin_addr.s_addr), reessai, 0, NULL);
+			admissionRefuser(dSC, reessai);
+			continue;
+		}
+
+		// Enregistrement du client ; faute de mémoire pour ses tampons, ou de place sous le plafond
+		// mémoire, il est refusé comme quand le serveur est complet
+		char *pseudo = malloc(sizeof(char) * TAILLE_PSEUDO);
+		LecteurTrame *lecteur = malloc(sizeof(LecteurTrame));
 		pthread_mutex_lock(&mutexTabClient);
 		long numClient = donnerNumClient();
+		if (pseudo == NULL || lecteur == NULL || memoireAdmettre(numClient) != 0)
+		{
+			pthread_mutex_unlock(&mutexTabClient);
+			free(pseudo);
+			free(lecteur);
+			admissionRendre(aC.sin_addr.s_addr);
+			metriqueIncrementer(CPT_CONNEXIONS_REFUSEES, 1);
+			journalEchantillonne(JOURNAL_AVERTISSEMENT, EVT_REFUS, ntohl(aC.sin_addr.s_addr), REESSAI_COMPLET, 0, NULL);
+			admissionRefuser(dSC, REESSAI_COMPLET);
+			continue;
+		}
+		metriqueIncrementer(CPT_CONNEXIONS_ACCEPTEES, 1);
 		tabClient[numClient].estOccupe = 1;
 		tabClient[numClient].dSC = dSC;
-		tabClient[numClient].pseudo = malloc(sizeof(char) * TAILLE_PSEUDO);
+		tabClient[numClient].adresse = aC.sin_addr.s_addr;
+		tabClient[numClient].pseudo = pseudo;
 		strcpy(tabClient[numClient].pseudo, " ");
+		tabClient[numClient].lecteur = lecteur;
+		tabClient[numClient].lecteur->rempli = 0;
+		// Ce qu'il négocie n'est connu qu'avec son pseudo
+		tabClient[numClient].estIdentifie = 0;
+		tabClient[numClient].recoitEphemeres = 0;
+		tabClient[numClient].recoitHistorique = 0;
+		chiffrementOuvrir(numClient);
 		pthread_mutex_unlock(&mutexTabClient);
+		journalEcrire(JOURNAL_INFO, EVT_CONNEXION, numClient, nbClient, 0, NULL);
+		preparerClient(numClient);
 
 		//_____________________ Communication _____________________
 		if (pthread_create(&tabThread[numClient], NULL, communication, (void *)numClient) == -1)
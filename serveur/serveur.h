@@ -0,0 +1,170 @@
+#ifndef SERVEUR_H
+#define SERVEUR_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "debit.h"
+#include "identite.h"
+#include "minuterie.h"
+#include "protocole.h"
+#include "sortie.h"
+
+/**
+ * @brief Structure Client pour regrouper toutes les informations du client.
+ *
+ * @param estOccupe 1 si le Client est connecté au serveur ; 0 sinon
+ * @param dSC Socket de transmission des messages classiques au Client
+ * @param adresse Adresse IPv4 du Client (ordre réseau), comptée par le contrôle d'admission
+ * @param pseudo Appellation que le Client rentre à sa première connexion
+ * @param idPseudo Identité du pseudo (identiteInterner), -1 avant son choix
+ * @param estIdentifie 1 si le Client reçoit les messages des salons par identifiant d'expéditeur
+ * @param identitesConnues Identités dont le Client a déjà reçu le pseudo, un bit par identité
+ * @param recoitEphemeres 1 si le Client reçoit les événements éphémères de son salon
+ * @param recoitHistorique 1 si le Client reçoit l'historique en pages TRAME_HISTORIQUE et peut en demander
+ * @param dSCFC Socket de transfert des fichiers
+ * @param nomFichier Nomination du fichier choisi par le client pour le transfert
+ * @param lecteur Tampon de réception des trames du client
+ * @param drapeaux Drapeaux du dernier fragment de texte reçu (DRAPEAU_DEFLATE sur celui du pseudo,
+ *        DRAPEAU_SUITE si le message continue)
+ * @param decalageTrame Octets de la trame texte en tête du lecteur déjà rendus par reception(), 0 sinon
+ * @param mutexEnvoi Protège la file d'envoi et le réveil après ralentissement
+ * @param file Trames en attente d'envoi, vidée par un travailleur d'envoi
+ * @param estEnAttente 1 si le client est dans la liste d'attente de son travailleur
+ * @param suivantEnAttente Client suivant dans cette liste
+ * @param derniereActivite Instant (µs) de la dernière trame reçue, quelle qu'elle soit
+ * @param dernierMessage Instant (µs) du dernier message ou de la dernière commande reçus
+ * @param minuterieVie Minuterie des pings, du silence et de l'inactivité
+ * @param minuteriePoignee Minuterie du délai accordé pour choisir un pseudo
+ * @param seauDebit Seau à jetons du client, débité du coût de ses diffusions
+ * @param minuterieDebit Minuterie réveillant le client quand il est ralenti
+ * @param condDebit Condition sur laquelle attend le client ralenti
+ * @param estReveille 1 quand la minuterie de débit a expiré
+ */
+typedef struct Client Client;
+struct Client
+{
+	int estOccupe;
+	long dSC;
+	uint32_t adresse;
+	int idSalon;
+	char *pseudo;
+	int idPseudo;
+	int estIdentifie;
+	_Atomic uint64_t identitesConnues[MAX_IDENTITES / 64];
+	int recoitEphemeres;
+	int recoitHistorique;
+	long dSCFC;
+	char nomFichier[100];
+	LecteurTrame *lecteur;
+	uint8_t drapeaux;
+	uint16_t decalageTrame;
+	pthread_mutex_t mutexEnvoi;
+	FileEnvoi file;
+	int estEnAttente;
+	int suivantEnAttente;
+	_Atomic uint64_t derniereActivite;
+	_Atomic uint64_t dernierMessage;
+	Minuterie minuterieVie;
+	Minuterie minuteriePoignee;
+	SeauJetons seauDebit;
+	Minuterie minuterieDebit;
+	pthread_cond_t condDebit;
+	int estReveille;
+};
+
+/**
+ *  @brief Définition d'une structure Salon pour regrouper toutes les informations d'un salon.
+ *
+ * @param idSalon Identifiant du salon
+ * @param estOccupe 1 si le salon existe ; 0 sinon
+ * @param nom Appellation du salon, donné à la création (max 20)
+ * @param description Description du salon, donné à la création (max 200)
+ * @param nbPlace Nombre de place que peut accepter le salon, donné à la création
+ * @param tailleMaxMessage Taille maximum (octets) d'un message dans le salon, 0 pour la valeur par défaut
+ */
+
+typedef struct Salon Salon;
+struct Salon
+{
+	int idSalon;
+	int estOccupe;
+	char *nom;
+	char *description;
+	int nbPlace;
+	int tailleMaxMessage;
+};
+
+/**
+ * - MAX_CLIENT = nombre maximum de clients acceptés sur le serveur
+ * - MAX_SALON = nombre maximum de salons sur le serveur (la table grandit à la demande)
+ * - TAILLE_PSEUDO = taille maximum du pseudo
+ * - TAILLE_NOM_SALON = taille maximum du nom d'un salon
+ * - TAILLE_MESSAGE = taille maximum d'un fragment de message ; un message plus long est relayé en plusieurs fragments
+ * - LIMITE_MESSAGE = taille maximum par défaut d'un message dans un salon, tous fragments compris
+ * - INTERVALLE_PING = silence du client (ms) au-delà duquel on lui envoie un ping
+ * - DELAI_SILENCE = silence du client (ms) au-delà duquel on le considère perdu
+ * - DELAI_POIGNEE = temps (ms) accordé à un nouveau client pour choisir son pseudo
+ */
+#define MAX_CLIENT 7
+#define MAX_SALON (4 * 1024 * 1024)
+#define TAILLE_PSEUDO 20
+#define TAILLE_NOM_SALON 20
+#define TAILLE_MESSAGE 500
+#define LIMITE_MESSAGE (64 * 1024)
+#define INTERVALLE_PING 15000
+#define DELAI_SILENCE 45000
+#define DELAI_POIGNEE 60000
+
+/**
+ * Variables globales partagées entre les modules, définies et décrites dans serveur.c
+ */
+extern Client tabClient[MAX_CLIENT];
+extern pthread_t tabThread[MAX_CLIENT];
+extern Salon *tabSalon;
+extern int nbSalon;
+extern long nbClient;
+extern int dS;
+extern int portServeur;
+extern sem_t semaphoreNbClients;
+extern pthread_mutex_t mutexTabClient;
+extern pthread_mutex_t mutexSalon;
+extern size_t limiteMessage;
+
+// Déclaration des fonctions
+int donnerNumClient();
+int verifPseudo(char *pseudo);
+long pseudoToInt(char *pseudo);
+long pseudoTodSC(char *pseudo);
+void envoiMessage(int dS, int idSalon, int idPseudo, const char *pseudo, const char *texte, uint8_t drapeaux, uint32_t idMessage);
+int envoyerTrame(int numClient, uint8_t type, const char *charge, size_t longueur);
+int envoiVolumineux(int numClient, const char *charge, size_t longueur);
+int envoiPageHistorique(int numClient, uint32_t avant, int maximum, uint8_t drapeaux);
+void rejouerHistorique(int numClient);
+int nbDestinataires(int dS, int idSalon);
+void envoiATous(char *msg);
+void envoiPrive(char *pseudoRecepteur, char *msg);
+ssize_t reception(int numClient, char *rep, ssize_t size);
+int finDeCommunication(char *msg);
+void *copieFichierThread(void *clientIndex);
+void *envoieFichierThread(void *clientIndex);
+int nbChiffreDansNombre(int nombre);
+void endOfThread(int numclient);
+int utilisationCommande(char *msg, char *pseudoEnvoyeur);
+void *communication(void *clientParam);
+int choisirPseudo(int numClient);
+void finClient(int numClient);
+void preparerClient(long numClient);
+unsigned int verifierVie(void *clientParam);
+unsigned int expirerPoignee(void *clientParam);
+void sigintHandler(int sig_num);
+long jaugeClientsConnectes();
+long jaugePlacesLibres();
+long jaugeFileEnvoi();
+size_t commandeStats(char *arguments, char *tampon, size_t taille);
+size_t commandeLimite(char *arguments, char *tampon, size_t taille);
+
+#endif
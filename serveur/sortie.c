@@ -0,0 +1,840 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "serveur.h"
+#include "sortie.h"
+#include "debit.h"
+#include "metriques.h"
+#include "journal.h"
+#include "relais.h"
+#include "compression.h"
+#include "memoire.h"
+#include "chiffrement.h"
+
+/**
+ * - NB_IOV = nombre maximum de trames envoyées par un même sendmsg (ou scellées par un même envoi chiffré)
+ * - NB_EVENEMENTS_EPOLL = nombre d'événements lus par epoll_wait
+ * - EVENEMENT_REVEIL = identifiant epoll de l'eventfd de réveil
+ */
+#define NB_IOV 16
+#define NB_EVENEMENTS_EPOLL 64
+#define EVENEMENT_REVEIL UINT32_MAX
+
+/**
+ * @brief Travailleur d'envoi : vide les files des clients numClient % NB_TRAVAILLEURS == indice.
+ *
+ * @param thread thread du travailleur
+ * @param epoll ensemble des sockets en attente de place (EPOLLOUT) et de l'eventfd
+ * @param reveil eventfd signalant de nouvelles files à vider
+ * @param mutex protège la liste des clients en attente
+ * @param premierEnAttente premier client de la liste d'attente, -1 si vide
+ * @param budget seau du budget d'octets sortants, utilisé par ce seul thread
+ */
+typedef struct Travailleur Travailleur;
+struct Travailleur
+{
+	pthread_t thread;
+	int epoll;
+	int reveil;
+	pthread_mutex_t mutex;
+	int premierEnAttente;
+	SeauJetons budget;
+};
+
+/**
+ * - travailleurs = pool des travailleurs d'envoi
+ * - budgetTravailleur = octets par seconde que chaque travailleur peut envoyer
+ * - poidsClasses = part relative de chaque classe de trafic quand plusieurs sont en attente
+ */
+static Travailleur travailleurs[NB_TRAVAILLEURS];
+static int64_t budgetTravailleur = 64 * 1024 * 1024;
+static const int poidsClasses[NB_CLASSES] = {8, 8, 4, 1};
+
+/**
+ * @brief Construit une trame partagée dont la charge est faite de deux parties.
+ *
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param prefixe début de la charge utile
+ * @param longueurPrefixe taille du début
+ * @param charge suite de la charge utile
+ * @param longueur taille de la suite ; l'ensemble est tronqué à TAILLE_MAX_TRAME
+ * @return la trame, avec une référence détenue par l'appelant ; NULL si la mémoire manque.
+ */
+static Message *assembler(uint8_t type, uint8_t drapeaux, const void *prefixe, size_t longueurPrefixe,
+						  const void *charge, size_t longueur)
+{
+	if (longueurPrefixe > TAILLE_MAX_TRAME)
+	{
+		longueurPrefixe = TAILLE_MAX_TRAME;
+	}
+	if (longueurPrefixe + longueur > TAILLE_MAX_TRAME)
+	{
+		longueur = TAILLE_MAX_TRAME - longueurPrefixe;
+	}
+	Message *message = malloc(sizeof(Message) + TAILLE_ENTETE_TRAME + longueurPrefixe + longueur);
+	if (message == NULL)
+	{
+		return NULL;
+	}
+	atomic_init(&message->references, 1);
+	message->classe = type == TRAME_PING || type == TRAME_PONG ? CLASSE_CONTROLE
+					  : type == TRAME_EPHEMERE ? CLASSE_EPHEMERE
+					  : type == TRAME_HISTORIQUE ? CLASSE_VRAC : CLASSE_INTERACTIF;
+	message->estBrut = 0;
+	message->creation = metriqueHorloge();
+	message->longueur = TAILLE_ENTETE_TRAME + longueurPrefixe + longueur;
+	trameEcrireEntete(message->octets, type, drapeaux, longueurPrefixe + longueur);
+	if (longueurPrefixe > 0)
+	{
+		memcpy(message->octets + TAILLE_ENTETE_TRAME, prefixe, longueurPrefixe);
+	}
+	if (longueur > 0)
+	{
+		memcpy(message->octets + TAILLE_ENTETE_TRAME + longueurPrefixe, charge, longueur);
+	}
+	return message;
+}
+
+/**
+ * @brief Construit une trame partagée.
+ *
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param charge charge utile
+ * @param longueur taille de la charge utile, tronquée à TAILLE_MAX_TRAME
+ * @return la trame, avec une référence détenue par l'appelant ; NULL si la mémoire manque.
+ */
+Message *messageCreer(uint8_t type, uint8_t drapeaux, const void *charge, size_t longueur)
+{
+	return assembler(type, drapeaux, NULL, 0, charge, longueur);
+}
+
+/**
+ * @brief Construit une trame partagée dont la charge commence par un préfixe
+ * (identifiant ou pseudo de l'expéditeur), sans assembler la charge au préalable.
+ *
+ * @param type type de la trame
+ * @param drapeaux drapeaux de la trame
+ * @param prefixe début de la charge utile
+ * @param longueurPrefixe taille du début
+ * @param charge suite de la charge utile
+ * @param longueur taille de la suite ; l'ensemble est tronqué à TAILLE_MAX_TRAME
+ * @return la trame, avec une référence détenue par l'appelant ; NULL si la mémoire manque.
+ */
+Message *messageCreerPrefixe(uint8_t type, uint8_t drapeaux, const void *prefixe, size_t longueurPrefixe, const void *charge, size_t longueur)
+{
+	return assembler(type, drapeaux, prefixe, longueurPrefixe, charge, longueur);
+}
+
+/**
+ * @brief Construit un message à partir d'octets déjà encodés (reprise d'une file lors d'un relais).
+ *
+ * @param octets octets à envoyer tels quels
+ * @param longueur nombre d'octets
+ * @return le message, avec une référence détenue par l'appelant ; NULL si la mémoire manque.
+ */
+Message *messageCreerBrut(const void *octets, size_t longueur)
+{
+	Message *message = malloc(sizeof(Message) + longueur);
+	if (message == NULL)
+	{
+		return NULL;
+	}
+	atomic_init(&message->references, 1);
+	message->classe = CLASSE_INTERACTIF;
+	message->estBrut = 1;
+	message->creation = metriqueHorloge();
+	message->longueur = longueur;
+	memcpy(message->octets, octets, longueur);
+	return message;
+}
+
+/**
+ * @brief Abandonne une référence sur un message, et le libère à la dernière.
+ *
+ * @param message message à libérer
+ */
+void messageLiberer(Message *message)
+{
+	if (message != NULL && atomic_fetch_sub(&message->references, 1) == 1)
+	{
+		free(message);
+	}
+}
+
+/**
+ * @brief Ajoute un client à la liste d'attente de son travailleur, sans le réveiller.
+ *
+ * @param numClient numéro du client
+ */
+static void mettreEnAttente(int numClient)
+{
+	Travailleur *travailleur = &travailleurs[numClient % NB_TRAVAILLEURS];
+	pthread_mutex_lock(&travailleur->mutex);
+	if (!tabClient[numClient].estEnAttente)
+	{
+		tabClient[numClient].estEnAttente = 1;
+		tabClient[numClient].suivantEnAttente = travailleur->premierEnAttente;
+		travailleur->premierEnAttente = numClient;
+	}
+	pthread_mutex_unlock(&travailleur->mutex);
+}
+
+/**
+ * @brief Confie la file d'un client à son travailleur et le réveille.
+ *
+ * @param numClient numéro du client
+ */
+static void planifier(int numClient)
+{
+	mettreEnAttente(numClient);
+	uint64_t un = 1;
+	write(travailleurs[numClient % NB_TRAVAILLEURS].reveil, &un, sizeof(un));
+}
+
+/**
+ * @brief Ajoute une trame à la file d'un client, dans la classe de la trame.
+ * La file prend sa propre référence : l'appelant reste responsable de la sienne.
+ *
+ * @param numClient numéro du client destinataire
+ * @param message trame à envoyer
+ * @return 0 si la trame est en file, -1 si sa classe est pleine dans la file du client.
+ */
+int fileEnfiler(int numClient, Message *message)
+{
+	Client *client = &tabClient[numClient];
+	int classe = message->classe;
+
+	// La trame en file est imputée au budget mémoire du client, qui borne ce qu'une
+	// connexion coûte quel que soit le nombre de fragments qui lui sont relayés ; un ping
+	// passe toujours. Sous pression mémoire, les événements éphémères sont les premiers perdus
+	size_t cout = message->longueur + sizeof(ElementFile);
+	if (classe == CLASSE_EPHEMERE && memoirePression() >= PRESSION_EPHEMERES)
+	{
+		metriqueIncrementer(CPT_DELESTAGE_EPHEMERES, 1);
+		return -1;
+	}
+	memoireDelester();
+	if (classe == CLASSE_CONTROLE)
+	{
+		memoireImputer(numClient, cout);
+	}
+	else if (memoireReserver(numClient, cout) != 0)
+	{
+		return -1;
+	}
+	ElementFile *element = malloc(sizeof(ElementFile));
+	if (element == NULL)
+	{
+		memoireRendre(numClient, cout);
+		return -1;
+	}
+
+	// Chaque classe a sa limite : un transfert ne fait pas perdre de messages. Un
+	// événement éphémère n'entre que dans une file presque vide
+	pthread_mutex_lock(&client->mutexEnvoi);
+	if (client->file.octetsClasse[classe] + message->longueur > FILE_MAX_OCTETS ||
+		(classe == CLASSE_EPHEMERE && client->file.octets + message->longueur > SEUIL_EPHEMERE))
+	{
+		pthread_mutex_unlock(&client->mutexEnvoi);
+		free(element);
+		memoireRendre(numClient, cout);
+		return -1;
+	}
+	atomic_fetch_add(&message->references, 1);
+	element->message = message;
+	element->suivant = NULL;
+	if (client->file.fin[classe] != NULL)
+	{
+		client->file.fin[classe]->suivant = element;
+	}
+	else
+	{
+		client->file.tete[classe] = element;
+	}
+	client->file.fin[classe] = element;
+	client->file.octetsClasse[classe] += message->longueur;
+	client->file.octets += message->longueur;
+
+	int estNouvelle = !client->file.estPlanifie;
+	client->file.estPlanifie = 1;
+	pthread_mutex_unlock(&client->mutexEnvoi);
+
+	if (estNouvelle)
+	{
+		planifier(numClient);
+	}
+	return 0;
+}
+
+/**
+ * @brief Replanifie la file d'un client dont le transport peut de nouveau
+ * envoyer : poignée de main TLS terminée, ou enregistrements TLS à émettre
+ * produits par une lecture.
+ *
+ * @param numClient numéro du client
+ */
+void sortieReveiller(int numClient)
+{
+	Client *client = &tabClient[numClient];
+	pthread_mutex_lock(&client->mutexEnvoi);
+	int estNouvelle = !client->file.estPlanifie;
+	client->file.estPlanifie = 1;
+	pthread_mutex_unlock(&client->mutexEnvoi);
+
+	if (estNouvelle)
+	{
+		planifier(numClient);
+	}
+}
+
+/**
+ * @brief Indique si une classe de la file a encore des trames. Appelée sous mutexEnvoi.
+ */
+static int resteClasses(const FileEnvoi *file)
+{
+	for (int classe = 0; classe < NB_CLASSES; classe++)
+	{
+		if (file->tete[classe] != NULL)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Fait passer une trame qui vient d'être engagée dans le flux de
+ * compression du client : l'ordre d'engagement est l'ordre d'envoi, que le
+ * client suit en décompressant. TRAME_COMPRESSION ouvre le flux, dont l'état
+ * est imputé au budget mémoire du client. Appelée sous mutexEnvoi.
+ */
+static void compresserEngagee(int numClient, FileEnvoi *file, ElementFile *element)
+{
+	Message *message = element->message;
+	if (message->estBrut)
+	{
+		return;
+	}
+	if (message->octets[0] == TRAME_COMPRESSION && file->compression == NULL)
+	{
+		// Sans mémoire, le flux reste fermé : le client n'y verra que des trames non compressées
+		if (memoireReserver(numClient, MEMOIRE_COMPRESSION) == 0)
+		{
+			file->compression = compressionCreer();
+			if (file->compression == NULL)
+			{
+				memoireRendre(numClient, MEMOIRE_COMPRESSION);
+			}
+		}
+		return;
+	}
+	if (file->compression == NULL)
+	{
+		return;
+	}
+	Message *compresse = compressionTraiter(file->compression, message);
+	if (compresse != NULL)
+	{
+		file->octets = file->octets - message->longueur + compresse->longueur;
+		memoireImputer(numClient, (int64_t)compresse->longueur - message->longueur);
+		element->message = compresse;
+		messageLiberer(message);
+	}
+}
+
+/**
+ * @brief Fixe l'ordre d'envoi des prochaines trames, par deficit round robin
+ * entre les classes : à son tour, une classe reçoit QUANTUM_CLASSE × son poids
+ * octets de crédit, et engage ses trames tant que le crédit les couvre. Une
+ * classe vide perd son crédit. On n'engage qu'une petite avance, pour qu'une
+ * trame urgente arrivée entre-temps ne patiente pas. Appelée sous mutexEnvoi.
+ */
+static void engager(int numClient, FileEnvoi *file)
+{
+	int nbEngagees = 0;
+	for (ElementFile *element = file->engagee; element != NULL; element = element->suivant)
+	{
+		nbEngagees++;
+	}
+
+	while (nbEngagees < NB_IOV && file->octetsEngages < TAILLE_ENGAGEMENT && resteClasses(file))
+	{
+		int classe = file->classeCourante;
+		ElementFile *element = file->tete[classe];
+		if (element == NULL || file->deficit[classe] < (int64_t)element->message->longueur)
+		{
+			// Fin du tour de cette classe ; la suivante est créditée pour le sien
+			if (element == NULL)
+			{
+				file->deficit[classe] = 0;
+			}
+			file->classeCourante = (classe + 1) % NB_CLASSES;
+			file->deficit[file->classeCourante] += QUANTUM_CLASSE * poidsClasses[file->classeCourante];
+			continue;
+		}
+
+		file->deficit[classe] -= element->message->longueur;
+		file->tete[classe] = element->suivant;
+		if (file->tete[classe] == NULL)
+		{
+			file->fin[classe] = NULL;
+		}
+		file->octetsClasse[classe] -= element->message->longueur;
+		compresserEngagee(numClient, file, element);
+
+		element->suivant = NULL;
+		if (file->finEngagee != NULL)
+		{
+			file->finEngagee->suivant = element;
+		}
+		else
+		{
+			file->engagee = element;
+		}
+		file->finEngagee = element;
+		file->octetsEngages += element->message->longueur;
+		nbEngagees++;
+	}
+}
+
+/**
+ * @brief Retire la première trame engagée, entièrement envoyée ou abandonnée.
+ * Appelée sous mutexEnvoi.
+ *
+ * @param numClient numéro du client
+ * @param file file du client
+ * @param estEnvoyee 1 si la trame est partie, pour mesurer son attente
+ */
+static void defiler(int numClient, FileEnvoi *file, int estEnvoyee)
+{
+	ElementFile *element = file->engagee;
+	file->engagee = element->suivant;
+	if (file->engagee == NULL)
+	{
+		file->finEngagee = NULL;
+	}
+	file->octetsEngages -= element->message->longueur;
+	file->decalage = 0;
+	if (estEnvoyee && element->message->classe == CLASSE_INTERACTIF)
+	{
+		metriqueObserver(HIST_ATTENTE_INTERACTIF, metriqueHorloge() - element->message->creation);
+	}
+	messageLiberer(element->message);
+	free(element);
+	memoireRendre(numClient, sizeof(ElementFile));
+}
+
+/**
+ * @brief Abandonne toutes les trames d'une file. Appelée sous mutexEnvoi.
+ *
+ * @return le nombre de trames abandonnées.
+ */
+static int abandonner(int numClient, FileEnvoi *file)
+{
+	int nombre = 0;
+	for (int classe = 0; classe < NB_CLASSES; classe++)
+	{
+		while (file->tete[classe] != NULL)
+		{
+			ElementFile *element = file->tete[classe];
+			file->tete[classe] = element->suivant;
+			messageLiberer(element->message);
+			free(element);
+			memoireRendre(numClient, sizeof(ElementFile));
+			nombre++;
+		}
+		file->fin[classe] = NULL;
+		file->octetsClasse[classe] = 0;
+		file->deficit[classe] = 0;
+	}
+	while (file->engagee != NULL)
+	{
+		defiler(numClient, file, 0);
+		nombre++;
+	}
+	memoireRendre(numClient, file->octets);
+	file->octets = 0;
+	return nombre;
+}
+
+/**
+ * @brief Délestage : retire de la file d'un client les trames éphémères et
+ * vrac qui ne sont pas encore engagées. Les trames de discussion et de
+ * contrôle restent.
+ *
+ * @param numClient numéro du client
+ * @return le nombre de trames retirées.
+ */
+int fileElaguer(int numClient)
+{
+	static const int classesElaguees[] = {CLASSE_EPHEMERE, CLASSE_VRAC};
+	FileEnvoi *file = &tabClient[numClient].file;
+	int nombre = 0;
+	pthread_mutex_lock(&tabClient[numClient].mutexEnvoi);
+	for (size_t n = 0; n < sizeof(classesElaguees) / sizeof(classesElaguees[0]); n++)
+	{
+		int classe = classesElaguees[n];
+		while (file->tete[classe] != NULL)
+		{
+			ElementFile *element = file->tete[classe];
+			file->tete[classe] = element->suivant;
+			file->octets -= element->message->longueur;
+			memoireRendre(numClient, element->message->longueur + sizeof(ElementFile));
+			messageLiberer(element->message);
+			free(element);
+			nombre++;
+		}
+		file->fin[classe] = NULL;
+		file->octetsClasse[classe] = 0;
+		file->deficit[classe] = 0;
+	}
+	pthread_mutex_unlock(&tabClient[numClient].mutexEnvoi);
+	return nombre;
+}
+
+/**
+ * @brief Vide la file d'un client qui se déconnecte et le retire de son travailleur.
+ * À appeler avant de fermer sa socket.
+ *
+ * @param numClient numéro du client
+ */
+void fileVider(int numClient)
+{
+	Client *client = &tabClient[numClient];
+	pthread_mutex_lock(&client->mutexEnvoi);
+	abandonner(numClient, &client->file);
+	client->file.estPlanifie = 0;
+	if (client->file.compression != NULL)
+	{
+		compressionLiberer(client->file.compression);
+		client->file.compression = NULL;
+		memoireRendre(numClient, MEMOIRE_COMPRESSION);
+	}
+	epoll_ctl(travailleurs[numClient % NB_TRAVAILLEURS].epoll, EPOLL_CTL_DEL, client->dSC, NULL);
+	pthread_mutex_unlock(&client->mutexEnvoi);
+}
+
+/**
+ * @brief Copie une partie des octets en attente dans la file d'un client :
+ * trames engagées d'abord, puis chaque classe. Utilisée par le relais, quand
+ * les travailleurs sont arrêtés.
+ *
+ * @param numClient numéro du client
+ * @param debut position du premier octet à copier, depuis le début de la file
+ * @param destination buffer de destination
+ * @param taille taille du buffer
+ * @return le nombre d'octets copiés.
+ */
+size_t fileLire(int numClient, size_t debut, uint8_t *destination, size_t taille)
+{
+	Client *client = &tabClient[numClient];
+	size_t copie = 0;
+	pthread_mutex_lock(&client->mutexEnvoi);
+	size_t position = 0;
+	size_t decalage = client->file.decalage;
+	for (int liste = -1; liste < NB_CLASSES; liste++)
+	{
+		ElementFile *element = liste < 0 ? client->file.engagee : client->file.tete[liste];
+		for (; element != NULL && copie < taille; element = element->suivant)
+		{
+			size_t longueur = element->message->longueur - decalage;
+			if (position + longueur > debut)
+			{
+				size_t depuis = debut > position ? debut - position : 0;
+				size_t n = longueur - depuis < taille - copie ? longueur - depuis : taille - copie;
+				memcpy(destination + copie, element->message->octets + decalage + depuis, n);
+				copie += n;
+				debut += n;
+			}
+			position += longueur;
+			decalage = 0;
+		}
+	}
+	pthread_mutex_unlock(&client->mutexEnvoi);
+	return copie;
+}
+
+/**
+ * @brief Demande à epoll de signaler la place libérée dans la socket d'un client.
+ * Appelée sous mutexEnvoi.
+ */
+static void attendrePlace(Travailleur *travailleur, int numClient)
+{
+	struct epoll_event evenement;
+	evenement.events = EPOLLOUT | EPOLLONESHOT;
+	evenement.data.u32 = numClient;
+	if (epoll_ctl(travailleur->epoll, EPOLL_CTL_MOD, tabClient[numClient].dSC, &evenement) == -1 && errno == ENOENT)
+	{
+		epoll_ctl(travailleur->epoll, EPOLL_CTL_ADD, tabClient[numClient].dSC, &evenement);
+	}
+}
+
+/**
+ * @brief Envoie autant que possible de la file d'un client, sans bloquer et
+ * sans dépasser QUANTUM_VISITE octets : au-delà, le client repasse en fin de
+ * tour pour ne pas retarder les autres clients du travailleur.
+ *
+ * @param travailleur travailleur du client
+ * @param numClient numéro du client
+ * @return 1 si le budget du travailleur est épuisé, 0 sinon.
+ */
+static int vider(Travailleur *travailleur, int numClient)
+{
+	Client *client = &tabClient[numClient];
+	size_t visite = 0;
+	pthread_mutex_lock(&client->mutexEnvoi);
+	// Avant la fin de la poignée de main TLS, la file attend : sortieReveiller la relancera
+	if (!chiffrementPret(numClient))
+	{
+		client->file.estPlanifie = 0;
+		pthread_mutex_unlock(&client->mutexEnvoi);
+		return 0;
+	}
+	while (client->file.engagee != NULL || resteClasses(&client->file) || chiffrementEnAttente(numClient))
+	{
+		// Pendant un relais, la file est transmise telle quelle au nouveau processus
+		if (relaisEnCours())
+		{
+			pthread_mutex_unlock(&client->mutexEnvoi);
+			planifier(numClient);
+			return 0;
+		}
+		if (seauRemplir(&travailleur->budget, budgetTravailleur, budgetTravailleur, metriqueHorloge()) <= 0)
+		{
+			pthread_mutex_unlock(&client->mutexEnvoi);
+			mettreEnAttente(numClient);
+			return 1;
+		}
+		if (visite >= QUANTUM_VISITE)
+		{
+			pthread_mutex_unlock(&client->mutexEnvoi);
+			mettreEnAttente(numClient);
+			return 0;
+		}
+
+		engager(numClient, &client->file);
+		struct iovec iov[NB_IOV];
+		int nbIov = 0;
+		size_t decalage = client->file.decalage;
+		for (ElementFile *element = client->file.engagee; element != NULL && nbIov < NB_IOV; element = element->suivant)
+		{
+			iov[nbIov].iov_base = element->message->octets + decalage;
+			iov[nbIov].iov_len = element->message->longueur - decalage;
+			nbIov++;
+			decalage = 0;
+		}
+
+		// En clair ou avec kTLS, un sendmsg sur les trames partagées, sans copie
+		ssize_t envoye = chiffrementEnvoyer(numClient, iov, nbIov);
+		if (envoye == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (envoye == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			attendrePlace(travailleur, numClient);
+			pthread_mutex_unlock(&client->mutexEnvoi);
+			return 0;
+		}
+		if (envoye == -1)
+		{
+			// Socket perdue : le thread du client s'en apercevra à la réception
+			journalEcrire(JOURNAL_AVERTISSEMENT, EVT_ERREUR_RESEAU, numClient, errno, 0, "send");
+			metriqueIncrementer(CPT_PERTES, abandonner(numClient, &client->file));
+			break;
+		}
+
+		visite += envoye;
+		travailleur->budget.jetons -= envoye;
+		metriqueIncrementer(CPT_OCTETS_ENVOYES, envoye);
+		client->file.octets -= envoye;
+		memoireRendre(numClient, envoye);
+		size_t reste = envoye;
+		while (reste > 0)
+		{
+			size_t longueur = client->file.engagee->message->longueur - client->file.decalage;
+			if (reste < longueur)
+			{
+				client->file.decalage += reste;
+				break;
+			}
+			reste -= longueur;
+			defiler(numClient, &client->file, 1);
+		}
+	}
+	client->file.estPlanifie = 0;
+	pthread_mutex_unlock(&client->mutexEnvoi);
+	return 0;
+}
+
+/**
+ * @brief Fonction principale d'un travailleur d'envoi.
+ *
+ * @param arg le travailleur
+ */
+static void *travailleurThread(void *arg)
+{
+	Travailleur *travailleur = arg;
+	struct epoll_event evenements[NB_EVENEMENTS_EPOLL];
+	struct timespec pause = {0, 10 * 1000000L};
+	int delai = -1;
+
+	while (1)
+	{
+		// Les files restent en place pendant un relais
+		if (relaisEnCours())
+		{
+			nanosleep(&pause, NULL);
+			continue;
+		}
+
+		int n = epoll_wait(travailleur->epoll, evenements, NB_EVENEMENTS_EPOLL, delai);
+		int estEpuise = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (evenements[i].data.u32 == EVENEMENT_REVEIL)
+			{
+				uint64_t valeur;
+				read(travailleur->reveil, &valeur, sizeof(valeur));
+			}
+			else
+			{
+				// Une socket a de nouveau de la place : la file repasse par la liste d'attente
+				mettreEnAttente(evenements[i].data.u32);
+			}
+		}
+
+		// Récupère la liste d'attente d'un coup, puis la traite sans verrou
+		pthread_mutex_lock(&travailleur->mutex);
+		int numClient = travailleur->premierEnAttente;
+		travailleur->premierEnAttente = -1;
+		pthread_mutex_unlock(&travailleur->mutex);
+
+		while (numClient != -1)
+		{
+			pthread_mutex_lock(&travailleur->mutex);
+			int suivant = tabClient[numClient].suivantEnAttente;
+			tabClient[numClient].estEnAttente = 0;
+			pthread_mutex_unlock(&travailleur->mutex);
+
+			if (!estEpuise)
+			{
+				estEpuise = vider(travailleur, numClient);
+			}
+			else
+			{
+				mettreEnAttente(numClient);
+			}
+			numClient = suivant;
+		}
+
+		// Budget épuisé : on attend qu'il se reconstitue ; clients remis en fin de tour : on enchaîne
+		pthread_mutex_lock(&travailleur->mutex);
+		int resteEnAttente = travailleur->premierEnAttente != -1;
+		pthread_mutex_unlock(&travailleur->mutex);
+		delai = estEpuise ? 1 + (int)(-travailleur->budget.jetons * 1000 / budgetTravailleur) : resteEnAttente ? 0 : -1;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Démarre les travailleurs d'envoi.
+ *
+ * @param budget octets par seconde que chaque travailleur peut envoyer, 0 pour la valeur par défaut
+ * @return 0 si tout se passe bien, -1 sinon.
+ */
+int sortieDemarrer(int64_t budget)
+{
+	if (budget > 0)
+	{
+		budgetTravailleur = budget;
+	}
+	for (int i = 0; i < NB_TRAVAILLEURS; i++)
+	{
+		Travailleur *travailleur = &travailleurs[i];
+		travailleur->epoll = epoll_create1(EPOLL_CLOEXEC);
+		travailleur->reveil = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		travailleur->premierEnAttente = -1;
+		pthread_mutex_init(&travailleur->mutex, NULL);
+		if (travailleur->epoll < 0 || travailleur->reveil < 0)
+		{
+			perror("Erreur création des travailleurs d'envoi");
+			return -1;
+		}
+
+		struct epoll_event evenement;
+		evenement.events = EPOLLIN;
+		evenement.data.u32 = EVENEMENT_REVEIL;
+		epoll_ctl(travailleur->epoll, EPOLL_CTL_ADD, travailleur->reveil, &evenement);
+
+		if (pthread_create(&travailleur->thread, NULL, travailleurThread, travailleur) != 0)
+		{
+			perror("Erreur thread d'envoi");
+			return -1;
+		}
+		pthread_detach(travailleur->thread);
+	}
+	return 0;
+}
+
+/**
+ * @brief Limite les octets non envoyés que le noyau garde pour une socket
+ * client : le reste attend dans la file, où l'ordonnancement par classe
+ * s'applique encore. EPOLLOUT n'est signalé que sous cette limite.
+ *
+ * @param dS socket du client
+ */
+void sortiePreparerSocket(int dS)
+{
+	int limite = LIMITE_NON_ENVOYE;
+	if (setsockopt(dS, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &limite, sizeof(limite)) < 0)
+	{
+		perror("Erreur setsockopt TCP_NOTSENT_LOWAT");
+	}
+}
+
+/**
+ * @brief Attend que toutes les files soient vides, au plus delai millisecondes.
+ * Utilisée à l'arrêt du serveur pour remettre les derniers messages.
+ *
+ * @param delai attente maximum en millisecondes
+ */
+void sortieAttendreVide(int delai)
+{
+	struct timespec pause = {0, 10 * 1000000L};
+	for (int attente = 0; attente < delai && jaugeFileApplicative() > 0; attente += 10)
+	{
+		nanosleep(&pause, NULL);
+	}
+}
+
+/**
+ * @brief Jauge des octets en attente dans les files d'envoi des clients.
+ *
+ * @return la somme des octets en file.
+ */
+long jaugeFileApplicative(void)
+{
+	long total = 0;
+	for (int i = 0; i < MAX_CLIENT; i++)
+	{
+		if (tabClient[i].estOccupe)
+		{
+			total += tabClient[i].file.octets;
+		}
+	}
+	return total;
+}
@@ -0,0 +1,135 @@
+#ifndef SORTIE_H
+#define SORTIE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Chemin d'envoi : chaque client a une file de trames, vidée par un pool de
+ * travailleurs d'envoi (epoll, envois non bloquants). Une trame diffusée est
+ * construite une seule fois et partagée, par comptage de références, entre
+ * les files de tous ses destinataires. Un destinataire lent ne retarde ni
+ * l'expéditeur ni les autres destinataires.
+ *
+ * Chaque file est partagée en classes de trafic servies en parts pondérées
+ * (deficit round robin), et le noyau ne garde que peu d'octets non envoyés
+ * par socket (TCP_NOTSENT_LOWAT) : une trame de discussion ne patiente
+ * jamais derrière un gros transfert, ni dans la file ni dans la socket.
+ */
+
+/**
+ * - NB_TRAVAILLEURS = nombre de threads d'envoi
+ * - FILE_MAX_OCTETS = taille maximum de chaque classe de la file d'un client ; au-delà, les trames sont perdues pour lui
+ * - SEUIL_EPHEMERE = octets en file au-delà desquels un client ne reçoit plus d'événements éphémères :
+ *   ils sont les premiers perdus quand il prend du retard
+ * - QUANTUM_CLASSE = octets ajoutés au crédit d'une classe à chaque tour, multipliés par son poids
+ * - TAILLE_ENGAGEMENT = octets dont l'ordre d'envoi est fixé à l'avance ; une trame urgente
+ *   arrivée entre-temps passe devant tout le reste
+ * - QUANTUM_VISITE = octets envoyés à un client avant de passer au suivant
+ * - LIMITE_NON_ENVOYE = octets non envoyés que le noyau garde dans une socket (TCP_NOTSENT_LOWAT)
+ */
+#define NB_TRAVAILLEURS 2
+#define FILE_MAX_OCTETS (256 * 1024)
+#define SEUIL_EPHEMERE (8 * 1024)
+#define QUANTUM_CLASSE 4096
+#define TAILLE_ENGAGEMENT (16 * 1024)
+#define QUANTUM_VISITE (64 * 1024)
+#define LIMITE_NON_ENVOYE (16 * 1024)
+
+/**
+ * @brief Classes de trafic sortant, avec leur poids dans le partage.
+ *
+ * - CLASSE_CONTROLE = pings, pongs et présence (poids 8)
+ * - CLASSE_EPHEMERE = événements éphémères : saisie en cours, marques de lecture (poids 8)
+ * - CLASSE_INTERACTIF = messages de discussion et réponses aux commandes (poids 4)
+ * - CLASSE_VRAC = transferts volumineux : fichiers, historique (poids 1)
+ */
+enum ClasseTrafic
+{
+	CLASSE_CONTROLE,
+	CLASSE_EPHEMERE,
+	CLASSE_INTERACTIF,
+	CLASSE_VRAC,
+	NB_CLASSES
+};
+
+/**
+ * @brief Trame prête à l'envoi, partagée entre plusieurs files.
+ *
+ * @param references nombre de files (et d'appelants) qui la détiennent
+ * @param classe classe de trafic (ClasseTrafic), déduite du type et modifiable avant d'enfiler
+ * @param estBrut 1 pour des octets repris tels quels, qui ne commencent pas forcément par un en-tête
+ * @param creation instant (µs) de création, pour mesurer l'attente en file
+ * @param longueur nombre d'octets de la trame, en-tête compris
+ * @param octets la trame
+ */
+typedef struct Message Message;
+struct Message
+{
+	_Atomic int references;
+	uint8_t classe;
+	uint8_t estBrut;
+	uint64_t creation;
+	uint32_t longueur;
+	uint8_t octets[];
+};
+
+/**
+ * @brief Maillon d'une file d'envoi.
+ */
+typedef struct ElementFile ElementFile;
+struct ElementFile
+{
+	Message *message;
+	ElementFile *suivant;
+};
+
+/**
+ * @brief File d'envoi d'un client, protégée par son mutexEnvoi.
+ *
+ * @param tete prochaine trame de chaque classe
+ * @param fin dernière trame de chaque classe
+ * @param octetsClasse octets en attente dans chaque classe
+ * @param deficit crédit d'octets de chaque classe pour le tour en cours
+ * @param classeCourante classe dont c'est le tour
+ * @param engagee trames retirées des classes, dans leur ordre d'envoi définitif
+ * @param finEngagee dernière trame engagée
+ * @param octetsEngages octets des trames engagées
+ * @param decalage octets de la première trame engagée déjà envoyés
+ * @param octets octets restant à envoyer dans toute la file
+ * @param estPlanifie 1 si un travailleur a la file en charge (en attente ou sur EPOLLOUT)
+ * @param compression flux de compression des trames engagées, NULL tant que le client ne l'a pas négociée
+ */
+typedef struct FileEnvoi FileEnvoi;
+struct FileEnvoi
+{
+	ElementFile *tete[NB_CLASSES];
+	ElementFile *fin[NB_CLASSES];
+	size_t octetsClasse[NB_CLASSES];
+	int64_t deficit[NB_CLASSES];
+	int classeCourante;
+	ElementFile *engagee;
+	ElementFile *finEngagee;
+	size_t octetsEngages;
+	size_t decalage;
+	size_t octets;
+	int estPlanifie;
+	struct Compression *compression;
+};
+
+Message *messageCreer(uint8_t type, uint8_t drapeaux, const void *charge, size_t longueur);
+Message *messageCreerPrefixe(uint8_t type, uint8_t drapeaux, const void *prefixe, size_t longueurPrefixe, const void *charge, size_t longueur);
+Message *messageCreerBrut(const void *octets, size_t longueur);
+void messageLiberer(Message *message);
+int sortieDemarrer(int64_t budget);
+void sortiePreparerSocket(int dS);
+int fileEnfiler(int numClient, Message *message);
+void sortieReveiller(int numClient);
+void fileVider(int numClient);
+int fileElaguer(int numClient);
+size_t fileLire(int numClient, size_t debut, uint8_t *destination, size_t taille);
+void sortieAttendreVide(int delai);
+long jaugeFileApplicative(void);
+
+#endif